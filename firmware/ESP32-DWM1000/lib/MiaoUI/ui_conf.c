@@ -92,7 +92,7 @@ void start_ping_test() {
         uint16_t target_id = (ping_target_uwb_id & 0xFF) | (ping_role_is_anchor ? 0xFF00 : 0x0000);
         printf("Starting Ping Test to Target ID: 0x%04X\n", target_id);
         // uwb_send_range_trigger(target_id, uwb_node_id);
-        uwb_send_ping_req(target_id);
+        uwb_cmd_ping(target_id, UWB_CMD_PRIO_LOW);
         last_time = millis();
     }
 
@@ -136,7 +136,7 @@ void start_range_test() {
 
     if (millis() - last_time > 200) {
         printf("Starting Range Test to Target ID: 0x%04X\n", target_id);
-        uwb_send_range_trigger(target_id, uwb_node_id);
+        uwb_cmd_range_trigger(target_id, uwb_node_id, UWB_CMD_PRIO_LOW);
         last_time = millis();
     }
     if (range_final_received) {
@@ -180,7 +180,7 @@ void start_range_test_big_font() {
     uint16_t target_id = (range_target_uwb_id & 0xFF) | (range_role_is_anchor ? 0xFF00 : 0x0000);
 
     if (millis() - last_time > 200) {
-        uwb_send_range_trigger(target_id, uwb_node_id);
+        uwb_cmd_range_trigger(target_id, uwb_node_id, UWB_CMD_PRIO_LOW);
         last_time = millis();
     }
     if (range_final_received) {
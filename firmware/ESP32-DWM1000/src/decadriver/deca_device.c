@@ -12,6 +12,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "deca_types.h"
 #include "deca_param_types.h"
@@ -54,6 +55,66 @@ uint32 _dwt_otpread(uint16 address);
 uint32 _dwt_otpprogword32(uint32 data, uint16 address);
 // Upload the device configuration into always on memory
 void _dwt_aonarrayupload(void);
+// Compose the header of a read access, returns its length
+int _dwt_readheader(uint16 recordNumber, uint16 index, uint8 *header);
+// Read the RX good frame event of dwt_isr_fast(), and the status first if status is not NULL
+int _dwt_readrxevent(dwt_rx_event_t *event, uint32 *status);
+// Body of dwt_isr() and dwt_isr_fast()
+void _dwt_isr(dwt_rx_event_t *event);
+// Read SYS_CFG, SYS_MASK or ACK_RESP_T, from the shadow if valid
+uint32 _dwt_readshadowreg(uint16 regFileID);
+// Write SYS_CFG, SYS_MASK or ACK_RESP_T and its shadow, nothing is sent if the shadow already holds the value
+void _dwt_writeshadowreg(uint16 regFileID, uint32 value);
+// -------------------------------------------------------------------------------------------------------------------
+
+/*!
+ * SPI profiler attribution (DWT_SPI_PROF), see dwt_spiprofapi()
+ *
+ * DWT_PROF_API()       - first line of a dwt_* API, its SPI transactions are counted under its name. The innermost API
+ *                        wins, the name of the caller is restored when it returns (cleanup attribute of GCC)
+ * DWT_PROF_REG()       - first line of the register access functions, only names transactions issued directly by the
+ *                        application
+ * DWT_PROF_CALLBACK()  - callback from dwt_isr(), the application code in it is not counted under dwt_isr
+ *
+ * The active name is a single global, so the attribution is only right while one task calls the driver
+ * (DW1000_PORT_OWNER_CHECK in dw1000.h counts calls from other tasks)
+ */
+#if DWT_SPI_PROF
+static const char *_dwt_prof_api = NULL;
+
+static const char *_dwt_prof_enter(const char *api, int inner)
+{
+    const char *prev = _dwt_prof_api;
+    if(inner || (prev == NULL))
+    {
+        _dwt_prof_api = api;
+    }
+    return prev;
+}
+
+static void _dwt_prof_leave(const char **prev)
+{
+    _dwt_prof_api = *prev;
+}
+
+#define DWT_PROF_API() const char *_dwt_prof_prev __attribute__((cleanup(_dwt_prof_leave))) = _dwt_prof_enter(__func__, 1)
+#define DWT_PROF_REG() const char *_dwt_prof_prev __attribute__((cleanup(_dwt_prof_leave))) = _dwt_prof_enter(__func__, 0)
+#define DWT_PROF_CALLBACK(call) do { const char *_dwt_prof_cb = _dwt_prof_api; _dwt_prof_api = NULL; call; _dwt_prof_api = _dwt_prof_cb; } while(0)
+
+const char *dwt_spiprofapi(void)
+{
+    return _dwt_prof_api;
+}
+#else
+#define DWT_PROF_API()
+#define DWT_PROF_REG()
+#define DWT_PROF_CALLBACK(call) call
+
+const char *dwt_spiprofapi(void)
+{
+    return NULL;
+}
+#endif
 // -------------------------------------------------------------------------------------------------------------------
 
 /*!
@@ -72,7 +133,11 @@ typedef struct
     uint8       otprev ;            // OTP revision number (read during initialisation)
     uint32      txFCTRL ;           // Keep TX_FCTRL register config
     uint32      sysCFGreg ;         // Local copy of system config register
+    uint32      sysMASKreg ;        // Shadow of the interrupt mask register (DWT_REG_SHADOW)
+    uint32      ackRESPreg ;        // Shadow of the ACK_RESP_T register (DWT_REG_SHADOW)
+    uint8       shadowValid ;       // DWT_SHADOW_xxx bits of the shadows holding the register value
     uint8       dblbuffon;          // Double RX buffer mode flag
+    uint8       dblbuffsync;        // Set when the host/IC buffer pointers were synced, e.g. by the RX good callback
     uint8       wait4resp ;         // wait4response was set with last TX start command
     uint16      sleep_mode;         // Used for automatic reloading of LDO tune and microcode at wake-up
     uint16      otp_mask ;          // Local copy of the OTP mask used in dwt_initialise call
@@ -83,6 +148,11 @@ typedef struct
     dwt_cb_t    cbRxErr;            // Callback for RX error events
 } dwt_local_data_t ;
 
+// shadowValid bits
+#define DWT_SHADOW_SYS_CFG      0x01
+#define DWT_SHADOW_SYS_MASK     0x02
+#define DWT_SHADOW_ACK_RESP_T   0x04
+
 static dwt_local_data_t dw1000local[DWT_NUM_DW_DEV] ; // Static local device data, can be an array to support multiple DW1000 testing applications/platforms
 static dwt_local_data_t *pdw1000local = dw1000local ; // Static local data structure pointer
 
@@ -172,12 +242,15 @@ int dwt_setlocaldataptr(unsigned int index)
 
 int dwt_initialise(int config)
 {
+    DWT_PROF_API();
     uint16 otp_xtaltrim_and_rev = 0;
     uint32 ldo_tune = 0;
 
     pdw1000local->dblbuffon = 0; // - set to 0 - meaning double buffer mode is off by default
+    pdw1000local->dblbuffsync = 0;
     pdw1000local->wait4resp = 0; // - set to 0 - meaning wait for response not active
     pdw1000local->sleep_mode = 0; // - set to 0 - meaning sleep mode has not been configured
+    pdw1000local->shadowValid = 0; // - register shadows are read again after the reset
 
     pdw1000local->cbTxDone = NULL;
     pdw1000local->cbRxOk = NULL;
@@ -318,6 +391,9 @@ int dwt_initialise(int config)
 
     // Read system register / store local copy
     pdw1000local->sysCFGreg = dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+#if DWT_REG_SHADOW
+    pdw1000local->shadowValid |= DWT_SHADOW_SYS_CFG;
+#endif
     pdw1000local->longFrames = (pdw1000local->sysCFGreg & SYS_CFG_PHR_MODE_11) >> SYS_CFG_PHR_MODE_SHFT ; //configure longFrames
 
     pdw1000local->txFCTRL = dwt_read32bitreg(TX_FCTRL_ID) ;
@@ -358,6 +434,7 @@ uint8 dwt_otprevision(void)
  */
 void dwt_setfinegraintxseq(int enable)
 {
+    DWT_PROF_API();
     if (enable)
     {
         dwt_write16bitoffsetreg(PMSC_ID, PMSC_TXFINESEQ_OFFSET, PMSC_TXFINESEQ_ENABLE);
@@ -386,6 +463,7 @@ void dwt_setfinegraintxseq(int enable)
  */
 void dwt_setlnapamode(int lna_pa)
 {
+    DWT_PROF_API();
     uint32 gpio_mode = dwt_read32bitoffsetreg(GPIO_CTRL_ID, GPIO_MODE_OFFSET);
     gpio_mode &= ~(GPIO_MSGP4_MASK | GPIO_MSGP5_MASK | GPIO_MSGP6_MASK);
     if (lna_pa & DWT_LNA_ENABLE)
@@ -412,6 +490,7 @@ void dwt_setlnapamode(int lna_pa)
  */
 void dwt_enablegpioclocks(void)
 {
+    DWT_PROF_API();
     uint32 pmsc_clock_ctrl = dwt_read32bitreg(PMSC_ID);
     dwt_write32bitreg(PMSC_ID, pmsc_clock_ctrl | PMSC_CTRL0_GPCE | PMSC_CTRL0_GPRN) ;
 }
@@ -431,6 +510,7 @@ void dwt_enablegpioclocks(void)
  */
 void dwt_setgpiodirection(uint32 gpioNum, uint32 direction)
 {
+    DWT_PROF_API();
     uint8 buf[GPIO_DIR_LEN];
     uint32 command = direction | gpioNum;
 
@@ -456,6 +536,7 @@ void dwt_setgpiodirection(uint32 gpioNum, uint32 direction)
  */
 void dwt_setgpiovalue(uint32 gpioNum, uint32 value)
 {
+    DWT_PROF_API();
     uint8 buf[GPIO_DOUT_LEN];
     uint32 command = value | gpioNum;
 
@@ -481,6 +562,7 @@ void dwt_setgpiovalue(uint32 gpioNum, uint32 value)
  */
 int dwt_getgpiovalue(uint32 gpioNum)
 {
+    DWT_PROF_API();
     return ((dwt_read32bitoffsetreg(GPIO_CTRL_ID, GPIO_RAW_OFFSET) & gpioNum)? 1 : 0);
 }
 
@@ -584,6 +666,7 @@ uint32 dwt_getlotid(void)
  */
 uint32 dwt_readdevid(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitoffsetreg(DEV_ID_ID,0);
 }
 
@@ -603,6 +686,7 @@ uint32 dwt_readdevid(void)
  */
 void dwt_configuretxrf(dwt_txconfig_t *config)
 {
+    DWT_PROF_API();
 
     // Configure RF TX PG_DELAY
     dwt_write8bitoffsetreg(TX_CAL_ID, TC_PGDELAY_OFFSET, config->PGdly);
@@ -629,6 +713,7 @@ void dwt_configuretxrf(dwt_txconfig_t *config)
  */
 void dwt_configurefor64plen(int prf)
 {
+    DWT_PROF_API();
     dwt_write8bitoffsetreg(CRTR_ID, CRTR_GEAR_OFFSET, DEMOD_GEAR_64L);
 
     if(prf == DWT_PRF_16M)
@@ -659,6 +744,7 @@ void dwt_configurefor64plen(int prf)
  */
 void dwt_configure(dwt_config_t *config)
 {
+    DWT_PROF_API();
     uint8 nsSfd_result  = 0;
     uint8 useDWnsSFD = 0;
     uint8 chan = config->chan ;
@@ -798,6 +884,7 @@ void dwt_configure(dwt_config_t *config)
  */
 void dwt_setrxantennadelay(uint16 rxDelay)
 {
+    DWT_PROF_API();
     // Set the RX antenna delay for auto TX timestamp adjustment
     dwt_write16bitoffsetreg(LDE_IF_ID, LDE_RXANTD_OFFSET, rxDelay);
 }
@@ -817,6 +904,7 @@ void dwt_setrxantennadelay(uint16 rxDelay)
  */
 void dwt_settxantennadelay(uint16 txDelay)
 {
+    DWT_PROF_API();
     // Set the TX antenna delay for auto TX timestamp adjustment
     dwt_write16bitoffsetreg(TX_ANTD_ID, TX_ANTD_OFFSET, txDelay);
 }
@@ -843,6 +931,7 @@ void dwt_settxantennadelay(uint16 txDelay)
  */
 int dwt_writetxdata(uint16 txFrameLength, uint8 *txFrameBytes, uint16 txBufferOffset)
 {
+    DWT_PROF_API();
 #ifdef DWT_API_ERROR_CHECK
     assert(txFrameLength >= 2);
     assert((pdw1000local->longFrames && (txFrameLength <= 1023)) || (txFrameLength <= 127));
@@ -880,6 +969,7 @@ int dwt_writetxdata(uint16 txFrameLength, uint8 *txFrameBytes, uint16 txBufferOf
  */
 void dwt_writetxfctrl(uint16 txFrameLength, uint16 txBufferOffset, int ranging)
 {
+    DWT_PROF_API();
 
 #ifdef DWT_API_ERROR_CHECK
     assert((pdw1000local->longFrames && (txFrameLength <= 1023)) || (txFrameLength <= 127));
@@ -910,6 +1000,7 @@ void dwt_writetxfctrl(uint16 txFrameLength, uint16 txBufferOffset, int ranging)
  */
 void dwt_readrxdata(uint8 *buffer, uint16 length, uint16 rxBufferOffset)
 {
+    DWT_PROF_API();
     dwt_readfromdevice(RX_BUFFER_ID,rxBufferOffset,length,buffer) ;
 }
 
@@ -932,6 +1023,7 @@ void dwt_readrxdata(uint8 *buffer, uint16 length, uint16 rxBufferOffset)
  */
 void dwt_readaccdata(uint8 *buffer, uint16 len, uint16 accOffset)
 {
+    DWT_PROF_API();
     // Force on the ACC clocks if we are sequenced
     _dwt_enableclocks(READ_ACC_ON);
 
@@ -959,6 +1051,7 @@ void dwt_readaccdata(uint8 *buffer, uint16 len, uint16 accOffset)
 
 int32 dwt_readcarrierintegrator(void)
 {
+    DWT_PROF_API();
     uint32  regval = 0 ;
     int     j ;
     uint8   buffer[DRX_CARRIER_INT_LEN] ;
@@ -992,6 +1085,7 @@ int32 dwt_readcarrierintegrator(void)
  */
 void dwt_readdiagnostics(dwt_rxdiag_t *diagnostics)
 {
+    DWT_PROF_API();
     // Read the HW FP index
     diagnostics->firstPath = dwt_read16bitoffsetreg(RX_TIME_ID, RX_TIME_FP_INDEX_OFFSET);
 
@@ -1020,6 +1114,7 @@ void dwt_readdiagnostics(dwt_rxdiag_t *diagnostics)
  */
 void dwt_readtxtimestamp(uint8 * timestamp)
 {
+    DWT_PROF_API();
     dwt_readfromdevice(TX_TIME_ID, TX_TIME_TX_STAMP_OFFSET, TX_TIME_TX_STAMP_LEN, timestamp) ; // Read bytes directly into buffer
 }
 
@@ -1036,6 +1131,7 @@ void dwt_readtxtimestamp(uint8 * timestamp)
  */
 uint32 dwt_readtxtimestamphi32(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitoffsetreg(TX_TIME_ID, 1); // Offset is 1 to get the 4 upper bytes out of 5
 }
 
@@ -1052,6 +1148,7 @@ uint32 dwt_readtxtimestamphi32(void)
  */
 uint32 dwt_readtxtimestamplo32(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitreg(TX_TIME_ID); // Read TX TIME as a 32-bit register to get the 4 lower bytes out of 5
 }
 
@@ -1069,6 +1166,7 @@ uint32 dwt_readtxtimestamplo32(void)
  */
 void dwt_readrxtimestamp(uint8 * timestamp)
 {
+    DWT_PROF_API();
     dwt_readfromdevice(RX_TIME_ID, RX_TIME_RX_STAMP_OFFSET, RX_TIME_RX_STAMP_LEN, timestamp) ; // Get the adjusted time of arrival
 }
 
@@ -1085,6 +1183,7 @@ void dwt_readrxtimestamp(uint8 * timestamp)
  */
 uint32 dwt_readrxtimestamphi32(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitoffsetreg(RX_TIME_ID, 1); // Offset is 1 to get the 4 upper bytes out of 5
 }
 
@@ -1101,6 +1200,7 @@ uint32 dwt_readrxtimestamphi32(void)
  */
 uint32 dwt_readrxtimestamplo32(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitreg(RX_TIME_ID); // Read RX TIME as a 32-bit register to get the 4 lower bytes out of 5
 }
 
@@ -1117,6 +1217,7 @@ uint32 dwt_readrxtimestamplo32(void)
  */
 uint32 dwt_readsystimestamphi32(void)
 {
+    DWT_PROF_API();
     return dwt_read32bitoffsetreg(SYS_TIME_ID, 1); // Offset is 1 to get the 4 upper bytes out of 5
 }
 
@@ -1135,6 +1236,7 @@ uint32 dwt_readsystimestamphi32(void)
  */
 void dwt_readsystime(uint8 * timestamp)
 {
+    DWT_PROF_API();
     dwt_readfromdevice(SYS_TIME_ID, SYS_TIME_OFFSET, SYS_TIME_LEN, timestamp) ;
 }
 
@@ -1169,6 +1271,7 @@ void dwt_writetodevice
     const uint8   *buffer
 )
 {
+    DWT_PROF_REG();
     uint8 header[3] ; // Buffer to compose header in
     int   cnt = 0; // Counter for length of header
 #ifdef DWT_API_ERROR_CHECK
@@ -1233,7 +1336,34 @@ void dwt_readfromdevice
     uint8         *buffer
 )
 {
+    DWT_PROF_REG();
     uint8 header[3] ; // Buffer to compose header in
+    int   cnt = _dwt_readheader(recordNumber, index, header); // Length of header
+
+#ifdef DWT_API_ERROR_CHECK
+    assert((index == 0) || ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
+#endif
+
+    // Do the read from the SPI
+    readfromspi(cnt, header, length, buffer);  // result is stored in the buffer
+} // end dwt_readfromdevice()
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_readheader()
+ *
+ * @brief  this function composes the one to three byte header of a read access, see dwt_readfromdevice()
+ *
+ * input parameters:
+ * @param recordNumber  - ID of register file or buffer being accessed
+ * @param index         - byte index into register file or buffer being accessed
+ * @param header        - pointer to a 3 byte buffer for the header
+ *
+ * output parameters
+ *
+ * returns the length of the header
+ */
+int _dwt_readheader(uint16 recordNumber, uint16 index, uint8 *header)
+{
     int   cnt = 0; // Counter for length of header
 #ifdef DWT_API_ERROR_CHECK
     assert(recordNumber <= 0x3F); // Record number is limited to 6-bits.
@@ -1247,7 +1377,7 @@ void dwt_readfromdevice
     else
     {
 #ifdef DWT_API_ERROR_CHECK
-        assert((index <= 0x7FFF) && ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
+        assert(index <= 0x7FFF); // Index is limited to 15-bits.
 #endif
         header[cnt++] = (uint8)(0x40 | recordNumber) ; // Bit-7 zero is READ operation, bit-6 one=sub-address follows, bits 5-0 is reg file id
 
@@ -1262,9 +1392,8 @@ void dwt_readfromdevice
         }
     }
 
-    // Do the read from the SPI
-    readfromspi(cnt, header, length, buffer);  // result is stored in the buffer
-} // end dwt_readfromdevice()
+    return cnt;
+} // end _dwt_readheader()
 
 
 
@@ -1283,6 +1412,7 @@ void dwt_readfromdevice
  */
 uint32 dwt_read32bitoffsetreg(int regFileID, int regOffset)
 {
+    DWT_PROF_REG();
     uint32  regval = 0 ;
     int     j ;
     uint8   buffer[4] ;
@@ -1312,6 +1442,7 @@ uint32 dwt_read32bitoffsetreg(int regFileID, int regOffset)
  */
 uint16 dwt_read16bitoffsetreg(int regFileID, int regOffset)
 {
+    DWT_PROF_REG();
     uint16  regval = 0 ;
     uint8   buffer[2] ;
 
@@ -1337,6 +1468,7 @@ uint16 dwt_read16bitoffsetreg(int regFileID, int regOffset)
  */
 uint8 dwt_read8bitoffsetreg(int regFileID, int regOffset)
 {
+    DWT_PROF_REG();
     uint8 regval;
 
     dwt_readfromdevice(regFileID, regOffset, 1, &regval);
@@ -1360,6 +1492,7 @@ uint8 dwt_read8bitoffsetreg(int regFileID, int regOffset)
  */
 void dwt_write8bitoffsetreg(int regFileID, int regOffset, uint8 regval)
 {
+    DWT_PROF_REG();
     dwt_writetodevice(regFileID, regOffset, 1, &regval);
 }
 
@@ -1379,6 +1512,7 @@ void dwt_write8bitoffsetreg(int regFileID, int regOffset, uint8 regval)
  */
 void dwt_write16bitoffsetreg(int regFileID, int regOffset, uint16 regval)
 {
+    DWT_PROF_REG();
     uint8   buffer[2] ;
 
     buffer[0] = regval & 0xFF;
@@ -1403,6 +1537,7 @@ void dwt_write16bitoffsetreg(int regFileID, int regOffset, uint16 regval)
  */
 void dwt_write32bitoffsetreg(int regFileID, int regOffset, uint32 regval)
 {
+    DWT_PROF_REG();
     int     j ;
     uint8   buffer[4] ;
 
@@ -1437,7 +1572,8 @@ void dwt_write32bitoffsetreg(int regFileID, int regOffset, uint32 regval)
  */
 void dwt_enableframefilter(uint16 enable)
 {
-    uint32 sysconfig = SYS_CFG_MASK & dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+    DWT_PROF_API();
+    uint32 sysconfig = SYS_CFG_MASK & _dwt_readshadowreg(SYS_CFG_ID) ; // Read sysconfig register
 
     if(enable)
     {
@@ -1450,8 +1586,7 @@ void dwt_enableframefilter(uint16 enable)
         sysconfig &= ~(SYS_CFG_FFE);
     }
 
-    pdw1000local->sysCFGreg = sysconfig ;
-    dwt_write32bitreg(SYS_CFG_ID,sysconfig) ;
+    _dwt_writeshadowreg(SYS_CFG_ID, sysconfig) ;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -1468,6 +1603,7 @@ void dwt_enableframefilter(uint16 enable)
  */
 void dwt_setpanid(uint16 panID)
 {
+    DWT_PROF_API();
     // PAN ID is high 16 bits of register
     dwt_write16bitoffsetreg(PANADR_ID, PANADR_PAN_ID_OFFSET, panID);
 }
@@ -1486,6 +1622,7 @@ void dwt_setpanid(uint16 panID)
  */
 void dwt_setaddress16(uint16 shortAddress)
 {
+    DWT_PROF_API();
     // Short address into low 16 bits
     dwt_write16bitoffsetreg(PANADR_ID, PANADR_SHORT_ADDR_OFFSET, shortAddress);
 }
@@ -1504,6 +1641,7 @@ void dwt_setaddress16(uint16 shortAddress)
  */
 void dwt_seteui(uint8 *eui64)
 {
+    DWT_PROF_API();
     dwt_writetodevice(EUI_64_ID, EUI_64_OFFSET, EUI_64_LEN, eui64);
 }
 
@@ -1521,6 +1659,7 @@ void dwt_seteui(uint8 *eui64)
  */
 void dwt_geteui(uint8 *eui64)
 {
+    DWT_PROF_API();
     dwt_readfromdevice(EUI_64_ID, EUI_64_OFFSET, EUI_64_LEN, eui64);
 }
 
@@ -1540,6 +1679,7 @@ void dwt_geteui(uint8 *eui64)
  */
 void dwt_otpread(uint16 address, uint32 *array, uint8 length)
 {
+    DWT_PROF_API();
     int i;
 
     _dwt_enableclocks(FORCE_SYS_XTI); // NOTE: Set system clock to XTAL - this is necessary to make sure the values read by _dwt_otpread are reliable
@@ -1800,6 +1940,7 @@ uint32 _dwt_otpprogword32(uint32 data, uint16 address)
  */
 int dwt_otpwriteandverify(uint32 value, uint16 address)
 {
+    DWT_PROF_API();
     int prog_ok = DWT_SUCCESS;
     int retry = 0;
     // Firstly set the system clock to crystal
@@ -1891,8 +2032,10 @@ void _dwt_aonarrayupload(void)
  */
 void dwt_entersleep(void)
 {
+    DWT_PROF_API();
     // Copy config to AON - upload the new configuration
     _dwt_aonarrayupload();
+    pdw1000local->shadowValid = 0;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -1911,6 +2054,7 @@ void dwt_entersleep(void)
  */
 void dwt_configuresleepcnt(uint16 sleepcnt)
 {
+    DWT_PROF_API();
     // Force system clock to crystal
     _dwt_enableclocks(FORCE_SYS_XTI);
 
@@ -1949,6 +2093,7 @@ void dwt_configuresleepcnt(uint16 sleepcnt)
  */
 uint16 dwt_calibratesleepcnt(void)
 {
+    DWT_PROF_API();
     uint16 result;
 
     // Enable calibration of the sleep counter
@@ -2036,6 +2181,7 @@ uint16 dwt_calibratesleepcnt(void)
  */
 void dwt_configuresleep(uint16 mode, uint8 wake)
 {
+    DWT_PROF_API();
     // Add predefined sleep settings before writing the mode
     mode |= pdw1000local->sleep_mode;
     dwt_write16bitoffsetreg(AON_ID, AON_WCFG_OFFSET, mode);
@@ -2061,11 +2207,13 @@ void dwt_configuresleep(uint16 mode, uint8 wake)
  */
 void dwt_entersleepaftertx(int enable)
 {
+    DWT_PROF_API();
     uint32 reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
     // Set the auto TX -> sleep bit
     if(enable)
     {
         reg |= PMSC_CTRL1_ATXSLP;
+        pdw1000local->shadowValid = 0; // Not known when the device sleeps
     }
     else
     {
@@ -2100,6 +2248,7 @@ void dwt_entersleepaftertx(int enable)
  */
 int dwt_spicswakeup(uint8 *buff, uint16 length)
 {
+    DWT_PROF_API();
     if(dwt_readdevid() != DWT_DEVICE_ID) // Device was in deep sleep (the first read fails)
     {
         // Need to keep chip select line low for at least 500us
@@ -2191,6 +2340,7 @@ void _dwt_loaducodefromrom(void)
  */
 void dwt_loadopsettabfromotp(uint8 ops_sel)
 {
+    DWT_PROF_API();
     uint16 reg = ((ops_sel << OTP_SF_OPS_SEL_SHFT) & OTP_SF_OPS_SEL_MASK) | OTP_SF_OPS_KICK; // Select defined OPS table and trigger its loading
 
     // Set up clocks
@@ -2217,20 +2367,21 @@ void dwt_loadopsettabfromotp(uint8 ops_sel)
  */
 void dwt_setsmarttxpower(int enable)
 {
+    DWT_PROF_API();
     // Config system register
-    pdw1000local->sysCFGreg = dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+    uint32 sysconfig = _dwt_readshadowreg(SYS_CFG_ID) ; // Read sysconfig register
 
     // Disable smart power configuration
     if(enable)
     {
-        pdw1000local->sysCFGreg &= ~(SYS_CFG_DIS_STXP) ;
+        sysconfig &= ~(SYS_CFG_DIS_STXP) ;
     }
     else
     {
-        pdw1000local->sysCFGreg |= SYS_CFG_DIS_STXP ;
+        sysconfig |= SYS_CFG_DIS_STXP ;
     }
 
-    dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
+    _dwt_writeshadowreg(SYS_CFG_ID, sysconfig) ;
 }
 
 
@@ -2250,8 +2401,10 @@ void dwt_setsmarttxpower(int enable)
  */
 void dwt_enableautoack(uint8 responseDelayTime)
 {
+    DWT_PROF_API();
     // Set auto ACK reply delay
     dwt_write8bitoffsetreg(ACK_RESP_T_ID, ACK_RESP_T_ACK_TIM_OFFSET, responseDelayTime); // In symbols
+    pdw1000local->shadowValid &= ~DWT_SHADOW_ACK_RESP_T;
     // Enable auto ACK
     pdw1000local->sysCFGreg |= SYS_CFG_AUTOACK;
     dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
@@ -2271,6 +2424,7 @@ void dwt_enableautoack(uint8 responseDelayTime)
  */
 void dwt_setdblrxbuffmode(int enable)
 {
+    DWT_PROF_API();
     if(enable)
     {
         // Enable double RX buffer mode
@@ -2301,13 +2455,107 @@ void dwt_setdblrxbuffmode(int enable)
  */
 void dwt_setrxaftertxdelay(uint32 rxDelayTime)
 {
-    uint32 val = dwt_read32bitreg(ACK_RESP_T_ID) ; // Read ACK_RESP_T_ID register
+    DWT_PROF_API();
+    uint32 val = _dwt_readshadowreg(ACK_RESP_T_ID) ; // Read ACK_RESP_T_ID register
 
     val &= ~(ACK_RESP_T_W4R_TIM_MASK) ; // Clear the timer (19:0)
 
     val |= (rxDelayTime & ACK_RESP_T_W4R_TIM_MASK) ; // In UWB microseconds (e.g. turn the receiver on 20uus after TX)
 
-    dwt_write32bitreg(ACK_RESP_T_ID, val) ;
+    _dwt_writeshadowreg(ACK_RESP_T_ID, val) ;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_shadowreg()
+ *
+ * @brief shadow and shadowValid bit of a shadowed register, see DWT_REG_SHADOW
+ *
+ * input parameters
+ * @param regFileID - SYS_CFG_ID, SYS_MASK_ID or ACK_RESP_T_ID
+ * @param bit - the DWT_SHADOW_xxx bit of the register
+ *
+ * output parameters
+ *
+ * returns pointer to the shadow
+ */
+static uint32 *_dwt_shadowreg(uint16 regFileID, uint8 *bit)
+{
+    switch(regFileID)
+    {
+        case SYS_CFG_ID:
+            *bit = DWT_SHADOW_SYS_CFG;
+            return &pdw1000local->sysCFGreg;
+        case SYS_MASK_ID:
+            *bit = DWT_SHADOW_SYS_MASK;
+            return &pdw1000local->sysMASKreg;
+        default:
+#ifdef DWT_API_ERROR_CHECK
+            assert(regFileID == ACK_RESP_T_ID);
+#endif
+            *bit = DWT_SHADOW_ACK_RESP_T;
+            return &pdw1000local->ackRESPreg;
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_readshadowreg()
+ *
+ * @brief read a 32 bit register kept in a shadow, over SPI only if the shadow is not valid (or DWT_REG_SHADOW is 0)
+ *
+ * input parameters
+ * @param regFileID - SYS_CFG_ID, SYS_MASK_ID or ACK_RESP_T_ID
+ *
+ * output parameters
+ *
+ * returns the register value
+ */
+uint32 _dwt_readshadowreg(uint16 regFileID)
+{
+    uint8 bit;
+    uint32 *shadow = _dwt_shadowreg(regFileID, &bit);
+
+#if DWT_REG_SHADOW
+    if(pdw1000local->shadowValid & bit)
+    {
+        return *shadow;
+    }
+#endif
+
+    *shadow = dwt_read32bitreg(regFileID);
+#if DWT_REG_SHADOW
+    pdw1000local->shadowValid |= bit;
+#endif
+    return *shadow;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_writeshadowreg()
+ *
+ * @brief write a 32 bit register kept in a shadow, skipped if the valid shadow already holds the value
+ *
+ * input parameters
+ * @param regFileID - SYS_CFG_ID, SYS_MASK_ID or ACK_RESP_T_ID
+ * @param value - the new register value
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void _dwt_writeshadowreg(uint16 regFileID, uint32 value)
+{
+    uint8 bit;
+    uint32 *shadow = _dwt_shadowreg(regFileID, &bit);
+
+#if DWT_REG_SHADOW
+    if((pdw1000local->shadowValid & bit) && (*shadow == value))
+    {
+        return;
+    }
+    pdw1000local->shadowValid |= bit;
+#endif
+
+    *shadow = value;
+    dwt_write32bitreg(regFileID, value);
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -2349,6 +2597,7 @@ void dwt_setcallbacks(dwt_cb_t cbTxDone, dwt_cb_t cbRxOk, dwt_cb_t cbRxTo, dwt_c
  */
 uint8 dwt_checkirq(void)
 {
+    DWT_PROF_API();
     return (dwt_read8bitoffsetreg(SYS_STATUS_ID, SYS_STATUS_OFFSET) & SYS_STATUS_IRQS); // Reading the lower byte only is enough for this operation
 }
 
@@ -2365,6 +2614,11 @@ uint8 dwt_checkirq(void)
  *        will also toggle between reception buffers once the reception callback processing has ended.
  *
  *        /!\ This version of the ISR supports double buffering but does not support automatic RX re-enabling!
+ *        The RX good callback may re-enable the receiver with DWT_NO_SYNC_PTRS so that it receives into the other buffer
+ *        while the current frame is processed. A frame found in the other buffer after the toggle is reported in the same
+ *        call with DWT_CB_DATA_RX_FLAG_DBUF, the IRQ line stays high in between so it would not raise a new edge.
+ *        If the callback synced the pointers (dwt_forcetrxoff, dwt_rxenable without DWT_NO_SYNC_PTRS) no toggle is done.
+ *        An RX overrun (both buffers full) resets the receiver and is reported through cbRxErr.
  *
  * NOTE:  In PC based system using (Cheetah or ARM) USB to SPI converter there can be no interrupts, however we still need something
  *        to take the place of it and operate in a polled way. In an embedded system this function should be configured to be triggered
@@ -2378,20 +2632,149 @@ uint8 dwt_checkirq(void)
  */
 void dwt_isr(void)
 {
-    uint32 status = pdw1000local->cbData.status = dwt_read32bitreg(SYS_STATUS_ID); // Read status register low 32bits
+    DWT_PROF_API();
+    _dwt_isr(NULL);
+}
 
-    // Handle RX good frame event
-    if(status & SYS_STATUS_RXFCG)
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_isr_fast()
+ *
+ * @brief see dwt_isr() and the declaration in deca_device_api.h
+ *
+ * input parameters
+ * @param event - preallocated event, filled before the RX good callback
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_isr_fast(dwt_rx_event_t *event)
+{
+    DWT_PROF_API();
+    _dwt_isr(event);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_readrxevent()
+ *
+ * @brief Read status (optional), frame info, the first bytes of the RX buffer and the RX timestamp in one batch.
+ *        In double buffer mode all but the status come from the host side buffer set, the one the status reports.
+ *
+ * input parameters
+ * @param event - event to fill
+ * @param status - status register low 32 bits, read first, or NULL to skip it
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int _dwt_readrxevent(dwt_rx_event_t *event, uint32 *status)
+{
+    uint8 header[4][3];
+    uint8 statusbuf[4];
+    uint8 finfo[RX_FINFO_LEN];
+    dw1000_spi_read_t reads[4];
+    int n = 0;
+    uint16 len;
+
+    if(status != NULL)
+    {
+        reads[n].headerBuffer = header[n]; reads[n].headerLength = _dwt_readheader(SYS_STATUS_ID, 0, header[n]);
+        reads[n].readlength = sizeof(statusbuf); reads[n].readBuffer = statusbuf; n++;
+    }
+    reads[n].headerBuffer = header[n]; reads[n].headerLength = _dwt_readheader(RX_FINFO_ID, RX_FINFO_OFFSET, header[n]);
+    reads[n].readlength = sizeof(finfo); reads[n].readBuffer = finfo; n++;
+    // Frame length not known yet, read the same number of bytes every time
+    reads[n].headerBuffer = header[n]; reads[n].headerLength = _dwt_readheader(RX_BUFFER_ID, 0, header[n]);
+    reads[n].readlength = DWT_RX_EVENT_DATA_LEN; reads[n].readBuffer = event->data; n++;
+    reads[n].headerBuffer = header[n]; reads[n].headerLength = _dwt_readheader(RX_TIME_ID, RX_TIME_RX_STAMP_OFFSET, header[n]);
+    reads[n].readlength = RX_STAMP_LEN; reads[n].readBuffer = event->rxStamp; n++;
+
+    if(readfromspi_batch(reads, n) != 0)
+    {
+        return DWT_ERROR;
+    }
+
+    if(status != NULL)
+    {
+        *status = (uint32)statusbuf[0] | ((uint32)statusbuf[1] << 8) | ((uint32)statusbuf[2] << 16) | ((uint32)statusbuf[3] << 24);
+    }
+    event->finfo = (uint32)finfo[0] | ((uint32)finfo[1] << 8) | ((uint32)finfo[2] << 16) | ((uint32)finfo[3] << 24);
+
+    len = event->finfo & RX_FINFO_RXFL_MASK_1023;
+    if(pdw1000local->longFrames == 0)
+    {
+        len &= RX_FINFO_RXFLEN_MASK;
+    }
+    event->datalength = (len < DWT_RX_EVENT_DATA_LEN) ? len : DWT_RX_EVENT_DATA_LEN;
+
+    return DWT_SUCCESS;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_isr()
+ *
+ * @brief body of dwt_isr() and dwt_isr_fast(), with an event the frame is read in one batch with the status
+ *
+ * input parameters
+ * @param event - RX good frame event, or NULL for the separate reads of dwt_isr()
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void _dwt_isr(dwt_rx_event_t *event)
+{
+    uint32 status;
+    uint8 rx_flags = 0;
+    uint8 event_valid = 0;
+
+    if((event != NULL) && (_dwt_readrxevent(event, &status) == DWT_SUCCESS))
+    {
+        event_valid = 1;
+    }
+    else
+    {
+        status = dwt_read32bitreg(SYS_STATUS_ID); // Read status register low 32bits
+    }
+    pdw1000local->cbData.status = status;
+    pdw1000local->cbData.rx_event = NULL;
+
+    // Handle RX overrun event, only possible in double buffer mode. The frame in the buffers may be corrupted, drop them.
+    if(status & SYS_STATUS_RXOVRR)
+    {
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXOVRR | SYS_STATUS_ALL_RX_GOOD); // Clear overrun and receive status bits
+
+        pdw1000local->wait4resp = 0;
+        dwt_forcetrxoff();
+        dwt_rxreset();
+
+        if(pdw1000local->cbRxErr != NULL)
+        {
+            DWT_PROF_CALLBACK(pdw1000local->cbRxErr(&pdw1000local->cbData));
+        }
+        status &= ~(SYS_STATUS_RXOVRR | SYS_STATUS_ALL_RX_GOOD);
+    }
+
+    // Handle RX good frame event, in double buffer mode also the frame waiting in the other buffer
+    while(status & SYS_STATUS_RXFCG)
     {
         uint16 finfo16;
         uint16 len;
 
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_GOOD); // Clear all receive status bits
 
-        pdw1000local->cbData.rx_flags = 0;
+        pdw1000local->cbData.rx_flags = rx_flags;
 
         // Read frame info - Only the first two bytes of the register are used here.
-        finfo16 = dwt_read16bitoffsetreg(RX_FINFO_ID, RX_FINFO_OFFSET);
+        if(event_valid)
+        {
+            finfo16 = (uint16)event->finfo;
+        }
+        else
+        {
+            finfo16 = dwt_read16bitoffsetreg(RX_FINFO_ID, RX_FINFO_OFFSET);
+        }
 
         // Report frame length - Standard frame length up to 127, extended frame length up to 1023 bytes
         len = finfo16 & RX_FINFO_RXFL_MASK_1023;
@@ -2408,7 +2791,15 @@ void dwt_isr(void)
         }
 
         // Report frame control - First bytes of the received frame.
-        dwt_readfromdevice(RX_BUFFER_ID, 0, FCTRL_LEN_MAX, pdw1000local->cbData.fctrl);
+        if(event_valid)
+        {
+            memcpy(pdw1000local->cbData.fctrl, event->data, FCTRL_LEN_MAX);
+            pdw1000local->cbData.rx_event = event;
+        }
+        else
+        {
+            dwt_readfromdevice(RX_BUFFER_ID, 0, FCTRL_LEN_MAX, pdw1000local->cbData.fctrl);
+        }
 
         // Because of a previous frame not being received properly, AAT bit can be set upon the proper reception of a frame not requesting for
         // acknowledgement (ACK frame is not actually sent though). If the AAT bit is set, check ACK request bit in frame control to confirm (this
@@ -2422,16 +2813,27 @@ void dwt_isr(void)
         }
 
         // Call the corresponding callback if present
+        pdw1000local->dblbuffsync = 0;
         if(pdw1000local->cbRxOk != NULL)
         {
-            pdw1000local->cbRxOk(&pdw1000local->cbData);
+            DWT_PROF_CALLBACK(pdw1000local->cbRxOk(&pdw1000local->cbData));
         }
+        pdw1000local->cbData.rx_event = NULL;
 
-        if (pdw1000local->dblbuffon)
+        // Pointers already synced by the callback, the other buffer was dropped with the receiver restart
+        if (!pdw1000local->dblbuffon || pdw1000local->dblbuffsync)
         {
-            // Toggle the Host side Receive Buffer Pointer
-            dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_HRBT_OFFSET, 1);
+            break;
         }
+
+        // Toggle the Host side Receive Buffer Pointer
+        dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_HRBT_OFFSET, 1);
+
+        // Status now shows the other buffer, a good frame there was received while the callback ran
+        status = pdw1000local->cbData.status = dwt_read32bitreg(SYS_STATUS_ID);
+        rx_flags = DWT_CB_DATA_RX_FLAG_DBUF;
+        // Only the status is read speculatively, the rest of that frame in a batch once it is there
+        event_valid = (event != NULL) && (status & SYS_STATUS_RXFCG) && (_dwt_readrxevent(event, NULL) == DWT_SUCCESS);
     }
 
     // Handle TX confirmation event
@@ -2453,7 +2855,7 @@ void dwt_isr(void)
         // Call the corresponding callback if present
         if(pdw1000local->cbTxDone != NULL)
         {
-            pdw1000local->cbTxDone(&pdw1000local->cbData);
+            DWT_PROF_CALLBACK(pdw1000local->cbTxDone(&pdw1000local->cbData));
         }
     }
 
@@ -2473,12 +2875,14 @@ void dwt_isr(void)
         // Call the corresponding callback if present
         if(pdw1000local->cbRxTo != NULL)
         {
-            pdw1000local->cbRxTo(&pdw1000local->cbData);
+            DWT_PROF_CALLBACK(pdw1000local->cbRxTo(&pdw1000local->cbData));
         }
     }
 
     // Handle RX errors events
-    if(status & SYS_STATUS_ALL_RX_ERR)
+    // AFFREJ is left out: the receiver re-enables itself after a frame filter rejection, and a latched
+    // AFFREJ must not force TRX off after the RX good callback has already started a delayed TX
+    if(status & (SYS_STATUS_ALL_RX_ERR & ~SYS_STATUS_AFFREJ))
     {
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR); // Clear RX error event bits
 
@@ -2493,7 +2897,7 @@ void dwt_isr(void)
         // Call the corresponding callback if present
         if(pdw1000local->cbRxErr != NULL)
         {
-            pdw1000local->cbRxErr(&pdw1000local->cbData);
+            DWT_PROF_CALLBACK(pdw1000local->cbRxErr(&pdw1000local->cbData));
         }
     }
 }
@@ -2515,6 +2919,7 @@ void dwt_isr(void)
  */
 void dwt_lowpowerlistenisr(void)
 {
+    DWT_PROF_API();
     uint32 status = pdw1000local->cbData.status = dwt_read32bitreg(SYS_STATUS_ID); // Read status register low 32bits
     uint16 finfo16;
     uint16 len;
@@ -2562,7 +2967,7 @@ void dwt_lowpowerlistenisr(void)
     // Call the corresponding callback if present
     if(pdw1000local->cbRxOk != NULL)
     {
-        pdw1000local->cbRxOk(&pdw1000local->cbData);
+        DWT_PROF_CALLBACK(pdw1000local->cbRxOk(&pdw1000local->cbData));
     }
 }
 
@@ -2585,6 +2990,7 @@ void dwt_lowpowerlistenisr(void)
  */
 void dwt_setleds(uint8 mode)
 {
+    DWT_PROF_API();
     uint32 reg;
 
     if (mode & DWT_LEDS_ENABLE)
@@ -2738,6 +3144,7 @@ void _dwt_disablesequencing(void) // Disable sequencing and go to state "INIT"
  */
 void dwt_setdelayedtrxtime(uint32 starttime)
 {
+    DWT_PROF_API();
     dwt_write32bitoffsetreg(DX_TIME_ID, 1, starttime); // Write at offset 1 as the lower 9 bits of this register are ignored
 
 } // end dwt_setdelayedtrxtime()
@@ -2760,6 +3167,7 @@ void dwt_setdelayedtrxtime(uint32 starttime)
 
 int dwt_starttx(uint8 mode)
 {
+    DWT_PROF_API();
     int retval = DWT_SUCCESS ;
     uint8 temp  = 0x00;
     uint16 checkTxOK = 0 ;
@@ -2811,10 +3219,11 @@ int dwt_starttx(uint8 mode)
  */
 void dwt_forcetrxoff(void)
 {
+    DWT_PROF_API();
     decaIrqStatus_t stat ;
     uint32 mask;
 
-    mask = dwt_read32bitreg(SYS_MASK_ID) ; // Read set interrupt mask
+    mask = _dwt_readshadowreg(SYS_MASK_ID) ; // Read set interrupt mask
 
     // Need to beware of interrupts occurring in the middle of following read modify write cycle
     // We can disable the radio, but before the status is cleared an interrupt can be set (e.g. the
@@ -2829,6 +3238,14 @@ void dwt_forcetrxoff(void)
     // Forcing Transceiver off - so we do not want to see any new events that may have happened
     dwt_write32bitreg(SYS_STATUS_ID, (SYS_STATUS_ALL_TX | SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_GOOD));
 
+    if (pdw1000local->dblbuffon)
+    {
+        // Also clear the events of the other buffer, a frame left there would be reported after the next toggle
+        dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_HRBT_OFFSET, 1);
+        dwt_write32bitreg(SYS_STATUS_ID, (SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_GOOD));
+        dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_HRBT_OFFSET, 1);
+    }
+
     dwt_syncrxbufptrs();
 
     dwt_write32bitreg(SYS_MASK_ID, mask) ; // Set interrupt mask to what it was
@@ -2853,9 +3270,11 @@ void dwt_forcetrxoff(void)
  */
 void dwt_syncrxbufptrs(void)
 {
+    DWT_PROF_API();
     uint8  buff ;
     // Need to make sure that the host/IC buffer pointers are aligned before starting RX
     buff = dwt_read8bitoffsetreg(SYS_STATUS_ID, 3); // Read 1 byte at offset 3 to get the 4th byte out of 5
+    pdw1000local->dblbuffsync = 1; // dwt_isr must not toggle the host side pointer after the RX good callback
 
     if((buff & (SYS_STATUS_ICRBP >> 24)) !=     // IC side Receive Buffer Pointer
        ((buff & (SYS_STATUS_HSRBP>>24)) << 1) ) // Host Side Receive Buffer Pointer
@@ -2885,6 +3304,7 @@ void dwt_syncrxbufptrs(void)
  */
 void dwt_setsniffmode(int enable, uint8 timeOn, uint8 timeOff)
 {
+    DWT_PROF_API();
     uint32 pmsc_reg;
     if (enable)
     {
@@ -2937,6 +3357,7 @@ void dwt_setsniffmode(int enable, uint8 timeOn, uint8 timeOff)
  */
 void dwt_setlowpowerlistening(int enable)
 {
+    DWT_PROF_API();
     uint32 pmsc_reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
     if (enable)
     {
@@ -2967,6 +3388,7 @@ void dwt_setlowpowerlistening(int enable)
  */
 void dwt_setsnoozetime(uint8 snooze_time)
 {
+    DWT_PROF_API();
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_SNOZT_OFFSET, snooze_time);
 }
 
@@ -2991,6 +3413,7 @@ void dwt_setsnoozetime(uint8 snooze_time)
  */
 int dwt_rxenable(int mode)
 {
+    DWT_PROF_API();
     uint16 temp ;
     uint8 temp1 ;
 
@@ -3042,8 +3465,26 @@ int dwt_rxenable(int mode)
  */
 void dwt_setrxtimeout(uint16 time)
 {
+    DWT_PROF_API();
     uint8 temp ;
 
+#if DWT_REG_SHADOW
+    if(pdw1000local->shadowValid & DWT_SHADOW_SYS_CFG)
+    {
+        // Upper byte from the shadow, no write at all if RXWTOE does not change
+        if(time > 0)
+        {
+            dwt_write16bitoffsetreg(RX_FWTO_ID, RX_FWTO_OFFSET, time) ;
+        }
+        if(((pdw1000local->sysCFGreg & SYS_CFG_RXWTOE) != 0) != (time > 0))
+        {
+            pdw1000local->sysCFGreg ^= SYS_CFG_RXWTOE;
+            dwt_write8bitoffsetreg(SYS_CFG_ID, 3, (uint8)(pdw1000local->sysCFGreg >> 24)); // Write at offset 3 to write the upper byte only
+        }
+        return;
+    }
+#endif
+
     temp = dwt_read8bitoffsetreg(SYS_CFG_ID, 3); // Read at offset 3 to get the upper byte only
 
     if(time > 0)
@@ -3084,6 +3525,7 @@ void dwt_setrxtimeout(uint16 time)
  */
 void dwt_setpreambledetecttimeout(uint16 timeout)
 {
+    DWT_PROF_API();
     dwt_write16bitoffsetreg(DRX_CONF_ID, DRX_PRETOC_OFFSET, timeout);
 }
 
@@ -3114,6 +3556,7 @@ void dwt_setpreambledetecttimeout(uint16 timeout)
  */
 void dwt_setinterrupt(uint32 bitmask, uint8 operation)
 {
+    DWT_PROF_API();
     decaIrqStatus_t stat ;
     uint32 mask ;
 
@@ -3122,11 +3565,11 @@ void dwt_setinterrupt(uint32 bitmask, uint8 operation)
 
     if(operation == 2)
     {
-        dwt_write32bitreg(SYS_MASK_ID, bitmask) ; // New value
+        _dwt_writeshadowreg(SYS_MASK_ID, bitmask) ; // New value
     }
     else
     {
-        mask = dwt_read32bitreg(SYS_MASK_ID) ; // Read register
+        mask = _dwt_readshadowreg(SYS_MASK_ID) ; // Read register
         if(operation == 1)
         {
             mask |= bitmask ;
@@ -3135,7 +3578,7 @@ void dwt_setinterrupt(uint32 bitmask, uint8 operation)
         {
             mask &= ~bitmask ; // Clear the bit
         }
-        dwt_write32bitreg(SYS_MASK_ID, mask) ; // New value
+        _dwt_writeshadowreg(SYS_MASK_ID, mask) ; // New value
     }
 
     decamutexoff(stat) ;
@@ -3154,6 +3597,7 @@ void dwt_setinterrupt(uint32 bitmask, uint8 operation)
  */
 void dwt_configeventcounters(int enable)
 {
+    DWT_PROF_API();
     // Need to clear and disable, can't just clear
     dwt_write8bitoffsetreg(DIG_DIAG_ID, EVC_CTRL_OFFSET, (uint8)(EVC_CLR));
 
@@ -3177,6 +3621,7 @@ void dwt_configeventcounters(int enable)
  */
 void dwt_readeventcounters(dwt_deviceentcnts_t *counters)
 {
+    DWT_PROF_API();
     uint32 temp;
 
     temp= dwt_read32bitoffsetreg(DIG_DIAG_ID, EVC_PHE_OFFSET); // Read sync loss (31-16), PHE (15-0)
@@ -3218,6 +3663,7 @@ void dwt_readeventcounters(dwt_deviceentcnts_t *counters)
  */
 void dwt_rxreset(void)
 {
+    DWT_PROF_API();
     // Set RX reset
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_SOFTRESET_OFFSET, PMSC_CTRL0_RESET_RX);
 
@@ -3238,6 +3684,7 @@ void dwt_rxreset(void)
  */
 void dwt_softreset(void)
 {
+    DWT_PROF_API();
     _dwt_disablesequencing();
 
     // Clear any AON auto download bits (as reset will trigger AON download)
@@ -3258,6 +3705,7 @@ void dwt_softreset(void)
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_SOFTRESET_OFFSET, PMSC_CTRL0_RESET_CLEAR);
 
     pdw1000local->wait4resp = 0;
+    pdw1000local->shadowValid = 0;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -3274,6 +3722,7 @@ void dwt_softreset(void)
  */
 void dwt_setxtaltrim(uint8 value)
 {
+    DWT_PROF_API();
     // The 3 MSb in this 8-bit register must be kept to 0b011 to avoid any malfunction.
     uint8 reg_val = (3 << 5) | (value & FS_XTALT_MASK);
     dwt_write8bitoffsetreg(FS_CTRL_ID, FS_XTALT_OFFSET, reg_val);
@@ -3293,6 +3742,7 @@ void dwt_setxtaltrim(uint8 value)
  */
 uint8 dwt_getxtaltrim(void)
 {
+    DWT_PROF_API();
     return (dwt_read8bitoffsetreg(FS_CTRL_ID, FS_XTALT_OFFSET) & FS_XTALT_MASK);
 }
 
@@ -3310,6 +3760,7 @@ uint8 dwt_getxtaltrim(void)
  */
 void dwt_configcwmode(uint8 chan)
 {
+    DWT_PROF_API();
 #ifdef DWT_API_ERROR_CHECK
     assert((chan >= 1) && (chan <= 7) && (chan != 6));
 #endif
@@ -3362,6 +3813,7 @@ void dwt_configcwmode(uint8 chan)
  */
 void dwt_configcontinuousframemode(uint32 framerepetitionrate)
 {
+    DWT_PROF_API();
     //
     // Disable TX/RX RF block sequencing (needed for continuous frame mode)
     //
@@ -3411,6 +3863,7 @@ void dwt_configcontinuousframemode(uint32 framerepetitionrate)
  */
 uint16 dwt_readtempvbat(uint8 fastSPI)
 {
+    DWT_PROF_API();
     uint8 wr_buf[2];
     uint8 vbat_raw;
     uint8 temp_raw;
@@ -3590,6 +4043,7 @@ uint8 dwt_convertvoltstoraw(int32 externalmvolt)
  */
 uint8 dwt_readwakeuptemp(void)
 {
+    DWT_PROF_API();
     return dwt_read8bitoffsetreg(TX_CAL_ID, TC_SARL_SAR_LTEMP_OFFSET);
 }
 
@@ -3608,6 +4062,7 @@ uint8 dwt_readwakeuptemp(void)
  */
 uint8 dwt_readwakeupvbat(void)
 {
+    DWT_PROF_API();
     return dwt_read8bitoffsetreg(TX_CAL_ID, TC_SARL_SAR_LVBAT_OFFSET);
 }
 
@@ -3629,6 +4084,7 @@ uint8 dwt_readwakeupvbat(void)
  */
 uint32 dwt_calcbandwidthtempadj(uint16 target_count)
 {
+    DWT_PROF_API();
     int i;
     uint8 bit_field, curr_bw;
     int32 delta_count = 0;
@@ -3855,6 +4311,7 @@ uint32 _dwt_computetxpowersetting(uint32 ref_powerreg, int32 power_adj)
  */
 uint16 dwt_calcpgcount(uint8 pgdly)
 {
+    DWT_PROF_API();
     // Perform PG count read ten times and take an average to smooth out any noise
     const int NUM_SAMPLES = 10;
     uint32 sum_count = 0;
@@ -64,6 +64,20 @@ typedef signed long int32;
 #define DWT_NUM_DW_DEV (1)
 #endif
 
+// Write-through shadow of the SYS_CFG, SYS_MASK and ACK_RESP_T registers, read-modify-write calls such as
+// dwt_setrxtimeout(), dwt_setrxaftertxdelay(), dwt_setinterrupt() and dwt_forcetrxoff() take the old value from it
+// and skip writes that do not change the register. Dropped on dwt_initialise(), dwt_softreset() and sleep.
+// Registers changed with dwt_writetodevice() by the application are not seen, set DWT_REG_SHADOW to 0 then.
+#ifndef DWT_REG_SHADOW
+#define DWT_REG_SHADOW (1)
+#endif
+
+// Every dwt_* API records its name for the SPI profiler of the port layer, see dwt_spiprofapi().
+// Off by default, it adds a store on entry and exit of every API; enable it in build_flags for profiling.
+#ifndef DWT_SPI_PROF
+#define DWT_SPI_PROF (0)
+#endif
+
 #define DWT_SUCCESS (0)
 #define DWT_ERROR   (-1)
 
@@ -208,6 +222,10 @@ typedef signed long int32;
 
 // Call-back data RX frames flags
 #define DWT_CB_DATA_RX_FLAG_RNG 0x1 // Ranging bit
+#define DWT_CB_DATA_RX_FLAG_DBUF 0x2 // Frame was received into the other buffer while the previous one was processed (double buffer mode)
+
+// RX good frame read by dwt_isr_fast(), see below
+typedef struct dwt_rx_event_s dwt_rx_event_t;
 
 // TX/RX call-back data
 typedef struct
@@ -216,6 +234,7 @@ typedef struct
     uint16 datalength;  //length of frame
     uint8  fctrl[2];    //frame control bytes
     uint8  rx_flags;    //RX frame flags, see above
+    const dwt_rx_event_t *rx_event; //RX good callback of dwt_isr_fast(): frame info, timestamp, diagnostics and first bytes, NULL otherwise
 } dwt_cb_data_t;
 
 // Call-back type for all events
@@ -268,6 +287,18 @@ typedef struct
     uint16      firstPath ;         // First path index (10.6 bits fixed point integer)
 }dwt_rxdiag_t ;
 
+// Frame bytes dwt_isr_fast() reads with the status, short frames such as poll/response/final fit in it
+#define DWT_RX_EVENT_DATA_LEN 24
+
+// Everything of a good frame dwt_isr_fast() reads in one batch of SPI transactions
+struct dwt_rx_event_s
+{
+    uint32      finfo ;             // RX_FINFO register
+    uint8       rxStamp[5] ;        // Adjusted RX timestamp, as dwt_readrxtimestamp()
+    uint16      datalength ;        // Bytes of the frame in data, the rest is still in the RX buffer
+    uint8       data[DWT_RX_EVENT_DATA_LEN] ;
+} ;
+
 
 typedef struct
 {
@@ -1183,6 +1214,23 @@ uint8 dwt_checkirq(void);
  */
 void dwt_isr(void);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_isr_fast()
+ *
+ * @brief Same as dwt_isr(), but reads the status together with the frame info, the first DWT_RX_EVENT_DATA_LEN bytes
+ *        of the RX buffer and the RX timestamp in one batch of back-to-back SPI reads (readfromspi_batch).
+ *        The RX good callback finds all of it in cb_data->rx_event and needs no further read for frames up to
+ *        DWT_RX_EVENT_DATA_LEN bytes. The reads are wasted if the event is not a good frame, use it when one is expected.
+ *
+ * input parameters
+ * @param event - preallocated event, filled before the RX good callback
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_isr_fast(dwt_rx_event_t *event);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_isr_lplisten()
  *
@@ -1965,6 +2013,40 @@ int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength
  */
 int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer);
 
+// one read of a batch, same args as readfromspi
+typedef struct {
+    uint16 headerLength;
+    const uint8 *headerBuffer;
+    uint32 readlength;
+    uint8 *readBuffer;
+} dw1000_spi_read_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn readfromspi_batch()
+ *
+ * @brief Several reads queued back-to-back on the bus, e.g. status + frame info + rx data in dwt_isr_fast()
+ *
+ * Note: The body of this function is platform specific, see dw1000.h for the max count
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int readfromspi_batch(const dw1000_spi_read_t *reads, int count);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_spiprofapi()
+ *
+ * @brief For the SPI profiler in readfromspi() / writetospi(): name of the dwt_* API the transaction in progress
+ *        belongs to, the innermost one if APIs call each other. Register access functions such as
+ *        dwt_write32bitoffsetreg() only count as API when the application calls them directly.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the function name, NULL if no API is active or DWT_SPI_PROF is 0
+ */
+const char *dwt_spiprofapi(void);
+
 // ---------------------------------------------------------------------------
 //
 // NB: The purpose of the deca_mutex.c file is to provide for microprocessor interrupt enable/disable, this is used for
@@ -1,25 +1,97 @@
-
 #include <Arduino.h>
-#include <SPI.h>
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
 
 #include "dw1000.h"
+#include "dw1000_spi_prof.h"
 #include "deca_device_api.h"
 #include "uwb.h"
 
-SPISettings dw1000_spi_slow_setting = SPISettings(2000000, MSBFIRST, SPI_MODE0); // 2MHz
-SPISettings dw1000_spi_fast_setting = SPISettings(2000000, MSBFIRST, SPI_MODE0); // 8MHz
-SPISettings * dw1000_spi_current_setting = &dw1000_spi_slow_setting;
+#define DW1000_SPI_HOST VSPI_HOST
+
+static spi_device_handle_t dw1000_spi = NULL;
+
+// DMA capable buffers, header and body are sent in one transaction
+static uint8_t *dw1000_spi_tx_buf[DW1000_SPI_BATCH_MAX];
+static uint8_t *dw1000_spi_rx_buf[DW1000_SPI_BATCH_MAX];
+
+static int dw1000_spi_clock_hz = 0;
+
+static TaskHandle_t dw1000_port_owner = NULL;
+static uint32_t dw1000_port_foreign = 0;
+
+void dw1000_port_set_owner(TaskHandle_t task) {
+    dw1000_port_owner = task;
+}
+
+uint32_t dw1000_port_foreign_count() {
+    return dw1000_port_foreign;
+}
+
+// a transaction of another task would overwrite the buffers of the owner
+static inline void dw1000_port_check_owner() {
+#if DW1000_PORT_OWNER_CHECK
+    if (dw1000_port_owner != NULL && xTaskGetCurrentTaskHandle() != dw1000_port_owner) {
+        dw1000_port_foreign++;
+    }
+#endif
+}
+
+
+// (re)add the device with the new clock, the bus stays acquired by the DW1000
+static void dw1000_spi_set_clock(int clock_hz) {
+    if (clock_hz == dw1000_spi_clock_hz) {
+        return;
+    }
 
+    if (dw1000_spi != NULL) {
+        spi_device_release_bus(dw1000_spi);
+        spi_bus_remove_device(dw1000_spi);
+        dw1000_spi = NULL;
+    }
+
+    spi_device_interface_config_t devcfg;
+    memset(&devcfg, 0, sizeof(devcfg));
+    devcfg.mode = 0;
+    devcfg.clock_speed_hz = clock_hz;
+    devcfg.spics_io_num = PIN_DW1000_SS;
+    devcfg.queue_size = DW1000_SPI_BATCH_MAX;
+
+    if (spi_bus_add_device(DW1000_SPI_HOST, &devcfg, &dw1000_spi) != ESP_OK) {
+        Serial.println("[dw1000] Failed to add SPI device");
+        dw1000_spi = NULL;
+        return;
+    }
+    // only DW1000 on this bus, hold it to skip the bus arbitration on every transaction
+    spi_device_acquire_bus(dw1000_spi, portMAX_DELAY);
+    dw1000_spi_clock_hz = clock_hz;
+}
 
 void init_DW1000(){
     pinMode(PIN_DW1000_RST, OUTPUT);
     
     pinMode(PIN_DW1000_IRQ, INPUT);
 
-    pinMode(PIN_DW1000_SS, OUTPUT);
-    digitalWrite(PIN_DW1000_SS, HIGH); // SS high
-    
-    SPI.begin();
+    if (dw1000_spi_tx_buf[0] == NULL) {
+        for (int i = 0; i < DW1000_SPI_BATCH_MAX; i++) {
+            dw1000_spi_tx_buf[i] = (uint8_t *)heap_caps_malloc(DW1000_SPI_MAX_TRANS_LEN, MALLOC_CAP_DMA);
+            dw1000_spi_rx_buf[i] = (uint8_t *)heap_caps_malloc(DW1000_SPI_MAX_TRANS_LEN, MALLOC_CAP_DMA);
+        }
+
+        spi_bus_config_t buscfg;
+        memset(&buscfg, 0, sizeof(buscfg));
+        buscfg.mosi_io_num = PIN_DW1000_MOSI;
+        buscfg.miso_io_num = PIN_DW1000_MISO;
+        buscfg.sclk_io_num = PIN_DW1000_SCK;
+        buscfg.quadwp_io_num = -1;
+        buscfg.quadhd_io_num = -1;
+        buscfg.max_transfer_sz = DW1000_SPI_MAX_TRANS_LEN;
+        if (spi_bus_initialize(DW1000_SPI_HOST, &buscfg, SPI_DMA_CH_AUTO) != ESP_OK) {
+            Serial.println("[dw1000] Failed to init SPI bus");
+        }
+    }
+
+    dw1000_spi_set_clock(DW1000_SPI_SLOW_HZ);
 
     reset_DW1000();
 
@@ -36,52 +108,114 @@ void reset_DW1000() {
 
 void set_dw1000_spi_rate_fast(bool fast) {
     if(fast)
-        dw1000_spi_current_setting = &dw1000_spi_fast_setting;
+        dw1000_spi_set_clock(DW1000_SPI_FAST_HZ);
     else
-        dw1000_spi_current_setting = &dw1000_spi_slow_setting;
+        dw1000_spi_set_clock(DW1000_SPI_SLOW_HZ);
 }
 
 int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodyLength, const uint8 *bodyBuffer) {
-    // decaIrqStatus_t  stat ;
-    // stat = decamutexon() ;
-
-    digitalWrite(PIN_DW1000_SS, LOW); // Make sure the SS pin is low
+    if (headerLength + bodyLength > DW1000_SPI_MAX_TRANS_LEN) {
+        return -1;
+    }
 
-    // header
-    SPI.beginTransaction(*dw1000_spi_current_setting);
-    SPI.transferBytes(headerBuffer, NULL, headerLength);
-    // data
-    SPI.transferBytes(bodyBuffer, NULL, bodyLength);
-    SPI.endTransaction();
+    dw1000_port_check_owner();
+    uint32_t t0 = ESP.getCycleCount();
 
-    digitalWrite(PIN_DW1000_SS, HIGH); // Make sure the SS pin is high
+    // header and body in one transaction, CS is driven by the SPI peripheral
+    uint8_t *tx = dw1000_spi_tx_buf[0];
+    memcpy(tx, headerBuffer, headerLength);
+    memcpy(tx + headerLength, bodyBuffer, bodyLength);
 
-    // decamutexoff(stat);
+    spi_transaction_t t;
+    memset(&t, 0, sizeof(t));
+    t.length = (headerLength + bodyLength) * 8;
+    t.tx_buffer = tx;
+    t.rx_buffer = NULL;
 
-    return 0;
+    int ret = (spi_device_polling_transmit(dw1000_spi, &t) == ESP_OK) ? 0 : -1;
+    dw1000_spi_prof_record(headerBuffer, headerLength, headerLength + bodyLength, true, ESP.getCycleCount() - t0);
+    return ret;
 }
 
 int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer) {
-    int i;
-    // decaIrqStatus_t  stat ;
-    // stat = decamutexon() ;
+    if (headerLength + readlength > DW1000_SPI_MAX_TRANS_LEN) {
+        return -1;
+    }
 
-    digitalWrite(PIN_DW1000_SS, LOW); // Make sure the SS pin is low
+    dw1000_port_check_owner();
+    uint32_t t0 = ESP.getCycleCount();
 
-    // header
-    SPI.beginTransaction(*dw1000_spi_current_setting);
-    SPI.transferBytes(headerBuffer, NULL, headerLength);
-    // data
-    SPI.transferBytes(NULL, readBuffer, readlength);
-    SPI.endTransaction();
+    // full duplex, the bytes clocked in during the header are skipped
+    uint8_t *tx = dw1000_spi_tx_buf[0];
+    uint8_t *rx = dw1000_spi_rx_buf[0];
+    memcpy(tx, headerBuffer, headerLength);
 
-    digitalWrite(PIN_DW1000_SS, HIGH); // Make sure the SS pin is high
+    spi_transaction_t t;
+    memset(&t, 0, sizeof(t));
+    t.length = (headerLength + readlength) * 8;
+    t.tx_buffer = tx;
+    t.rx_buffer = rx;
 
-    // decamutexoff(stat);
+    if (spi_device_polling_transmit(dw1000_spi, &t) != ESP_OK) {
+        return -1;
+    }
+    memcpy(readBuffer, rx + headerLength, readlength);
+    dw1000_spi_prof_record(headerBuffer, headerLength, headerLength + readlength, false, ESP.getCycleCount() - t0);
 
     return 0;
 } // end readfromspi()
 
+int readfromspi_batch(const dw1000_spi_read_t *reads, int count) {
+    if (count > DW1000_SPI_BATCH_MAX) {
+        return -1;
+    }
+
+    dw1000_port_check_owner();
+    uint32_t t0 = ESP.getCycleCount();
+
+    // queue all transactions, the driver runs them back-to-back with DMA
+    spi_transaction_t trans[DW1000_SPI_BATCH_MAX];
+    int queued = 0;
+    for (int i = 0; i < count; i++) {
+        const dw1000_spi_read_t *r = &reads[i];
+        if (r->headerLength + r->readlength > DW1000_SPI_MAX_TRANS_LEN) {
+            break;
+        }
+        memcpy(dw1000_spi_tx_buf[i], r->headerBuffer, r->headerLength);
+
+        memset(&trans[i], 0, sizeof(spi_transaction_t));
+        trans[i].length = (r->headerLength + r->readlength) * 8;
+        trans[i].tx_buffer = dw1000_spi_tx_buf[i];
+        trans[i].rx_buffer = dw1000_spi_rx_buf[i];
+        if (spi_device_queue_trans(dw1000_spi, &trans[i], portMAX_DELAY) != ESP_OK) {
+            break;
+        }
+        queued++;
+    }
+
+    // results come back in queue order
+    for (int i = 0; i < queued; i++) {
+        spi_transaction_t *done;
+        spi_device_get_trans_result(dw1000_spi, &done, portMAX_DELAY);
+    }
+    for (int i = 0; i < queued; i++) {
+        memcpy(reads[i].readBuffer, dw1000_spi_rx_buf[i] + reads[i].headerLength, reads[i].readlength);
+    }
+
+    // the batch time is shared by bytes
+    uint32_t cycles = ESP.getCycleCount() - t0;
+    uint32_t bytes = 0;
+    for (int i = 0; i < queued; i++) {
+        bytes += reads[i].headerLength + reads[i].readlength;
+    }
+    for (int i = 0; i < queued; i++) {
+        uint32_t n = reads[i].headerLength + reads[i].readlength;
+        dw1000_spi_prof_record(reads[i].headerBuffer, reads[i].headerLength, n, false, (uint32_t)((uint64_t)cycles * n / bytes));
+    }
+
+    return (queued == count) ? 0 : -1;
+}
+
 void Sleep(int time_ms){delay(time_ms);}
 void deca_sleep(unsigned int time_ms){delay(time_ms);}
 void lcd_display_str(const char *str){Serial.printf("[LCD PRINT] %s\n", str);}
@@ -110,4 +244,4 @@ void decamutexoff(decaIrqStatus_t s) {
 }
 
 
-// ARDUINO_ISR_ATTR 
\ No newline at end of file
+// ARDUINO_ISR_ATTR 
@@ -5,12 +5,34 @@
 #define __DW1000_H__
 
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include "deca_types.h"
 #include "deca_device_api.h"
 
 #define PIN_DW1000_RST 16
 #define PIN_DW1000_IRQ 4
 #define PIN_DW1000_SS 17
+#define PIN_DW1000_SCK 18
+#define PIN_DW1000_MISO 19
+#define PIN_DW1000_MOSI 23
+
+// DW1000 must run SPI <= 3MHz before dwt_initialise, up to 20MHz after
+#define DW1000_SPI_SLOW_HZ 2000000
+#define DW1000_SPI_FAST_HZ 20000000
+
+// max bytes in one transaction, 3 bytes header + 1024 bytes of the biggest register file
+#define DW1000_SPI_MAX_TRANS_LEN (3 + 1024)
+// max reads in one readfromspi_batch call (deca_device_api.h), dwt_isr_fast needs 4
+#define DW1000_SPI_BATCH_MAX 4
+
+// the port layer has no lock, every transaction uses the same DMA buffers and decamutexon only masks the IRQ
+// so the decadriver may only be called by one task, uwb_task (dw1000_port_set_owner), other tasks use uwb_cmd.h
+// 1: count transactions from any other task in dw1000_port_foreign_count (`stats` spi_foreign)
+#ifndef DW1000_PORT_OWNER_CHECK
+#define DW1000_PORT_OWNER_CHECK 1
+#endif
 
 
 
@@ -34,6 +56,10 @@ void port_set_dw1000_fastrate();
 decaIrqStatus_t decamutexon(void);
 void decamutexoff(decaIrqStatus_t s);
 
+// task allowed to call the decadriver, NULL before uwb_task starts
+void dw1000_port_set_owner(TaskHandle_t task);
+uint32_t dw1000_port_foreign_count();
+
 
 #ifdef __cplusplus
 }
@@ -19,18 +19,7 @@
 // };
 
 
-static dwt_config_t config = {
-    2,               /* Channel number. */
-    DWT_PRF_64M,     /* Pulse repetition frequency. */
-    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
-    DWT_PAC64,       /* Preamble acquisition chunk size. Used in RX only. */
-    9,               /* TX preamble code. Used in TX only. */
-    9,               /* RX preamble code. Used in RX only. */
-    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
-    DWT_BR_110K,     /* Data rate. */
-    DWT_PHRMODE_STD, /* PHY header mode. */
-    (1024 + 1 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
-};
+// channel / preamble / data rate are selected at runtime from the PHY profiles in uwb_phy.cpp
 
 static dwt_txconfig_t txconfig = {
     0xC2,            /* PG delay. */
@@ -62,8 +51,7 @@ static dwt_txconfig_t txconfig = {
 // ### ping ###
 // #define PING_RX_TIMEOUT_UUS 60000
 
-// for int test
-#define PING_RX_TIMEOUT_UUS 30000
+// ping / range rx timeouts and reply delays are derived from the PHY profile (uwb_phy.h)
 
 // ### range ###
 // //only polling
@@ -73,13 +61,12 @@ static dwt_txconfig_t txconfig = {
 // #define RANGE_RESP_RX_TIMEOUT_UUS   30000 // resp rx timeout
 // #define RANGE_FINAL_RX_TIMEOUT_UUS  30000 // final rx timeout
 
+// int test 2000:x 3000:OK (110k_1024)
+// #define RANGE_RESP_TX_DELAY_UUS     5000 // resp tx delay
+// #define RANGE_FINAL_TX_DELAY_UUS    5000 // final tx delay
 
-// int test 2000:x 3000:OK 
-#define RANGE_RESP_TX_DELAY_UUS     5000 // resp tx delay
-#define RANGE_FINAL_TX_DELAY_UUS    5000 // final tx delay
-
-#define RANGE_RESP_RX_TIMEOUT_UUS   30000 // resp rx timeout
-#define RANGE_FINAL_RX_TIMEOUT_UUS  30000 // final rx timeout
+// #define RANGE_RESP_RX_TIMEOUT_UUS   30000 // resp rx timeout
+// #define RANGE_FINAL_RX_TIMEOUT_UUS  30000 // final rx timeout
 
 
 // //polling
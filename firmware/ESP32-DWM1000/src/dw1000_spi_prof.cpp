@@ -0,0 +1,136 @@
+#include "dw1000_spi_prof.h"
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+
+
+typedef struct {
+    const char *api;     // __func__ of the dwt_* API, NULL if none
+    uint8_t reg;         // register file id
+    bool write;
+    uint32_t count;
+    uint32_t bytes;
+    uint64_t cycles;
+} dw1000_spi_prof_entry_t;
+
+static bool prof_enabled = false;
+static dw1000_spi_prof_entry_t prof_entries[DW1000_SPI_PROF_ENTRIES];
+static uint32_t prof_used = 0;
+static uint32_t prof_last = 0;      // entry of the last transaction, consecutive ones often hit it again
+static uint32_t prof_dropped = 0;   // transactions that found the table full
+
+
+void dw1000_spi_prof_enable(bool enable) {
+    if (enable && !prof_enabled) {
+        dw1000_spi_prof_reset();
+    }
+    prof_enabled = enable;
+}
+
+bool dw1000_spi_prof_is_enabled() {
+    return prof_enabled;
+}
+
+void dw1000_spi_prof_reset() {
+    memset(prof_entries, 0, sizeof(prof_entries));
+    prof_used = 0;
+    prof_last = 0;
+    prof_dropped = 0;
+}
+
+void dw1000_spi_prof_record(const uint8_t *header, uint16_t header_len, uint32_t bytes, bool write, uint32_t cycles) {
+    if (!prof_enabled || header_len == 0) {
+        return;
+    }
+    const char *api = dwt_spiprofapi();
+    uint8_t reg = header[0] & 0x3F;
+
+    dw1000_spi_prof_entry_t *e = &prof_entries[prof_last];
+    if (prof_last >= prof_used || e->api != api || e->reg != reg || e->write != write) {
+        uint32_t i = 0;
+        while (i < prof_used && (prof_entries[i].api != api || prof_entries[i].reg != reg || prof_entries[i].write != write)) {
+            i++;
+        }
+        if (i == prof_used) {
+            if (prof_used == DW1000_SPI_PROF_ENTRIES) {
+                prof_dropped++;
+                return;
+            }
+            prof_used++;
+            prof_entries[i].api = api;
+            prof_entries[i].reg = reg;
+            prof_entries[i].write = write;
+        }
+        prof_last = i;
+        e = &prof_entries[i];
+    }
+    e->count++;
+    e->bytes += bytes;
+    e->cycles += cycles;
+}
+
+static const char *reg_name(uint8_t reg) {
+    switch (reg) {
+#define REG_NAME(name) case name##_ID: return #name;
+        REG_NAME(DEV_ID) REG_NAME(EUI_64) REG_NAME(PANADR) REG_NAME(SYS_CFG) REG_NAME(SYS_TIME)
+        REG_NAME(TX_FCTRL) REG_NAME(TX_BUFFER) REG_NAME(DX_TIME) REG_NAME(RX_FWTO) REG_NAME(SYS_CTRL)
+        REG_NAME(SYS_MASK) REG_NAME(SYS_STATUS) REG_NAME(RX_FINFO) REG_NAME(RX_BUFFER) REG_NAME(RX_FQUAL)
+        REG_NAME(RX_TTCKI) REG_NAME(RX_TTCKO) REG_NAME(RX_TIME) REG_NAME(TX_TIME) REG_NAME(TX_ANTD)
+        REG_NAME(SYS_STATE) REG_NAME(ACK_RESP_T) REG_NAME(RX_SNIFF) REG_NAME(TX_POWER) REG_NAME(CHAN_CTRL)
+        REG_NAME(USR_SFD) REG_NAME(AGC_CTRL) REG_NAME(EXT_SYNC) REG_NAME(ACC_MEM) REG_NAME(GPIO_CTRL)
+        REG_NAME(DRX_CONF) REG_NAME(RF_CONF) REG_NAME(TX_CAL) REG_NAME(FS_CTRL) REG_NAME(AON)
+        REG_NAME(OTP_IF) REG_NAME(LDE_IF) REG_NAME(DIG_DIAG) REG_NAME(CRTR) REG_NAME(PMSC)
+#undef REG_NAME
+        default: return NULL;
+    }
+}
+
+// by api name, register, read before write
+static int entry_cmp(const dw1000_spi_prof_entry_t *a, const dw1000_spi_prof_entry_t *b) {
+    int c = strcmp(a->api ? a->api : "", b->api ? b->api : "");
+    if (c == 0) {
+        c = (int)a->reg - (int)b->reg;
+    }
+    if (c == 0) {
+        c = (int)a->write - (int)b->write;
+    }
+    return c;
+}
+
+void dw1000_spi_prof_report() {
+    uint32_t mhz = getCpuFrequencyMhz();
+
+    // sorted copy of the indices, the table keeps the order of the first hit
+    static uint8_t order[DW1000_SPI_PROF_ENTRIES];
+    uint32_t n = prof_used;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = i;
+        while (j > 0 && entry_cmp(&prof_entries[order[j - 1]], &prof_entries[i]) > 0) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (uint8_t)i;
+    }
+
+    uint32_t total_count = 0;
+    uint64_t total_bytes = 0;
+    uint64_t total_cycles = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const dw1000_spi_prof_entry_t *e = &prof_entries[order[i]];
+        const char *name = reg_name(e->reg);
+        char reg[8];
+        if (name == NULL) {
+            snprintf(reg, sizeof(reg), "0x%02X", e->reg);
+            name = reg;
+        }
+        Serial.printf("{\"event\":\"spiprof\",\"api\":\"%s\",\"reg\":\"%s\",\"dir\":\"%c\",\"count\":%u,\"bytes\":%u,\"cycles\":%llu,\"us\":%u}\n",
+            e->api ? e->api : "-", name, e->write ? 'w' : 'r', (unsigned)e->count, (unsigned)e->bytes,
+            (unsigned long long)e->cycles, (unsigned)(e->cycles / mhz));
+        total_count += e->count;
+        total_bytes += e->bytes;
+        total_cycles += e->cycles;
+    }
+    Serial.printf("{\"event\":\"spiprof_total\",\"enabled\":%d,\"entries\":%u,\"dropped\":%u,\"count\":%u,\"bytes\":%llu,\"cycles\":%llu,\"us\":%u}\n",
+        prof_enabled, (unsigned)n, (unsigned)prof_dropped, (unsigned)total_count, (unsigned long long)total_bytes,
+        (unsigned long long)total_cycles, (unsigned)(total_cycles / mhz));
+}
@@ -0,0 +1,34 @@
+#ifndef __DW1000_SPI_PROF_H__
+#define __DW1000_SPI_PROF_H__
+
+#include <Arduino.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// SPI transaction profile of the decadriver port layer (writetospi / readfromspi in dw1000.cpp)
+// every transaction is counted under the dwt_* API that issued it (dwt_spiprofapi, DWT_SPI_PROF),
+// the register file and the direction, with bytes and CPU cycles. off until enabled
+#define DW1000_SPI_PROF_ENTRIES 96
+
+
+void dw1000_spi_prof_enable(bool enable);
+bool dw1000_spi_prof_is_enabled();
+void dw1000_spi_prof_reset();
+
+// call after a transaction, header as sent to the DW1000, bytes with the header, cycles from ESP.getCycleCount
+void dw1000_spi_prof_record(const uint8_t *header, uint16_t header_len, uint32_t bytes, bool write, uint32_t cycles);
+
+// one {"event":"spiprof",...} line per api / register / direction, sorted to diff two builds,
+// then a {"event":"spiprof_total",...} line
+void dw1000_spi_prof_report();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DW1000_SPI_PROF_H__
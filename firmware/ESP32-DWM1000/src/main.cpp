@@ -11,6 +11,9 @@
 
 #include "safe_print.h"
 #include "system_config.h"
+#include "serial_report.h"
+#include "serial_cmd.h"
+#include "dw1000_spi_prof.h"
 
 
 
@@ -59,10 +62,253 @@ void ui_task(void *param) {
     }
 }
 
+// parse uart commands, serial_cmd.h already took the optional "#<req_id>" prefix
+// results of ping / trigger* carry the request id, other commands reply directly before the ack
+// cmd1: ping <node_id>
+// cmd2: trigger <node_id> <range_node_id>
+//       trigger_ss <node_id> <range_node_id>  (single-sided TWR, poll + resp)
+// cmd3: trigger_multi <node_id> <range_node_id_1> [<range_node_id_2> ...]
+//       trigger_bcast <node_id> <range_node_id_1> [<range_node_id_2> ...]  (one broadcast poll)
+// cmd4: range <range_node_id>
+// cmd5: mode <json|bin>
+// cmd6: baud <baudrate>
+// cmd7: stats
+// cmd8: prof <on|off|reset|tune|notune|show>
+// cmd9: phy [<index|name>]
+// cmd10: tdma [off | <slot_ms> <tag_id,...> <anchor_id,...>]
+// cmd11: twr bench [<iterations>]
+// cmd12: tdoa [off | <sync_ms> [<blink_ms> [<anchors> [<tags>]]]]
+// cmd13: spiprof <on|off|reset|show>
+static bool handle_command(char *line) {
+    uint32_t req_id = serial_cmd_req_id();
+    bool ok = true;
+
+    char cmd[32];
+    char arg1[32];
+    char arg2[32];
+    char arg3[64];
+    char arg4[32];
+
+    int num_args = sscanf(line, "%31s %31s %31s %63s %31s", cmd, arg1, arg2, arg3, arg4);
+    if (num_args < 1) {
+        return false;
+    }
+
+    if (strcmp(cmd, "ping") == 0 && num_args == 2) {
+        uint16_t target_node_id = strtol(arg1, NULL, 0);
+        ok = uwb_cmd_ping(target_node_id, UWB_CMD_PRIO_NORMAL);
+        if (ok) {
+            serial_cmd_expect(req_id, SERIAL_CMD_RESULT_PING, target_node_id, 0);
+        }
+    }
+    else if ((strcmp(cmd, "trigger") == 0 || strcmp(cmd, "trigger_ss") == 0) && num_args == 3) {
+        uint16_t initiator_id = strtol(arg1, NULL, 0);
+        uint16_t responder_id = strtol(arg2, NULL, 0);
+        if (strcmp(cmd, "trigger_ss") == 0) {
+            ok = uwb_cmd_range_trigger_ss(initiator_id, responder_id, UWB_CMD_PRIO_NORMAL);
+        } else {
+            ok = uwb_cmd_range_trigger(initiator_id, responder_id, UWB_CMD_PRIO_NORMAL);
+        }
+        if (ok) {
+            serial_cmd_expect(req_id, SERIAL_CMD_RESULT_RANGE, initiator_id, responder_id);
+        }
+    }
+    else if ((strcmp(cmd, "trigger_multi") == 0 || strcmp(cmd, "trigger_bcast") == 0) && num_args >= 3) {
+        // split all args, first is initiator, the rest are responders
+        char args[128];
+        strncpy(args, line, sizeof(args) - 1);
+        args[sizeof(args) - 1] = '\0';
+
+        uint16_t initiator_id = 0;
+        uint16_t responder_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+        uint8_t num_responders = 0;
+        bool too_many = false;
+
+        char *save_ptr = NULL;
+        strtok_r(args, " ", &save_ptr); // skip cmd
+        initiator_id = strtol(strtok_r(NULL, " ", &save_ptr), NULL, 0);
+        for (char *tok = strtok_r(NULL, " ", &save_ptr); tok != NULL; tok = strtok_r(NULL, " ", &save_ptr)) {
+            if (num_responders >= UWB_RANGE_MULTI_MAX_TARGETS) {
+                too_many = true;
+                break;
+            }
+            responder_ids[num_responders++] = strtol(tok, NULL, 0);
+        }
+
+        if (too_many) {
+            Serial.printf("Too many responders, max %d\n", UWB_RANGE_MULTI_MAX_TARGETS);
+            ok = false;
+        } else {
+            uint8_t type = (strcmp(cmd, "trigger_bcast") == 0) ? UWB_CMD_RANGE_TRIGGER_BCAST : UWB_CMD_RANGE_TRIGGER_MULTI;
+            ok = uwb_cmd_range_trigger_list(type, initiator_id, responder_ids, num_responders, UWB_CMD_PRIO_NORMAL);
+            // one result per responder, all answer the same request
+            for (uint8_t i = 0; ok && i < num_responders; i++) {
+                serial_cmd_expect(req_id, SERIAL_CMD_RESULT_RANGE, initiator_id, responder_ids[i]);
+            }
+        }
+    }
+    else if (strcmp(cmd, "mode") == 0 && num_args == 2) {
+        if (strcmp(arg1, "bin") == 0) {
+            serial_report_set_mode(SERIAL_REPORT_MODE_BINARY);
+        } else if (strcmp(arg1, "json") == 0) {
+            serial_report_set_mode(SERIAL_REPORT_MODE_JSON);
+        } else {
+            Serial.println("Unknown mode, use json or bin");
+            ok = false;
+        }
+    }
+    else if (strcmp(cmd, "baud") == 0 && num_args == 2) {
+        uint32_t baud = strtoul(arg1, NULL, 0);
+        ok = serial_report_set_baudrate(baud);
+    }
+    else if (strcmp(cmd, "stats") == 0 && num_args == 1) {
+        Serial.printf("{\"event\":\"stats\",\"result_pushed\":%u,\"result_overflow\":%u,\"result_max_level\":%u,\"log_drop\":%u,\"log_drop_bytes\":%u,\"log_record_drop\":%u,\"cmd_submitted\":%u,\"cmd_rejected\":%u,\"cmd_timeout\":%u,\"session_active\":%u,\"session_expired\":%u,\"session_overflow\":%u,\"rx_frames\":%u,\"rx_recovered\":%u,\"rx_overrun\":%u,\"cmd_line_overflow\":%u,\"req_expired\":%u,\"spi_foreign\":%u}\n",
+            (unsigned)uwb_result_pushed_count(),
+            (unsigned)uwb_result_overflow_count(),
+            (unsigned)uwb_result_max_level(),
+            (unsigned)safe_print_drop_count(),
+            (unsigned)safe_print_drop_bytes(),
+            (unsigned)uwb_log_drop_count(),
+            (unsigned)uwb_cmd_submitted_count(),
+            (unsigned)uwb_cmd_rejected_count(),
+            (unsigned)uwb_cmd_timeout_count(),
+            (unsigned)uwb_session_active_count(),
+            (unsigned)uwb_session_expired_count(),
+            (unsigned)uwb_session_overflow_count(),
+            (unsigned)uwb_rx_frame_count(),
+            (unsigned)uwb_rx_recovered_count(),
+            (unsigned)uwb_rx_overrun_count(),
+            (unsigned)serial_cmd_overflow_count(),
+            (unsigned)serial_cmd_expired_count(),
+            (unsigned)dw1000_port_foreign_count()
+        );
+    }
+    else if (strcmp(cmd, "prof") == 0 && num_args >= 1) {
+        if (num_args == 1 || strcmp(arg1, "show") == 0) {
+            uwb_profile_report();
+        } else if (strcmp(arg1, "on") == 0) {
+            uwb_profile_enable(true);
+        } else if (strcmp(arg1, "off") == 0) {
+            uwb_profile_enable(false);
+        } else if (strcmp(arg1, "reset") == 0) {
+            uwb_profile_reset();
+        } else if (strcmp(arg1, "tune") == 0) {
+            uwb_profile_autotune(true);
+        } else if (strcmp(arg1, "notune") == 0) {
+            uwb_profile_autotune(false);
+        } else {
+            Serial.println("Unknown prof option");
+            ok = false;
+        }
+    }
+    else if (strcmp(cmd, "phy") == 0 && num_args <= 2) {
+        if (num_args == 2) {
+            // accept index or profile name
+            uint8_t index = uwb_phy_profile_count;
+            for (uint8_t i = 0; i < uwb_phy_profile_count; i++) {
+                if (strcmp(arg1, uwb_phy_profiles[i].name) == 0) {
+                    index = i;
+                }
+            }
+            if (index == uwb_phy_profile_count && isdigit((unsigned char)arg1[0])) {
+                index = strtoul(arg1, NULL, 0);
+            }
+            if (index >= uwb_phy_profile_count) {
+                Serial.println("Unknown phy profile");
+                ok = false;
+            }
+            else if (!set_uwb_phy_profile(index)) {
+                Serial.println("Radio command queue full");
+                ok = false;
+            }
+        }
+        // timings are of the active profile, a new selection is applied by uwb_task after the current exchange
+        Serial.printf("{\"event\":\"phy\",\"index\":%u,\"name\":\"%s\",\"active\":\"%s\",\"resp_tx_delay_uus\":%u,\"final_tx_delay_uus\":%u,\"resp_rx_timeout_uus\":%u,\"frame_us\":%u}\n",
+            (unsigned)get_uwb_phy_profile(),
+            uwb_phy_profiles[get_uwb_phy_profile()].name,
+            uwb_phy_current()->name,
+            (unsigned)uwb_phy_timing.resp_tx_delay_uus,
+            (unsigned)uwb_phy_timing.final_tx_delay_uus,
+            (unsigned)uwb_phy_timing.resp_rx_timeout_uus,
+            (unsigned)(uwb_phy_frame_duration_ns(uwb_phy_current(), UWB_PHY_MAX_FRAME_LEN) / 1000)
+        );
+    }
+    else if (strcmp(cmd, "tdma") == 0 && (num_args == 1 || num_args == 2 || num_args == 4)) {
+        if (num_args == 2 && strcmp(arg1, "off") == 0) {
+            uwb_tdma_stop();
+        }
+        else if (num_args == 4) {
+            // id lists are comma separated
+            uint16_t tag_ids[UWB_TDMA_MAX_TAGS];
+            uint16_t anchor_ids[UWB_TDMA_MAX_ANCHORS];
+            uint8_t num_tags = 0;
+            uint8_t num_anchors = 0;
+            char *save_ptr = NULL;
+
+            for (char *tok = strtok_r(arg2, ",", &save_ptr); tok != NULL && num_tags < UWB_TDMA_MAX_TAGS; tok = strtok_r(NULL, ",", &save_ptr)) {
+                tag_ids[num_tags++] = strtol(tok, NULL, 0);
+            }
+            for (char *tok = strtok_r(arg3, ",", &save_ptr); tok != NULL && num_anchors < UWB_TDMA_MAX_ANCHORS; tok = strtok_r(NULL, ",", &save_ptr)) {
+                anchor_ids[num_anchors++] = strtol(tok, NULL, 0);
+            }
+
+            uint16_t slot_ms = strtoul(arg1, NULL, 0);
+            if (!uwb_tdma_start(slot_ms, tag_ids, num_tags, anchor_ids, num_anchors)) {
+                Serial.printf("TDMA start failed, max %d tags / %d anchors, min slot %u us\n", UWB_TDMA_MAX_TAGS, UWB_TDMA_MAX_ANCHORS, (unsigned)uwb_tdma_min_slot_us(num_anchors));
+                ok = false;
+            }
+        }
+        else if (num_args == 2) {
+            Serial.println("Unknown tdma option");
+            ok = false;
+        }
+        uwb_tdma_report();
+    }
+    else if (strcmp(cmd, "tdoa") == 0 && num_args <= 5) {
+        if (num_args >= 2 && strcmp(arg1, "off") == 0) {
+            uwb_tdoa_stop();
+        }
+        else if (num_args >= 2) {
+            uint16_t sync_ms = strtoul(arg1, NULL, 10);
+            uint16_t blink_ms = (num_args >= 3) ? strtoul(arg2, NULL, 10) : UWB_TDOA_DEFAULT_BLINK_MS;
+            uint8_t anchors = (num_args >= 4) ? strtoul(arg3, NULL, 10) : UWB_TDOA_DEFAULT_ANCHORS;
+            uint16_t tags = (num_args == 5) ? strtoul(arg4, NULL, 10) : 0;
+            if (!uwb_tdoa_start(sync_ms, blink_ms, anchors, tags)) {
+                Serial.printf("TDoA start failed, max %u tags\n", (unsigned)uwb_tdoa_max_tags(sync_ms, blink_ms, anchors));
+                ok = false;
+            }
+        }
+        uwb_tdoa_report();
+    }
+    else if (strcmp(cmd, "spiprof") == 0 && num_args <= 2) {
+        if (num_args == 1 || strcmp(arg1, "show") == 0) {
+            dw1000_spi_prof_report();
+        } else if (strcmp(arg1, "on") == 0) {
+            dw1000_spi_prof_enable(true);
+        } else if (strcmp(arg1, "off") == 0) {
+            dw1000_spi_prof_enable(false);
+        } else if (strcmp(arg1, "reset") == 0) {
+            dw1000_spi_prof_reset();
+        } else {
+            Serial.println("Unknown spiprof option");
+            ok = false;
+        }
+    }
+    else if (strcmp(cmd, "twr") == 0 && num_args >= 2 && strcmp(arg1, "bench") == 0) {
+        uint32_t iterations = (num_args >= 3) ? strtoul(arg2, NULL, 10) : 1000;
+        uwb_twr_benchmark(iterations);
+    }
+    else {
+        Serial.println("Unknown command or wrong number of arguments");
+        ok = false;
+    }
+    return ok;
+}
+
 void setup() {
 
 
-    Serial.begin(115200);
+    Serial.begin(SERIAL_REPORT_DEFAULT_BAUD);
     // Serial.begin(2000000);
     uint64_t chipid64 = ESP.getEfuseMac();
     Serial.printf("[esp32] ESP32 Chip ID: %08X%08X\n", (uint32_t)(chipid64>>32), (uint32_t)chipid64);
@@ -128,6 +374,10 @@ void setup() {
     power_init();
 
     safe_print_init();
+    uwb_log_init();
+
+    // setup() and loop() share the arduino loop task, it is woken by uart data
+    serial_cmd_init(handle_command);
 
     xTaskCreatePinnedToCore(
         ui_task,          /* Task function. */
@@ -144,66 +394,37 @@ void setup() {
 
 
 void loop() {
-    // delay
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // woken at once by uart data, otherwise every 10 ms for the results
+    serial_cmd_wait(10);
 
     // ui_loop(&ui);
 
     // uwb_process();
     // uwb_process_polling_irq();
 
-    static unsigned long last_print_ping_resp = 0;
-    static unsigned long last_print_range_final = 0;
-    static unsigned long last_print_range_report = 0;
-
-    if (ping_resp_ts != last_print_ping_resp) {
-        last_print_ping_resp = ping_resp_ts;
-        // Serial.printf("Ping Resp Received: Node ID: 0x%04X, System State: 0x%02X, Voltage: %d mV\n",
-        //     ping_resp_node_id,
-        //     ping_resp_system_state, 
-        //     ping_resp_voltage_mv
-        // );
-    
-        // print as JSON format for easy parsing
-        Serial.printf("{\"event\":\"ping_resp\",\"node_id\":%d,\"system_state\":%d,\"voltage_mv\":%d}\n",
-            ping_resp_node_id,
-            ping_resp_system_state, 
-            ping_resp_voltage_mv
-        );
-    }
-
-    if (range_final_ts != last_print_range_final) {
-        last_print_range_final = range_final_ts;
-        // Serial.printf("Range Final Received: Node A ID: 0x%04X, Node B ID: 0x%04X, Distance: %.2f m\n",
-        //     range_final_node_a_id,
-        //     range_final_node_b_id,
-        //     range_final_distance_m
-        // );
-    
-        Serial.printf("{\"event\":\"range_final\",\"node_a_id\":%d,\"node_b_id\":%d,\"distance_m\":%.2f,\"rssi_dbm\":%.2f}\n",
-            range_final_node_a_id,
-            range_final_node_b_id,
-            range_final_distance_m,
-            range_final_rssi_dbm
-        );
-    }
-
-    if (range_report_ts != last_print_range_report) {
-        last_print_range_report = range_report_ts;
-        // Serial.printf("Range Report Received: Node A ID: 0x%04X, Node B ID: 0x%04X, Distance: %.2f m, RSSI: %.2f dBm\n",
-        //     range_report_node_a_id,
-        //     range_report_node_b_id,
-        //     range_report_distance_m,
-        //     range_report_rssi_dbm
-        // );
-    
-        // print as JSON format for easy parsing
-        Serial.printf("{\"event\":\"range_report\",\"node_a_id\":%d,\"node_b_id\":%d,\"distance_m\":%.2f,\"rssi_dbm\":%.2f}\n",
-            range_report_node_a_id,
-            range_report_node_b_id,
-            range_report_distance_m,
-            range_report_rssi_dbm
-        );
+    // drain all results produced by uwb_task since last loop, none is lost between two loops
+    static uwb_result_t results[16];
+    uint32_t num_results;
+    while ((num_results = uwb_result_pop_batch(results, sizeof(results) / sizeof(results[0]))) > 0) {
+        for (uint32_t i = 0; i < num_results; i++) {
+            uwb_result_t *r = &results[i];
+            switch (r->type) {
+                case UWB_RESULT_PING_RESP:
+                    serial_report_ping_resp(r->ping.node_id, r->ping.system_state, r->ping.voltage_mv, serial_cmd_match(SERIAL_CMD_RESULT_PING, r->ping.node_id, 0));
+                    break;
+                case UWB_RESULT_RANGE_FINAL:
+                    serial_report_range(SERIAL_FRAME_TYPE_RANGE_FINAL, r->range.node_a_id, r->range.node_b_id, r->range.distance_mm, r->range.rssi_dbm,
+                                        serial_cmd_match(SERIAL_CMD_RESULT_RANGE, r->range.node_a_id, r->range.node_b_id));
+                    break;
+                case UWB_RESULT_RANGE_REPORT:
+                    serial_report_range(SERIAL_FRAME_TYPE_RANGE_REPORT, r->range.node_a_id, r->range.node_b_id, r->range.distance_mm, r->range.rssi_dbm,
+                                        serial_cmd_match(SERIAL_CMD_RESULT_RANGE, r->range.node_a_id, r->range.node_b_id));
+                    break;
+                case UWB_RESULT_TDOA:
+                    serial_report_tdoa(r->tdoa.anchor_id, r->tdoa.tag_id, r->tdoa.blink_seq, r->tdoa.ts);
+                    break;
+            }
+        }
     }
 
 
@@ -225,39 +446,6 @@ void loop() {
         // }
     }
 
-    // parse uart commands 
-    // cmd1: ping <node_id>
-    // cmd2: trigger <node_id> <range_node_id>
-    // cmd3: range <range_node_id>
-    
-    if (Serial.available()) {
-        String line = Serial.readStringUntil('\n');
-        line.trim();
-        if (line.length() == 0) {
-            return;
-        }
-
-        // Serial.printf("Received command: %s\n", line.c_str());
-
-        char cmd[32];
-        char arg1[32];
-        char arg2[32];
-
-        int num_args = sscanf(line.c_str(), "%31s %31s %31s", cmd, arg1, arg2);
-
-        if (strcmp(cmd, "ping") == 0 && num_args == 2) {
-            uint16_t target_node_id = strtol(arg1, NULL, 0);
-            uint8_t succ = uwb_send_ping_req(target_node_id);
-        }
-        else if (strcmp(cmd, "trigger") == 0 && num_args == 3) {
-            uint16_t initiator_id = strtol(arg1, NULL, 0);
-            uint16_t responder_id = strtol(arg2, NULL, 0);
-            uint8_t succ = uwb_send_range_trigger(initiator_id, responder_id);
-        }
-        else {
-            Serial.println("Unknown command or wrong number of arguments");
-        }
-
-    }
-
-}
\ No newline at end of file
+    // uart commands, see handle_command()
+    serial_cmd_poll();
+}
@@ -0,0 +1,905 @@
+#include "dw1000_model.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <list>
+#include <vector>
+
+#include "deca_regs.h"
+#include "deca_device_api.h"
+#include "dw1000.h"
+
+
+#define MASK40 0xFFFFFFFFFFULL
+#define DTU_PER_UUS 65536
+// frames kept for the collision check after they ended
+#define AIR_HISTORY_DTU HAL_MS_TO_DTU(10)
+
+// first files of the RX double buffer sets, RX_FINFO .. RX_TIME
+#define RX_SET_FIRST RX_FINFO_ID
+#define RX_SET_COUNT (RX_TIME_ID - RX_FINFO_ID + 1)
+
+// status bits kept per RX buffer set (SYS_STATUS_ALL_DBLBUFF)
+#define STATUS_SWING (SYS_STATUS_RXDFR | SYS_STATUS_RXFCG)
+#define STATUS_RX_HEAD (SYS_STATUS_RXPRD | SYS_STATUS_RXSFDD | SYS_STATUS_LDEDONE | SYS_STATUS_RXPHD)
+
+enum {
+    RADIO_IDLE = 0,
+    RADIO_TX,
+    RADIO_RX,
+};
+
+typedef struct {
+    dw1000_air_frame_t frame;
+    hal_time_t start;   // first preamble symbol at this antenna
+    hal_time_t sfd;     // start of the SFD
+    hal_time_t end;     // last bit
+    bool locked;        // the receiver took it
+} rx_air_t;
+
+struct dw1000_model {
+    hal_node_t *node;
+
+    std::vector<uint8_t> file[0x40];
+    std::vector<uint8_t> set_file[2][RX_SET_COUNT];
+
+    uint64_t status;      // all but the double buffered bits
+    uint32_t swing[2];
+    bool full[2];
+    uint8_t icp;          // IC side buffer, the next frame goes there
+    uint8_t hsp;          // host side buffer, what the registers show
+
+    uint64_t clock_offset;
+    int32_t clock_ppb;
+    uint16_t phys_tx_ant;
+    uint16_t phys_rx_ant;
+    float ts_noise;
+
+    uint8_t radio;
+    bool irq_level;
+
+    // TX
+    dw1000_air_frame_t tx_frame;
+    uint64_t tx_raw_local;
+    bool tx_w4r;
+    hal_event_t *tx_emit_event;
+    hal_event_t *tx_done_event;
+
+    // RX
+    std::list<rx_air_t> air;
+    rx_air_t *locked;
+    hal_event_t *rx_on_event;
+    hal_event_t *rx_end_event;
+    hal_event_t *rx_fwto_event;
+    hal_event_t *rx_pto_event;
+
+    dw1000_model_tx_cb_t tx_cb;
+    void *tx_arg;
+
+    dw1000_model_stats_t stats;
+    dw1000_bus_stats_t bus;
+};
+
+
+static void rx_try_lock(dw1000_model_t *m);
+
+// ---------------- registers ----------------
+
+static uint32_t file_size(uint8_t id) {
+    switch (id) {
+        case TX_BUFFER_ID:
+        case RX_BUFFER_ID: return 1024;
+        case ACC_MEM_ID:   return 4064;
+        case LDE_IF_ID:    return 0x2810;
+        default:           return 0x100;
+    }
+}
+
+static bool dbl_on(dw1000_model_t *m) {
+    return (m->file[SYS_CFG_ID][1] & (SYS_CFG_DIS_DRXB >> 8)) == 0;
+}
+
+static std::vector<uint8_t> &host_file(dw1000_model_t *m, uint8_t id) {
+    if (id >= RX_SET_FIRST && id < RX_SET_FIRST + RX_SET_COUNT) {
+        return m->set_file[dbl_on(m) ? m->hsp : 0][id - RX_SET_FIRST];
+    }
+    return m->file[id];
+}
+
+static std::vector<uint8_t> &ic_file(dw1000_model_t *m, uint8_t id) {
+    return m->set_file[dbl_on(m) ? m->icp : 0][id - RX_SET_FIRST];
+}
+
+static uint64_t get_le(const std::vector<uint8_t> &f, uint32_t offset, uint32_t n) {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < n && offset + i < f.size(); i++) {
+        v |= (uint64_t)f[offset + i] << (8 * i);
+    }
+    return v;
+}
+
+static void put_le(std::vector<uint8_t> &f, uint32_t offset, uint64_t v, uint32_t n) {
+    for (uint32_t i = 0; i < n && offset + i < f.size(); i++) {
+        f[offset + i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint64_t reg(dw1000_model_t *m, uint8_t id, uint32_t offset, uint32_t n) {
+    return get_le(m->file[id], offset, n);
+}
+
+static void set_reg(dw1000_model_t *m, uint8_t id, uint32_t offset, uint64_t v, uint32_t n) {
+    put_le(m->file[id], offset, v, n);
+}
+
+static uint64_t status_value(dw1000_model_t *m) {
+    uint64_t s = m->status;
+    if (dbl_on(m)) {
+        s |= m->swing[m->hsp];
+        s |= m->hsp ? SYS_STATUS_HSRBP : 0;
+        s |= m->icp ? SYS_STATUS_ICRBP : 0;
+    } else {
+        s |= m->swing[0];
+    }
+    uint32_t mask = (uint32_t)reg(m, SYS_MASK_ID, 0, 4);
+    if (s & mask & ~(SYS_STATUS_IRQS | SYS_STATUS_HSRBP | SYS_STATUS_ICRBP)) {
+        s |= SYS_STATUS_IRQS;
+    }
+    return s;
+}
+
+static void update_irq(dw1000_model_t *m) {
+    bool level = (status_value(m) & SYS_STATUS_IRQS) != 0;
+    if (level != m->irq_level) {
+        m->irq_level = level;
+        hal_gpio_input(m->node, PIN_DW1000_IRQ, level);
+    }
+}
+
+static void status_clear(dw1000_model_t *m, uint64_t bits) {
+    m->swing[dbl_on(m) ? m->hsp : 0] &= ~(uint32_t)(bits & STATUS_SWING);
+    m->status &= ~(bits & ~(uint64_t)(STATUS_SWING | SYS_STATUS_IRQS | SYS_STATUS_HSRBP | SYS_STATUS_ICRBP));
+}
+
+
+// ---------------- clock ----------------
+
+uint64_t dw1000_model_local_time(dw1000_model_t *m, hal_time_t t) {
+    __int128 local = (__int128)m->clock_offset + t + (__int128)t * m->clock_ppb / 1000000000;
+    return (uint64_t)local & MASK40;
+}
+
+// global interval of a device clock interval
+static hal_time_t local_to_global_dtu(dw1000_model_t *m, uint64_t local_dtu) {
+    return (hal_time_t)((__int128)local_dtu * 1000000000 / (1000000000 + m->clock_ppb));
+}
+
+static float gauss(dw1000_model_t *m) {
+    double u1 = (hal_node_random(m->node) + 1.0) / 4294967297.0;
+    double u2 = hal_node_random(m->node) / 4294967296.0;
+    return (float)(sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+
+// ---------------- air time ----------------
+
+static hal_time_t symbol_dtu(const dw1000_phy_t *phy) {
+    return (phy->prf == DWT_PRF_16M) ? 63488 : 65024;
+}
+
+static hal_time_t data_bit_dtu(uint8_t data_rate) {
+    switch (data_rate) {
+        case DWT_BR_110K: return 524288;
+        case DWT_BR_850K: return 65536;
+        default:          return 8192;
+    }
+}
+
+hal_time_t dw1000_model_shr_dtu(const dw1000_phy_t *phy) {
+    return (hal_time_t)(phy->plen + phy->sfd_symbols) * symbol_dtu(phy);
+}
+
+hal_time_t dw1000_model_tail_dtu(const dw1000_phy_t *phy, uint16_t len) {
+    // 21 bits PHR (850k for 6.8M too), data with 48 Reed Solomon parity bits per 330 bits block
+    hal_time_t phr_bit = (phy->data_rate == DWT_BR_110K) ? 524288 : 65536;
+    uint32_t data_bits = len * 8;
+    data_bits += ((data_bits + 329) / 330) * 48;
+    return 21 * phr_bit + data_bits * data_bit_dtu(phy->data_rate);
+}
+
+float dw1000_model_sensitivity_dbm(const dw1000_phy_t *phy) {
+    switch (phy->data_rate) {
+        case DWT_BR_110K: return -106.0f;
+        case DWT_BR_850K: return -102.0f;
+        default:          return -95.0f;
+    }
+}
+
+static uint16_t plen_symbols(uint8_t code) {
+    switch (code) {
+        case DWT_PLEN_4096: return 4096;
+        case DWT_PLEN_2048: return 2048;
+        case DWT_PLEN_1536: return 1536;
+        case DWT_PLEN_1024: return 1024;
+        case DWT_PLEN_512:  return 512;
+        case DWT_PLEN_256:  return 256;
+        case DWT_PLEN_128:  return 128;
+        default:            return 64;
+    }
+}
+
+static uint8_t sfd_symbols(uint8_t data_rate, bool dwsfd) {
+    if (data_rate == DWT_BR_110K) {
+        return 64;
+    }
+    return (data_rate == DWT_BR_850K && dwsfd) ? 16 : 8;
+}
+
+void dw1000_model_tx_phy(dw1000_model_t *m, dw1000_phy_t *phy) {
+    uint32_t fctrl = (uint32_t)reg(m, TX_FCTRL_ID, 0, 4);
+    uint32_t chan_ctrl = (uint32_t)reg(m, CHAN_CTRL_ID, 0, 4);
+    phy->chan = chan_ctrl & CHAN_CTRL_TX_CHAN_MASK;
+    phy->pcode = (chan_ctrl & CHAN_CTRL_TX_PCOD_MASK) >> CHAN_CTRL_TX_PCOD_SHIFT;
+    phy->prf = (fctrl & TX_FCTRL_TXPRF_MASK) >> TX_FCTRL_TXPRF_SHFT;
+    phy->data_rate = (fctrl & TX_FCTRL_TXBR_MASK) >> TX_FCTRL_TXBR_SHFT;
+    phy->plen = plen_symbols((fctrl & TX_FCTRL_TXPSR_PE_MASK) >> 16);
+    phy->sfd_symbols = sfd_symbols(phy->data_rate, chan_ctrl & CHAN_CTRL_DWSFD);
+}
+
+
+// ---------------- CRC ----------------
+
+uint16_t dw1000_model_crc16(const uint8_t *data, uint16_t len) {
+    // CRC-16/KERMIT, x^16 + x^12 + x^5 + 1 bit reversed, zero seed
+    uint16_t crc = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+
+// ---------------- receiver ----------------
+
+static void rx_off(dw1000_model_t *m) {
+    hal_event_cancel(m->rx_end_event);
+    hal_event_cancel(m->rx_fwto_event);
+    hal_event_cancel(m->rx_pto_event);
+    m->rx_end_event = NULL;
+    m->rx_fwto_event = NULL;
+    m->rx_pto_event = NULL;
+    m->locked = NULL;
+    if (m->radio == RADIO_RX) {
+        m->radio = RADIO_IDLE;
+    }
+}
+
+static void rx_fwto_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    m->rx_fwto_event = NULL;
+    // frame wait timeout, also aborts a frame being received
+    m->status |= SYS_STATUS_RXRFTO;
+    m->stats.rx_timeouts++;
+    rx_off(m);
+    update_irq(m);
+}
+
+static void rx_pto_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    m->rx_pto_event = NULL;
+    if (m->locked == NULL) {
+        m->status |= SYS_STATUS_RXPTO;
+        m->stats.rx_timeouts++;
+        rx_off(m);
+        update_irq(m);
+    }
+}
+
+static bool rx_frame_filter(dw1000_model_t *m, const dw1000_air_frame_t *f) {
+    uint32_t cfg = (uint32_t)reg(m, SYS_CFG_ID, 0, 4);
+    if ((cfg & SYS_CFG_FFE) == 0) {
+        return true;
+    }
+    if (f->len < 5) {
+        return false;
+    }
+
+    uint16_t fc = f->data[0] | (f->data[1] << 8);
+    static const uint32_t allow[8] = {
+        SYS_CFG_FFAB, SYS_CFG_FFAD, SYS_CFG_FFAA, SYS_CFG_FFAM,
+        SYS_CFG_FFA4, SYS_CFG_FFA5, SYS_CFG_FFAR, SYS_CFG_FFAR,
+    };
+    uint8_t type = fc & 0x7;
+    if ((cfg & allow[type]) == 0) {
+        return false;
+    }
+    if (type == 2) {
+        return true; // ACK has no address
+    }
+
+    // destination PAN and address, the only ones checked
+    uint8_t dst_mode = (fc >> 10) & 0x3;
+    if (dst_mode == 0) {
+        return (cfg & SYS_CFG_FFBC) != 0;
+    }
+    uint32_t addr_len = (dst_mode == 3) ? 8 : 2;
+    if (f->len < 3 + 2 + addr_len + 2) {
+        return false;
+    }
+    uint16_t pan = f->data[3] | (f->data[4] << 8);
+    uint16_t own_pan = (uint16_t)reg(m, PANADR_ID, PANADR_PAN_ID_OFFSET, 2);
+    if (pan != 0xFFFF && pan != own_pan) {
+        return false;
+    }
+    if (dst_mode == 2) {
+        uint16_t dst = f->data[5] | (f->data[6] << 8);
+        uint16_t own = (uint16_t)reg(m, PANADR_ID, PANADR_SHORT_ADDR_OFFSET, 2);
+        return dst == 0xFFFF || dst == own;
+    }
+    return memcmp(&f->data[5], &m->file[EUI_64_ID][0], 8) == 0;
+}
+
+// frame became the one the receiver is locked on
+static void rx_end_cb(void *arg);
+
+static void rx_lock(dw1000_model_t *m, rx_air_t *a) {
+    a->locked = true;
+    m->locked = a;
+    hal_event_cancel(m->rx_pto_event);
+    m->rx_pto_event = NULL;
+    m->rx_end_event = hal_event_at(m->node, a->end, rx_end_cb, m);
+}
+
+static bool rx_can_lock(dw1000_model_t *m, const rx_air_t *a, hal_time_t listen_from) {
+    uint32_t chan_ctrl = (uint32_t)reg(m, CHAN_CTRL_ID, 0, 4);
+    const dw1000_phy_t *phy = &a->frame.phy;
+    if (phy->chan != ((chan_ctrl & CHAN_CTRL_RX_CHAN_MASK) >> CHAN_CTRL_RX_CHAN_SHIFT)
+        || phy->pcode != ((chan_ctrl & CHAN_CTRL_RX_PCOD_MASK) >> CHAN_CTRL_RX_PCOD_SHIFT)
+        || phy->prf != ((chan_ctrl & CHAN_CTRL_RXFPRF_MASK) >> CHAN_CTRL_RXFPRF_SHIFT)) {
+        return false;
+    }
+    if (a->frame.rx_power_dbm < dw1000_model_sensitivity_dbm(phy)) {
+        return false;
+    }
+    // enough preamble left to acquire
+    hal_time_t from = (listen_from > a->start) ? listen_from : a->start;
+    return from + DW1000_MODEL_MIN_ACQ_SYMBOLS * symbol_dtu(phy) <= a->sfd;
+}
+
+static void rx_try_lock(dw1000_model_t *m) {
+    if (m->radio != RADIO_RX || m->locked != NULL) {
+        return;
+    }
+    rx_air_t *best = NULL;
+    hal_time_t now = hal_now();
+    for (rx_air_t &a : m->air) {
+        if (!a.locked && a.start <= now && a.end > now && rx_can_lock(m, &a, now)
+            && (best == NULL || a.frame.rx_power_dbm > best->frame.rx_power_dbm)) {
+            best = &a;
+        }
+    }
+    if (best != NULL) {
+        rx_lock(m, best);
+    }
+}
+
+static void rx_listen(dw1000_model_t *m) {
+    m->radio = RADIO_RX;
+    m->locked = NULL;
+
+    uint32_t cfg = (uint32_t)reg(m, SYS_CFG_ID, 0, 4);
+    uint16_t fwto = (uint16_t)reg(m, RX_FWTO_ID, RX_FWTO_OFFSET, 2);
+    if ((cfg & SYS_CFG_RXWTOE) && fwto != 0) {
+        m->rx_fwto_event = hal_event_at(m->node, hal_now() + local_to_global_dtu(m, (uint64_t)fwto * DTU_PER_UUS), rx_fwto_cb, m);
+    }
+    // preamble detection timeout in PAC units, 8 symbols taken as the PAC
+    uint16_t pretoc = (uint16_t)reg(m, DRX_CONF_ID, DRX_PRETOC_OFFSET, 2);
+    if (pretoc != 0) {
+        m->rx_pto_event = hal_event_at(m->node, hal_now() + (hal_time_t)pretoc * 8 * 65024, rx_pto_cb, m);
+    }
+    rx_try_lock(m);
+}
+
+static void rx_on_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    m->rx_on_event = NULL;
+    rx_listen(m);
+    update_irq(m);
+}
+
+static int32_t carrier_integrator(dw1000_model_t *m, const dw1000_air_frame_t *f) {
+    // user manual 7.2.40.11, inverse of the ppb conversion in uwb_twr_clock_offset_ppb
+    double hz_mult = 998.4e6 / 2.0 / ((f->phy.data_rate == DWT_BR_110K) ? 8192.0 : 1024.0) / 131072.0;
+    double fc;
+    switch (f->phy.chan) {
+        case 1:  fc = 3494.4e6; break;
+        case 3:  fc = 4492.8e6; break;
+        case 5:
+        case 7:  fc = 6489.6e6; break;
+        default: fc = 3993.6e6; break;
+    }
+    double ppb_per_unit = hz_mult * (-1.0e6 / fc) * 1.0e3;
+    double ci = round((double)(f->tx_clock_ppb - m->clock_ppb) / ppb_per_unit);
+    if (ci > 0xFFFFF) ci = 0xFFFFF;
+    if (ci < -0xFFFFF) ci = -0xFFFFF;
+    return (int32_t)ci;
+}
+
+static void rx_store(dw1000_model_t *m, const rx_air_t *a) {
+    const dw1000_air_frame_t *f = &a->frame;
+
+    uint32_t rxpacc = (f->phy.plen > 0xFFF) ? 0xFFF : f->phy.plen;
+    uint32_t finfo = f->len | ((uint32_t)f->phy.data_rate << RX_FINFO_RXBR_SHIFT)
+                   | (f->ranging ? RX_FINFO_RNG : 0) | ((uint32_t)f->phy.prf << RX_FINFO_RXPRF_SHIFT)
+                   | (rxpacc << RX_FINFO_RXPACC_SHIFT);
+    put_le(ic_file(m, RX_FINFO_ID), 0, finfo, 4);
+
+    std::vector<uint8_t> &buf = ic_file(m, RX_BUFFER_ID);
+    memcpy(&buf[0], f->data, f->len);
+
+    // RMARKER at the digital side, minus the programmed delay
+    uint64_t raw = dw1000_model_local_time(m, f->rmarker + m->phys_rx_ant);
+    int64_t noise = (m->ts_noise > 0) ? (int64_t)lroundf(gauss(m) * m->ts_noise) : 0;
+    uint64_t stamp = (raw - reg(m, LDE_IF_ID, LDE_RXANTD_OFFSET, 2) + noise) & MASK40;
+    std::vector<uint8_t> &rx_time = ic_file(m, RX_TIME_ID);
+    put_le(rx_time, RX_TIME_RX_STAMP_OFFSET, stamp, 5);
+    put_le(rx_time, RX_TIME_FP_INDEX_OFFSET, 750 << 6, 2);
+    put_le(rx_time, RX_TIME_FP_RAWST_OFFSET, raw & ~0x1FFULL, 5);
+
+    // CIR_PWR so that the user manual 4.7.2 formula gives the rx power back, the estimate
+    // is compressed above -88 dBm like on the chip (calc_rssi corrects it by 1.1667)
+    double a_dbm = (f->phy.prf == DWT_PRF_16M) ? 113.77 : 121.74;
+    double level = f->rx_power_dbm;
+    if (level > -88.0) {
+        level = -88.0 + (level + 88.0) / 2.1667;
+    }
+    double cir = (double)rxpacc * rxpacc / 131072.0 * pow(10.0, (level + a_dbm) / 10.0);
+    uint16_t cir_pwr = (cir > 0xFFFF) ? 0xFFFF : (uint16_t)cir;
+    uint16_t fp_ampl = (uint16_t)(sqrt((double)cir_pwr) * 64);
+    std::vector<uint8_t> &fqual = ic_file(m, RX_FQUAL_ID);
+    put_le(fqual, 0, 40, 2);       // STD_NOISE
+    put_le(fqual, 2, fp_ampl, 2);  // FP_AMPL2
+    put_le(fqual, 4, fp_ampl, 2);  // FP_AMPL3
+    put_le(fqual, 6, cir_pwr, 2);  // CIR_PWR
+    put_le(rx_time, RX_TIME_FP_AMPL1_OFFSET, fp_ampl, 2);
+
+    set_reg(m, DRX_CONF_ID, DRX_CARRIER_INT_OFFSET, (uint32_t)carrier_integrator(m, f) & DRX_CARRIER_INT_MASK, 3);
+}
+
+static bool rx_collided(dw1000_model_t *m, const rx_air_t *a) {
+    for (const rx_air_t &o : m->air) {
+        if (&o == a || o.frame.phy.chan != a->frame.phy.chan || o.end <= a->start || o.start >= a->end) {
+            continue;
+        }
+        if (o.frame.rx_power_dbm > a->frame.rx_power_dbm - DW1000_MODEL_CAPTURE_DB) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void rx_end_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    rx_air_t *a = m->locked;
+    m->rx_end_event = NULL;
+    m->locked = NULL;
+
+    uint32_t cfg = (uint32_t)reg(m, SYS_CFG_ID, 0, 4);
+    uint32_t chan_ctrl = (uint32_t)reg(m, CHAN_CTRL_ID, 0, 4);
+    bool rx_110k = (cfg & SYS_CFG_RXM110K) != 0;
+    uint8_t expect_sfd = sfd_symbols(a->frame.phy.data_rate, chan_ctrl & CHAN_CTRL_DWSFD);
+
+    if (rx_110k != (a->frame.phy.data_rate == DWT_BR_110K) || expect_sfd != a->frame.phy.sfd_symbols) {
+        // preamble found, SFD of another mode never comes
+        m->status |= SYS_STATUS_RXPRD | SYS_STATUS_RXSFDTO;
+        m->stats.rx_crc_errors++;
+        rx_off(m);
+        update_irq(m);
+        return;
+    }
+
+    bool collided = rx_collided(m, a);
+    if (a->frame.corrupt || collided) {
+        m->status |= STATUS_RX_HEAD | SYS_STATUS_RXFCE;
+        m->stats.rx_crc_errors++;
+        m->stats.rx_collisions += collided ? 1 : 0;
+        rx_off(m);
+        update_irq(m);
+        return;
+    }
+
+    if (!rx_frame_filter(m, &a->frame)) {
+        // dropped without an interrupt, the receiver keeps listening
+        m->status |= SYS_STATUS_AFFREJ;
+        m->stats.rx_filtered++;
+        rx_try_lock(m);
+        update_irq(m);
+        return;
+    }
+
+    bool dbl = dbl_on(m);
+    uint8_t set = dbl ? m->icp : 0;
+    if (dbl && m->full[set]) {
+        // host still owns both buffers
+        m->status |= SYS_STATUS_RXOVRR;
+        m->stats.rx_overruns++;
+        rx_off(m);
+        update_irq(m);
+        return;
+    }
+
+    rx_store(m, a);
+    m->status |= STATUS_RX_HEAD;
+    m->swing[set] |= STATUS_SWING;
+    if (dbl) {
+        m->full[set] = true;
+        m->icp ^= 1;
+    }
+    m->stats.rx_frames++;
+    rx_off(m);
+    update_irq(m);
+}
+
+static void air_prune(dw1000_model_t *m) {
+    hal_time_t now = hal_now();
+    for (auto it = m->air.begin(); it != m->air.end();) {
+        if (&*it != m->locked && it->end + AIR_HISTORY_DTU < now) {
+            if (!it->locked) {
+                m->stats.rx_missed++;
+            }
+            it = m->air.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void dw1000_model_deliver(dw1000_model_t *m, const dw1000_air_frame_t *frame) {
+    air_prune(m);
+
+    rx_air_t a;
+    a.frame = *frame;
+    a.sfd = frame->rmarker - frame->phy.sfd_symbols * symbol_dtu(&frame->phy);
+    a.start = frame->rmarker - dw1000_model_shr_dtu(&frame->phy);
+    a.end = frame->rmarker + dw1000_model_tail_dtu(&frame->phy, frame->len);
+    a.locked = false;
+    m->air.push_back(a);
+
+    rx_try_lock(m);
+}
+
+
+// ---------------- transmitter ----------------
+
+static void tx_emit_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    m->tx_emit_event = NULL;
+    m->status |= SYS_STATUS_TXFRB;
+    if (m->tx_cb != NULL) {
+        m->tx_cb(m, &m->tx_frame, m->tx_arg);
+    }
+    update_irq(m);
+}
+
+static void tx_done_cb(void *arg) {
+    dw1000_model_t *m = (dw1000_model_t *)arg;
+    m->tx_done_event = NULL;
+    m->radio = RADIO_IDLE;
+    m->stats.tx_frames++;
+
+    uint64_t stamp = (m->tx_raw_local + reg(m, TX_ANTD_ID, TX_ANTD_OFFSET, 2)) & MASK40;
+    set_reg(m, TX_TIME_ID, TX_TIME_TX_STAMP_OFFSET, stamp, 5);
+    set_reg(m, TX_TIME_ID, TX_TIME_TX_RAWST_OFFSET, m->tx_raw_local, 5);
+    m->status |= SYS_STATUS_TXPRS | SYS_STATUS_TXPHS | SYS_STATUS_TXFRS;
+
+    if (m->tx_w4r) {
+        // receiver on W4R_TIM after the frame
+        uint32_t w4r_uus = (uint32_t)reg(m, ACK_RESP_T_ID, 0, 4) & ACK_RESP_T_W4R_TIM_MASK;
+        if (w4r_uus == 0) {
+            rx_listen(m);
+        } else {
+            m->rx_on_event = hal_event_at(m->node, hal_now() + local_to_global_dtu(m, (uint64_t)w4r_uus * DTU_PER_UUS), rx_on_cb, m);
+        }
+    }
+    update_irq(m);
+}
+
+// delayed start, global time of DX_TIME, false if it is already over
+static bool dx_time_global(dw1000_model_t *m, uint64_t *target_local, hal_time_t *at) {
+    hal_time_t now = hal_now();
+    *target_local = reg(m, DX_TIME_ID, 0, 5) & MASK40 & ~0x1FFULL;
+    uint64_t delta = (*target_local - dw1000_model_local_time(m, now)) & MASK40;
+    if (delta > (MASK40 >> 1)) {
+        m->status |= SYS_STATUS_HPDWARN;
+        return false;
+    }
+    *at = now + local_to_global_dtu(m, delta);
+    return true;
+}
+
+static void tx_start(dw1000_model_t *m, bool delayed, bool w4r) {
+    if (m->radio == RADIO_TX) {
+        return;
+    }
+    rx_off(m);
+    hal_event_cancel(m->rx_on_event);
+    m->rx_on_event = NULL;
+    m->status &= ~(SYS_STATUS_HPDWARN | SYS_STATUS_TXPUTE);
+
+    dw1000_air_frame_t *f = &m->tx_frame;
+    memset(f, 0, sizeof(*f));
+    dw1000_model_tx_phy(m, &f->phy);
+    uint32_t fctrl = (uint32_t)reg(m, TX_FCTRL_ID, 0, 4);
+    f->len = fctrl & TX_FCTRL_FLE_MASK;
+    if (f->len > sizeof(f->data)) {
+        f->len = sizeof(f->data);
+    }
+    uint32_t offset = (fctrl & TX_FCTRL_TXBOFFS_MASK) >> TX_FCTRL_TXBOFFS_SHFT;
+    for (uint16_t i = 0; i < f->len; i++) {
+        f->data[i] = (offset + i < 1024) ? m->file[TX_BUFFER_ID][offset + i] : 0;
+    }
+    if (f->len >= 2) {
+        uint16_t crc = dw1000_model_crc16(f->data, f->len - 2);
+        f->data[f->len - 2] = (uint8_t)crc;
+        f->data[f->len - 1] = (uint8_t)(crc >> 8);
+    }
+    f->ranging = (fctrl & TX_FCTRL_TR) != 0;
+    f->tx_clock_ppb = m->clock_ppb;
+
+    hal_time_t now = hal_now();
+    hal_time_t shr = dw1000_model_shr_dtu(&f->phy);
+    hal_time_t powerup = HAL_US_TO_DTU(DW1000_MODEL_TX_POWERUP_US);
+    hal_time_t rmarker_raw;
+    if (delayed) {
+        uint64_t target;
+        if (!dx_time_global(m, &target, &rmarker_raw)) {
+            m->stats.tx_late++;
+            return;
+        }
+        if (rmarker_raw < now + powerup + shr) {
+            m->status |= SYS_STATUS_TXPUTE;
+            m->stats.tx_late++;
+            return;
+        }
+        m->tx_raw_local = target;
+    } else {
+        rmarker_raw = now + powerup + shr;
+        m->tx_raw_local = dw1000_model_local_time(m, rmarker_raw);
+    }
+
+    m->radio = RADIO_TX;
+    m->tx_w4r = w4r;
+    f->rmarker = rmarker_raw + m->phys_tx_ant;
+    m->tx_emit_event = hal_event_at(m->node, f->rmarker - shr, tx_emit_cb, m);
+    m->tx_done_event = hal_event_at(m->node, f->rmarker + dw1000_model_tail_dtu(&f->phy, f->len), tx_done_cb, m);
+}
+
+static void rx_enable(dw1000_model_t *m, bool delayed) {
+    if (m->radio != RADIO_IDLE || m->rx_on_event != NULL) {
+        return; // already on, or waiting to turn on
+    }
+    if (!delayed) {
+        rx_listen(m);
+        return;
+    }
+    uint64_t target;
+    hal_time_t at;
+    m->status &= ~SYS_STATUS_HPDWARN;
+    if (dx_time_global(m, &target, &at)) {
+        m->rx_on_event = hal_event_at(m->node, at, rx_on_cb, m);
+    }
+}
+
+static void trx_off(dw1000_model_t *m) {
+    // a frame already on air is not called back
+    hal_event_cancel(m->tx_emit_event);
+    hal_event_cancel(m->tx_done_event);
+    hal_event_cancel(m->rx_on_event);
+    m->tx_emit_event = NULL;
+    m->tx_done_event = NULL;
+    m->rx_on_event = NULL;
+    rx_off(m);
+    m->radio = RADIO_IDLE;
+    m->status &= ~(SYS_STATUS_HPDWARN | SYS_STATUS_TXPUTE);
+}
+
+static void host_toggle(dw1000_model_t *m) {
+    if (!dbl_on(m)) {
+        return;
+    }
+    // the buffer the host leaves is free again
+    m->full[m->hsp] = false;
+    m->swing[m->hsp] = 0;
+    m->hsp ^= 1;
+}
+
+static void sys_ctrl(dw1000_model_t *m, uint32_t v) {
+    if (v & SYS_CTRL_TRXOFF) {
+        // TXSTRT with TRXOFF is the SFD init of dwt_configure, started and aborted at once
+        trx_off(m);
+    } else if (v & SYS_CTRL_TXSTRT) {
+        tx_start(m, v & SYS_CTRL_TXDLYS, v & SYS_CTRL_WAIT4RESP);
+    } else if (v & SYS_CTRL_RXENAB) {
+        rx_enable(m, v & SYS_CTRL_RXDLYE);
+    }
+    if (v & SYS_CTRL_HRBT) {
+        host_toggle(m);
+    }
+}
+
+
+// ---------------- API ----------------
+
+dw1000_model_t *dw1000_model_create(hal_node_t *node) {
+    dw1000_model_t *m = new dw1000_model_t();
+    m->node = node;
+    m->phys_tx_ant = DW1000_MODEL_ANT_DLY;
+    m->phys_rx_ant = DW1000_MODEL_ANT_DLY;
+    for (int id = 0; id < 0x40; id++) {
+        m->file[id].assign(file_size(id), 0);
+    }
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < RX_SET_COUNT; i++) {
+            m->set_file[s][i].assign(file_size(RX_SET_FIRST + i), 0);
+        }
+    }
+    dw1000_model_reset(m);
+    return m;
+}
+
+void dw1000_model_reset(dw1000_model_t *m) {
+    trx_off(m);
+    m->air.clear();
+
+    for (int id = 0; id < 0x40; id++) {
+        std::fill(m->file[id].begin(), m->file[id].end(), 0);
+    }
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < RX_SET_COUNT; i++) {
+            std::fill(m->set_file[s][i].begin(), m->set_file[s][i].end(), 0);
+        }
+    }
+    set_reg(m, DEV_ID_ID, 0, 0xDECA0130, 4);
+    set_reg(m, PANADR_ID, 0, 0xFFFFFFFF, 4);
+    set_reg(m, SYS_CFG_ID, 0, SYS_CFG_HIRQ_POL | SYS_CFG_DIS_DRXB, 4);
+    set_reg(m, TX_FCTRL_ID, 0, 0x0015400C, 5);
+    set_reg(m, CHAN_CTRL_ID, 0, 0x00000055, 4);
+    set_reg(m, PMSC_ID, 0, 0xF0300200, 4);
+
+    m->status = 0;
+    m->swing[0] = m->swing[1] = 0;
+    m->full[0] = m->full[1] = false;
+    m->icp = m->hsp = 0;
+    update_irq(m);
+}
+
+void dw1000_model_set_clock(dw1000_model_t *m, uint64_t offset, int32_t ppb) {
+    m->clock_offset = offset & MASK40;
+    m->clock_ppb = ppb;
+}
+
+int32_t dw1000_model_clock_ppb(dw1000_model_t *m) {
+    return m->clock_ppb;
+}
+
+void dw1000_model_set_antenna_delay(dw1000_model_t *m, uint16_t tx_dtu, uint16_t rx_dtu) {
+    m->phys_tx_ant = tx_dtu;
+    m->phys_rx_ant = rx_dtu;
+}
+
+void dw1000_model_set_ts_noise(dw1000_model_t *m, float sigma_dtu) {
+    m->ts_noise = sigma_dtu;
+}
+
+void dw1000_model_set_tx_cb(dw1000_model_t *m, dw1000_model_tx_cb_t cb, void *arg) {
+    m->tx_cb = cb;
+    m->tx_arg = arg;
+}
+
+void dw1000_model_spi_write(dw1000_model_t *m, uint8_t id, uint16_t offset, const uint8_t *buf, uint32_t len) {
+    id &= 0x3F;
+    switch (id) {
+        case SYS_STATUS_ID: {
+            // write one to clear
+            uint64_t bits = 0;
+            for (uint32_t i = 0; i < len && offset + i < SYS_STATUS_LEN; i++) {
+                bits |= (uint64_t)buf[i] << (8 * (offset + i));
+            }
+            status_clear(m, bits);
+            break;
+        }
+        case SYS_CTRL_ID: {
+            // self clearing, nothing stored
+            uint32_t v = 0;
+            for (uint32_t i = 0; i < len && offset + i < SYS_CTRL_LEN; i++) {
+                v |= (uint32_t)buf[i] << (8 * (offset + i));
+            }
+            sys_ctrl(m, v);
+            break;
+        }
+        case SYS_CFG_ID: {
+            bool dbl = dbl_on(m);
+            for (uint32_t i = 0; i < len && offset + i < m->file[id].size(); i++) {
+                m->file[id][offset + i] = buf[i];
+            }
+            if (dbl != dbl_on(m)) {
+                m->swing[0] = m->swing[1] = 0;
+                m->full[0] = m->full[1] = false;
+                m->icp = m->hsp = 0;
+            }
+            break;
+        }
+        case PMSC_ID:
+            for (uint32_t i = 0; i < len && offset + i < m->file[id].size(); i++) {
+                m->file[id][offset + i] = buf[i];
+            }
+            if (offset <= PMSC_CTRL0_SOFTRESET_OFFSET && offset + len > PMSC_CTRL0_SOFTRESET_OFFSET) {
+                uint8_t v = buf[PMSC_CTRL0_SOFTRESET_OFFSET - offset];
+                if (v == PMSC_CTRL0_RESET_ALL) {
+                    dw1000_model_reset(m);
+                } else if (v == PMSC_CTRL0_RESET_RX) {
+                    rx_off(m);
+                }
+            }
+            break;
+        case DEV_ID_ID:
+        case SYS_TIME_ID:
+        case TX_TIME_ID:
+        case SYS_STATE_ID:
+            break; // read only
+        default:
+            if (id >= RX_SET_FIRST && id < RX_SET_FIRST + RX_SET_COUNT) {
+                break; // read only
+            }
+            for (uint32_t i = 0; i < len && offset + i < m->file[id].size(); i++) {
+                m->file[id][offset + i] = buf[i];
+            }
+            break;
+    }
+    update_irq(m);
+}
+
+void dw1000_model_spi_read(dw1000_model_t *m, uint8_t id, uint16_t offset, uint8_t *buf, uint32_t len) {
+    id &= 0x3F;
+    memset(buf, 0, len);
+    switch (id) {
+        case SYS_STATUS_ID: {
+            uint64_t s = status_value(m);
+            for (uint32_t i = 0; i < len && offset + i < SYS_STATUS_LEN; i++) {
+                buf[i] = (uint8_t)(s >> (8 * (offset + i)));
+            }
+            break;
+        }
+        case SYS_TIME_ID: {
+            // 125 MHz counter, the low 9 bits read 0
+            uint64_t t = dw1000_model_local_time(m, hal_now()) & ~0x1FFULL;
+            for (uint32_t i = 0; i < len && offset + i < 5; i++) {
+                buf[i] = (uint8_t)(t >> (8 * (offset + i)));
+            }
+            break;
+        }
+        default: {
+            std::vector<uint8_t> &f = host_file(m, id);
+            for (uint32_t i = 0; i < len && offset + i < f.size(); i++) {
+                buf[i] = f[offset + i];
+            }
+            break;
+        }
+    }
+}
+
+const dw1000_model_stats_t *dw1000_model_stats(dw1000_model_t *m) {
+    return &m->stats;
+}
+
+dw1000_bus_stats_t *dw1000_model_bus_stats(dw1000_model_t *m) {
+    return &m->bus;
+}
+
+hal_node_t *dw1000_model_node(dw1000_model_t *m) {
+    return m->node;
+}
@@ -0,0 +1,117 @@
+#ifndef __DW1000_MODEL_H__
+#define __DW1000_MODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal_native.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// register level DW1000 model of the native build, sits below writetospi / readfromspi
+// register files, double buffered RX sets, SYS_STATUS / SYS_MASK / IRQ line, TX and RX timing on
+// air with a 40 bit device clock of its own (offset + drift), delayed TX, frame wait timeout,
+// frame filter and the carrier integrator. nothing of the analog part, AGC or the accumulator.
+
+// time from TXSTRT to the first preamble symbol, and the limit for a delayed TX (TXPUTE)
+#define DW1000_MODEL_TX_POWERUP_US 10
+// receiver needs this many preamble symbols before the SFD to lock on a frame
+#define DW1000_MODEL_MIN_ACQ_SYMBOLS 32
+// a frame overlapping the received one corrupts it unless it is this much weaker
+#define DW1000_MODEL_CAPTURE_DB 6.0f
+// physical antenna delays, same as TX_ANT_DLY of the firmware so the default node is calibrated
+#define DW1000_MODEL_ANT_DLY 16470
+
+typedef struct dw1000_model dw1000_model_t;
+
+typedef struct {
+    uint8_t chan;
+    uint8_t prf;          // DWT_PRF_16M / DWT_PRF_64M
+    uint8_t pcode;
+    uint8_t data_rate;    // DWT_BR_110K / DWT_BR_850K / DWT_BR_6M8
+    uint16_t plen;        // preamble symbols
+    uint8_t sfd_symbols;
+} dw1000_phy_t;
+
+// one frame on air, times are global (hal_time_t) at the antenna that sees them
+typedef struct {
+    uint8_t data[128];     // crc included
+    uint16_t len;
+    bool ranging;
+    hal_time_t rmarker;    // first symbol of the PHR
+    dw1000_phy_t phy;
+    int32_t tx_clock_ppb;  // drift of the sender, for the carrier integrator of the receiver
+    float rx_power_dbm;    // set by the medium for every receiver
+    bool corrupt;          // lost bits, e.g. decided by the medium, fails the crc
+} dw1000_air_frame_t;
+
+// called at the first preamble symbol of every frame sent
+typedef void (*dw1000_model_tx_cb_t)(dw1000_model_t *m, const dw1000_air_frame_t *frame, void *arg);
+
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t tx_late;          // HPDWARN / TXPUTE of a delayed TX
+    uint32_t rx_frames;        // good frames into a RX buffer
+    uint32_t rx_crc_errors;    // corrupt or collided
+    uint32_t rx_collisions;    // of them, lost to an overlapping frame
+    uint32_t rx_filtered;      // rejected by the frame filter
+    uint32_t rx_missed;        // arrived while the receiver was off or busy
+    uint32_t rx_timeouts;      // frame wait / preamble detect timeout
+    uint32_t rx_overruns;
+} dw1000_model_stats_t;
+
+// SPI bus of the node, kept by dw1000_native.cpp
+typedef struct {
+    uint32_t clock_hz;
+    uint32_t transactions;
+    uint64_t bytes;
+    hal_time_t busy_dtu;
+} dw1000_bus_stats_t;
+
+
+dw1000_model_t *dw1000_model_create(hal_node_t *node);
+// power on reset, clock, antenna delays, callbacks and stats stay
+void dw1000_model_reset(dw1000_model_t *m);
+
+// device clock = offset + global time * (1 + ppb / 1e9), 40 bit
+void dw1000_model_set_clock(dw1000_model_t *m, uint64_t offset, int32_t ppb);
+uint64_t dw1000_model_local_time(dw1000_model_t *m, hal_time_t t);
+int32_t dw1000_model_clock_ppb(dw1000_model_t *m);
+// physical delays between the digital timestamp and the antenna
+void dw1000_model_set_antenna_delay(dw1000_model_t *m, uint16_t tx_dtu, uint16_t rx_dtu);
+// gaussian error of the RX timestamps, 0 for none
+void dw1000_model_set_ts_noise(dw1000_model_t *m, float sigma_dtu);
+void dw1000_model_set_tx_cb(dw1000_model_t *m, dw1000_model_tx_cb_t cb, void *arg);
+
+// frame reaching the antenna, call it at the first preamble symbol (frame->rmarker - shr)
+void dw1000_model_deliver(dw1000_model_t *m, const dw1000_air_frame_t *frame);
+
+// register access of writetospi / readfromspi, the IRQ pin follows right away
+void dw1000_model_spi_write(dw1000_model_t *m, uint8_t id, uint16_t offset, const uint8_t *buf, uint32_t len);
+void dw1000_model_spi_read(dw1000_model_t *m, uint8_t id, uint16_t offset, uint8_t *buf, uint32_t len);
+
+// air time of a frame, SHR (preamble + SFD) and after RMARKER (PHR + data)
+hal_time_t dw1000_model_shr_dtu(const dw1000_phy_t *phy);
+hal_time_t dw1000_model_tail_dtu(const dw1000_phy_t *phy, uint16_t len);
+// lowest rx power a frame is received with
+float dw1000_model_sensitivity_dbm(const dw1000_phy_t *phy);
+// TX config from the registers
+void dw1000_model_tx_phy(dw1000_model_t *m, dw1000_phy_t *phy);
+
+const dw1000_model_stats_t *dw1000_model_stats(dw1000_model_t *m);
+dw1000_bus_stats_t *dw1000_model_bus_stats(dw1000_model_t *m);
+hal_node_t *dw1000_model_node(dw1000_model_t *m);
+
+// CRC-16 of IEEE 802.15.4 frames
+uint16_t dw1000_model_crc16(const uint8_t *data, uint16_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DW1000_MODEL_H__
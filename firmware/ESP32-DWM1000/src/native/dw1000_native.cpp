@@ -0,0 +1,174 @@
+#include <Arduino.h>
+
+#include "dw1000.h"
+#include "dw1000_spi_prof.h"
+#include "deca_device_api.h"
+#include "uwb.h"
+
+#include "hal_native.h"
+#include "dw1000_model.h"
+
+// dw1000.cpp of the native build, SPI goes to the DW1000 model of the running node
+
+// time of the ESP-IDF polling transaction around the bytes, and of every further one in a batch
+#define DW1000_SPI_TRANS_OVERHEAD_NS 2500
+#define DW1000_SPI_BATCH_NEXT_NS 800
+
+
+static TaskHandle_t dw1000_port_owner = NULL;
+static uint32_t dw1000_port_foreign = 0;
+
+void dw1000_port_set_owner(TaskHandle_t task) {
+    dw1000_port_owner = task;
+}
+
+uint32_t dw1000_port_foreign_count() {
+    return dw1000_port_foreign;
+}
+
+// a transaction of another task would overwrite the buffers of the owner
+static inline void dw1000_port_check_owner() {
+#if DW1000_PORT_OWNER_CHECK
+    if (dw1000_port_owner != NULL && xTaskGetCurrentTaskHandle() != dw1000_port_owner) {
+        dw1000_port_foreign++;
+    }
+#endif
+}
+
+static dw1000_model_t *dw1000_radio() {
+    return (dw1000_model_t *)hal_node_radio(hal_node_current());
+}
+
+// register file id and sub address from the 1 to 3 bytes header
+static void dw1000_spi_header(const uint8 *header, uint16 len, uint8_t *id, uint16_t *offset) {
+    *id = header[0] & 0x3F;
+    *offset = 0;
+    if (len > 1 && (header[0] & 0x40)) {
+        *offset = header[1] & 0x7F;
+        if (len > 2 && (header[1] & 0x80)) {
+            *offset |= (uint16_t)header[2] << 7;
+        }
+    }
+}
+
+static void dw1000_spi_spend(dw1000_model_t *m, uint32_t bytes, uint32_t overhead_ns) {
+    dw1000_bus_stats_t *bus = dw1000_model_bus_stats(m);
+    hal_time_t dt = HAL_NS_TO_DTU(overhead_ns);
+    if (bus->clock_hz != 0) {
+        dt += (hal_time_t)bytes * 8 * 63897600000ULL / bus->clock_hz;
+    }
+    bus->transactions++;
+    bus->bytes += bytes;
+    bus->busy_dtu += dt;
+    hal_spend(dt);
+}
+
+void init_DW1000(){
+    pinMode(PIN_DW1000_RST, OUTPUT);
+
+    pinMode(PIN_DW1000_IRQ, INPUT);
+
+    set_dw1000_spi_rate_fast(false);
+
+    reset_DW1000();
+}
+
+
+void reset_DW1000() {
+    digitalWrite(PIN_DW1000_RST, LOW);
+    dw1000_model_reset(dw1000_radio());
+    delay(10);
+    digitalWrite(PIN_DW1000_RST, HIGH);
+    delay(10);
+}
+
+void set_dw1000_spi_rate_fast(bool fast) {
+    dw1000_model_bus_stats(dw1000_radio())->clock_hz = fast ? DW1000_SPI_FAST_HZ : DW1000_SPI_SLOW_HZ;
+}
+
+int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodyLength, const uint8 *bodyBuffer) {
+    if (headerLength + bodyLength > DW1000_SPI_MAX_TRANS_LEN) {
+        return -1;
+    }
+
+    dw1000_port_check_owner();
+    dw1000_model_t *m = dw1000_radio();
+    uint8_t id;
+    uint16_t offset;
+    dw1000_spi_header(headerBuffer, headerLength, &id, &offset);
+
+    // the register changes at the end of the transaction
+    uint32_t t0 = ESP.getCycleCount();
+    dw1000_spi_spend(m, headerLength + bodyLength, DW1000_SPI_TRANS_OVERHEAD_NS);
+    dw1000_spi_prof_record(headerBuffer, headerLength, headerLength + bodyLength, true, ESP.getCycleCount() - t0);
+    dw1000_model_spi_write(m, id, offset, bodyBuffer, bodyLength);
+    return 0;
+}
+
+int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer) {
+    if (headerLength + readlength > DW1000_SPI_MAX_TRANS_LEN) {
+        return -1;
+    }
+
+    dw1000_port_check_owner();
+    dw1000_model_t *m = dw1000_radio();
+    uint8_t id;
+    uint16_t offset;
+    dw1000_spi_header(headerBuffer, headerLength, &id, &offset);
+
+    uint32_t t0 = ESP.getCycleCount();
+    dw1000_spi_spend(m, headerLength + readlength, DW1000_SPI_TRANS_OVERHEAD_NS);
+    dw1000_spi_prof_record(headerBuffer, headerLength, headerLength + readlength, false, ESP.getCycleCount() - t0);
+    dw1000_model_spi_read(m, id, offset, readBuffer, readlength);
+    return 0;
+} // end readfromspi()
+
+int readfromspi_batch(const dw1000_spi_read_t *reads, int count) {
+    if (count > DW1000_SPI_BATCH_MAX) {
+        return -1;
+    }
+
+    dw1000_port_check_owner();
+    // queued back-to-back, only the first one pays the full overhead
+    dw1000_model_t *m = dw1000_radio();
+    for (int i = 0; i < count; i++) {
+        const dw1000_spi_read_t *r = &reads[i];
+        if (r->headerLength + r->readlength > DW1000_SPI_MAX_TRANS_LEN) {
+            return -1;
+        }
+        uint8_t id;
+        uint16_t offset;
+        dw1000_spi_header(r->headerBuffer, r->headerLength, &id, &offset);
+        uint32_t t0 = ESP.getCycleCount();
+        dw1000_spi_spend(m, r->headerLength + r->readlength, (i == 0) ? DW1000_SPI_TRANS_OVERHEAD_NS : DW1000_SPI_BATCH_NEXT_NS);
+        dw1000_spi_prof_record(r->headerBuffer, r->headerLength, r->headerLength + r->readlength, false, ESP.getCycleCount() - t0);
+        dw1000_model_spi_read(m, id, offset, r->readBuffer, r->readlength);
+    }
+    return 0;
+}
+
+void Sleep(int time_ms){delay(time_ms);}
+void deca_sleep(unsigned int time_ms){delay(time_ms);}
+void lcd_display_str(const char *str){Serial.printf("[LCD PRINT] %s\n", str);}
+
+void port_set_dw1000_slowrate(){set_dw1000_spi_rate_fast(false);}
+void port_set_dw1000_fastrate(){set_dw1000_spi_rate_fast(true);}
+
+
+bool is_irq_attached = false;
+
+decaIrqStatus_t decamutexon(void) {
+	// check if interrupt is attached, if so, disable it and return true
+    decaIrqStatus_t s = is_irq_attached;
+	if(s) {
+        detachInterrupt(PIN_DW1000_IRQ); // disable interrupt
+	}
+	return s ;   // return state before disable, value is used to re-enable in decamutexoff call
+}
+
+/// set the interrupt state, enable interrupt if s is true
+void decamutexoff(decaIrqStatus_t s) {
+	if(s) {
+        attachInterrupt(PIN_DW1000_IRQ, uwb_irq_handler, RISING);
+    }
+}
@@ -0,0 +1,986 @@
+#include "hal_native.h"
+
+#include <ucontext.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "esp_timer.h"
+
+
+#define HAL_NUM_PINS 40
+
+enum {
+    HAL_TASK_READY,
+    HAL_TASK_RUNNING,
+    HAL_TASK_BLOCKED,
+    HAL_TASK_WAKING,   // woken from an interrupt, ready after HAL_WAKE_LATENCY_US
+    HAL_TASK_DONE,
+};
+
+struct hal_event {
+    hal_time_t t;
+    uint64_t seq;
+    hal_node_t *node;
+    hal_event_cb_t cb;
+    void *arg;
+    bool cancelled;
+};
+
+struct hal_task {
+    ucontext_t ctx;
+    uint8_t *stack;
+    hal_node_t *node;
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t priority;
+    char name[16];
+
+    uint8_t state;
+    uint64_t ready_seq;
+    bool timed_out;
+    hal_event_t *timeout_event;
+
+    uint32_t notify_value;
+    bool notify_waiting;
+};
+
+struct hal_node {
+    char name[24];
+    std::vector<hal_task *> tasks;
+
+    void (*irq_handler[HAL_NUM_PINS])(void);
+    uint8_t pin_level[HAL_NUM_PINS];
+
+    std::string serial_line;
+    std::deque<uint8_t> serial_in;
+    void (*serial_rx_cb)(void);
+    hal_serial_line_cb_t line_cb;
+    void *line_arg;
+    bool echo;
+
+    std::map<std::string, uint32_t> prefs;
+    uint32_t rng;
+
+    void *radio;
+    void *user;
+
+    // program globals of this node while another node runs
+    std::vector<uint8_t> image;
+};
+
+struct hal_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    std::vector<uint8_t> items;
+    // tasks blocked in receive / send, a woken task removes itself
+    std::deque<hal_task *> receivers;
+    std::deque<hal_task *> senders;
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    hal_node_t *node;
+    uint64_t period_us; // 0 for one shot
+    hal_time_t next;
+    hal_event_t *event;
+};
+
+struct hal_event_later {
+    bool operator()(const hal_event_t *a, const hal_event_t *b) const {
+        return (a->t != b->t) ? (a->t > b->t) : (a->seq > b->seq);
+    }
+};
+
+// highest priority first, FIFO within a priority
+struct hal_task_later {
+    bool operator()(const hal_task *a, const hal_task *b) const {
+        return (a->priority != b->priority) ? (a->priority < b->priority) : (a->ready_seq > b->ready_seq);
+    }
+};
+
+typedef struct {
+    hal_time_t now;
+    hal_time_t run_end;
+    uint64_t seq;
+    std::priority_queue<hal_event_t *, std::vector<hal_event_t *>, hal_event_later> events;
+    std::priority_queue<hal_task *, std::vector<hal_task *>, hal_task_later> ready;
+
+    ucontext_t sched_ctx;
+    hal_task *current_task;
+    hal_node_t *current_node;
+    int isr_depth;
+
+    uint64_t event_count;
+    uint64_t switch_count;
+    uint64_t image_swaps;
+    std::vector<hal_node_t *> nodes;
+
+    bool images;
+    std::vector<uint8_t> image_init;
+    hal_node_t *image_owner;   // node whose globals are in memory
+} hal_state_t;
+
+// all scheduler state behind one pointer, outside of the data the firmware sees as its globals
+static __thread hal_state_t *hal = NULL;
+
+// GNU ld, .data and .bss of the program
+extern "C" char __data_start[];
+extern "C" char _end[];
+
+HardwareSerial Serial;
+EspClass ESP;
+
+
+static void hal_fatal(const char *what) {
+    fprintf(stderr, "[hal] %s (node %s)\n", what, hal->current_node ? hal->current_node->name : "-");
+    abort();
+}
+
+void hal_init() {
+    if (hal == NULL) {
+        hal = new hal_state_t();
+    }
+}
+
+hal_time_t hal_now() {
+    return hal->now;
+}
+
+uint64_t hal_event_count() {
+    return hal->event_count;
+}
+
+uint64_t hal_switch_count() {
+    return hal->switch_count;
+}
+
+static void hal_node_enter(hal_node_t *node) {
+    hal->current_node = node;
+    if (!hal->images || node == NULL || node == hal->image_owner) {
+        return;
+    }
+    size_t size = _end - __data_start;
+    if (hal->image_owner != NULL) {
+        memcpy(hal->image_owner->image.data(), __data_start, size);
+    }
+    memcpy(__data_start, node->image.data(), size);
+    hal->image_owner = node;
+    hal->image_swaps++;
+}
+
+void hal_node_images_enable() {
+    if (!hal->nodes.empty()) {
+        hal_fatal("hal_node_images_enable after hal_node_create");
+    }
+    hal->images = true;
+    hal->image_init.assign(__data_start, _end);
+}
+
+uint64_t hal_image_swap_count() {
+    return hal->image_swaps;
+}
+
+hal_node_t *hal_node_current() {
+    return hal->current_node;
+}
+
+
+// ---------------- events ----------------
+
+hal_event_t *hal_event_at(hal_node_t *node, hal_time_t t, hal_event_cb_t cb, void *arg) {
+    hal_event_t *ev = new hal_event_t();
+    ev->t = (t < hal->now) ? hal->now : t;
+    ev->seq = hal->seq++;
+    ev->node = node;
+    ev->cb = cb;
+    ev->arg = arg;
+    ev->cancelled = false;
+    hal->events.push(ev);
+    return ev;
+}
+
+void hal_event_cancel(hal_event_t *event) {
+    if (event != NULL) {
+        event->cancelled = true; // freed when it comes up
+    }
+}
+
+
+// ---------------- tasks ----------------
+
+static bool hal_in_task() {
+    return hal->current_task != NULL && hal->isr_depth == 0;
+}
+
+static void hal_task_make_ready(hal_task *t) {
+    t->state = HAL_TASK_READY;
+    t->ready_seq = hal->seq++;
+    hal->ready.push(t);
+}
+
+static void hal_task_entry() {
+    hal_task *t = hal->current_task;
+    t->fn(t->arg);
+    // FreeRTOS tasks must not return, same as vTaskDelete(NULL)
+    t->state = HAL_TASK_DONE;
+    swapcontext(&t->ctx, &hal->sched_ctx);
+}
+
+static hal_task *hal_task_create(hal_node_t *node, TaskFunction_t fn, const char *name, void *arg, UBaseType_t priority) {
+    hal_task *t = new hal_task();
+    t->stack = (uint8_t *)malloc(HAL_TASK_STACK_SIZE);
+    t->node = node;
+    t->fn = fn;
+    t->arg = arg;
+    t->priority = priority;
+    snprintf(t->name, sizeof(t->name), "%s", name ? name : "task");
+
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = t->stack;
+    t->ctx.uc_stack.ss_size = HAL_TASK_STACK_SIZE;
+    t->ctx.uc_link = NULL;
+    makecontext(&t->ctx, hal_task_entry, 0);
+
+    node->tasks.push_back(t);
+    hal_task_make_ready(t);
+    return t;
+}
+
+static void hal_task_run(hal_task *t) {
+    hal->current_task = t;
+    hal_node_enter(t->node);
+    t->state = HAL_TASK_RUNNING;
+    hal->switch_count++;
+    swapcontext(&hal->sched_ctx, &t->ctx);
+    hal->current_task = NULL;
+
+    if (t->state == HAL_TASK_DONE && t->stack != NULL) {
+        // handles may still point to the task, only the stack goes
+        free(t->stack);
+        t->stack = NULL;
+    }
+}
+
+static void hal_task_timeout_cb(void *arg) {
+    hal_task *t = (hal_task *)arg;
+    t->timeout_event = NULL;
+    if (t->state == HAL_TASK_BLOCKED) {
+        t->timed_out = true;
+        hal_task_make_ready(t);
+    }
+}
+
+// block the running task until woken or timeout (dtu, HAL_TIME_NEVER for none), false on timeout
+static bool hal_task_block(hal_time_t timeout) {
+    if (!hal_in_task()) {
+        hal_fatal("blocking call outside of a task");
+    }
+    hal_task *t = hal->current_task;
+    t->state = HAL_TASK_BLOCKED;
+    t->timed_out = false;
+    if (timeout != HAL_TIME_NEVER) {
+        t->timeout_event = hal_event_at(t->node, hal->now + timeout, hal_task_timeout_cb, t);
+    }
+    swapcontext(&t->ctx, &hal->sched_ctx);
+    return !t->timed_out;
+}
+
+static void hal_task_wake_cb(void *arg) {
+    hal_task *t = (hal_task *)arg;
+    if (t->state == HAL_TASK_WAKING) {
+        hal_task_make_ready(t);
+    }
+}
+
+// wake a blocked task, from an interrupt or callback it runs after the wake up latency
+static bool hal_task_wake(hal_task *t) {
+    if (t->state != HAL_TASK_BLOCKED) {
+        return false;
+    }
+    if (t->timeout_event != NULL) {
+        hal_event_cancel(t->timeout_event);
+        t->timeout_event = NULL;
+    }
+    if (hal_in_task()) {
+        hal_task_make_ready(t);
+    } else {
+        t->state = HAL_TASK_WAKING;
+        hal_event_at(t->node, hal->now + HAL_US_TO_DTU(HAL_WAKE_LATENCY_US), hal_task_wake_cb, t);
+    }
+    return true;
+}
+
+static bool hal_task_wake_first(std::deque<hal_task *> &waiters) {
+    for (hal_task *t : waiters) {
+        if (hal_task_wake(t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void hal_task_forget(std::deque<hal_task *> &waiters, hal_task *t) {
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), t), waiters.end());
+}
+
+static hal_time_t hal_ticks_to_dtu(TickType_t ticks) {
+    return (ticks == portMAX_DELAY) ? HAL_TIME_NEVER : HAL_MS_TO_DTU((uint64_t)ticks * portTICK_PERIOD_MS);
+}
+
+void hal_spend(hal_time_t dt) {
+    if (!hal_in_task() || dt == 0) {
+        return;
+    }
+    hal_time_t end = hal->now + dt;
+    // nothing else due meanwhile, just move the clock
+    if (hal->ready.empty() && end <= hal->run_end && (hal->events.empty() || hal->events.top()->t > end)) {
+        hal->now = end;
+        return;
+    }
+    hal_task_block(dt);
+}
+
+bool hal_run_until(hal_time_t end) {
+    hal->run_end = end;
+    while (true) {
+        if (!hal->ready.empty()) {
+            hal_task *t = hal->ready.top();
+            hal->ready.pop();
+            if (t->state == HAL_TASK_READY) {
+                hal_task_run(t);
+            }
+            continue;
+        }
+
+        if (hal->events.empty()) {
+            if (end != HAL_TIME_NEVER && hal->now < end) {
+                hal->now = end;
+            }
+            return false;
+        }
+        hal_event_t *ev = hal->events.top();
+        if (ev->t > end) {
+            hal->now = end;
+            return true;
+        }
+        hal->events.pop();
+        if (!ev->cancelled) {
+            hal->now = ev->t;
+            hal->current_task = NULL;
+            hal_node_enter(ev->node);
+            ev->cb(ev->arg);
+            hal->event_count++;
+        }
+        delete ev;
+    }
+}
+
+
+// ---------------- nodes ----------------
+
+hal_node_t *hal_node_create(const char *name, uint32_t seed) {
+    hal_node_t *node = new hal_node_t();
+    snprintf(node->name, sizeof(node->name), "%s", name);
+    node->rng = seed ? seed : 0x2545F491;
+    if (hal->images) {
+        // globals as they were before any node ran
+        node->image = hal->image_init;
+    }
+    hal->nodes.push_back(node);
+    return node;
+}
+
+const char *hal_node_name(hal_node_t *node) {
+    return node->name;
+}
+
+void hal_node_start(hal_node_t *node, void (*fn)(void *), void *arg, UBaseType_t priority) {
+    hal_task_create(node, fn, "loopTask", arg, priority);
+}
+
+void hal_node_set_radio(hal_node_t *node, void *radio) {
+    node->radio = radio;
+}
+
+void *hal_node_radio(hal_node_t *node) {
+    return node->radio;
+}
+
+void hal_node_set_user(hal_node_t *node, void *user) {
+    node->user = user;
+}
+
+void *hal_node_user(hal_node_t *node) {
+    return node->user;
+}
+
+uint32_t hal_node_random(hal_node_t *node) {
+    uint32_t x = node->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    node->rng = x;
+    return x;
+}
+
+void hal_gpio_input(hal_node_t *node, uint8_t pin, int level) {
+    if (pin >= HAL_NUM_PINS) {
+        return;
+    }
+    uint8_t old = node->pin_level[pin];
+    node->pin_level[pin] = level ? 1 : 0;
+    if (old || !level || node->irq_handler[pin] == NULL) {
+        return;
+    }
+
+    // rising edge, the handler runs in interrupt context of the node
+    hal_node_t *prev = hal->current_node;
+    hal_node_enter(node);
+    hal->isr_depth++;
+    node->irq_handler[pin]();
+    hal->isr_depth--;
+    hal_node_enter(prev);
+}
+
+int hal_gpio_output(hal_node_t *node, uint8_t pin) {
+    return (pin < HAL_NUM_PINS) ? node->pin_level[pin] : 0;
+}
+
+void hal_serial_set_line_cb(hal_node_t *node, hal_serial_line_cb_t cb, void *arg) {
+    node->line_cb = cb;
+    node->line_arg = arg;
+}
+
+void hal_serial_set_echo(hal_node_t *node, bool echo) {
+    node->echo = echo;
+}
+
+static void hal_serial_rx_cb(void *arg) {
+    hal_node_t *node = (hal_node_t *)arg;
+    if (node->serial_rx_cb != NULL) {
+        node->serial_rx_cb();
+    }
+}
+
+void hal_serial_input(hal_node_t *node, const char *data, size_t len) {
+    node->serial_in.insert(node->serial_in.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+    // uart event task of the node
+    hal_event_at(node, hal->now, hal_serial_rx_cb, node);
+}
+
+static void hal_serial_output(const uint8_t *buf, size_t len) {
+    hal_node_t *node = hal->current_node;
+    if (node == NULL) {
+        fwrite(buf, 1, len, stdout);
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)buf[i];
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            node->serial_line.push_back(c);
+            continue;
+        }
+        if (node->echo) {
+            printf("[%s] %s\n", node->name, node->serial_line.c_str());
+        }
+        if (node->line_cb != NULL) {
+            node->line_cb(node, node->serial_line.c_str(), node->line_arg);
+        }
+        node->serial_line.clear();
+    }
+}
+
+static std::string hal_prefs_key(const char *ns, const char *key) {
+    return std::string(ns) + "/" + key;
+}
+
+void hal_prefs_set(hal_node_t *node, const char *ns, const char *key, uint32_t value) {
+    node->prefs[hal_prefs_key(ns, key)] = value;
+}
+
+bool hal_prefs_get(hal_node_t *node, const char *ns, const char *key, uint32_t *value) {
+    auto it = node->prefs.find(hal_prefs_key(ns, key));
+    if (it == node->prefs.end()) {
+        return false;
+    }
+    *value = it->second;
+    return true;
+}
+
+void hal_prefs_erase(hal_node_t *node, const char *ns) {
+    std::string prefix = std::string(ns) + "/";
+    for (auto it = node->prefs.begin(); it != node->prefs.end();) {
+        it = (it->first.compare(0, prefix.size(), prefix) == 0) ? node->prefs.erase(it) : std::next(it);
+    }
+}
+
+
+// ---------------- Arduino ----------------
+
+unsigned long millis(void) {
+    return (unsigned long)(HAL_DTU_TO_US(hal->now) / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)HAL_DTU_TO_US(hal->now);
+}
+
+void delay(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    hal_spend(HAL_US_TO_DTU(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (hal->current_node != NULL && pin < HAL_NUM_PINS) {
+        hal->current_node->pin_level[pin] = val ? 1 : 0;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return (hal->current_node != NULL) ? hal_gpio_output(hal->current_node, pin) : 0;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+    if (mode != RISING) {
+        hal_fatal("only RISING interrupts are simulated");
+    }
+    if (hal->current_node != NULL && pin < HAL_NUM_PINS) {
+        hal->current_node->irq_handler[pin] = handler;
+    }
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (hal->current_node != NULL && pin < HAL_NUM_PINS) {
+        hal->current_node->irq_handler[pin] = NULL;
+    }
+}
+
+long random(long howbig) {
+    if (howbig <= 0 || hal->current_node == NULL) {
+        return 0;
+    }
+    return (long)(hal_node_random(hal->current_node) % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+    return howsmall + random(howbig - howsmall);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rx_pin, int8_t tx_pin) {
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+}
+
+void HardwareSerial::end() {
+}
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len <= 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(buf)) {
+        return write((const uint8_t *)buf, len);
+    }
+
+    std::string big(len + 1, '\0');
+    va_start(args, fmt);
+    vsnprintf(&big[0], big.size(), fmt, args);
+    va_end(args);
+    return write((const uint8_t *)big.data(), len);
+}
+
+size_t HardwareSerial::print(const char *s) {
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t HardwareSerial::println(const char *s) {
+    return print(s) + println();
+}
+
+size_t HardwareSerial::println() {
+    return write((const uint8_t *)"\r\n", 2);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+    hal_serial_output(buf, len);
+    return len;
+}
+
+int HardwareSerial::available() {
+    return (hal->current_node != NULL) ? (int)hal->current_node->serial_in.size() : 0;
+}
+
+int HardwareSerial::read() {
+    hal_node_t *node = hal->current_node;
+    if (node == NULL || node->serial_in.empty()) {
+        return -1;
+    }
+    int c = node->serial_in.front();
+    node->serial_in.pop_front();
+    return c;
+}
+
+void HardwareSerial::flush() {
+}
+
+void HardwareSerial::onReceive(void (*cb)(void), bool only_on_timeout) {
+    if (hal->current_node != NULL) {
+        hal->current_node->serial_rx_cb = cb;
+    }
+}
+
+uint32_t getCpuFrequencyMhz(void) {
+    return 240;
+}
+
+uint64_t EspClass::getEfuseMac() {
+    uint64_t mac = 0x24;
+    for (const char *p = hal->current_node ? hal->current_node->name : ""; *p; p++) {
+        mac = mac * 31 + (uint8_t)*p;
+    }
+    return mac & 0xFFFFFFFFFFFFULL;
+}
+
+uint32_t EspClass::getCycleCount() {
+    // 240 MHz, 240 / 63897.6 cycles per dtu
+    return (uint32_t)(hal->now * 25 / 6656);
+}
+
+
+// ---------------- Preferences ----------------
+
+bool Preferences::begin(const char *name, bool read_only) {
+    snprintf(ns, sizeof(ns), "%s", name);
+    this->read_only = read_only;
+    opened = (hal->current_node != NULL);
+    return opened;
+}
+
+void Preferences::end() {
+    opened = false;
+}
+
+bool Preferences::clear() {
+    if (!opened || read_only) {
+        return false;
+    }
+    hal_prefs_erase(hal->current_node, ns);
+    return true;
+}
+
+bool Preferences::isKey(const char *key) {
+    uint32_t value;
+    return opened && hal_prefs_get(hal->current_node, ns, key, &value);
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t default_value) {
+    uint32_t value;
+    return (opened && hal_prefs_get(hal->current_node, ns, key, &value)) ? (uint8_t)value : default_value;
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value) {
+    if (!opened || read_only) {
+        return 0;
+    }
+    hal_prefs_set(hal->current_node, ns, key, value);
+    return 1;
+}
+
+uint16_t Preferences::getUShort(const char *key, uint16_t default_value) {
+    uint32_t value;
+    return (opened && hal_prefs_get(hal->current_node, ns, key, &value)) ? (uint16_t)value : default_value;
+}
+
+size_t Preferences::putUShort(const char *key, uint16_t value) {
+    if (!opened || read_only) {
+        return 0;
+    }
+    hal_prefs_set(hal->current_node, ns, key, value);
+    return 2;
+}
+
+uint32_t Preferences::getULong(const char *key, uint32_t default_value) {
+    uint32_t value;
+    return (opened && hal_prefs_get(hal->current_node, ns, key, &value)) ? value : default_value;
+}
+
+size_t Preferences::putULong(const char *key, uint32_t value) {
+    if (!opened || read_only) {
+        return 0;
+    }
+    hal_prefs_set(hal->current_node, ns, key, value);
+    return 4;
+}
+
+
+// ---------------- FreeRTOS ----------------
+
+BaseType_t xPortInIsrContext(void) {
+    return hal->isr_depth > 0;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return 1;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+    if (hal->current_node == NULL) {
+        hal_fatal("task created outside of a node");
+    }
+    hal_task *t = hal_task_create(hal->current_node, task_code, name, parameters, priority);
+    if (created_task != NULL) {
+        *created_task = t;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL) {
+        task = hal->current_task;
+    }
+    if (task == hal->current_task && hal_in_task()) {
+        task->state = HAL_TASK_DONE;
+        swapcontext(&task->ctx, &hal->sched_ctx);
+        return;
+    }
+    if (task->timeout_event != NULL) {
+        hal_event_cancel(task->timeout_event);
+        task->timeout_event = NULL;
+    }
+    task->state = HAL_TASK_DONE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        // yield to the other ready tasks
+        if (!hal_in_task()) {
+            hal_fatal("vTaskDelay outside of a task");
+        }
+        hal_task *t = hal->current_task;
+        hal_task_make_ready(t);
+        swapcontext(&t->ctx, &hal->sched_ctx);
+        return;
+    }
+    hal_task_block(hal_ticks_to_dtu(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return hal->current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notify_value++;
+    if (task->notify_waiting) {
+        hal_task_wake(task);
+    }
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    hal_task *t = hal->current_task;
+    if (t->notify_value == 0 && ticks_to_wait != 0) {
+        t->notify_waiting = true;
+        hal_task_block(hal_ticks_to_dtu(ticks_to_wait));
+        t->notify_waiting = false;
+    }
+    uint32_t value = t->notify_value;
+    if (value != 0) {
+        t->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    hal_queue *q = new hal_queue();
+    q->length = length;
+    q->item_size = item_size;
+    q->items.resize((size_t)length * item_size);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    sem->count = 1;
+    return sem;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks_to_wait) {
+    hal_time_t timeout = hal_ticks_to_dtu(ticks_to_wait);
+    hal_time_t deadline = (timeout == HAL_TIME_NEVER) ? HAL_TIME_NEVER : hal->now + timeout;
+    while (q->count >= q->length) {
+        if (ticks_to_wait == 0 || hal->now >= deadline) {
+            return pdFALSE;
+        }
+        hal_task *self = hal->current_task;
+        q->senders.push_back(self);
+        hal_task_block((deadline == HAL_TIME_NEVER) ? HAL_TIME_NEVER : deadline - hal->now);
+        hal_task_forget(q->senders, self);
+    }
+
+    if (q->item_size > 0) {
+        uint32_t slot = (q->head + q->count) % q->length;
+        memcpy(&q->items[(size_t)slot * q->item_size], item, q->item_size);
+    }
+    q->count++;
+    hal_task_wake_first(q->receivers);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *higher_priority_task_woken) {
+    BaseType_t ok = xQueueSend(q, item, 0);
+    if (higher_priority_task_woken != NULL && ok == pdTRUE) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *buffer, TickType_t ticks_to_wait) {
+    hal_time_t timeout = hal_ticks_to_dtu(ticks_to_wait);
+    hal_time_t deadline = (timeout == HAL_TIME_NEVER) ? HAL_TIME_NEVER : hal->now + timeout;
+    while (q->count == 0) {
+        if (ticks_to_wait == 0 || hal->now >= deadline) {
+            return pdFALSE;
+        }
+        hal_task *self = hal->current_task;
+        q->receivers.push_back(self);
+        hal_task_block((deadline == HAL_TIME_NEVER) ? HAL_TIME_NEVER : deadline - hal->now);
+        hal_task_forget(q->receivers, self);
+    }
+
+    if (q->item_size > 0) {
+        memcpy(buffer, &q->items[(size_t)q->head * q->item_size], q->item_size);
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    hal_task_wake_first(q->senders);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    return q->count;
+}
+
+
+// ---------------- esp_timer ----------------
+
+static void hal_timer_fire(void *arg) {
+    esp_timer_handle_t timer = (esp_timer_handle_t)arg;
+    timer->event = NULL;
+    if (timer->period_us != 0) {
+        timer->next += HAL_US_TO_DTU(timer->period_us);
+        timer->event = hal_event_at(timer->node, timer->next, hal_timer_fire, timer);
+    }
+    timer->callback(timer->arg);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_handle_t timer = new esp_timer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->node = hal->current_node;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t hal_timer_start(esp_timer_handle_t timer, uint64_t us, uint64_t period_us) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->event != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = period_us;
+    timer->next = hal->now + HAL_US_TO_DTU(us);
+    timer->event = hal_event_at(timer->node, timer->next, hal_timer_fire, timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return hal_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return hal_timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->event == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    hal_event_cancel(timer->event);
+    timer->event = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->event != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)HAL_DTU_TO_US(hal->now);
+}
@@ -0,0 +1,105 @@
+#ifndef __HAL_NATIVE_H__
+#define __HAL_NATIVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// HAL of the native build, a discrete event scheduler with one or more simulated ESP32 nodes
+// every node has its own tasks (ucontext, cooperative), GPIO interrupts, UART, NVS and random numbers
+// the Arduino / FreeRTOS / esp_timer shims in native/include act on the node that is running
+
+// simulated time in DW1000 device time units (1 / (128 * 499.2 MHz), ~15.65 ps), shared by all nodes
+typedef uint64_t hal_time_t;
+
+#define HAL_TIME_NEVER UINT64_MAX
+// 1 us = 63897.6 dtu
+#define HAL_US_TO_DTU(us) ((hal_time_t)(us) * 638976ULL / 10)
+#define HAL_NS_TO_DTU(ns) ((hal_time_t)(ns) * 638976ULL / 10000)
+#define HAL_MS_TO_DTU(ms) HAL_US_TO_DTU((uint64_t)(ms) * 1000)
+#define HAL_DTU_TO_US(t) ((t) * 10 / 638976ULL)
+#define HAL_DTU_TO_NS(t) ((t) * 10000 / 638976ULL)
+
+// task wake up latency after an interrupt, timer or uart callback
+#define HAL_WAKE_LATENCY_US 5
+// stack of every simulated task, bigger than on the ESP32, host code uses more of it
+#define HAL_TASK_STACK_SIZE (128 * 1024)
+
+typedef struct hal_node hal_node_t;
+typedef struct hal_event hal_event_t;
+typedef void (*hal_event_cb_t)(void *arg);
+
+// uart line printed by a node, without the line end
+typedef void (*hal_serial_line_cb_t)(hal_node_t *node, const char *line, void *arg);
+
+
+// scheduler, call once before creating nodes
+void hal_init();
+hal_time_t hal_now();
+// run tasks and events up to time end (inclusive), returns false if nothing is left to run
+bool hal_run_until(hal_time_t end);
+// events dispatched and task switches since hal_init
+uint64_t hal_event_count();
+uint64_t hal_switch_count();
+
+// callback at time t in the context of node (NULL for no node), free after it ran or was cancelled
+// the owner must forget the handle inside the callback
+hal_event_t *hal_event_at(hal_node_t *node, hal_time_t t, hal_event_cb_t cb, void *arg);
+void hal_event_cancel(hal_event_t *event);
+
+// time taken by the running task, e.g. a SPI transaction, other tasks and events run meanwhile
+// no effect outside of a task
+void hal_spend(hal_time_t dt);
+
+
+// nodes
+hal_node_t *hal_node_create(const char *name, uint32_t seed);
+const char *hal_node_name(hal_node_t *node);
+// node of the running task or event, NULL in the scheduler itself
+hal_node_t *hal_node_current();
+// start the first task of the node at the current time, like the Arduino loopTask
+void hal_node_start(hal_node_t *node, void (*fn)(void *), void *arg, UBaseType_t priority);
+
+// every node gets its own copy of the program globals (.data / .bss, GNU ld symbols), swapped in
+// when the node runs, so several firmware instances share one process. call before hal_node_create,
+// state of the simulation itself must be on the heap or in __thread variables then
+void hal_node_images_enable();
+uint64_t hal_image_swap_count();
+
+// simulated radio of the node, used by dw1000_native.cpp
+void hal_node_set_radio(hal_node_t *node, void *radio);
+void *hal_node_radio(hal_node_t *node);
+// free pointer for the simulation
+void hal_node_set_user(hal_node_t *node, void *user);
+void *hal_node_user(hal_node_t *node);
+
+// level change of an input pin, RISING handlers attached with attachInterrupt run right away
+void hal_gpio_input(hal_node_t *node, uint8_t pin, int level);
+int hal_gpio_output(hal_node_t *node, uint8_t pin);
+
+// uart, every complete output line goes to the callback, echo prints it to stdout with the node name
+void hal_serial_set_line_cb(hal_node_t *node, hal_serial_line_cb_t cb, void *arg);
+void hal_serial_set_echo(hal_node_t *node, bool echo);
+void hal_serial_input(hal_node_t *node, const char *data, size_t len);
+
+// NVS content, e.g. preloaded node id before system_config_init
+void hal_prefs_set(hal_node_t *node, const char *ns, const char *key, uint32_t value);
+bool hal_prefs_get(hal_node_t *node, const char *ns, const char *key, uint32_t *value);
+void hal_prefs_erase(hal_node_t *node, const char *ns);
+
+// xorshift random of the node
+uint32_t hal_node_random(hal_node_t *node);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HAL_NATIVE_H__
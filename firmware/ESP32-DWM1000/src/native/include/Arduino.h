@@ -0,0 +1,95 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+// Arduino core subset for the native build, backed by the simulated node of hal_native.h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define IRAM_ATTR
+#define ARDUINO_ISR_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+uint32_t getCpuFrequencyMhz(void);
+
+#ifdef __cplusplus
+}
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+
+// UART0 of the current node, output goes to the node's line callback
+class HardwareSerial {
+public:
+    void begin(unsigned long baud, uint32_t config = 0, int8_t rx_pin = -1, int8_t tx_pin = -1);
+    void updateBaudRate(unsigned long baud);
+    void end();
+
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char *s);
+    size_t println(const char *s);
+    size_t println();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    size_t write(const char *buf, size_t len) { return write((const uint8_t *)buf, len); }
+
+    int available();
+    int read();
+    void flush();
+    void onReceive(void (*cb)(void), bool only_on_timeout = false);
+
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+
+class EspClass {
+public:
+    uint64_t getEfuseMac();
+    // 240 MHz cycles of the simulated time, code itself takes no time in the simulation
+    uint32_t getCycleCount();
+};
+
+extern EspClass ESP;
+
+#endif // __cplusplus
+
+#endif // __NATIVE_ARDUINO_H__
@@ -0,0 +1,28 @@
+#ifndef __NATIVE_PREFERENCES_H__
+#define __NATIVE_PREFERENCES_H__
+
+#include <Arduino.h>
+
+
+// NVS of the current node, kept in memory (hal_prefs_* in hal_native.h)
+class Preferences {
+public:
+    bool begin(const char *name, bool read_only = false);
+    void end();
+    bool clear();
+    bool isKey(const char *key);
+
+    uint8_t getUChar(const char *key, uint8_t default_value = 0);
+    size_t putUChar(const char *key, uint8_t value);
+    uint16_t getUShort(const char *key, uint16_t default_value = 0);
+    size_t putUShort(const char *key, uint16_t value);
+    uint32_t getULong(const char *key, uint32_t default_value = 0);
+    size_t putULong(const char *key, uint32_t value);
+
+private:
+    char ns[16] = {0};
+    bool opened = false;
+    bool read_only = false;
+};
+
+#endif // __NATIVE_PREFERENCES_H__
@@ -0,0 +1,7 @@
+#ifndef __NATIVE_SPI_H__
+#define __NATIVE_SPI_H__
+
+// the DW1000 SPI is simulated below writetospi / readfromspi (dw1000_native.cpp)
+#include <Arduino.h>
+
+#endif // __NATIVE_SPI_H__
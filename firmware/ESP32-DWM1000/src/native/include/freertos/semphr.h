@@ -0,0 +1,25 @@
+#ifndef __NATIVE_FREERTOS_SEMPHR_H__
+#define __NATIVE_FREERTOS_SEMPHR_H__
+
+#include "freertos/queue.h"
+
+// semaphores are queues with zero size items, like in FreeRTOS
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define xSemaphoreTake(sem, ticks) xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreGive(sem) xQueueSend((sem), NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken) xQueueSendFromISR((sem), NULL, (woken))
+#define vSemaphoreDelete(sem) vQueueDelete(sem)
+
+#endif // __NATIVE_FREERTOS_SEMPHR_H__
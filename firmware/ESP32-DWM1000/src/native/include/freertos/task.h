@@ -0,0 +1,31 @@
+#ifndef __NATIVE_FREERTOS_TASK_H__
+#define __NATIVE_FREERTOS_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct hal_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// the core is ignored, every task runs as if it had a core of its own
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NATIVE_FREERTOS_TASK_H__
@@ -0,0 +1,22 @@
+#include <Arduino.h>
+#include "power.h"
+
+// power.cpp of the native build, no ADC, the battery reads a fixed voltage
+
+#define NATIVE_BATTERY_MV 3900
+
+uint16_t battery_voltage_mv = NATIVE_BATTERY_MV;
+
+void update_battery_voltage_mv(uint16_t voltage_mv) {
+    battery_voltage_mv = voltage_mv;
+}
+
+uint16_t get_battery_voltage_mv() {
+    return battery_voltage_mv;
+}
+
+void power_init() {
+}
+
+void power_task() {
+}
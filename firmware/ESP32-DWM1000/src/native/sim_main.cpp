@@ -0,0 +1,472 @@
+#include <Arduino.h>
+
+#include <chrono>
+
+#include "uwb.h"
+#include "system_config.h"
+#include "safe_print.h"
+#include "uwb_log.h"
+#include "dw1000_spi_prof.h"
+
+#include "hal_native.h"
+#include "dw1000_model.h"
+#include "sim_net.h"
+
+// native build entry, one firmware node (the DUT) on the DW1000 model and a scripted peer radio
+// the peer answers like the firmware would, with its own clock and a distance to the DUT
+// every case prints a {"event":"sim_case",...} line, exit code 1 if one failed
+// `program net ...` runs the multi node benchmark of sim_net.h instead
+// `--spiprof` adds the SPI profile of the whole run (dw1000_spi_prof.h), to diff two builds
+
+#define SIM_GROUP_ID 0x1234
+#define SIM_DUT_ID 0xFF01
+#define SIM_PEER_ID 0x0002
+
+// peer processing time before an immediate reply
+#define SIM_PEER_TURNAROUND_US 300
+// wait for the result of one case
+#define SIM_CASE_TIMEOUT_MS 200
+// DS-TWR error limit, SS-TWR adds the carrier integrator rounding
+#define SIM_DS_MAX_ERR_MM 20
+#define SIM_SS_MAX_ERR_MM 50
+// frames of the dwt_isr / dwt_isr_fast benchmark and their spacing
+#define SIM_ISR_BENCH_FRAMES 100
+#define SIM_ISR_BENCH_PERIOD_MS 2
+// 850k_256 of uwb_phy.cpp, a blink fits in the period
+#define SIM_ISR_BENCH_PROFILE 1
+
+#define MASK40 0xFFFFFFFFFFULL
+
+typedef enum {
+    SIM_CASE_PING = 0,
+    SIM_CASE_DS_RESPONDER,   // peer polls the DUT, DUT computes the distance
+    SIM_CASE_DS_INITIATOR,   // DUT polls the peer, peer sends the report
+    SIM_CASE_SS_INITIATOR,   // DUT polls the peer single-sided, carrier integrator correction
+    SIM_CASE_COUNT
+} sim_case_t;
+
+static const char *sim_case_names[SIM_CASE_COUNT] = {"ping", "ds_responder", "ds_initiator", "ss_initiator"};
+
+typedef struct {
+    uint64_t clock_offset;
+    int32_t clock_ppb;
+    hal_time_t tof;
+    float rx_power_dbm;
+    uint8_t seq;
+    uint8_t poll_seq;
+
+    // peer as DS initiator
+    uint64_t poll_tx_ts;
+    // peer as responder
+    uint64_t poll_rx_ts;
+    uint64_t resp_tx_ts;
+} sim_peer_t;
+
+typedef struct {
+    hal_node_t *node;
+    dw1000_air_frame_t frame;
+} sim_delivery_t;
+
+static hal_node_t *dut;
+static dw1000_model_t *dut_radio;
+static sim_peer_t peer;
+
+static volatile bool sim_done = false;
+static bool sim_spiprof = false;
+static uint32_t sim_spi_foreign = 0;
+static int sim_failed = 0;
+static int sim_cases = 0;
+
+
+// ---------------- scripted peer ----------------
+
+static uint64_t peer_local(hal_time_t t) {
+    __int128 local = (__int128)peer.clock_offset + t + (__int128)t * peer.clock_ppb / 1000000000;
+    return (uint64_t)local & MASK40;
+}
+
+// global time of a peer clock value not long after time near
+static hal_time_t peer_global(uint64_t local, hal_time_t near) {
+    uint64_t dl = (local - peer_local(near)) & MASK40;
+    return near + (hal_time_t)((__int128)dl * 1000000000 / (1000000000 + peer.clock_ppb));
+}
+
+static void peer_deliver_cb(void *arg) {
+    sim_delivery_t *d = (sim_delivery_t *)arg;
+    dw1000_model_deliver(dut_radio, &d->frame);
+    delete d;
+}
+
+// frame of len bytes (crc included) leaving the peer antenna with RMARKER at depart
+static void peer_send(const void *pkt, uint16_t len, hal_time_t depart) {
+    sim_delivery_t *d = new sim_delivery_t();
+    dw1000_air_frame_t *f = &d->frame;
+    memcpy(f->data, pkt, len);
+    f->len = len;
+    uint16_t crc = dw1000_model_crc16(f->data, len - 2);
+    f->data[len - 2] = (uint8_t)crc;
+    f->data[len - 1] = (uint8_t)(crc >> 8);
+    f->ranging = true;
+    dw1000_model_tx_phy(dut_radio, &f->phy);
+    f->rmarker = depart + peer.tof;
+    f->tx_clock_ppb = peer.clock_ppb;
+    f->rx_power_dbm = peer.rx_power_dbm;
+
+    hal_event_at(dut, f->rmarker - dw1000_model_shr_dtu(&f->phy), peer_deliver_cb, d);
+}
+
+static void peer_header(uwb_common_header_t *hdr, uint16_t dest_id, uint8_t msg_type) {
+    hdr->frame_ctrl = UWB_FRAME_CTRL;
+    hdr->seq_num = peer.seq++;
+    hdr->group_id = SIM_GROUP_ID;
+    hdr->dest_id = dest_id;
+    hdr->src_id = SIM_PEER_ID;
+    hdr->msg_type = msg_type;
+}
+
+// delayed reply like the firmware, TX time reply_uus after the rx timestamp, 512 dtu resolution
+static uint64_t peer_reply_ts(uint64_t rx_ts, uint32_t reply_uus) {
+    return (rx_ts + (uint64_t)reply_uus * UUS_TO_DWT_TIME) & MASK40 & ~0x1FFULL;
+}
+
+static void peer_send_trigger(uint8_t msg_type) {
+    uwb_pkt_range_trigger_t pkt;
+    peer_header(&pkt.header, SIM_DUT_ID, msg_type);
+    pkt.target_node_id = SIM_PEER_ID;
+    peer_send(&pkt, sizeof(pkt), hal_now() + HAL_US_TO_DTU(SIM_PEER_TURNAROUND_US));
+}
+
+// every frame the DUT sends, called at its first preamble symbol
+static void peer_on_frame(dw1000_model_t *m, const dw1000_air_frame_t *frame, void *arg) {
+    const uwb_common_header_t *hdr = (const uwb_common_header_t *)frame->data;
+    if (frame->len < sizeof(uwb_common_header_t) + 2 || (hdr->dest_id != SIM_PEER_ID && hdr->dest_id != UWB_BROADCAST_ID)) {
+        return;
+    }
+
+    hal_time_t rx_at = frame->rmarker + peer.tof;
+    uint64_t rx_ts = peer_local(rx_at);
+    hal_time_t turnaround = rx_at + dw1000_model_tail_dtu(&frame->phy, frame->len) + HAL_US_TO_DTU(SIM_PEER_TURNAROUND_US);
+
+    switch (hdr->msg_type) {
+        case UWB_MSG_TYPE_PING_REQ: {
+            uwb_pkt_ping_resp_t resp;
+            peer_header(&resp.header, hdr->src_id, UWB_MSG_TYPE_PING_RESP);
+            resp.system_state = 1;
+            resp.voltage_mv = 3700;
+            peer_send(&resp, sizeof(resp), turnaround);
+            break;
+        }
+        case UWB_MSG_TYPE_RANGE_TRIGGER: {
+            // DUT asked the peer to range with the DUT
+            const uwb_pkt_range_trigger_t *trigger = (const uwb_pkt_range_trigger_t *)frame->data;
+            uwb_pkt_range_poll_t poll;
+            peer.poll_seq = peer.seq;
+            peer_header(&poll.header, trigger->target_node_id, UWB_MSG_TYPE_RANGE_POLL);
+            peer.poll_tx_ts = peer_local(turnaround);
+            peer_send(&poll, sizeof(poll), turnaround);
+            break;
+        }
+        case UWB_MSG_TYPE_RANGE_RESP: {
+            uwb_pkt_range_final_t final;
+            uint64_t final_tx_ts = peer_reply_ts(rx_ts, uwb_final_tx_delay_uus);
+            peer.seq = peer.poll_seq + 1;
+            peer_header(&final.header, hdr->src_id, UWB_MSG_TYPE_RANGE_FINAL);
+            final.poll_tx_ts = (uint32_t)peer.poll_tx_ts;
+            final.resp_rx_ts = (uint32_t)rx_ts;
+            final.final_tx_ts = (uint32_t)final_tx_ts;
+            peer_send(&final, sizeof(final), peer_global(final_tx_ts, rx_at));
+            break;
+        }
+        case UWB_MSG_TYPE_RANGE_POLL: {
+            uwb_pkt_range_resp_t resp;
+            peer.poll_rx_ts = rx_ts;
+            peer.resp_tx_ts = peer_reply_ts(rx_ts, uwb_resp_tx_delay_uus);
+            peer_header(&resp.header, hdr->src_id, UWB_MSG_TYPE_RANGE_RESP);
+            peer_send(&resp, sizeof(resp), peer_global(peer.resp_tx_ts, rx_at));
+            break;
+        }
+        case UWB_MSG_TYPE_RANGE_FINAL: {
+            const uwb_pkt_range_final_t *final = (const uwb_pkt_range_final_t *)frame->data;
+            int32_t mm = uwb_twr_ds_distance_mm(final->poll_tx_ts, final->resp_rx_ts, final->final_tx_ts,
+                                                (uint32_t)peer.poll_rx_ts, (uint32_t)peer.resp_tx_ts, (uint32_t)rx_ts);
+            uwb_pkt_range_report_t report;
+            peer_header(&report.header, UWB_BROADCAST_ID, UWB_MSG_TYPE_RANGE_REPORT);
+            report.node_a_id = hdr->src_id;
+            report.node_b_id = SIM_PEER_ID;
+            report.distance_mm = (mm > 0) ? mm : 0;
+            report.rssi_centi_dbm = (int16_t)(peer.rx_power_dbm * 100.0f);
+            peer_send(&report, sizeof(report), turnaround);
+            break;
+        }
+        case UWB_MSG_TYPE_RANGE_POLL_SS: {
+            uwb_pkt_range_resp_ss_t resp;
+            uint64_t resp_tx_ts = peer_reply_ts(rx_ts, uwb_resp_tx_delay_uus);
+            peer_header(&resp.header, hdr->src_id, UWB_MSG_TYPE_RANGE_RESP_SS);
+            resp.poll_rx_ts = (uint32_t)rx_ts;
+            resp.resp_tx_ts = (uint32_t)resp_tx_ts;
+            peer_send(&resp, sizeof(resp), peer_global(resp_tx_ts, rx_at));
+            break;
+        }
+        default:
+            break; // reports of the DUT
+    }
+}
+
+
+// ---------------- cases ----------------
+
+static void sim_drain_results() {
+    uwb_result_t results[8];
+    while (uwb_result_pop_batch(results, 8) > 0) {
+    }
+}
+
+// wait for the result of the case, false on timeout
+static bool sim_wait_result(uint8_t type, uwb_result_t *out) {
+    unsigned long start = millis();
+    while (millis() - start < SIM_CASE_TIMEOUT_MS) {
+        uwb_result_t results[8];
+        uint32_t n = uwb_result_pop_batch(results, 8);
+        for (uint32_t i = 0; i < n; i++) {
+            if (results[i].type == type) {
+                *out = results[i];
+                return true;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+static void sim_run_case(uint8_t c, float distance_m, int32_t ppb) {
+    // distance as a whole number of dtu, the expected result is exact
+    peer.tof = (hal_time_t)llround(distance_m * 1000.0 * (1 << 24) / UWB_TWR_MM_PER_DTU_Q24);
+    double expect_mm = (double)peer.tof * UWB_TWR_MM_PER_DTU_Q24 / (1 << 24);
+    peer.clock_ppb = ppb;
+    peer.clock_offset = hal_node_random(dut) * 256ULL;
+    peer.rx_power_dbm = -45.0f - 20.0f * log10f(distance_m);
+
+    sim_drain_results();
+    unsigned long start_us = micros();
+    uwb_result_t result;
+    bool ok = false;
+    double measured_mm = 0;
+    int32_t max_err_mm = 0;
+
+    switch (c) {
+        case SIM_CASE_PING:
+            uwb_cmd_ping(SIM_PEER_ID, UWB_CMD_PRIO_NORMAL);
+            ok = sim_wait_result(UWB_RESULT_PING_RESP, &result) && result.ping.node_id == SIM_PEER_ID && result.ping.voltage_mv == 3700;
+            break;
+        case SIM_CASE_DS_RESPONDER:
+            uwb_cmd_range_trigger(SIM_PEER_ID, SIM_DUT_ID, UWB_CMD_PRIO_NORMAL);
+            ok = sim_wait_result(UWB_RESULT_RANGE_FINAL, &result) && result.range.node_a_id == SIM_PEER_ID;
+            measured_mm = result.range.distance_mm;
+            max_err_mm = SIM_DS_MAX_ERR_MM;
+            break;
+        case SIM_CASE_DS_INITIATOR:
+            peer_send_trigger(UWB_MSG_TYPE_RANGE_TRIGGER);
+            ok = sim_wait_result(UWB_RESULT_RANGE_REPORT, &result) && result.range.node_a_id == SIM_DUT_ID;
+            measured_mm = result.range.distance_mm;
+            max_err_mm = SIM_DS_MAX_ERR_MM;
+            break;
+        case SIM_CASE_SS_INITIATOR:
+            peer_send_trigger(UWB_MSG_TYPE_RANGE_TRIGGER_SS);
+            ok = sim_wait_result(UWB_RESULT_RANGE_FINAL, &result) && result.range.node_b_id == SIM_PEER_ID;
+            measured_mm = result.range.distance_mm;
+            max_err_mm = SIM_SS_MAX_ERR_MM;
+            break;
+    }
+    unsigned long latency_us = micros() - start_us;
+
+    double err_mm = measured_mm - expect_mm;
+    if (ok && max_err_mm > 0 && fabs(err_mm) > max_err_mm) {
+        ok = false;
+    }
+    sim_cases++;
+    sim_failed += ok ? 0 : 1;
+
+    printf("{\"event\":\"sim_case\",\"case\":\"%s\",\"profile\":\"%s\",\"distance_m\":%.3f,\"ppb\":%d,\"ok\":%s",
+        sim_case_names[c], uwb_phy_current()->name, distance_m, (int)ppb, ok ? "true" : "false");
+    if (max_err_mm > 0) {
+        printf(",\"measured_m\":%.3f,\"err_mm\":%.1f,\"rssi_dbm\":%.1f", measured_mm / 1000.0, err_mm, result.range.rssi_dbm);
+    }
+    printf(",\"latency_us\":%lu}\n", latency_us);
+
+    // let the report and the receiver settle before the next case
+    vTaskDelay(pdMS_TO_TICKS(20));
+}
+
+// SPI cost of one received frame, interrupt to receiver on again, with dwt_isr or dwt_isr_fast
+// the peer sends TDoA blinks, the DUT only takes the RX timestamp and sends nothing back
+static void sim_bench_isr(bool fast, uint32_t frames) {
+    uwb_rx_fast_isr = fast;
+    vTaskDelay(pdMS_TO_TICKS(5));
+
+    const dw1000_bus_stats_t *bus = dw1000_model_bus_stats(dut_radio);
+    dw1000_bus_stats_t bus0 = *bus;
+    uint32_t rx0 = uwb_rx_frame_count();
+
+    peer.tof = HAL_NS_TO_DTU(10);
+    for (uint32_t i = 0; i < frames; i++) {
+        uwb_pkt_tdoa_blink_t pkt;
+        peer_header(&pkt.header, UWB_BROADCAST_ID, UWB_MSG_TYPE_TDOA_BLINK);
+        pkt.blink_seq = (uint8_t)i;
+        peer_send(&pkt, sizeof(pkt), hal_now() + HAL_US_TO_DTU(100));
+        vTaskDelay(pdMS_TO_TICKS(SIM_ISR_BENCH_PERIOD_MS));
+    }
+
+    uint32_t rx = uwb_rx_frame_count() - rx0;
+    uint32_t n = rx ? rx : 1;
+    printf("{\"event\":\"sim_isr_bench\",\"mode\":\"%s\",\"frames\":%u,\"received\":%u,"
+        "\"spi_transactions_per_frame\":%.2f,\"spi_bytes_per_frame\":%.1f,\"spi_us_per_frame\":%.2f}\n",
+        fast ? "dwt_isr_fast" : "dwt_isr", (unsigned)frames, (unsigned)rx,
+        (double)(bus->transactions - bus0.transactions) / n, (double)(bus->bytes - bus0.bytes) / n,
+        (double)HAL_DTU_TO_NS(bus->busy_dtu - bus0.busy_dtu) / 1000.0 / n);
+    if (rx != frames) {
+        sim_failed++;
+    }
+}
+
+static void sim_app(void *arg) {
+    Serial.begin(115200);
+    system_config_init();
+    safe_print_init();
+    uwb_log_init();
+    uwb_task_init();
+    dw1000_spi_prof_enable(sim_spiprof);
+
+    static const float distances_m[] = {1.0f, 7.5f, 30.0f};
+    static const int32_t ppbs[] = {0, 15000, -15000};
+
+    for (uint8_t p = 0; p < uwb_phy_profile_count; p++) {
+        set_uwb_phy_profile(p);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        for (uint8_t c = 0; c < SIM_CASE_COUNT; c++) {
+            for (float d : distances_m) {
+                for (int32_t ppb : ppbs) {
+                    sim_run_case(c, d, ppb);
+                    if (c == SIM_CASE_PING) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    set_uwb_phy_profile(SIM_ISR_BENCH_PROFILE);
+    vTaskDelay(pdMS_TO_TICKS(10));
+    sim_bench_isr(false, SIM_ISR_BENCH_FRAMES);
+    sim_bench_isr(true, SIM_ISR_BENCH_FRAMES);
+    uwb_rx_fast_isr = UWB_RX_FAST_ISR;
+
+    if (sim_spiprof) {
+        dw1000_spi_prof_report();
+    }
+    // SPI of any task but uwb_task, see dw1000_port_set_owner
+    sim_spi_foreign = dw1000_port_foreign_count();
+
+    sim_done = true;
+    vTaskDelete(NULL);
+}
+
+
+// ---------------- benchmark ----------------
+
+// host time of the DS-TWR kernels, the simulated ESP32 clock does not count code
+static void sim_bench_twr(uint32_t iterations) {
+    volatile int32_t sink = 0;
+    uint32_t ts[6] = {1000, 0, 0, 0, 0, 0};
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        ts[3] = 0x12345678 + i;
+        ts[1] = ts[0] + 20000000 + (i & 0xFFF);
+        ts[4] = ts[3] + 19000000;
+        ts[2] = ts[1] + 30000000;
+        ts[5] = ts[4] + 31000000 + (i & 0xFF);
+        sink += uwb_twr_ds_distance_mm_int(ts[0], ts[1], ts[2], ts[3], ts[4], ts[5]);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        ts[3] = 0x12345678 + i;
+        ts[1] = ts[0] + 20000000 + (i & 0xFFF);
+        ts[4] = ts[3] + 19000000;
+        ts[2] = ts[1] + 30000000;
+        ts[5] = ts[4] + 31000000 + (i & 0xFF);
+        sink += uwb_twr_ds_distance_mm_float(ts[0], ts[1], ts[2], ts[3], ts[4], ts[5]);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    double int_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+    double float_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations;
+    printf("{\"event\":\"sim_twr_bench\",\"iterations\":%u,\"int_ns\":%.1f,\"float_ns\":%.1f}\n",
+        (unsigned)iterations, int_ns, float_ns);
+}
+
+
+// profile lines of the DUT go to stdout like the sim_* events
+static void sim_serial_line(hal_node_t *node, const char *line, void *arg) {
+    if (sim_spiprof && strncmp(line, "{\"event\":\"spiprof", 17) == 0) {
+        printf("%s\n", line);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "net") == 0) {
+        return sim_net_main(argc, argv);
+    }
+
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        if (strcmp(argv[i], "--spiprof") == 0) {
+            sim_spiprof = true;
+        }
+    }
+
+    hal_init();
+    dut = hal_node_create("dut", 1);
+    hal_serial_set_echo(dut, verbose);
+    hal_serial_set_line_cb(dut, sim_serial_line, NULL);
+    hal_prefs_set(dut, "syscfg", "uwb_gid", SIM_GROUP_ID);
+    hal_prefs_set(dut, "syscfg", "uwb_nid", SIM_DUT_ID);
+    hal_prefs_set(dut, "syscfg", "uwb_phy", 0);
+
+    dut_radio = dw1000_model_create(dut);
+    dw1000_model_set_clock(dut_radio, 0x0123456789ULL, 0);
+    dw1000_model_set_tx_cb(dut_radio, peer_on_frame, NULL);
+    hal_node_set_radio(dut, dut_radio);
+    peer.seq = 0x80;
+
+    auto t0 = std::chrono::steady_clock::now();
+    hal_node_start(dut, sim_app, NULL, 1);
+    while (!sim_done) {
+        if (!hal_run_until(hal_now() + HAL_MS_TO_DTU(100))) {
+            break;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (!sim_done) {
+        printf("{\"event\":\"sim_stalled\",\"sim_ms\":%llu}\n", (unsigned long long)(HAL_DTU_TO_US(hal_now()) / 1000));
+        sim_failed++;
+    }
+
+    const dw1000_model_stats_t *st = dw1000_model_stats(dut_radio);
+    const dw1000_bus_stats_t *bus = dw1000_model_bus_stats(dut_radio);
+    printf("{\"event\":\"sim_radio\",\"tx\":%u,\"tx_late\":%u,\"rx\":%u,\"rx_err\":%u,\"rx_filtered\":%u,\"rx_missed\":%u,\"rx_timeouts\":%u,\"rx_overruns\":%u}\n",
+        st->tx_frames, st->tx_late, st->rx_frames, st->rx_crc_errors, st->rx_filtered, st->rx_missed, st->rx_timeouts, st->rx_overruns);
+    printf("{\"event\":\"sim_spi\",\"transactions\":%u,\"bytes\":%llu,\"busy_us\":%llu,\"foreign\":%u}\n",
+        bus->transactions, (unsigned long long)bus->bytes, (unsigned long long)HAL_DTU_TO_US(bus->busy_dtu), (unsigned)sim_spi_foreign);
+    if (sim_spi_foreign != 0) {
+        sim_failed++;
+    }
+    printf("{\"event\":\"sim_done\",\"cases\":%d,\"failed\":%d,\"sim_ms\":%llu,\"wall_ms\":%.1f,\"events\":%llu,\"switches\":%llu}\n",
+        sim_cases, sim_failed, (unsigned long long)(HAL_DTU_TO_US(hal_now()) / 1000),
+        std::chrono::duration<double, std::milli>(t1 - t0).count(),
+        (unsigned long long)hal_event_count(), (unsigned long long)hal_switch_count());
+
+    sim_bench_twr(1000000);
+
+    return sim_failed ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#include "sim_medium.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+
+typedef struct {
+    dw1000_model_t *radio;
+    hal_node_t *node;
+    float x, y, z;
+} sim_medium_port_t;
+
+struct sim_medium {
+    sim_medium_config_t config;
+    std::vector<sim_medium_port_t> ports;
+    uint32_t rng;
+    sim_medium_tx_hook_t hook;
+    void *hook_arg;
+    sim_medium_stats_t stats;
+};
+
+typedef struct {
+    dw1000_model_t *radio;
+    dw1000_air_frame_t frame;
+} sim_medium_delivery_t;
+
+
+static uint32_t medium_random(sim_medium_t *m) {
+    uint32_t x = m->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m->rng = x;
+    return x;
+}
+
+static float medium_uniform(sim_medium_t *m) {
+    return (medium_random(m) + 0.5f) / 4294967296.0f;
+}
+
+static float medium_gauss(sim_medium_t *m) {
+    return sqrtf(-2.0f * logf(medium_uniform(m))) * cosf(2.0f * (float)M_PI * medium_uniform(m));
+}
+
+static sim_medium_port_t *medium_port(sim_medium_t *m, dw1000_model_t *radio) {
+    for (sim_medium_port_t &p : m->ports) {
+        if (p.radio == radio) {
+            return &p;
+        }
+    }
+    return NULL;
+}
+
+static float port_distance(const sim_medium_port_t *a, const sim_medium_port_t *b) {
+    float dx = a->x - b->x;
+    float dy = a->y - b->y;
+    float dz = a->z - b->z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+float sim_medium_rx_power_dbm(sim_medium_t *m, uint8_t chan, float d_m) {
+    double fc;
+    switch (chan) {
+        case 1:  fc = 3494.4e6; break;
+        case 3:  fc = 4492.8e6; break;
+        case 5:
+        case 7:  fc = 6489.6e6; break;
+        default: fc = 3993.6e6; break;
+    }
+    // free space loss at 1 m, then log distance
+    float loss_1m = 20.0f * log10f((float)(4.0 * M_PI * fc / SIM_MEDIUM_SPEED_OF_LIGHT));
+    if (d_m < 0.1f) {
+        d_m = 0.1f;
+    }
+    return SIM_MEDIUM_TX_DBM - loss_1m - 10.0f * m->config.path_loss_exp * log10f(d_m);
+}
+
+static void medium_deliver_cb(void *arg) {
+    sim_medium_delivery_t *d = (sim_medium_delivery_t *)arg;
+    dw1000_model_deliver(d->radio, &d->frame);
+    delete d;
+}
+
+// called by the sending model at its first preamble symbol
+static void medium_tx_cb(dw1000_model_t *radio, const dw1000_air_frame_t *frame, void *arg) {
+    sim_medium_t *m = (sim_medium_t *)arg;
+    sim_medium_port_t *tx = medium_port(m, radio);
+    hal_time_t shr = dw1000_model_shr_dtu(&frame->phy);
+    float sensitivity = dw1000_model_sensitivity_dbm(&frame->phy);
+
+    m->stats.frames++;
+    m->stats.airtime += shr + dw1000_model_tail_dtu(&frame->phy, frame->len);
+    if (m->hook != NULL) {
+        m->hook(radio, frame, m->hook_arg);
+    }
+
+    for (sim_medium_port_t &rx : m->ports) {
+        if (&rx == tx) {
+            continue;
+        }
+        float d = port_distance(tx, &rx);
+        float power = sim_medium_rx_power_dbm(m, frame->phy.chan, d);
+        if (m->config.shadowing_db > 0) {
+            power += medium_gauss(m) * m->config.shadowing_db;
+        }
+        if (power < sensitivity) {
+            m->stats.out_of_range++;
+            if (power < sensitivity - SIM_MEDIUM_INTERFERENCE_MARGIN_DB) {
+                continue;
+            }
+        }
+
+        sim_medium_delivery_t *dl = new sim_medium_delivery_t();
+        dl->radio = rx.radio;
+        dl->frame = *frame;
+        dl->frame.rmarker = frame->rmarker + (hal_time_t)llround(d / SIM_MEDIUM_SPEED_OF_LIGHT * 499.2e6 * 128.0);
+        dl->frame.rx_power_dbm = power;
+        if (m->config.frame_loss > 0 && medium_uniform(m) < m->config.frame_loss) {
+            dl->frame.corrupt = true;
+            m->stats.lost++;
+        }
+        m->stats.deliveries++;
+        // the receiving node handles it in its own context
+        hal_event_at(rx.node, dl->frame.rmarker - shr, medium_deliver_cb, dl);
+    }
+}
+
+sim_medium_t *sim_medium_create(const sim_medium_config_t *config) {
+    sim_medium_t *m = new sim_medium_t();
+    m->config = *config;
+    m->rng = config->seed ? config->seed : 0x9E3779B9;
+    return m;
+}
+
+void sim_medium_add(sim_medium_t *m, dw1000_model_t *radio, float x, float y, float z) {
+    sim_medium_port_t p;
+    p.radio = radio;
+    p.node = dw1000_model_node(radio);
+    p.x = x;
+    p.y = y;
+    p.z = z;
+    m->ports.push_back(p);
+    dw1000_model_set_tx_cb(radio, medium_tx_cb, m);
+}
+
+void sim_medium_set_tx_hook(sim_medium_t *m, sim_medium_tx_hook_t hook, void *arg) {
+    m->hook = hook;
+    m->hook_arg = arg;
+}
+
+float sim_medium_distance(sim_medium_t *m, dw1000_model_t *a, dw1000_model_t *b) {
+    sim_medium_port_t *pa = medium_port(m, a);
+    sim_medium_port_t *pb = medium_port(m, b);
+    return (pa && pb) ? port_distance(pa, pb) : -1.0f;
+}
+
+const sim_medium_stats_t *sim_medium_stats(sim_medium_t *m) {
+    return &m->stats;
+}
@@ -0,0 +1,64 @@
+#ifndef __SIM_MEDIUM_H__
+#define __SIM_MEDIUM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal_native.h"
+#include "dw1000_model.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// shared radio channel of the multi node simulation
+// every frame a model sends reaches all other models after the propagation delay, with a log
+// distance path loss plus shadowing; collisions are decided by the receiving model (capture margin)
+
+// DW1000 at the -41.3 dBm/MHz limit over 500 MHz
+#define SIM_MEDIUM_TX_DBM -14.3f
+// frames this far below the sensitivity are not delivered at all, not even as interference
+#define SIM_MEDIUM_INTERFERENCE_MARGIN_DB 10.0f
+// speed of light in air, m/s
+#define SIM_MEDIUM_SPEED_OF_LIGHT 299702547.0
+
+typedef struct sim_medium sim_medium_t;
+
+typedef struct {
+    float path_loss_exp;   // 2.0 for free space
+    float shadowing_db;    // sigma of the per frame gaussian shadowing
+    float frame_loss;      // probability a delivered frame is corrupt (interference not modelled otherwise)
+    uint32_t seed;
+} sim_medium_config_t;
+
+typedef struct {
+    uint32_t frames;        // frames sent
+    uint32_t deliveries;    // frame copies handed to receivers
+    uint32_t out_of_range;  // below the sensitivity of a receiver
+    uint32_t lost;          // corrupted by frame_loss
+    hal_time_t airtime;     // sum of all frame durations
+} sim_medium_stats_t;
+
+// observer of every frame sent, e.g. to timestamp TDoA blinks
+typedef void (*sim_medium_tx_hook_t)(dw1000_model_t *sender, const dw1000_air_frame_t *frame, void *arg);
+
+
+sim_medium_t *sim_medium_create(const sim_medium_config_t *config);
+// attach a model at position x, y, z (m), takes over its tx callback
+void sim_medium_add(sim_medium_t *medium, dw1000_model_t *radio, float x, float y, float z);
+void sim_medium_set_tx_hook(sim_medium_t *medium, sim_medium_tx_hook_t hook, void *arg);
+
+float sim_medium_distance(sim_medium_t *medium, dw1000_model_t *a, dw1000_model_t *b);
+// mean rx power at distance d_m on channel chan
+float sim_medium_rx_power_dbm(sim_medium_t *medium, uint8_t chan, float d_m);
+
+const sim_medium_stats_t *sim_medium_stats(sim_medium_t *medium);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_MEDIUM_H__
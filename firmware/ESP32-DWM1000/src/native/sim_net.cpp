@@ -0,0 +1,706 @@
+#include <Arduino.h>
+
+#include <math.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "uwb.h"
+#include "uwb_cmd.h"
+#include "uwb_result.h"
+#include "uwb_session.h"
+#include "uwb_tdma.h"
+#include "uwb_tdoa.h"
+#include "system_config.h"
+#include "safe_print.h"
+#include "uwb_log.h"
+
+#include "hal_native.h"
+#include "dw1000_model.h"
+#include "sim_medium.h"
+#include "sim_net.h"
+
+// multi node benchmark, see sim_net.h
+// the globals of every node are swapped by the HAL, all state of this file is on the heap behind
+// a __thread pointer so the master task and the scheduler see the same
+
+#define SIM_NET_GROUP_ID 0x1234
+#define SIM_NET_MAX_ANCHORS 8
+#define SIM_NET_MAX_TAGS 250
+
+// room with the anchors on the walls, tags anywhere inside at hand height
+#define SIM_NET_ROOM_X_M 20.0f
+#define SIM_NET_ROOM_Y_M 14.0f
+#define SIM_NET_TAG_Z_M 1.0f
+// clock of every node, uniform in +-SIM_NET_MAX_PPB
+#define SIM_NET_MAX_PPB 10000
+#define SIM_NET_SHADOWING_DB 2.0f
+
+// master waits this long after its own start before the first command, the others boot meanwhile
+#define SIM_NET_BOOT_MS 100
+// results of a command stop coming in, restarted by every result
+#define SIM_NET_RESULT_TIMEOUT_MS 100
+// result ring poll period of the master, and of the other nodes
+#define SIM_NET_POLL_US 200
+#define SIM_NET_DRAIN_MS 10
+// tail after the window for results still on the way
+#define SIM_NET_TAIL_MS 300
+// TDoA needs two syncs before anchors report, TDMA a beacon before tags run
+#define SIM_NET_WARMUP_MS 500
+#define SIM_NET_DEFAULT_DURATION_MS 3000
+// anchors that must have a blink for a position fix
+#define SIM_NET_TDOA_FIX_ANCHORS 4
+
+#define MASK40 0xFFFFFFFFFFULL
+
+typedef enum {
+    SIM_NET_MODE_SINGLE = 0,  // uwb_cmd_range_trigger per tag / anchor pair
+    SIM_NET_MODE_SS,          // uwb_cmd_range_trigger_ss per pair
+    SIM_NET_MODE_MULTI,       // UWB_CMD_RANGE_TRIGGER_MULTI, tag with all anchors
+    SIM_NET_MODE_BCAST,       // UWB_CMD_RANGE_TRIGGER_BCAST
+    SIM_NET_MODE_TDMA,        // uwb_tdma_start, master anchor sends the beacons
+    SIM_NET_MODE_TDOA,        // uwb_tdoa_start, master anchor is the reference
+} sim_net_mode_t;
+
+typedef struct {
+    const char *name;
+    uint8_t mode;        // sim_net_mode_t
+    uint8_t phy;         // uwb_phy profile index
+    uint8_t anchors;
+    uint16_t tags;
+    float frame_loss;
+    uint16_t blink_ms;   // TDoA, 0 for the sync period
+    float min_success_pct;  // the scenario fails below this, 0 only needs one result
+} sim_net_scenario_t;
+
+static const sim_net_scenario_t sim_net_scenarios[] = {
+    {"multi_850k",       SIM_NET_MODE_MULTI,  1, 8, 50, 0.0f,  0, 0.0f},
+    {"bcast_850k",       SIM_NET_MODE_BCAST,  1, 8, 50, 0.0f,  0, 0.0f},
+    {"bcast_6m8",        SIM_NET_MODE_BCAST,  2, 8, 50, 0.0f,  0, 0.0f},
+    {"bcast_110k",       SIM_NET_MODE_BCAST,  0, 8, 50, 0.0f,  0, 0.0f},
+    {"bcast_850k_loss5", SIM_NET_MODE_BCAST,  1, 8, 50, 0.05f, 0, 0.0f},
+    {"single_850k",      SIM_NET_MODE_SINGLE, 1, 8, 50, 0.0f,  0, 0.0f},
+    {"ss_850k",          SIM_NET_MODE_SS,     1, 8, 50, 0.0f,  0, 0.0f},
+    // the beacon has room for UWB_TDMA_MAX_TAGS tags
+    {"tdma_850k",        SIM_NET_MODE_TDMA,   1, 8, UWB_TDMA_MAX_TAGS, 0.0f, 0, 0.0f},
+    // TDoA blinks go in their own slots after the reports, nothing may be lost
+    {"tdoa_850k",        SIM_NET_MODE_TDOA,   1, 8, 50, 0.0f,  0, 90.0f},
+    // one blink per tag and second, a fifth of the load of tdoa_850k
+    {"tdoa_850k_light",  SIM_NET_MODE_TDOA,   1, 8, 50, 0.0f,  1000, 90.0f},
+    // hundreds of tags, ids with a high byte are anchors so 255 is the most
+    {"tdoa_850k_250",    SIM_NET_MODE_TDOA,   1, 8, 250, 0.0f, 1000, 90.0f},
+};
+
+typedef struct {
+    hal_node_t *node;
+    dw1000_model_t *radio;
+    uint16_t id;
+
+    // firmware counters, read in the node context at the end
+    uint32_t cmd_timeouts;
+    uint32_t cmd_rejected;
+    uint32_t rx_recovered;
+    uint32_t rx_overruns;
+    uint32_t session_expired;
+    uint32_t session_overflow;
+    uint32_t result_overflow;
+    uint32_t log_drop;
+    uint32_t tdoa_entry_drop;
+    uint32_t tdoa_report_fail;
+} sim_net_node_t;
+
+// one TDoA blink on its way to the anchors
+typedef struct {
+    hal_time_t tx;
+    bool counted;        // sent in the window
+    bool fixed;
+    uint8_t anchor_mask;
+    uint64_t ts[SIM_NET_MAX_ANCHORS];
+} sim_net_blink_t;
+
+typedef struct {
+    const sim_net_scenario_t *sc;
+    sim_medium_t *medium;
+    std::vector<sim_net_node_t> nodes;   // anchors first, then the tags
+    uint16_t anchor_ids[SIM_NET_MAX_ANCHORS];
+    uint16_t tag_ids[SIM_NET_MAX_TAGS];
+
+    bool done;
+    hal_time_t window_len;
+    hal_time_t window_start;
+    hal_time_t window_end;
+
+    // triggered modes, the one command in flight
+    uint16_t cmd_tag;
+    uint8_t cmd_expect;  // anchor index mask
+    uint8_t cmd_got;
+    hal_time_t cmd_submit;
+
+    // TDMA, last poll of every tag / anchor pair, 0 once matched
+    hal_time_t poll_tx[SIM_NET_MAX_TAGS][SIM_NET_MAX_ANCHORS];
+    bool superframe_counted;  // beacon sent in the window
+    // TDoA
+    std::unordered_map<uint32_t, sim_net_blink_t> blinks;
+    uint32_t fixes;
+    uint32_t blinks_sent;
+
+    uint32_t requested;
+    uint32_t received;
+    uint32_t unmatched;   // late, of an earlier command or from outside the window
+    uint32_t invalid;     // distance 0
+    uint32_t rejected;    // command queue full or start refused
+    uint32_t beacons;
+    std::vector<double> latency_ms;
+    std::vector<double> err_cm;
+} sim_net_t;
+
+static __thread sim_net_t *net = NULL;
+
+
+// ---------------- helpers ----------------
+
+static uint32_t net_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float net_uniform(uint32_t *state) {
+    return (net_random(state) + 0.5f) / 4294967296.0f;
+}
+
+static int net_anchor_index(uint16_t id) {
+    for (int i = 0; i < net->sc->anchors; i++) {
+        if (net->anchor_ids[i] == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int net_tag_index(uint16_t id) {
+    if (id == 0 || id > net->sc->tags || (id & 0xFF00)) {
+        return -1;
+    }
+    return id - 1;
+}
+
+static sim_net_node_t *net_anchor(int i) {
+    return &net->nodes[i];
+}
+
+static sim_net_node_t *net_tag(int i) {
+    return &net->nodes[net->sc->anchors + i];
+}
+
+static bool net_in_window(hal_time_t t) {
+    return t >= net->window_start && t < net->window_end;
+}
+
+static double net_percentile(std::vector<double> &v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t i = (size_t)ceil(p * v.size());
+    return v[i > 0 ? i - 1 : 0];
+}
+
+static double net_ms(hal_time_t dt) {
+    return HAL_DTU_TO_NS(dt) / 1e6;
+}
+
+
+// ---------------- observer ----------------
+
+// every frame on air, marks the start of the exchanges the firmware runs by itself
+static void net_on_frame(dw1000_model_t *sender, const dw1000_air_frame_t *frame, void *arg) {
+    const uwb_common_header_t *hdr = (const uwb_common_header_t *)frame->data;
+    if (frame->len < sizeof(uwb_common_header_t) + 2 || hdr->group_id != SIM_NET_GROUP_ID) {
+        return;
+    }
+    hal_time_t now = hal_now();
+    int tag = net_tag_index(hdr->src_id);
+
+    switch (hdr->msg_type) {
+        case UWB_MSG_TYPE_TDMA_BEACON:
+            net->superframe_counted = net_in_window(now);
+            if (net->superframe_counted) {
+                net->beacons++;
+                net->requested += net->sc->tags * net->sc->anchors;
+            }
+            break;
+        case UWB_MSG_TYPE_RANGE_POLL: {
+            int anchor = net_anchor_index(hdr->dest_id);
+            if (net->sc->mode == SIM_NET_MODE_TDMA && tag >= 0 && anchor >= 0 && net->superframe_counted) {
+                net->poll_tx[tag][anchor] = now;
+            }
+            break;
+        }
+        case UWB_MSG_TYPE_TDOA_BLINK: {
+            if (tag < 0) {
+                break;
+            }
+            const uwb_pkt_tdoa_blink_t *pkt = (const uwb_pkt_tdoa_blink_t *)frame->data;
+            sim_net_blink_t &b = net->blinks[((uint32_t)tag << 8) | pkt->blink_seq];
+            b = sim_net_blink_t();
+            b.tx = now;
+            b.counted = net_in_window(now);
+            if (b.counted) {
+                net->blinks_sent++;
+                net->requested += net->sc->anchors;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+
+// ---------------- result matching, master context ----------------
+
+static void net_range_result(const uwb_result_t *r, hal_time_t now) {
+    uint16_t a = r->range.node_a_id;
+    uint16_t b = r->range.node_b_id;
+    int tag = net_tag_index(a) >= 0 ? net_tag_index(a) : net_tag_index(b);
+    int anchor = net_anchor_index(a) >= 0 ? net_anchor_index(a) : net_anchor_index(b);
+    if (tag < 0 || anchor < 0) {
+        net->unmatched++;
+        return;
+    }
+
+    hal_time_t start = 0;
+    if (net->sc->mode == SIM_NET_MODE_TDMA) {
+        start = net->poll_tx[tag][anchor];
+        net->poll_tx[tag][anchor] = 0;
+    } else if (net->tag_ids[tag] == net->cmd_tag && (net->cmd_expect & ~net->cmd_got & (1 << anchor))) {
+        start = net->cmd_submit;
+        net->cmd_got |= 1 << anchor;
+    }
+    if (start == 0) {
+        net->unmatched++;
+        return;
+    }
+
+    net->received++;
+    net->latency_ms.push_back(net_ms(now - start));
+    if (r->range.distance_mm <= 0) {
+        net->invalid++;
+        return;
+    }
+    float truth = sim_medium_distance(net->medium, net_tag(tag)->radio, net_anchor(anchor)->radio);
+    net->err_cm.push_back((r->range.distance_mm / 1000.0 - truth) * 100.0);
+}
+
+static void net_tdoa_result(const uwb_result_t *r, hal_time_t now) {
+    int tag = net_tag_index(r->tdoa.tag_id);
+    int anchor = net_anchor_index(r->tdoa.anchor_id);
+    auto it = net->blinks.find(((uint32_t)tag << 8) | r->tdoa.blink_seq);
+    if (tag < 0 || anchor < 0 || it == net->blinks.end() || (it->second.anchor_mask & (1 << anchor))) {
+        net->unmatched++;
+        return;
+    }
+    sim_net_blink_t &b = it->second;
+    b.anchor_mask |= 1 << anchor;
+    b.ts[anchor] = r->tdoa.ts;
+    if (!b.counted) {
+        return;
+    }
+    net->received++;
+
+    if (!b.fixed && __builtin_popcount(b.anchor_mask) >= SIM_NET_TDOA_FIX_ANCHORS) {
+        b.fixed = true;
+        net->fixes++;
+        net->latency_ms.push_back(net_ms(now - b.tx));
+    }
+
+    // time difference to the reference anchor (index 0) against the geometry
+    // an anchor timestamp is early by the sync flight time from the reference
+    int other = (anchor == 0) ? -1 : anchor;
+    if (anchor == 0) {
+        for (int i = 1; i < net->sc->anchors; i++) {
+            if (b.anchor_mask & (1 << i)) {
+                other = i;
+                break;
+            }
+        }
+    }
+    if (other < 0 || !(b.anchor_mask & 1)) {
+        return;
+    }
+    if (anchor == 0 && __builtin_popcount(b.anchor_mask) > 2) {
+        return; // pairs with the reference counted when they came in
+    }
+    dw1000_model_t *ref = net_anchor(0)->radio;
+    dw1000_model_t *tag_radio = net_tag(tag)->radio;
+    dw1000_model_t *other_radio = net_anchor(other)->radio;
+    int64_t dts = (int64_t)(((b.ts[other] - b.ts[0]) & MASK40) << 24) >> 24;
+    double measured_m = dts * SIM_MEDIUM_SPEED_OF_LIGHT / (499.2e6 * 128.0) + sim_medium_distance(net->medium, ref, other_radio);
+    double truth_m = sim_medium_distance(net->medium, tag_radio, other_radio) - sim_medium_distance(net->medium, tag_radio, ref);
+    net->err_cm.push_back((measured_m - truth_m) * 100.0);
+}
+
+static void net_poll_results() {
+    uwb_result_t results[8];
+    uint32_t n;
+    while ((n = uwb_result_pop_batch(results, 8)) > 0) {
+        hal_time_t now = hal_now();
+        for (uint32_t i = 0; i < n; i++) {
+            switch (results[i].type) {
+                case UWB_RESULT_RANGE_FINAL:
+                case UWB_RESULT_RANGE_REPORT:
+                    net_range_result(&results[i], now);
+                    break;
+                case UWB_RESULT_TDOA:
+                    net_tdoa_result(&results[i], now);
+                    break;
+                default:
+                    net->unmatched++;
+                    break;
+            }
+        }
+    }
+}
+
+// poll the results for ms, or until the command in flight got all of them
+static void net_wait(uint32_t ms, bool until_cmd_done) {
+    hal_time_t end = hal_now() + HAL_MS_TO_DTU(ms);
+    while (hal_now() < end) {
+        uint8_t got = net->cmd_got;
+        net_poll_results();
+        if (until_cmd_done) {
+            if (net->cmd_got == net->cmd_expect) {
+                return;
+            }
+            if (net->cmd_got != got) {
+                end = hal_now() + HAL_MS_TO_DTU(ms);
+            }
+        }
+        delayMicroseconds(SIM_NET_POLL_US);
+    }
+}
+
+
+// ---------------- driver, master anchor ----------------
+
+static bool net_submit(uint32_t k) {
+    const sim_net_scenario_t *sc = net->sc;
+    uint16_t tag = net->tag_ids[k % sc->tags];
+    // pairs go through all tags with one anchor, then the next anchor
+    int anchor = (k / sc->tags) % sc->anchors;
+
+    net->cmd_tag = tag;
+    net->cmd_got = 0;
+    net->cmd_submit = hal_now();
+    switch (sc->mode) {
+        case SIM_NET_MODE_SINGLE:
+            net->cmd_expect = 1 << anchor;
+            return uwb_cmd_range_trigger(tag, net->anchor_ids[anchor], UWB_CMD_PRIO_NORMAL);
+        case SIM_NET_MODE_SS:
+            net->cmd_expect = 1 << anchor;
+            return uwb_cmd_range_trigger_ss(tag, net->anchor_ids[anchor], UWB_CMD_PRIO_NORMAL);
+        case SIM_NET_MODE_MULTI:
+        case SIM_NET_MODE_BCAST:
+            net->cmd_expect = (uint8_t)((1 << sc->anchors) - 1);
+            return uwb_cmd_range_trigger_list(sc->mode == SIM_NET_MODE_MULTI ? UWB_CMD_RANGE_TRIGGER_MULTI : UWB_CMD_RANGE_TRIGGER_BCAST,
+                                              tag, net->anchor_ids, sc->anchors, UWB_CMD_PRIO_NORMAL);
+    }
+    return false;
+}
+
+static void net_drive_triggered() {
+    for (uint32_t k = 0; hal_now() < net->window_end; k++) {
+        if (!net_submit(k)) {
+            net->rejected++;
+            net->cmd_expect = 0;
+            net_wait(1, false);
+            continue;
+        }
+        net->requested += __builtin_popcount(net->cmd_expect);
+        net_wait(SIM_NET_RESULT_TIMEOUT_MS, true);
+    }
+    // results of the last command
+    net_wait(SIM_NET_TAIL_MS, true);
+    net->cmd_expect = 0;
+}
+
+static void net_drive_tdma() {
+    uint32_t slot_ms = (uwb_tdma_min_slot_us(net->sc->anchors) + 999) / 1000 + 1;
+    if (!uwb_tdma_start(slot_ms, net->tag_ids, net->sc->tags, net->anchor_ids, net->sc->anchors)) {
+        net->rejected++;
+        return;
+    }
+    net_wait(net_ms(net->window_end - hal_now()), false);
+    uwb_tdma_stop();
+    net_wait(SIM_NET_TAIL_MS, false);
+}
+
+static void net_drive_tdoa() {
+    uint32_t sync_ms = UWB_TDOA_DEFAULT_SYNC_MS;
+    uint32_t blink_ms = net->sc->blink_ms ? net->sc->blink_ms : sync_ms;
+    if (!uwb_tdoa_start(sync_ms, blink_ms, net->sc->anchors, net->sc->tags)) {
+        net->rejected++;
+        return;
+    }
+    net_wait(net_ms(net->window_end - hal_now()), false);
+    // one more sync carries the reports of the last period
+    net_wait(sync_ms + SIM_NET_TAIL_MS, false);
+    uwb_tdoa_stop();
+}
+
+static void net_app(void *arg) {
+    Serial.begin(115200);
+    system_config_init();
+    safe_print_init();
+    uwb_log_init();
+    uwb_task_init();
+
+    if (arg == NULL) {
+        // the other nodes only empty their result ring, like the serial report of main.cpp
+        uwb_result_t results[8];
+        while (true) {
+            while (uwb_result_pop_batch(results, 8) > 0) {
+            }
+            vTaskDelay(pdMS_TO_TICKS(SIM_NET_DRAIN_MS));
+        }
+    }
+
+    const sim_net_scenario_t *sc = (const sim_net_scenario_t *)arg;
+    vTaskDelay(pdMS_TO_TICKS(SIM_NET_BOOT_MS));
+    hal_time_t warmup = (sc->mode == SIM_NET_MODE_TDMA || sc->mode == SIM_NET_MODE_TDOA) ? HAL_MS_TO_DTU(SIM_NET_WARMUP_MS) : 0;
+    net->window_start = hal_now() + warmup;
+    net->window_end = net->window_start + net->window_len;
+
+    switch (sc->mode) {
+        case SIM_NET_MODE_TDMA: net_drive_tdma(); break;
+        case SIM_NET_MODE_TDOA: net_drive_tdoa(); break;
+        default: net_drive_triggered(); break;
+    }
+
+    net->done = true;
+    vTaskDelete(NULL);
+}
+
+static void net_collect_cb(void *arg) {
+    sim_net_node_t *n = (sim_net_node_t *)arg;
+    n->cmd_timeouts = uwb_cmd_timeout_count();
+    n->cmd_rejected = uwb_cmd_rejected_count();
+    n->rx_recovered = uwb_rx_recovered_count();
+    n->rx_overruns = uwb_rx_overrun_count();
+    n->session_expired = uwb_session_expired_count();
+    n->session_overflow = uwb_session_overflow_count();
+    n->result_overflow = uwb_result_overflow_count();
+    n->log_drop = uwb_log_drop_count();
+    n->tdoa_entry_drop = uwb_tdoa_entry_drop_count();
+    n->tdoa_report_fail = uwb_tdoa_report_fail_count();
+}
+
+
+// ---------------- scenario ----------------
+
+static void net_place(uint32_t *rng) {
+    const sim_net_scenario_t *sc = net->sc;
+    // corners first, then the middle of the walls, every other anchor high on the wall
+    static const float anchor_xy[SIM_NET_MAX_ANCHORS][2] = {
+        {0, 0}, {1, 1}, {1, 0}, {0, 1}, {0.5f, 0}, {1, 0.5f}, {0.5f, 1}, {0, 0.5f},
+    };
+    for (int i = 0; i < sc->anchors; i++) {
+        float z = (i % 2) ? 0.8f : 2.5f;
+        sim_medium_add(net->medium, net_anchor(i)->radio, anchor_xy[i][0] * SIM_NET_ROOM_X_M, anchor_xy[i][1] * SIM_NET_ROOM_Y_M, z);
+    }
+    for (int i = 0; i < sc->tags; i++) {
+        sim_medium_add(net->medium, net_tag(i)->radio, net_uniform(rng) * SIM_NET_ROOM_X_M, net_uniform(rng) * SIM_NET_ROOM_Y_M, SIM_NET_TAG_Z_M);
+    }
+}
+
+static sim_net_node_t net_node(uint16_t id, uint8_t phy, uint32_t *rng) {
+    char name[16];
+    snprintf(name, sizeof(name), "%04x", id);
+    sim_net_node_t n = {};
+    n.id = id;
+    n.node = hal_node_create(name, net_random(rng));
+    hal_prefs_set(n.node, "syscfg", "uwb_gid", SIM_NET_GROUP_ID);
+    hal_prefs_set(n.node, "syscfg", "uwb_nid", id);
+    hal_prefs_set(n.node, "syscfg", "uwb_phy", phy);
+
+    n.radio = dw1000_model_create(n.node);
+    int32_t ppb = (int32_t)(net_random(rng) % (2 * SIM_NET_MAX_PPB + 1)) - SIM_NET_MAX_PPB;
+    uint64_t offset = (((uint64_t)net_random(rng) << 32) | net_random(rng)) & MASK40;
+    dw1000_model_set_clock(n.radio, offset, ppb);
+    hal_node_set_radio(n.node, n.radio);
+    return n;
+}
+
+// runs in a child process, the HAL has no teardown
+static int net_run(const sim_net_scenario_t *sc, uint32_t duration_ms, uint32_t seed, bool verbose) {
+    net = new sim_net_t();
+    net->sc = sc;
+    net->window_len = HAL_MS_TO_DTU(duration_ms);
+    uint32_t rng = seed ? seed : 1;
+
+    hal_init();
+    hal_node_images_enable();
+
+    sim_medium_config_t config = {};
+    config.path_loss_exp = 2.0f;
+    config.shadowing_db = SIM_NET_SHADOWING_DB;
+    config.frame_loss = sc->frame_loss;
+    config.seed = net_random(&rng);
+    net->medium = sim_medium_create(&config);
+    sim_medium_set_tx_hook(net->medium, net_on_frame, NULL);
+
+    for (int i = 0; i < sc->anchors; i++) {
+        net->anchor_ids[i] = 0xFF00 + i;
+        net->nodes.push_back(net_node(net->anchor_ids[i], sc->phy, &rng));
+    }
+    for (int i = 0; i < sc->tags; i++) {
+        net->tag_ids[i] = 0x0001 + i;
+        net->nodes.push_back(net_node(net->tag_ids[i], sc->phy, &rng));
+    }
+    net_place(&rng);
+    hal_serial_set_echo(net_anchor(0)->node, verbose);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < net->nodes.size(); i++) {
+        hal_node_start(net->nodes[i].node, net_app, i == 0 ? (void *)sc : NULL, 1);
+    }
+    hal_time_t limit = HAL_MS_TO_DTU(SIM_NET_BOOT_MS + SIM_NET_WARMUP_MS + duration_ms + 5000);
+    while (!net->done && hal_now() < limit) {
+        if (!hal_run_until(hal_now() + HAL_MS_TO_DTU(100))) {
+            break;
+        }
+    }
+    for (sim_net_node_t &n : net->nodes) {
+        hal_event_at(n.node, hal_now(), net_collect_cb, &n);
+    }
+    hal_run_until(hal_now());
+    auto t1 = std::chrono::steady_clock::now();
+
+    dw1000_model_stats_t radio = {};
+    sim_net_node_t fw = {};
+    for (sim_net_node_t &n : net->nodes) {
+        const dw1000_model_stats_t *st = dw1000_model_stats(n.radio);
+        radio.tx_late += st->tx_late;
+        radio.rx_crc_errors += st->rx_crc_errors;
+        radio.rx_collisions += st->rx_collisions;
+        radio.rx_missed += st->rx_missed;
+        radio.rx_timeouts += st->rx_timeouts;
+        radio.rx_overruns += st->rx_overruns;
+        fw.cmd_timeouts += n.cmd_timeouts;
+        fw.cmd_rejected += n.cmd_rejected;
+        fw.rx_recovered += n.rx_recovered;
+        fw.rx_overruns += n.rx_overruns;
+        fw.session_expired += n.session_expired;
+        fw.session_overflow += n.session_overflow;
+        fw.result_overflow += n.result_overflow;
+        fw.log_drop += n.log_drop;
+        fw.tdoa_entry_drop += n.tdoa_entry_drop;
+        fw.tdoa_report_fail += n.tdoa_report_fail;
+    }
+    const sim_medium_stats_t *air = sim_medium_stats(net->medium);
+
+    double window_s = net_ms(net->window_end - net->window_start) / 1000.0;
+    std::sort(net->latency_ms.begin(), net->latency_ms.end());
+    std::vector<double> abs_err;
+    double sum_abs = 0;
+    for (double e : net->err_cm) {
+        abs_err.push_back(fabs(e));
+        sum_abs += fabs(e);
+    }
+    std::sort(abs_err.begin(), abs_err.end());
+
+    printf("{\"event\":\"sim_net\",\"scenario\":\"%s\",\"phy\":\"%s\",\"anchors\":%u,\"tags\":%u,\"seed\":%u,\"window_s\":%.3f,"
+           "\"requested\":%u,\"received\":%u,\"success_pct\":%.1f,\"ranges_per_s\":%.1f",
+        sc->name, uwb_phy_profiles[sc->phy].name, (unsigned)sc->anchors, (unsigned)sc->tags, (unsigned)seed, window_s,
+        (unsigned)net->requested, (unsigned)net->received, net->requested ? 100.0 * net->received / net->requested : 0.0,
+        window_s > 0 ? net->received / window_s : 0.0);
+    if (sc->mode == SIM_NET_MODE_TDOA) {
+        printf(",\"blinks\":%u,\"fixes\":%u,\"fixes_per_s\":%.1f", (unsigned)net->blinks_sent, (unsigned)net->fixes, window_s > 0 ? net->fixes / window_s : 0.0);
+    }
+    if (sc->mode == SIM_NET_MODE_TDMA) {
+        printf(",\"beacons\":%u", (unsigned)net->beacons);
+    }
+    printf(",\"latency_ms\":{\"n\":%u,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"max\":%.2f}",
+        (unsigned)net->latency_ms.size(), net_percentile(net->latency_ms, 0.5), net_percentile(net->latency_ms, 0.9),
+        net_percentile(net->latency_ms, 0.99), net->latency_ms.empty() ? 0.0 : net->latency_ms.back());
+    printf(",\"err_cm\":{\"mean_abs\":%.1f,\"p95_abs\":%.1f}", abs_err.empty() ? 0.0 : sum_abs / abs_err.size(), net_percentile(abs_err, 0.95));
+    printf(",\"airtime_pct\":%.1f", hal_now() ? 100.0 * air->airtime / hal_now() : 0.0);
+    printf(",\"fail\":{\"missing\":%u,\"unmatched\":%u,\"invalid\":%u,\"rejected\":%u,"
+           "\"collisions\":%u,\"crc_errors\":%u,\"rx_missed\":%u,\"rx_timeouts\":%u,\"rx_overruns\":%u,\"tx_late\":%u,"
+           "\"air_lost\":%u,\"out_of_range\":%u,"
+           "\"cmd_timeouts\":%u,\"cmd_rejected\":%u,\"session_expired\":%u,\"session_overflow\":%u,\"result_overflow\":%u,"
+           "\"fw_rx_overruns\":%u,\"fw_rx_recovered\":%u,\"log_drop\":%u,\"tdoa_entry_drop\":%u,\"tdoa_report_fail\":%u}",
+        (unsigned)(net->requested > net->received ? net->requested - net->received : 0), (unsigned)net->unmatched, (unsigned)net->invalid, (unsigned)net->rejected,
+        (unsigned)radio.rx_collisions, (unsigned)radio.rx_crc_errors, (unsigned)radio.rx_missed, (unsigned)radio.rx_timeouts, (unsigned)radio.rx_overruns, (unsigned)radio.tx_late,
+        (unsigned)air->lost, (unsigned)air->out_of_range,
+        (unsigned)fw.cmd_timeouts, (unsigned)fw.cmd_rejected, (unsigned)fw.session_expired, (unsigned)fw.session_overflow, (unsigned)fw.result_overflow,
+        (unsigned)fw.rx_overruns, (unsigned)fw.rx_recovered, (unsigned)fw.log_drop,
+        (unsigned)fw.tdoa_entry_drop, (unsigned)fw.tdoa_report_fail);
+    printf(",\"sim_s\":%.3f,\"wall_s\":%.2f,\"events\":%llu,\"image_swaps\":%llu}\n",
+        net_ms(hal_now()) / 1000.0, std::chrono::duration<double>(t1 - t0).count(),
+        (unsigned long long)hal_event_count(), (unsigned long long)hal_image_swap_count());
+    fflush(stdout);
+
+    if (net->received == 0 || (net->requested && 100.0 * net->received / net->requested < sc->min_success_pct)) {
+        return 1;
+    }
+    return 0;
+}
+
+
+int sim_net_main(int argc, char **argv) {
+    const char *which = "all";
+    uint32_t duration_ms = SIM_NET_DEFAULT_DURATION_MS;
+    uint32_t seed = 1;
+    bool verbose = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_ms = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            which = argv[i];
+        }
+    }
+
+    if (strcmp(which, "list") == 0) {
+        for (const sim_net_scenario_t &sc : sim_net_scenarios) {
+            printf("%s\n", sc.name);
+        }
+        return 0;
+    }
+
+    int failed = 0;
+    int ran = 0;
+    for (const sim_net_scenario_t &sc : sim_net_scenarios) {
+        if (strcmp(which, "all") != 0 && strcmp(which, sc.name) != 0) {
+            continue;
+        }
+        ran++;
+        // every scenario in a fresh process, nodes and globals start over
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(net_run(&sc, duration_ms, seed, verbose));
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("{\"event\":\"sim_net_failed\",\"scenario\":\"%s\"}\n", sc.name);
+            failed++;
+        }
+    }
+    if (ran == 0) {
+        printf("{\"event\":\"sim_net_failed\",\"scenario\":\"%s\",\"error\":\"unknown\"}\n", which);
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
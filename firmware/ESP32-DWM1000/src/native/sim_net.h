@@ -0,0 +1,21 @@
+#ifndef __SIM_NET_H__
+#define __SIM_NET_H__
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// multi node benchmark of the native build, `program net [<scenario>|list] [--duration <ms>] [--seed <n>]`
+// anchors and tags all run the firmware on their own DW1000 model, joined by sim_medium.h
+// the first anchor plays the one on the host serial port and drives the scenario through uwb_cmd.h
+// prints one {"event":"sim_net",...} line per scenario, exit code 1 if a scenario got no result at all
+int sim_net_main(int argc, char **argv);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_NET_H__
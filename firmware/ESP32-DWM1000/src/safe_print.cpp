@@ -1,75 +1,125 @@
-
 #include "safe_print.h"
 
 #include <Arduino.h>
 
 
-QueueHandle_t safe_print_queue = NULL;
+static uint8_t safe_print_ring[SAFE_PRINT_RING_SIZE];
+
+// free running indexes, head moved by producers under the lock, tail only moved by the writer task
+static volatile uint32_t safe_print_head = 0;
+static volatile uint32_t safe_print_tail = 0;
+
+static uint32_t safe_print_dropped = 0;
+static uint32_t safe_print_dropped_bytes = 0;
+
+// producers can be on both cores and in ISR
+static portMUX_TYPE safe_print_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t safe_print_task_handle = NULL;
 
 void safe_print_init(){
-    if (safe_print_queue != NULL) {
+    if (safe_print_task_handle != NULL) {
         Serial.println("[safe_print_init] Already initialized");
         return;
     }
 
-    safe_print_queue = xQueueCreate(SAFE_PRINT_QUEUE_SIZE, sizeof(char));
-    if (safe_print_queue == NULL) {
-        // Handle queue creation failure
-        Serial.println("[safe_print_init] Failed to create safe print queue");
-    } else {
-        // Create the safe print task
-        xTaskCreatePinnedToCore(
-            safe_print_task,       // Task function
-            "SafePrintTask",       // Name of the task
-            4096,                  // Stack size in words
-            NULL,                  // Task input parameter
-            1,                     // Priority of the task
-            NULL,                  // Task handle
-            1                      // Core to run the task on
-        );
+    // Create the safe print task
+    BaseType_t ok = xTaskCreatePinnedToCore(
+        safe_print_task,       // Task function
+        "SafePrintTask",       // Name of the task
+        4096,                  // Stack size in words
+        NULL,                  // Task input parameter
+        1,                     // Priority of the task
+        &safe_print_task_handle, // Task handle
+        1                      // Core to run the task on
+    );
+    if (ok != pdPASS) {
+        safe_print_task_handle = NULL;
+        Serial.println("[safe_print_init] Failed to create safe print task");
     }
 }
 
 
 void safe_print_task(void *pvParameters){
-    char c;
     while(1) {
-        if (xQueueReceive(safe_print_queue, &c, portMAX_DELAY) == pdTRUE) {
-            // Process the received character
-            Serial.write(c);
+        // woken by producers, timeout only as a fallback
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+        uint32_t tail = safe_print_tail;
+        uint32_t head = __atomic_load_n(&safe_print_head, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            // write the contiguous span up to head or up to the end of ring
+            uint32_t offset = tail & (SAFE_PRINT_RING_SIZE - 1);
+            uint32_t len = head - tail;
+            if (len > SAFE_PRINT_RING_SIZE - offset) {
+                len = SAFE_PRINT_RING_SIZE - offset;
+            }
+            Serial.write(&safe_print_ring[offset], len);
+
+            tail += len;
+            __atomic_store_n(&safe_print_tail, tail, __ATOMIC_RELEASE);
+            head = __atomic_load_n(&safe_print_head, __ATOMIC_ACQUIRE);
         }
     }
 }
 
 void safe_printf(const char *fmt, ...){
-    if (safe_print_queue == NULL) {
+    if (safe_print_task_handle == NULL) {
         return;
     }
-    static char buffer[SAFE_PRINT_BUFFER_SIZE];
+
+    // format on the caller stack, safe for concurrent callers
+    char buffer[SAFE_PRINT_BUFFER_SIZE];
     va_list args;
     va_start(args, fmt);
     int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
-    len = (len < SAFE_PRINT_BUFFER_SIZE) ? len : SAFE_PRINT_BUFFER_SIZE;
+    if (len <= 0) {
+        return;
+    }
+    len = (len < SAFE_PRINT_BUFFER_SIZE) ? len : SAFE_PRINT_BUFFER_SIZE - 1;
 
-    if (len){
-        if (xPortInIsrContext()){
-            // In ISR context, use FromISR version
-            BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-            for (int i = 0; i < len; i++){
-                xQueueSendFromISR(safe_print_queue, &buffer[i], &xHigherPriorityTaskWoken);
-            }
-            if (xHigherPriorityTaskWoken) {
-                portYIELD_FROM_ISR();
-            }
+    // reserve and copy under a short spinlock, message stays in one piece
+    bool dropped = false;
+    portENTER_CRITICAL_SAFE(&safe_print_mux);
+    uint32_t head = safe_print_head;
+    uint32_t used = head - __atomic_load_n(&safe_print_tail, __ATOMIC_ACQUIRE);
+    if (SAFE_PRINT_RING_SIZE - used < (uint32_t)len) {
+        safe_print_dropped++;
+        safe_print_dropped_bytes += len;
+        dropped = true;
+    } else {
+        uint32_t offset = head & (SAFE_PRINT_RING_SIZE - 1);
+        uint32_t first = SAFE_PRINT_RING_SIZE - offset;
+        if (first > (uint32_t)len) {
+            first = len;
+        }
+        memcpy(&safe_print_ring[offset], buffer, first);
+        memcpy(&safe_print_ring[0], buffer + first, len - first);
+        __atomic_store_n(&safe_print_head, head + len, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL_SAFE(&safe_print_mux);
 
-        } else {
-            // Normal context
-            for (int i = 0; i < len; i++){
-                xQueueSend(safe_print_queue, &buffer[i], portMAX_DELAY);
-            }
+    if (dropped) {
+        return;
+    }
+
+    // wake the writer task
+    if (xPortInIsrContext()){
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(safe_print_task_handle, &xHigherPriorityTaskWoken);
+        if (xHigherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
         }
+    } else {
+        xTaskNotifyGive(safe_print_task_handle);
     }
 }
 
+uint32_t safe_print_drop_count(){
+    return safe_print_dropped;
+}
+
+uint32_t safe_print_drop_bytes(){
+    return safe_print_dropped_bytes;
+}
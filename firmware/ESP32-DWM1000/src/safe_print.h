@@ -2,7 +2,7 @@
 #define __SAFE_PRINT_H__
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
 
 
 #ifdef __cplusplus
@@ -10,21 +10,24 @@ extern "C" {
 #endif
 
 
-#define SAFE_PRINT_QUEUE_SIZE 1024
+// byte ring shared by all producers, must be power of 2
+#define SAFE_PRINT_RING_SIZE 4096
+// max length of one message
 #define SAFE_PRINT_BUFFER_SIZE 128
 
-extern QueueHandle_t safe_print_queue;
-
 void safe_print_init();
 
 void safe_print_task(void *pvParameters);   
 
+// never blocks, message is dropped as a whole when the ring is full
 void safe_printf(const char *fmt, ...);
 
+uint32_t safe_print_drop_count();
+uint32_t safe_print_drop_bytes();
 
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif // __SAFE_PRINT_H__
\ No newline at end of file
+#endif // __SAFE_PRINT_H__
@@ -0,0 +1,183 @@
+#include "serial_cmd.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+typedef struct {
+    uint32_t req_id;        // 0 = free
+    uint8_t kind;           // SERIAL_CMD_RESULT_*
+    uint16_t node_a_id;
+    uint16_t node_b_id;
+    unsigned long start_ms;
+} serial_cmd_pending_t;
+
+static serial_cmd_handler_t cmd_handler = NULL;
+static TaskHandle_t cmd_task = NULL;
+
+// only used by the task that calls serial_cmd_poll
+static char line_buf[SERIAL_CMD_LINE_MAX];
+static uint32_t line_len = 0;
+static bool line_overflow = false;
+static uint32_t current_req_id = 0;
+
+static serial_cmd_pending_t pending[SERIAL_CMD_PENDING_MAX];
+
+static uint32_t overflow_count = 0;
+static uint32_t expired_count = 0;
+
+
+// runs on the uart event task
+static void serial_cmd_on_receive() {
+    if (cmd_task != NULL) {
+        xTaskNotifyGive(cmd_task);
+    }
+}
+
+void serial_cmd_init(serial_cmd_handler_t handler) {
+    cmd_handler = handler;
+    cmd_task = xTaskGetCurrentTaskHandle();
+    Serial.onReceive(serial_cmd_on_receive);
+}
+
+void serial_cmd_wait(uint32_t timeout_ms) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
+
+uint32_t serial_cmd_req_id() {
+    return current_req_id;
+}
+
+static void serial_cmd_handle_line(char *line) {
+    // trim
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    char *end = line + strlen(line);
+    while (end > line && (end[-1] == ' ' || end[-1] == '\t')) {
+        *--end = '\0';
+    }
+    if (*line == '\0') {
+        return;
+    }
+
+    // optional "#<req_id> " prefix
+    uint32_t req_id = 0;
+    if (line[0] == '#') {
+        char *num_end = NULL;
+        req_id = strtoul(line + 1, &num_end, 10);
+        if (num_end != line + 1) {
+            line = num_end;
+            while (*line == ' ' || *line == '\t') {
+                line++;
+            }
+        }
+    }
+
+    // the handler may split the line in place, keep the command name for the ack
+    char cmd[16];
+    uint32_t cmd_len = strcspn(line, " \t");
+    if (cmd_len >= sizeof(cmd)) {
+        cmd_len = sizeof(cmd) - 1;
+    }
+    memcpy(cmd, line, cmd_len);
+    cmd[cmd_len] = '\0';
+
+    current_req_id = req_id;
+    bool ok = (cmd_handler != NULL) && cmd_handler(line);
+    current_req_id = 0;
+
+    // ack after the direct reply of the command, always JSON like the mode ack
+    if (req_id != 0) {
+        Serial.printf("{\"event\":\"ack\",\"req\":%u,\"cmd\":\"%s\",\"ok\":%d}\n", (unsigned)req_id, cmd, ok ? 1 : 0);
+    }
+}
+
+void serial_cmd_poll() {
+    int c;
+    while ((c = Serial.read()) >= 0) {
+        if (c == '\n' || c == '\r') {
+            if (line_overflow) {
+                overflow_count++;
+                Serial.printf("Command too long, max %d\n", SERIAL_CMD_LINE_MAX - 1);
+            } else {
+                line_buf[line_len] = '\0';
+                serial_cmd_handle_line(line_buf);
+            }
+            line_len = 0;
+            line_overflow = false;
+            continue;
+        }
+        if (line_len >= SERIAL_CMD_LINE_MAX - 1) {
+            line_overflow = true; // drop the rest of the line
+            continue;
+        }
+        line_buf[line_len++] = (char)c;
+    }
+}
+
+static void serial_cmd_expire() {
+    unsigned long now = millis();
+    for (int i = 0; i < SERIAL_CMD_PENDING_MAX; i++) {
+        if (pending[i].req_id != 0 && now - pending[i].start_ms > SERIAL_CMD_PENDING_TIMEOUT_MS) {
+            pending[i].req_id = 0;
+            expired_count++;
+        }
+    }
+}
+
+void serial_cmd_expect(uint32_t req_id, uint8_t kind, uint16_t node_a_id, uint16_t node_b_id) {
+    if (req_id == 0) {
+        return;
+    }
+    serial_cmd_expire();
+
+    // free slot, or replace the oldest request
+    int slot = 0;
+    for (int i = 0; i < SERIAL_CMD_PENDING_MAX; i++) {
+        if (pending[i].req_id == 0) {
+            slot = i;
+            break;
+        }
+        if ((long)(pending[i].start_ms - pending[slot].start_ms) < 0) {
+            slot = i;
+        }
+    }
+    if (pending[slot].req_id != 0) {
+        expired_count++;
+    }
+    pending[slot].req_id = req_id;
+    pending[slot].kind = kind;
+    pending[slot].node_a_id = node_a_id;
+    pending[slot].node_b_id = node_b_id;
+    pending[slot].start_ms = millis();
+}
+
+uint32_t serial_cmd_match(uint8_t kind, uint16_t node_a_id, uint16_t node_b_id) {
+    serial_cmd_expire();
+
+    int slot = -1;
+    for (int i = 0; i < SERIAL_CMD_PENDING_MAX; i++) {
+        if (pending[i].req_id == 0 || pending[i].kind != kind ||
+            pending[i].node_a_id != node_a_id || pending[i].node_b_id != node_b_id) {
+            continue;
+        }
+        if (slot < 0 || (long)(pending[i].start_ms - pending[slot].start_ms) < 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return 0;
+    }
+    uint32_t req_id = pending[slot].req_id;
+    pending[slot].req_id = 0;
+    return req_id;
+}
+
+uint32_t serial_cmd_overflow_count() {
+    return overflow_count;
+}
+
+uint32_t serial_cmd_expired_count() {
+    return expired_count;
+}
@@ -0,0 +1,54 @@
+#ifndef __SERIAL_CMD_H__
+#define __SERIAL_CMD_H__
+
+#include <Arduino.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// uart command reader, bytes are collected into a fixed line buffer as they arrive
+// a line may start with "#<req_id> ", the id is echoed in the ack and in the radio results of the command
+// e.g. "#17 trigger 0x0001 0xFF00" -> {"event":"ack","req":17,"cmd":"trigger","ok":1}
+//                                  -> {"event":"range_report",...,"req":17}
+#define SERIAL_CMD_LINE_MAX 160
+// radio results still expected for requests with an id
+#define SERIAL_CMD_PENDING_MAX 32
+#define SERIAL_CMD_PENDING_TIMEOUT_MS 1000
+
+// result a pending request waits for, a ping of node X and a range of pair (X, 0) must not take each other's id
+#define SERIAL_CMD_RESULT_PING  1
+#define SERIAL_CMD_RESULT_RANGE 2
+
+// handle one command line without the request id, return false if unknown or rejected
+typedef bool (*serial_cmd_handler_t)(char *line);
+
+
+// call from setup(), the task that calls it is woken by uart data
+void serial_cmd_init(serial_cmd_handler_t handler);
+
+// block until uart data arrives or timeout_ms passed
+void serial_cmd_wait(uint32_t timeout_ms);
+
+// read all received bytes without blocking, run the handler for every complete line
+void serial_cmd_poll();
+
+// request id of the line being handled, 0 if it has none
+uint32_t serial_cmd_req_id();
+
+// remember that a result of kind SERIAL_CMD_RESULT_* for node pair (a, b) answers req_id, ping uses (node_id, 0)
+void serial_cmd_expect(uint32_t req_id, uint8_t kind, uint16_t node_a_id, uint16_t node_b_id);
+// request id waiting for a result of this kind and node pair (a, b), 0 if none, the oldest one is taken
+uint32_t serial_cmd_match(uint8_t kind, uint16_t node_a_id, uint16_t node_b_id);
+
+uint32_t serial_cmd_overflow_count();   // lines longer than SERIAL_CMD_LINE_MAX
+uint32_t serial_cmd_expired_count();    // requests whose result never came
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SERIAL_CMD_H__
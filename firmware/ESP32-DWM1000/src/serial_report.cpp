@@ -0,0 +1,155 @@
+#include "serial_report.h"
+
+
+static serial_report_mode_t serial_report_mode = SERIAL_REPORT_MODE_JSON;
+
+// supported baud rates, both sides must agree before switching
+static const uint32_t serial_report_baud_list[] = {
+    115200, 230400, 460800, 921600, 1000000, 2000000
+};
+
+
+void serial_report_set_mode(serial_report_mode_t mode) {
+    serial_report_mode = mode;
+    // ack always in JSON, host can parse it in both modes
+    Serial.printf("{\"event\":\"mode\",\"mode\":\"%s\"}\n", mode == SERIAL_REPORT_MODE_BINARY ? "bin" : "json");
+}
+
+serial_report_mode_t serial_report_get_mode() {
+    return serial_report_mode;
+}
+
+bool serial_report_set_baudrate(uint32_t baud) {
+    bool supported = false;
+    for (uint32_t i = 0; i < sizeof(serial_report_baud_list) / sizeof(serial_report_baud_list[0]); i++) {
+        if (serial_report_baud_list[i] == baud) {
+            supported = true;
+            break;
+        }
+    }
+    if (!supported) {
+        Serial.printf("{\"event\":\"baud\",\"baud\":0}\n");
+        return false;
+    }
+
+    // ack with the old baud rate, wait it sent out, then switch
+    Serial.printf("{\"event\":\"baud\",\"baud\":%u}\n", (unsigned)baud);
+    Serial.flush();
+    Serial.updateBaudRate(baud);
+    return true;
+}
+
+// CRC-16/CCITT-FALSE, poly 0x1021, init 0xFFFF
+uint16_t serial_frame_crc16(const uint8_t *data, uint32_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+void serial_report_frame(uint8_t type, const void *payload, uint8_t len) {
+    uint8_t frame[SERIAL_FRAME_OVERHEAD + 32];
+    if (len > sizeof(frame) - SERIAL_FRAME_OVERHEAD) {
+        return;
+    }
+
+    frame[0] = SERIAL_FRAME_SYNC;
+    frame[1] = type;
+    frame[2] = len;
+    memcpy(&frame[3], payload, len);
+    uint16_t crc = serial_frame_crc16(&frame[1], len + 2);
+    frame[3 + len] = crc & 0xFF;
+    frame[4 + len] = crc >> 8;
+
+    // one write per frame, keep the frame in one piece
+    Serial.write(frame, len + SERIAL_FRAME_OVERHEAD);
+}
+
+// payload with the request id appended if there is one
+static void serial_report_frame_req(uint8_t type, const void *payload, uint8_t len, uint32_t req_id) {
+    uint8_t buf[32];
+    if (req_id == 0 || len + sizeof(req_id) > sizeof(buf)) {
+        serial_report_frame(type, payload, len);
+        return;
+    }
+    memcpy(buf, payload, len);
+    memcpy(buf + len, &req_id, sizeof(req_id));
+    serial_report_frame(type, buf, len + sizeof(req_id));
+}
+
+// ",\"req\":N" for the JSON events, empty without request id
+static const char *serial_report_req_field(char *buf, uint32_t size, uint32_t req_id) {
+    buf[0] = '\0';
+    if (req_id != 0) {
+        snprintf(buf, size, ",\"req\":%u", (unsigned)req_id);
+    }
+    return buf;
+}
+
+void serial_report_ping_resp(uint16_t node_id, uint8_t system_state, uint16_t voltage_mv, uint32_t req_id) {
+    if (serial_report_mode == SERIAL_REPORT_MODE_BINARY) {
+        serial_frame_ping_resp_t payload;
+        payload.node_id = node_id;
+        payload.system_state = system_state;
+        payload.voltage_mv = voltage_mv;
+        serial_report_frame_req(SERIAL_FRAME_TYPE_PING_RESP, &payload, sizeof(payload), req_id);
+        return;
+    }
+
+    // print as JSON format for easy parsing
+    char req_field[20];
+    Serial.printf("{\"event\":\"ping_resp\",\"node_id\":%d,\"system_state\":%d,\"voltage_mv\":%d%s}\n",
+        node_id,
+        system_state,
+        voltage_mv,
+        serial_report_req_field(req_field, sizeof(req_field), req_id)
+    );
+}
+
+void serial_report_range(serial_frame_type_t type, uint16_t node_a_id, uint16_t node_b_id, int32_t distance_mm, float rssi_dbm, uint32_t req_id) {
+    if (serial_report_mode == SERIAL_REPORT_MODE_BINARY) {
+        serial_frame_range_t payload;
+        payload.node_a_id = node_a_id;
+        payload.node_b_id = node_b_id;
+        payload.distance_mm = distance_mm;
+        payload.rssi_centi_dbm = (int16_t)(rssi_dbm * 100.0f);
+        serial_report_frame_req(type, &payload, sizeof(payload), req_id);
+        return;
+    }
+
+    // print as JSON format for easy parsing
+    // distance_m stays in metres for the JSON consumers, exact to the mm of the result
+    char req_field[20];
+    Serial.printf("{\"event\":\"%s\",\"node_a_id\":%d,\"node_b_id\":%d,\"distance_m\":%.3f,\"rssi_dbm\":%.2f%s}\n",
+        type == SERIAL_FRAME_TYPE_RANGE_FINAL ? "range_final" : "range_report",
+        node_a_id,
+        node_b_id,
+        distance_mm / 1000.0,
+        rssi_dbm,
+        serial_report_req_field(req_field, sizeof(req_field), req_id)
+    );
+}
+
+void serial_report_tdoa(uint16_t anchor_id, uint16_t tag_id, uint8_t blink_seq, uint64_t ts) {
+    if (serial_report_mode == SERIAL_REPORT_MODE_BINARY) {
+        serial_frame_tdoa_t payload;
+        payload.anchor_id = anchor_id;
+        payload.tag_id = tag_id;
+        payload.blink_seq = blink_seq;
+        payload.ts_lo = (uint32_t)ts;
+        payload.ts_hi = (uint8_t)(ts >> 32);
+        serial_report_frame(SERIAL_FRAME_TYPE_TDOA, &payload, sizeof(payload));
+        return;
+    }
+
+    Serial.printf("{\"event\":\"tdoa_ts\",\"anchor_id\":%d,\"tag_id\":%d,\"blink_seq\":%d,\"ts\":%llu}\n",
+        anchor_id,
+        tag_id,
+        blink_seq,
+        (unsigned long long)ts
+    );
+}
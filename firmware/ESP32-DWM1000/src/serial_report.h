@@ -0,0 +1,78 @@
+#ifndef __SERIAL_REPORT_H__
+#define __SERIAL_REPORT_H__
+
+#include <Arduino.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// binary frame: SYNC | type | len | payload[len] | crc16 (little endian, over type+len+payload)
+// SYNC is not ASCII, so frames can be told apart from the text log lines
+#define SERIAL_FRAME_SYNC 0xA5
+#define SERIAL_FRAME_OVERHEAD 5
+
+#define SERIAL_REPORT_DEFAULT_BAUD 115200
+#define SERIAL_REPORT_MAX_BAUD 2000000
+
+typedef enum {
+    SERIAL_REPORT_MODE_JSON = 0,
+    SERIAL_REPORT_MODE_BINARY = 1,
+} serial_report_mode_t;
+
+// frame types, same value as the uwb msg type of the result
+typedef enum {
+    SERIAL_FRAME_TYPE_PING_RESP = 0x02,
+    SERIAL_FRAME_TYPE_RANGE_FINAL = 0x14,
+    SERIAL_FRAME_TYPE_RANGE_REPORT = 0x15,
+    SERIAL_FRAME_TYPE_LOG = 0x30, // uwb_log_record_t
+    SERIAL_FRAME_TYPE_TDOA = 0x33,
+} serial_frame_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t node_id;
+    uint8_t system_state;
+    uint16_t voltage_mv;
+} serial_frame_ping_resp_t;
+
+// same layout as the payload of uwb_pkt_range_report_t
+typedef struct __attribute__((packed)) {
+    uint16_t node_a_id;
+    uint16_t node_b_id;
+    int32_t distance_mm;
+    int16_t rssi_centi_dbm;
+} serial_frame_range_t;
+
+// ping_resp and range frames of a command sent with a request id (serial_cmd.h)
+// carry it as an extra trailing uint32_t, the frame len tells if it is there
+
+// one blink timestamp, ts is 40 bit in the reference anchor clock
+typedef struct __attribute__((packed)) {
+    uint16_t anchor_id;
+    uint16_t tag_id;
+    uint8_t blink_seq;
+    uint32_t ts_lo;
+    uint8_t ts_hi;
+} serial_frame_tdoa_t;
+
+
+void serial_report_set_mode(serial_report_mode_t mode);
+serial_report_mode_t serial_report_get_mode();
+bool serial_report_set_baudrate(uint32_t baud);
+
+uint16_t serial_frame_crc16(const uint8_t *data, uint32_t len);
+void serial_report_frame(uint8_t type, const void *payload, uint8_t len);
+
+// req_id 0 if the result answers no request
+void serial_report_ping_resp(uint16_t node_id, uint8_t system_state, uint16_t voltage_mv, uint32_t req_id);
+void serial_report_range(serial_frame_type_t type, uint16_t node_a_id, uint16_t node_b_id, int32_t distance_mm, float rssi_dbm, uint32_t req_id);
+void serial_report_tdoa(uint16_t anchor_id, uint16_t tag_id, uint8_t blink_seq, uint64_t ts);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SERIAL_REPORT_H__
@@ -34,6 +34,15 @@ void system_config_init() {
         save_uwb_node_id();
         Serial.printf("[system_config] No saved uwb node_id in NVS, use default %04X\n", get_uwb_node_id());
     }
+
+    if (prefs.isKey("uwb_phy") && prefs.getUChar("uwb_phy") < uwb_phy_profile_count) {
+        set_uwb_phy_profile(prefs.getUChar("uwb_phy"));
+        Serial.printf("[system_config] Load uwb phy profile %s from NVS\n", uwb_phy_current()->name);
+    } 
+    else {
+        set_uwb_phy_profile(0); // 預設值
+        Serial.printf("[system_config] No saved uwb phy profile in NVS, use default %s\n", uwb_phy_current()->name);
+    }
     
 }
 
@@ -60,3 +69,12 @@ void save_uwb_node_id() {
     //     Serial.printf("[system_config] uwb node_id %04X unchanged, not saving to NVS\n", get_uwb_node_id());
     // }
 }
+
+// 保存 UWB PHY profile 到 NVS
+void save_uwb_phy_profile() {
+    // check if no existing or different, save only when changed
+    if (!prefs.isKey("uwb_phy") || prefs.getUChar("uwb_phy") != get_uwb_phy_profile()) {
+        prefs.putUChar("uwb_phy", get_uwb_phy_profile());
+        Serial.printf("[system_config] Saved uwb phy profile %u to NVS\n", get_uwb_phy_profile());
+    } 
+}
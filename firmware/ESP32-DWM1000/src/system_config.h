@@ -15,6 +15,7 @@ void system_config_init();
 
 void save_uwb_group_id();
 void save_uwb_node_id();
+void save_uwb_phy_profile();
 
 
 #ifdef __cplusplus
@@ -7,6 +7,8 @@
 
 
 static SemaphoreHandle_t uwb_isr_sem;
+// given by uwb_task once uwb_init is done
+static SemaphoreHandle_t uwb_ready_sem;
 
 uint8_t uwb_state = UWB_STATE_IDLE;
 
@@ -14,6 +16,25 @@ uint8_t seq_num;
 uint16_t uwb_group_id;
 uint16_t uwb_node_id;
 
+// radio is configured, address changes go to the frame filter through the command queue
+static bool uwb_radio_ready = false;
+
+// PAN ID and short address of the DW1000 frame filter
+void uwb_apply_address(){
+    dwt_setpanid(uwb_group_id);
+    dwt_setaddress16(uwb_node_id);
+}
+
+// setters run on the loop or the ui task, uwb_task writes the filter when the radio is idle
+static void uwb_request_address(){
+    if (!uwb_radio_ready) {
+        return; // uwb_init takes the ids
+    }
+    if (!uwb_cmd_set_address(UWB_CMD_PRIO_HIGH)) {
+        safe_printf("[uwb] command queue full, frame filter address not updated\n");
+    }
+}
+
 // in ui uwb_node_id split to 2 boolean and 1 int
 bool uwb_node_is_anchor = false;
 bool uwb_node_is_tag = true;
@@ -23,7 +44,103 @@ int uwb_node_id_int = 0;
 uint8_t rx_buffer[RX_BUF_LEN];
 uint8_t tx_buffer[TX_BUF_LEN];
 
-uint32_t poll_rx_ts_presave;
+// trigger multi session, the initiator ranges with each target back-to-back
+static uint16_t range_multi_targets[UWB_RANGE_MULTI_MAX_TARGETS];
+static uint8_t range_multi_count = 0;
+static uint8_t range_multi_index = 0;
+static void uwb_range_multi_next();
+
+static void (*_uwb_event_callback)(uwb_event_t event, void *data) = NULL;
+
+// broadcast poll session, tag side
+static uint16_t range_bcast_anchors[UWB_RANGE_MULTI_MAX_TARGETS];
+static uint32_t range_bcast_resp_rx_ts[UWB_RANGE_MULTI_MAX_TARGETS];
+static uint8_t range_bcast_count = 0;
+static uint8_t range_bcast_rx_count = 0;
+static uint32_t range_bcast_window_end; // system time high 32 bit, end of the last reply slot
+static void uwb_range_bcast_continue();
+
+// a frame is queued or on air, set by uwb_starttx and cleared by the TX done callback
+static bool uwb_tx_pending = false;
+static unsigned long uwb_tx_pending_ms = 0;
+
+// dwt_starttx that marks the radio busy until the frame is out,
+// the responder stays IDLE after a delayed resp so uwb_state alone does not cover it
+static int uwb_starttx(uint8_t mode){
+    uwb_tx_pending = true;
+    uwb_tx_pending_ms = millis();
+    int succ = dwt_starttx(mode);
+    if (succ != DWT_SUCCESS) {
+        uwb_tx_pending = false;
+    }
+    return succ;
+}
+
+// RX counters, only written by uwb_task
+static uint32_t rx_frame_count = 0;
+static uint32_t rx_recovered_count = 0;
+static uint32_t rx_overrun_count = 0;
+
+// receiver already re-enabled into the other buffer for the frame being handled
+static bool rx_listen_early = false;
+
+bool uwb_rx_fast_isr = UWB_RX_FAST_ISR;
+// set by the DW1000 interrupt, the semaphore is shared with the TDMA timers and commands
+static volatile bool uwb_irq_pending = false;
+// filled by dwt_isr_fast, rx_event_cur is set while rx_ok_cb handles a frame of it
+static dwt_rx_event_t rx_event;
+static const dwt_rx_event_t *rx_event_cur = NULL;
+
+uint32_t uwb_rx_frame_count(){
+    return rx_frame_count;
+}
+
+uint32_t uwb_rx_recovered_count(){
+    return rx_recovered_count;
+}
+
+uint32_t uwb_rx_overrun_count(){
+    return rx_overrun_count;
+}
+
+// frames whose handler only keeps listening, TX paths of them start with dwt_forcetrxoff
+static bool uwb_rx_listen_only(uint8_t msg_type){
+    switch (msg_type) {
+        case UWB_MSG_TYPE_RANGE_REPORT:
+        case UWB_MSG_TYPE_TDMA_BEACON:
+        case UWB_MSG_TYPE_TDOA_BLINK:
+        case UWB_MSG_TYPE_TDOA_SYNC:
+        case UWB_MSG_TYPE_TDOA_REPORT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// back to listening without timeout after a listen-only frame
+static void uwb_rx_listen(){
+    if (rx_listen_early) {
+        return; // receiver is on since rx_ok_cb, a sync of the buffer pointers would drop the next frame
+    }
+    dwt_setrxtimeout(0);
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+}
+
+bool uwb_radio_busy(){
+    if (uwb_tx_pending && millis() - uwb_tx_pending_ms > UWB_TX_PENDING_TIMEOUT_MS) {
+        // lost TX done event, longest delayed TX is below the rx timeout limit
+        uwb_tx_pending = false;
+    }
+    return uwb_state != UWB_STATE_IDLE || uwb_tx_pending;
+}
+
+// expired responder sessions, the final never came
+static void uwb_session_expire(){
+    uint8_t expired = uwb_session_reap(millis());
+    while (expired-- > 0 && _uwb_event_callback) {
+        _uwb_event_callback(UWB_EVENT_RANGE_FINAL_TIMEOUT, NULL);
+    }
+}
 
 
 // ++++++++++++++++++++++++++++++++++++++++++++++
@@ -61,6 +178,7 @@ uint16_t get_uwb_group_id() {
 void set_uwb_group_id(uint16_t group_id){
     uwb_group_id = group_id;
     save_uwb_group_id();
+    uwb_request_address();
 }
 
 // ui only support int type, so need to sync when set/get
@@ -82,18 +200,28 @@ void set_uwb_node_id(uint16_t node_id){
     uwb_node_id_int = uwb_node_id & 0x00FF;
 
     save_uwb_node_id();
+    uwb_request_address();
 }
 
 void sync_uwb_node_id_ui_to_uint16(){
     uwb_node_id = (uwb_node_is_anchor ? 0xFF00 : 0x0000) | (uwb_node_id_int & 0x00FF);
     save_uwb_node_id();
+    uwb_request_address();
 }
 
 
 
-static void (*_uwb_event_callback)(uwb_event_t event, void *data) = NULL;
 
 
+void uwb_fill_header(uwb_common_header_t *hdr, uint16_t dest_id, uint8_t msg_type){
+    hdr->frame_ctrl = UWB_FRAME_CTRL;
+    hdr->seq_num = seq_num++;
+    hdr->group_id = uwb_group_id;
+    hdr->dest_id = dest_id;
+    hdr->src_id = uwb_node_id;
+    hdr->msg_type = msg_type;
+}
+
 void uwb_register_event_callback(void (*cb)(uwb_event_t event, void *data)){
     _uwb_event_callback = cb;
 }
@@ -101,56 +229,124 @@ void uwb_register_event_callback(void (*cb)(uwb_event_t event, void *data)){
 // QueueHandle_t log_queue;
 
 
-static void rx_ok_cb(const dwt_cb_data_t *cb_data) {
+static void rx_ok_handle(const dwt_cb_data_t *cb_data) {
+    uwb_profile_mark(UWB_PROFILE_STAGE_RX_CB);
+    rx_frame_count++;
+    if (cb_data->rx_flags & DWT_CB_DATA_RX_FLAG_DBUF) {
+        rx_recovered_count++; // arrived while the previous frame was handled
+    }
     memset(rx_buffer, 0, RX_BUF_LEN);
 
     uint32_t frame_len = cb_data->datalength;
     
     if (frame_len <= RX_BUF_LEN){
-        dwt_readrxdata(rx_buffer, frame_len, 0);
+        // the fast ISR already read the head of the frame, only the rest of a long one is left
+        uint32_t head_len = 0;
+        if (rx_event_cur != NULL) {
+            head_len = rx_event_cur->datalength;
+            memcpy(rx_buffer, rx_event_cur->data, head_len);
+        }
+        if (frame_len > head_len) {
+            dwt_readrxdata(rx_buffer + head_len, frame_len - head_len, head_len);
+        }
     }
 
     uint8_t rx_frame_valid = uwb_check_frame_valid(rx_buffer, frame_len);
     if(rx_frame_valid) {
         uwb_common_header_t *hdr = (uwb_common_header_t *)rx_buffer;
+#if UWB_RX_DOUBLE_BUFFER
+        // frame and RX timestamp stay in the host side buffer, listen into the other one meanwhile
+        if (uwb_state == UWB_STATE_IDLE && uwb_rx_listen_only(hdr->msg_type)) {
+            dwt_setrxtimeout(0);
+            dwt_rxenable(DWT_START_RX_IMMEDIATE | DWT_NO_SYNC_PTRS);
+            rx_listen_early = true;
+        }
+#endif
         switch (hdr->msg_type){
             case UWB_MSG_TYPE_PING_REQ: uwb_handle_ping_req((uwb_pkt_ping_req_t *)hdr); break;
             case UWB_MSG_TYPE_PING_RESP: uwb_handle_ping_resp((uwb_pkt_ping_resp_t *)hdr);  break;
 
             case UWB_MSG_TYPE_RANGE_TRIGGER: uwb_handle_range_trigger((uwb_pkt_range_trigger_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_TRIGGER_MULTI: uwb_handle_range_trigger_multi((uwb_pkt_range_trigger_multi_t *)hdr); break;
             
             case UWB_MSG_TYPE_RANGE_POLL: uwb_handle_range_poll((uwb_pkt_range_poll_t *)hdr); break;
             case UWB_MSG_TYPE_RANGE_RESP: uwb_handle_range_resp((uwb_pkt_range_resp_t *)hdr); break;
             case UWB_MSG_TYPE_RANGE_FINAL: uwb_handle_range_final((uwb_pkt_range_final_t *)hdr); break;
             case UWB_MSG_TYPE_RANGE_REPORT: uwb_handle_range_report((uwb_pkt_range_report_t *)hdr); break;
+
+            case UWB_MSG_TYPE_RANGE_TRIGGER_BCAST: uwb_handle_range_trigger_bcast((uwb_pkt_range_trigger_multi_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_POLL_BCAST: uwb_handle_range_poll_bcast((uwb_pkt_range_poll_bcast_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_FINAL_BCAST: uwb_handle_range_final_bcast((uwb_pkt_range_final_bcast_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_TRIGGER_SS: uwb_handle_range_trigger_ss((uwb_pkt_range_trigger_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_POLL_SS: uwb_handle_range_poll_ss((uwb_pkt_range_poll_t *)hdr); break;
+            case UWB_MSG_TYPE_RANGE_RESP_SS: uwb_handle_range_resp_ss((uwb_pkt_range_resp_ss_t *)hdr); break;
+
+            case UWB_MSG_TYPE_TDMA_BEACON: uwb_handle_tdma_beacon((uwb_pkt_tdma_beacon_t *)hdr); break;
+            case UWB_MSG_TYPE_TDOA_BLINK: uwb_handle_tdoa_blink((uwb_pkt_tdoa_blink_t *)hdr); break;
+            case UWB_MSG_TYPE_TDOA_SYNC: uwb_handle_tdoa_sync((uwb_pkt_tdoa_sync_t *)hdr); break;
+            case UWB_MSG_TYPE_TDOA_REPORT: uwb_handle_tdoa_report((uwb_pkt_tdoa_report_t *)hdr); break;
             default:
-                safe_printf("[rx_ok_cb] rx frame valid but not found handler for msg_type=0x%02X\n", hdr->msg_type);
+                UWB_LOG1(UWB_LOG_RX_NO_HANDLER, hdr->msg_type);
         }
+        rx_listen_early = false;
     }
     else {
+        // broadcast frames do not abort the running exchange (frames to other nodes are
+        // already dropped by the frame filter), e.g. a TDoA sync during a broadcast poll
+        uwb_common_header_t *hdr = (uwb_common_header_t *)rx_buffer;
+        if (uwb_state != UWB_STATE_IDLE && hdr->dest_id != uwb_node_id) {
+            if (uwb_state == UWB_STATE_WAIT_RANGE_RESP_BCAST) {
+                uwb_range_bcast_continue();
+            } else {
+                dwt_rxenable(DWT_START_RX_IMMEDIATE);
+            }
+            return;
+        }
+
         // safe_printf("[rx_ok_cb] Received frame is invalid\n");
         if (_uwb_event_callback) {
             _uwb_event_callback(UWB_EVENT_INVALID_FRAME_RECEIVED, NULL);
         }
 
         // go to idle state
+        bool was_busy = (uwb_state != UWB_STATE_IDLE);
         uwb_state = UWB_STATE_IDLE;
         dwt_rxreset();
         dwt_setrxtimeout(0);
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
+
+        // exchange aborted, continue with the next target of trigger multi
+        if (was_busy) {
+            uwb_range_multi_next();
+        }
     }
 }
 
+static void rx_ok_cb(const dwt_cb_data_t *cb_data) {
+    rx_event_cur = cb_data->rx_event;
+    rx_ok_handle(cb_data);
+    rx_event_cur = NULL;
+}
+
 static void rx_to_cb(const dwt_cb_data_t *cb_data) {
-    if(uwb_state != UWB_STATE_IDLE) {
+    // broadcast poll, wait until the last reply slot is over
+    if (uwb_state == UWB_STATE_WAIT_RANGE_RESP_BCAST) {
+        uwb_range_bcast_continue();
+        return;
+    }
+
+    bool was_busy = (uwb_state != UWB_STATE_IDLE);
+    if(was_busy) {
         // timeout occurred while waiting for a response
-        safe_printf("[rx_to_cb] Timeout, uwb_state: %d\n", uwb_state);
+        UWB_LOG1(UWB_LOG_RX_TIMEOUT, uwb_state);
         
         if (_uwb_event_callback) {
             uint8_t event;
             switch (uwb_state) {
                 case UWB_STATE_WAIT_PING_RESP: event = UWB_EVENT_PING_RESP_TIMEOUT; break;
-                case UWB_STATE_WAIT_RANGE_RESP: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
+                case UWB_STATE_WAIT_RANGE_RESP:
+                case UWB_STATE_WAIT_RANGE_RESP_SS:
+                case UWB_STATE_WAIT_RANGE_RESP_BCAST: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
                 case UWB_STATE_WAIT_RANGE_FINAL: event = UWB_EVENT_RANGE_FINAL_TIMEOUT; break;
                 case UWB_STATE_WAIT_RANGE_REPORT: event = UWB_EVENT_RANGE_REPORT_TIMEOUT; break;
                 default: event = UWB_EVENT_UNKNOWN_FRAME_TIMEOUT; break;
@@ -165,18 +361,32 @@ static void rx_to_cb(const dwt_cb_data_t *cb_data) {
     dwt_setrxtimeout(0);
     dwt_rxenable(DWT_START_RX_IMMEDIATE);
 
+    if (was_busy) {
+        uwb_range_multi_next();
+    }
 }
 
 static void rx_err_cb(const dwt_cb_data_t *cb_data) {
+    if (cb_data->status & SYS_STATUS_RXOVRR) {
+        rx_overrun_count++; // both RX buffers were full, dwt_isr dropped them
+    }
     print_rx_err_flags(cb_data->status);
-    if(uwb_state != UWB_STATE_IDLE) {
-        safe_printf("[rx_err_cb] RX error occurred in state %d, %08X\n", uwb_state, cb_data->status);
+    // broadcast poll, a collided or corrupted reply only loses that slot
+    if (uwb_state == UWB_STATE_WAIT_RANGE_RESP_BCAST) {
+        uwb_range_bcast_continue();
+        return;
+    }
+    bool was_busy = (uwb_state != UWB_STATE_IDLE);
+    if(was_busy) {
+        UWB_LOG2(UWB_LOG_RX_ERROR, uwb_state, cb_data->status);
 
         if (_uwb_event_callback) {
             uint8_t event;
             switch (uwb_state) {
                 case UWB_STATE_WAIT_PING_RESP: event = UWB_EVENT_PING_RESP_TIMEOUT; break;
-                case UWB_STATE_WAIT_RANGE_RESP: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
+                case UWB_STATE_WAIT_RANGE_RESP:
+                case UWB_STATE_WAIT_RANGE_RESP_SS:
+                case UWB_STATE_WAIT_RANGE_RESP_BCAST: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
                 case UWB_STATE_WAIT_RANGE_FINAL: event = UWB_EVENT_RANGE_FINAL_TIMEOUT; break;
                 case UWB_STATE_WAIT_RANGE_REPORT: event = UWB_EVENT_RANGE_REPORT_TIMEOUT; break;
                 default: event = UWB_EVENT_UNKNOWN_FRAME_ERROR; break;
@@ -190,9 +400,16 @@ static void rx_err_cb(const dwt_cb_data_t *cb_data) {
     dwt_setrxtimeout(0);
     dwt_rxenable(DWT_START_RX_IMMEDIATE);
 
+    if (was_busy) {
+        uwb_range_multi_next();
+    }
 }
 
 static void tx_conf_cb(const dwt_cb_data_t *cb_data) {
+    uwb_tx_pending = false;
+    // keeps the radio busy with the next report frame before a queued command can start
+    uwb_tdoa_on_tx_done();
+    uwb_cmd_on_tx_done();
 }
 
 
@@ -213,18 +430,25 @@ void uwb_init(){
     }
     port_set_dw1000_fastrate();
 
-    dwt_configure(&config);
-    dwt_setsmarttxpower(0);
-    dwt_configuretxrf(&txconfig);
+    // PHY config, tx power, antenna delay and derived timing (uwb_phy.h)
+    uwb_phy_apply();
 
-    dwt_setrxantennadelay(RX_ANT_DLY);
-    dwt_settxantennadelay(TX_ANT_DLY);
+    // drop frames of other groups and other nodes in the DW1000, broadcast frames still pass
+    // rejected frames raise no interrupt and the receiver re-enables itself
+    uwb_apply_address();
+    dwt_enableframefilter(DWT_FF_DATA_EN);
+    uwb_radio_ready = true;
+
+#if UWB_RX_DOUBLE_BUFFER
+    // dwt_isr toggles the host side buffer and reports a frame waiting in the other one
+    dwt_setdblrxbuffmode(1);
+#endif
 
 
     // Register RX call-back.
-    dwt_setcallbacks(NULL, &rx_ok_cb, &rx_to_cb, &rx_err_cb);
+    dwt_setcallbacks(&tx_conf_cb, &rx_ok_cb, &rx_to_cb, &rx_err_cb);
     // Enable wanted interrupts (TX confirmation, RX good frames, RX timeouts and RX errors).
-    dwt_setinterrupt(DWT_INT_TFRS | DWT_INT_RFCG | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_SFDT, 1);
+    dwt_setinterrupt(DWT_INT_TFRS | DWT_INT_RFCG | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_SFDT | DWT_INT_RXOVRR, 1);
     // enable interrupts
     decamutexoff(true); // enable interrupts
 
@@ -249,7 +473,11 @@ uint64_t get_tx_timestamp() {
 
 uint64_t get_rx_timestamp(){
     uint8_t ts_buf[5];
-    dwt_readrxtimestamp(ts_buf);
+    if (rx_event_cur != NULL) {
+        memcpy(ts_buf, rx_event_cur->rxStamp, sizeof(ts_buf));
+    } else {
+        dwt_readrxtimestamp(ts_buf);
+    }
     uint64_t ts = 
         ((uint64_t)ts_buf[0]) |
         ((uint64_t)ts_buf[1] << 8) |
@@ -296,10 +524,8 @@ static float calc_rssi(dwt_rxdiag_t *rxdiag) {
 bool uwb_check_frame_valid(uint8_t *buf, uint32_t len){
     uwb_common_header_t *hdr = (uwb_common_header_t *)buf;
 
-    if (hdr->group_id != uwb_group_id) {
-        return false;
-    }
-    if (hdr->dest_id != uwb_node_id && hdr->dest_id != 0xFFFF) { // not to me or broadcast
+    // group_id / dest_id are checked by the DW1000 frame filter
+    if (len < sizeof(uwb_common_header_t) || hdr->frame_ctrl != UWB_FRAME_CTRL) {
         return false;
     }
 
@@ -311,6 +537,20 @@ bool uwb_check_frame_valid(uint8_t *buf, uint32_t len){
         case UWB_MSG_TYPE_RANGE_RESP:   if (len != sizeof(uwb_pkt_range_resp_t)) return false; break;
         case UWB_MSG_TYPE_RANGE_FINAL:  if (len != sizeof(uwb_pkt_range_final_t)) return false; break;
         case UWB_MSG_TYPE_RANGE_REPORT: if (len != sizeof(uwb_pkt_range_report_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_TRIGGER_MULTI: if (len != sizeof(uwb_pkt_range_trigger_multi_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_TRIGGER_BCAST: if (len != sizeof(uwb_pkt_range_trigger_multi_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_POLL_BCAST: if (len != sizeof(uwb_pkt_range_poll_bcast_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_FINAL_BCAST: if (len != sizeof(uwb_pkt_range_final_bcast_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_TRIGGER_SS: if (len != sizeof(uwb_pkt_range_trigger_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_POLL_SS: if (len != sizeof(uwb_pkt_range_poll_t)) return false; break;
+        case UWB_MSG_TYPE_RANGE_RESP_SS: if (len != sizeof(uwb_pkt_range_resp_ss_t)) return false; break;
+        case UWB_MSG_TYPE_TDMA_BEACON:  if (len != sizeof(uwb_pkt_tdma_beacon_t)) return false; break;
+        case UWB_MSG_TYPE_TDOA_BLINK:   if (len != sizeof(uwb_pkt_tdoa_blink_t)) return false; break;
+        case UWB_MSG_TYPE_TDOA_SYNC:    if (len != sizeof(uwb_pkt_tdoa_sync_t)) return false; break;
+        case UWB_MSG_TYPE_TDOA_REPORT:
+            if (len < UWB_TDOA_REPORT_LEN(1) || buf[offsetof(uwb_pkt_tdoa_report_t, num_entries)] > UWB_TDOA_REPORT_MAX_ENTRIES ||
+                len != UWB_TDOA_REPORT_LEN(buf[offsetof(uwb_pkt_tdoa_report_t, num_entries)])) return false;
+            break;
         default: return false;
     }
     
@@ -318,8 +558,19 @@ bool uwb_check_frame_valid(uint8_t *buf, uint32_t len){
         case UWB_STATE_IDLE:
             if (hdr->msg_type == UWB_MSG_TYPE_PING_REQ ||
                 hdr->msg_type == UWB_MSG_TYPE_RANGE_TRIGGER ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_TRIGGER_MULTI ||
                 hdr->msg_type == UWB_MSG_TYPE_RANGE_POLL ||
-                hdr->msg_type == UWB_MSG_TYPE_RANGE_REPORT) {
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_REPORT ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_FINAL ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_FINAL_BCAST ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_TRIGGER_BCAST ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_POLL_BCAST ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_TRIGGER_SS ||
+                hdr->msg_type == UWB_MSG_TYPE_RANGE_POLL_SS ||
+                hdr->msg_type == UWB_MSG_TYPE_TDMA_BEACON ||
+                hdr->msg_type == UWB_MSG_TYPE_TDOA_BLINK ||
+                hdr->msg_type == UWB_MSG_TYPE_TDOA_SYNC ||
+                hdr->msg_type == UWB_MSG_TYPE_TDOA_REPORT) {
                 return true;
             }
             break;
@@ -333,8 +584,13 @@ bool uwb_check_frame_valid(uint8_t *buf, uint32_t len){
                 return true;
             }
             break;
-        case UWB_STATE_WAIT_RANGE_FINAL:
-            if (hdr->msg_type == UWB_MSG_TYPE_RANGE_FINAL) {
+        case UWB_STATE_WAIT_RANGE_RESP_BCAST:
+            if (hdr->msg_type == UWB_MSG_TYPE_RANGE_RESP) {
+                return true;
+            }
+            break;
+        case UWB_STATE_WAIT_RANGE_RESP_SS:
+            if (hdr->msg_type == UWB_MSG_TYPE_RANGE_RESP_SS) {
                 return true;
             }
             break;
@@ -345,26 +601,15 @@ bool uwb_check_frame_valid(uint8_t *buf, uint32_t len){
             break;
     }
 
-    safe_printf("[uwb_check_frame_valid] state=%d, msg_type=0x%02X\n", uwb_state, hdr->msg_type);
-    safe_printf("[uwb_check_frame_valid] Frame not expected in current UWB state\n");
+    UWB_LOG2(UWB_LOG_FRAME_UNEXPECTED, uwb_state, hdr->msg_type);
     return false;
 }
 
 void print_rx_err_flags(uint32_t status_reg){
-    safe_printf("[print_rx_err_flags] RX error flags: 0x%08X---", status_reg);
     //SYS_STATUS_RXRFTO | SYS_STATUS_RXPTO
     //SYS_STATUS_RXPHE | SYS_STATUS_RXFCE | SYS_STATUS_RXRFSL | SYS_STATUS_RXSFDTO | SYS_STATUS_AFFREJ | SYS_STATUS_LDEERR
-
-    safe_printf("rx_err_flags:");
-    if (status_reg & SYS_STATUS_RXRFTO)   safe_printf(" RXRFTO");
-    if (status_reg & SYS_STATUS_RXPTO)    safe_printf(" RXPTO");
-    if (status_reg & SYS_STATUS_RXPHE)    safe_printf(" RXPHE");
-    if (status_reg & SYS_STATUS_RXFCE)    safe_printf(" RXFCE");
-    if (status_reg & SYS_STATUS_RXRFSL)   safe_printf(" RXRFSL");
-    if (status_reg & SYS_STATUS_RXSFDTO)  safe_printf(" RXSFDTO");
-    if (status_reg & SYS_STATUS_LDEERR)   safe_printf(" LDEERR");
-    if (status_reg & SYS_STATUS_AFFREJ)   safe_printf(" AFFREJ");
-    safe_printf("\n");
+    // only the raw status is logged, uwb_log_task (text) or host_app/UWBLogDecoder.py (binary) names the flags
+    UWB_LOG1(UWB_LOG_RX_ERR_FLAGS, status_reg);
 
 }
 
@@ -372,16 +617,12 @@ void print_rx_err_flags(uint32_t status_reg){
 uint8_t uwb_send_ping_req(uint16_t dest_id){
 
     if (uwb_state != UWB_STATE_IDLE) {
-        safe_printf("[uwb_send_ping_req] Cannot send PING REQ, UWB not in IDLE state, state: %d\n", uwb_state);
+        UWB_LOG1(UWB_LOG_PING_NOT_IDLE, uwb_state);
         return false;
     }
 
     uwb_pkt_ping_req_t *pkt = (uwb_pkt_ping_req_t *)tx_buffer;
-    pkt->header.group_id = uwb_group_id;
-    pkt->header.src_id = uwb_node_id;
-    pkt->header.dest_id = dest_id;
-    pkt->header.seq_num = seq_num++;
-    pkt->header.msg_type = UWB_MSG_TYPE_PING_REQ;
+    uwb_fill_header(&pkt->header, dest_id, UWB_MSG_TYPE_PING_REQ);
 
 
     // Send the packet
@@ -390,10 +631,10 @@ uint8_t uwb_send_ping_req(uint16_t dest_id){
     dwt_forcetrxoff();
     dwt_rxreset();
     dwt_setrxaftertxdelay(0);
-    dwt_setrxtimeout(PING_RX_TIMEOUT_UUS);
-    int succ = dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    dwt_setrxtimeout(uwb_phy_timing.ping_rx_timeout_uus);
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
     if (succ != DWT_SUCCESS) {
-        safe_printf("[uwb_send_ping_req] Failed to start TX for PING REQ\n");
+        UWB_LOG0(UWB_LOG_PING_TX_FAIL);
         
         uwb_state = UWB_STATE_IDLE;
         dwt_forcetrxoff();
@@ -407,18 +648,15 @@ uint8_t uwb_send_ping_req(uint16_t dest_id){
     return true;
 }
 
-uint8_t uwb_send_range_trigger(uint16_t initiator_id, uint16_t responder_id){
+// RANGE TRIGGER and RANGE TRIGGER SS share the packet layout
+static uint8_t uwb_send_range_trigger_pkt(uint8_t msg_type, uint16_t initiator_id, uint16_t responder_id){
     if (uwb_state != UWB_STATE_IDLE) {
-        safe_printf("[uwb_send_range_trigger] Cannot send RANGE TRIGGER, UWB not in IDLE state, state: %d\n", uwb_state);
+        UWB_LOG2(UWB_LOG_TRIGGER_NOT_IDLE, msg_type, uwb_state);
         return false;
     }
 
     uwb_pkt_range_trigger_t *pkt = (uwb_pkt_range_trigger_t *)tx_buffer;
-    pkt->header.group_id = uwb_group_id;
-    pkt->header.src_id = uwb_node_id;
-    pkt->header.dest_id = initiator_id;
-    pkt->header.seq_num = seq_num++;
-    pkt->header.msg_type = UWB_MSG_TYPE_RANGE_TRIGGER;
+    uwb_fill_header(&pkt->header, initiator_id, msg_type);
     pkt->target_node_id = responder_id;
 
     // Send the packet
@@ -433,9 +671,230 @@ uint8_t uwb_send_range_trigger(uint16_t initiator_id, uint16_t responder_id){
     dwt_setrxaftertxdelay(0);
     dwt_setrxtimeout(0);
     
-    int succ = dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG1(UWB_LOG_TRIGGER_TX_FAIL, msg_type);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t uwb_send_range_trigger(uint16_t initiator_id, uint16_t responder_id){
+    return uwb_send_range_trigger_pkt(UWB_MSG_TYPE_RANGE_TRIGGER, initiator_id, responder_id);
+}
+
+uint8_t uwb_send_range_trigger_ss(uint16_t initiator_id, uint16_t responder_id){
+    return uwb_send_range_trigger_pkt(UWB_MSG_TYPE_RANGE_TRIGGER_SS, initiator_id, responder_id);
+}
+
+// RANGE TRIGGER MULTI and RANGE TRIGGER BCAST share the packet layout
+static uint8_t uwb_send_range_trigger_list(uint8_t msg_type, uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders){
+    if (uwb_state != UWB_STATE_IDLE) {
+        UWB_LOG2(UWB_LOG_TRIGGER_LIST_NOT_IDLE, msg_type, uwb_state);
+        return false;
+    }
+    if (num_responders == 0 || num_responders > UWB_RANGE_MULTI_MAX_TARGETS) {
+        UWB_LOG1(UWB_LOG_TRIGGER_LIST_INVALID, num_responders);
+        return false;
+    }
+
+    uwb_pkt_range_trigger_multi_t *pkt = (uwb_pkt_range_trigger_multi_t *)tx_buffer;
+    memset(pkt, 0, sizeof(uwb_pkt_range_trigger_multi_t));
+    uwb_fill_header(&pkt->header, initiator_id, msg_type);
+    pkt->num_targets = num_responders;
+    for (int i = 0; i < num_responders; i++) {
+        pkt->target_node_ids[i] = responder_ids[i];
+    }
+
+    // Send the packet
+    dwt_writetxdata(sizeof(uwb_pkt_range_trigger_multi_t), (uint8_t *)pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_trigger_multi_t), 0, 1);
+
+    // go to IDLE state after sending the trigger, the reports come as broadcast
+    uwb_state = UWB_STATE_IDLE;
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG1(UWB_LOG_TRIGGER_LIST_TX_FAIL, msg_type);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t uwb_send_range_trigger_multi(uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders){
+    return uwb_send_range_trigger_list(UWB_MSG_TYPE_RANGE_TRIGGER_MULTI, initiator_id, responder_ids, num_responders);
+}
+
+uint8_t uwb_send_range_trigger_bcast(uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders){
+    return uwb_send_range_trigger_list(UWB_MSG_TYPE_RANGE_TRIGGER_BCAST, initiator_id, responder_ids, num_responders);
+}
+
+uint8_t uwb_send_tdma_beacon(uint16_t superframe_seq, uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors){
+    if (uwb_state != UWB_STATE_IDLE) {
+        return false;
+    }
+    if (num_tags > UWB_TDMA_MAX_TAGS || num_anchors > UWB_TDMA_MAX_ANCHORS) {
+        return false;
+    }
+
+    uwb_pkt_tdma_beacon_t *pkt = (uwb_pkt_tdma_beacon_t *)tx_buffer;
+    memset(pkt, 0, sizeof(uwb_pkt_tdma_beacon_t));
+    uwb_fill_header(&pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_TDMA_BEACON);
+    pkt->superframe_seq = superframe_seq;
+    pkt->slot_ms = slot_ms;
+    pkt->num_tags = num_tags;
+    for (int i = 0; i < num_tags; i++) {
+        pkt->tag_ids[i] = tag_ids[i];
+    }
+    pkt->num_anchors = num_anchors;
+    for (int i = 0; i < num_anchors; i++) {
+        pkt->anchor_ids[i] = anchor_ids[i];
+    }
+
+    dwt_writetxdata(sizeof(uwb_pkt_tdma_beacon_t), (uint8_t *)pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_tdma_beacon_t), 0, 1);
+
+    // stay IDLE, the reports of the slots come as broadcast
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_BEACON_TX_FAIL);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t uwb_send_tdoa_sync(const uwb_tdoa_layout_t *layout){
+    if (uwb_state != UWB_STATE_IDLE) {
+        return false;
+    }
+
+    // delayed TX, so the TX timestamp is known and goes into the frame itself
+    uint32_t tx_time = dwt_readsystimestamphi32() + UWB_TDOA_SYNC_TX_DELAY_UUS * (UUS_TO_DWT_TIME >> 8);
+    // 真實從天線發射的時間 = 設定的時間 + TX_ANT_DLY
+    uint64_t tx_ts = ((((uint64_t)(tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY) & UWB_TWR_TS_MASK;
+
+    uwb_pkt_tdoa_sync_t *pkt = (uwb_pkt_tdoa_sync_t *)tx_buffer;
+    uwb_fill_header(&pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_TDOA_SYNC);
+    pkt->tx_ts_lo = (uint32_t)tx_ts;
+    pkt->tx_ts_hi = (uint8_t)(tx_ts >> 32);
+    memcpy(&pkt->layout, layout, sizeof(uwb_tdoa_layout_t));
+
+    dwt_writetxdata(sizeof(uwb_pkt_tdoa_sync_t), (uint8_t *)pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_tdoa_sync_t), 0, 1);
+
+    // stay IDLE, blinks and reports come as they like
+    dwt_forcetrxoff();
+    dwt_setdelayedtrxtime(tx_time);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+    if (uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_TDOA_SYNC_TX_FAIL);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+    return true;
+}
+
+uint8_t uwb_send_tdoa_blink(uint8_t blink_seq, uint32_t tx_time){
+    if (uwb_state != UWB_STATE_IDLE) {
+        return false;
+    }
+
+    uwb_pkt_tdoa_blink_t *pkt = (uwb_pkt_tdoa_blink_t *)tx_buffer;
+    uwb_fill_header(&pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_TDOA_BLINK);
+    pkt->blink_seq = blink_seq;
+
+    dwt_writetxdata(sizeof(uwb_pkt_tdoa_blink_t), (uint8_t *)pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_tdoa_blink_t), 0, 1);
+
+    // in its slot after the sync, no answer, back to listening for the next sync
+    dwt_forcetrxoff();
+    dwt_rxreset();
+    dwt_setdelayedtrxtime(tx_time);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+    if (uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS) {
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+    return true;
+}
+
+uint8_t uwb_send_tdoa_report(uint16_t dest_id, const uwb_tdoa_entry_t *entries, uint8_t num_entries, uint32_t tx_time){
+    if (num_entries == 0 || num_entries > UWB_TDOA_REPORT_MAX_ENTRIES) {
+        return false;
+    }
+
+    // only the used entries go on air
+    uint16_t len = UWB_TDOA_REPORT_LEN(num_entries);
+    uwb_pkt_tdoa_report_t *pkt = (uwb_pkt_tdoa_report_t *)tx_buffer;
+    uwb_fill_header(&pkt->header, dest_id, UWB_MSG_TYPE_TDOA_REPORT);
+    pkt->num_entries = num_entries;
+    memcpy((uint8_t *)pkt + offsetof(uwb_pkt_tdoa_report_t, entries), entries, num_entries * sizeof(uwb_tdoa_entry_t));
+
+    dwt_writetxdata(len, (uint8_t *)pkt, 0);
+    dwt_writetxfctrl(len, 0, 1);
+
+    dwt_forcetrxoff();
+    dwt_setdelayedtrxtime(tx_time);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+    if (uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_TDOA_REPORT_TX_FAIL);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+    return true;
+}
+
+// start the RANGE POLL (or RANGE POLL SS) to the responder node, return false if TX failed
+static uint8_t uwb_start_range_poll(uint16_t target_node_id, uint8_t msg_type){
+    uwb_pkt_range_poll_t *poll_pkt = (uwb_pkt_range_poll_t *)tx_buffer;
+    uwb_fill_header(&poll_pkt->header, target_node_id, msg_type);
+
+    dwt_writetxdata(sizeof(uwb_pkt_range_poll_t), (uint8_t *)poll_pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_poll_t), 0, 1);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(uwb_phy_timing.resp_rx_timeout_uus);
+
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
     if (succ != DWT_SUCCESS) {
-        safe_printf("[uwb_send_range_trigger] Failed to start TX for RANGE TRIGGER\n");
+        UWB_LOG0(UWB_LOG_POLL_TX_FAIL);
+        
+        uwb_state = UWB_STATE_IDLE;
         dwt_forcetrxoff();
         dwt_rxreset();
         dwt_setrxtimeout(0);
@@ -443,17 +902,28 @@ uint8_t uwb_send_range_trigger(uint16_t initiator_id, uint16_t responder_id){
         return false;
     }
 
+    uwb_state = (msg_type == UWB_MSG_TYPE_RANGE_POLL_SS) ? UWB_STATE_WAIT_RANGE_RESP_SS : UWB_STATE_WAIT_RANGE_RESP;
     return true;
 }
 
+// range with the next target of the trigger multi session, do nothing if no session
+static void uwb_range_multi_next(){
+    while (range_multi_index < range_multi_count) {
+        uint16_t target_node_id = range_multi_targets[range_multi_index++];
+        dwt_forcetrxoff(); // callers may have re-enabled RX already
+        if (uwb_start_range_poll(target_node_id, UWB_MSG_TYPE_RANGE_POLL)) {
+            return;
+        }
+    }
+    // all targets done
+    range_multi_count = 0;
+    range_multi_index = 0;
+}
+
 // HANDLE FUNCTIONS
 void uwb_handle_ping_req(uwb_pkt_ping_req_t *pkt){
     uwb_pkt_ping_resp_t *resp = (uwb_pkt_ping_resp_t *)tx_buffer;
-    resp->header.group_id = uwb_group_id;
-    resp->header.src_id = uwb_node_id;
-    resp->header.dest_id = pkt->header.src_id;
-    resp->header.seq_num = seq_num++;
-    resp->header.msg_type = UWB_MSG_TYPE_PING_RESP;
+    uwb_fill_header(&resp->header, pkt->header.src_id, UWB_MSG_TYPE_PING_RESP);
     resp->system_state = millis(); // example system state
     resp->voltage_mv = get_battery_voltage_mv(); 
     
@@ -465,7 +935,7 @@ void uwb_handle_ping_req(uwb_pkt_ping_req_t *pkt){
     dwt_forcetrxoff();
     dwt_rxreset();
     dwt_setrxtimeout(0);
-    dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
 
     // safe_printf("[uwb_handle_ping_req] Sent PING RESP to node_id=0x%04X\n", pkt->header.src_id);
 }
@@ -476,6 +946,14 @@ void uwb_handle_ping_resp(uwb_pkt_ping_resp_t *pkt){
     ping_resp_ts = millis();
     ping_resp_node_id = pkt->header.src_id;
     ping_resp_received = true;
+
+    uwb_result_t result;
+    result.type = UWB_RESULT_PING_RESP;
+    result.ts = ping_resp_ts;
+    result.ping.node_id = ping_resp_node_id;
+    result.ping.system_state = ping_resp_system_state;
+    result.ping.voltage_mv = ping_resp_voltage_mv;
+    uwb_result_push(&result);
     
     uwb_state = UWB_STATE_IDLE;
     dwt_forcetrxoff();
@@ -488,50 +966,194 @@ void uwb_handle_ping_resp(uwb_pkt_ping_resp_t *pkt){
 
 void uwb_handle_range_trigger(uwb_pkt_range_trigger_t *pkt){
     // send RANGE POLL to responder node
-    
-    uwb_pkt_range_poll_t *poll_pkt = (uwb_pkt_range_poll_t *)tx_buffer;
-    poll_pkt->header.group_id = uwb_group_id;
-    poll_pkt->header.src_id = uwb_node_id;
-    poll_pkt->header.dest_id = pkt->target_node_id;
-    poll_pkt->header.seq_num = seq_num++;
-    poll_pkt->header.msg_type = UWB_MSG_TYPE_RANGE_POLL;
+    uwb_start_range_poll(pkt->target_node_id, UWB_MSG_TYPE_RANGE_POLL);
+}
 
-    dwt_writetxdata(sizeof(uwb_pkt_range_poll_t), (uint8_t *)poll_pkt, 0);
-    dwt_writetxfctrl(sizeof(uwb_pkt_range_poll_t), 0, 1);
+void uwb_handle_range_trigger_ss(uwb_pkt_range_trigger_t *pkt){
+    // single-sided, the responder replies with its timestamps and no final follows
+    uwb_start_range_poll(pkt->target_node_id, UWB_MSG_TYPE_RANGE_POLL_SS);
+}
+
+uint8_t uwb_range_multi_start(const uint16_t *responder_ids, uint8_t num_responders){
+    if (num_responders > UWB_RANGE_MULTI_MAX_TARGETS) {
+        num_responders = UWB_RANGE_MULTI_MAX_TARGETS;
+    }
+    if (num_responders == 0) {
+        return false;
+    }
+
+    for (int i = 0; i < num_responders; i++) {
+        range_multi_targets[i] = responder_ids[i];
+    }
+    range_multi_count = num_responders;
+    range_multi_index = 0;
+
+    // send RANGE POLL to the first responder, the rest follow after each report
+    uwb_range_multi_next();
+    return true;
+}
+
+uint8_t uwb_range_bcast_start(const uint16_t *responder_ids, uint8_t num_responders){
+    if (num_responders > UWB_RANGE_MULTI_MAX_TARGETS) {
+        num_responders = UWB_RANGE_MULTI_MAX_TARGETS;
+    }
+    if (num_responders == 0) {
+        return false;
+    }
+
+    memcpy(range_bcast_anchors, responder_ids, num_responders * sizeof(uint16_t));
+    memset(range_bcast_resp_rx_ts, 0, sizeof(range_bcast_resp_rx_ts));
+    range_bcast_count = num_responders;
+    range_bcast_rx_count = 0;
+
+    uwb_pkt_range_poll_bcast_t *poll_pkt = (uwb_pkt_range_poll_bcast_t *)tx_buffer;
+    memset(poll_pkt, 0, sizeof(uwb_pkt_range_poll_bcast_t));
+    uwb_fill_header(&poll_pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_RANGE_POLL_BCAST);
+    poll_pkt->num_anchors = num_responders;
+    memcpy((uint8_t *)poll_pkt + offsetof(uwb_pkt_range_poll_bcast_t, anchor_ids), responder_ids, num_responders * sizeof(uint16_t));
+
+    // the resp window ends after the last reply slot
+    // slots are built from the delay of the PHY profile, the same on all nodes, prof tune is per node
+    uint32_t resp_uus = uwb_phy_frame_uus(sizeof(uwb_pkt_range_resp_t));
+    uint32_t slot_uus = resp_uus + UWB_PHY_REPLY_PROCESS_UUS;
+    uint32_t window_uus = uwb_phy_frame_uus(sizeof(uwb_pkt_range_poll_bcast_t)) + uwb_phy_timing.resp_tx_delay_uus
+                        + (num_responders - 1) * slot_uus + resp_uus + UWB_PHY_RX_TIMEOUT_MARGIN_UUS;
+    range_bcast_window_end = dwt_readsystimestamphi32() + window_uus * (UUS_TO_DWT_TIME >> 8);
+
+    dwt_forcetrxoff();
+    dwt_writetxdata(sizeof(uwb_pkt_range_poll_bcast_t), (uint8_t *)poll_pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_poll_bcast_t), 0, 1);
     dwt_setrxaftertxdelay(0);
-    dwt_setrxtimeout(RANGE_RESP_RX_TIMEOUT_UUS);
+    dwt_setrxtimeout(window_uus > 0xFFFF ? 0xFFFF : window_uus);
 
-    int succ = dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    int succ = uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
     if (succ != DWT_SUCCESS) {
-        safe_printf("[uwb_handle_range_trigger] Failed to start TX for RANGE POLL\n");
+        UWB_LOG0(UWB_LOG_POLL_TX_FAIL);
         
         uwb_state = UWB_STATE_IDLE;
+        range_bcast_count = 0;
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return false;
+    }
+
+    uwb_state = UWB_STATE_WAIT_RANGE_RESP_BCAST;
+    return true;
+}
+
+// send the single final with all resp RX timestamps of the broadcast poll
+static void uwb_range_bcast_send_final(){
+    // not tied to a RX timestamp, count the delay from now
+    // the anchors wait for it with the delay of the PHY profile, not a tuned one
+    uint32_t final_tx_time = dwt_readsystimestamphi32() + uwb_phy_timing.final_tx_delay_uus * (UUS_TO_DWT_TIME >> 8);
+    uint32_t final_tx_ts = (((uint64_t)(final_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
+
+    uwb_pkt_range_final_bcast_t *final_pkt = (uwb_pkt_range_final_bcast_t *)tx_buffer;
+    memset(final_pkt, 0, sizeof(uwb_pkt_range_final_bcast_t));
+    uwb_fill_header(&final_pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_RANGE_FINAL_BCAST);
+    final_pkt->num_anchors = range_bcast_count;
+    final_pkt->poll_tx_ts = (uint32_t)get_tx_timestamp();
+    final_pkt->final_tx_ts = final_tx_ts;
+    memcpy((uint8_t *)final_pkt + offsetof(uwb_pkt_range_final_bcast_t, anchor_ids), range_bcast_anchors, range_bcast_count * sizeof(uint16_t));
+    memcpy((uint8_t *)final_pkt + offsetof(uwb_pkt_range_final_bcast_t, resp_rx_ts), range_bcast_resp_rx_ts, range_bcast_count * sizeof(uint32_t));
+
+    dwt_writetxdata(sizeof(uwb_pkt_range_final_bcast_t), (uint8_t *)final_pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_final_bcast_t), 0, 1);
+
+    range_bcast_count = 0;
+    uwb_state = UWB_STATE_IDLE;
+    dwt_setdelayedtrxtime(final_tx_time);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+    int succ = uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_FINAL_TX_FAIL);
         dwt_forcetrxoff();
         dwt_rxreset();
         dwt_setrxtimeout(0);
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    }
+}
+
+// keep receiving until all anchors replied or the window is over, then send the final
+static void uwb_range_bcast_continue(){
+    // high 32 bit of system time, 256 units per uus
+    int32_t remaining_uus = (int32_t)(range_bcast_window_end - dwt_readsystimestamphi32()) / (int32_t)(UUS_TO_DWT_TIME >> 8);
+
+    if (range_bcast_rx_count < range_bcast_count && remaining_uus > 0) {
+        dwt_setrxtimeout(remaining_uus > 0xFFFF ? 0xFFFF : remaining_uus);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
         return;
     }
 
-    uwb_state = UWB_STATE_WAIT_RANGE_RESP;
+    dwt_forcetrxoff();
+    if (range_bcast_rx_count > 0) {
+        uwb_range_bcast_send_final();
+        return;
+    }
+
+    // no anchor replied
+    if (_uwb_event_callback) {
+        _uwb_event_callback(UWB_EVENT_RANGE_RESP_TIMEOUT, NULL);
+    }
+    range_bcast_count = 0;
+    uwb_state = UWB_STATE_IDLE;
+    dwt_rxreset();
+    dwt_setrxtimeout(0);
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+}
+
+static void uwb_range_bcast_on_resp(uwb_pkt_range_resp_t *pkt){
+    for (int i = 0; i < range_bcast_count; i++) {
+        if (range_bcast_anchors[i] == pkt->header.src_id && range_bcast_resp_rx_ts[i] == 0) {
+            range_bcast_resp_rx_ts[i] = (uint32_t)get_rx_timestamp();
+            range_bcast_rx_count++;
+            break;
+        }
+    }
+    uwb_range_bcast_continue();
+}
+
+void uwb_handle_range_trigger_multi(uwb_pkt_range_trigger_multi_t *pkt){
+    // packed ids are not 16 bit aligned
+    uint16_t target_node_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+    memcpy(target_node_ids, (uint8_t *)pkt + offsetof(uwb_pkt_range_trigger_multi_t, target_node_ids), sizeof(target_node_ids));
+    uwb_range_multi_start(target_node_ids, pkt->num_targets);
+}
+
+void uwb_handle_range_trigger_bcast(uwb_pkt_range_trigger_multi_t *pkt){
+    // packed ids are not 16 bit aligned
+    uint16_t target_node_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+    memcpy(target_node_ids, (uint8_t *)pkt + offsetof(uwb_pkt_range_trigger_multi_t, target_node_ids), sizeof(target_node_ids));
+    uwb_range_bcast_start(target_node_ids, pkt->num_targets);
 }
 
 void uwb_handle_range_poll(uwb_pkt_range_poll_t *pkt){
+    uwb_profile_mark(UWB_PROFILE_STAGE_HANDLER);
     
     // save poll RX timestamp
     uint64_t poll_rx_ts_64 = get_rx_timestamp();
 
-    poll_rx_ts_presave = (uint32_t)poll_rx_ts_64;
+    uint32_t resp_tx_time = (poll_rx_ts_64 + (uint64_t)uwb_resp_tx_delay_uus*UUS_TO_DWT_TIME)>>8;
 
-    uint32_t resp_tx_time = (poll_rx_ts_64 + RANGE_RESP_TX_DELAY_UUS*UUS_TO_DWT_TIME)>>8;
+    // per initiator exchange, the final is matched by the session table
+    unsigned long deadline_ms = millis() + (uwb_resp_tx_delay_uus + uwb_phy_timing.final_rx_timeout_uus) / 1000 + 1;
+    uwb_session_t *session = uwb_session_open(pkt->header.src_id, pkt->header.seq_num, deadline_ms);
+    if (session == NULL) {
+        UWB_LOG1(UWB_LOG_SESSION_FULL, pkt->header.src_id);
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
+    session->poll_rx_ts = (uint32_t)poll_rx_ts_64;
+    // 真實從天線發射的時間 = 設定的時間 + TX_ANT_DLY
+    session->resp_tx_ts = (uint32_t)((((uint64_t)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY);
     
     // send RANGE RESP to initiator node
     uwb_pkt_range_resp_t *resp_pkt = (uwb_pkt_range_resp_t *)tx_buffer;
-    resp_pkt->header.group_id = uwb_group_id;
-    resp_pkt->header.src_id = uwb_node_id;
-    resp_pkt->header.dest_id = pkt->header.src_id;
-    resp_pkt->header.seq_num = seq_num++;
-    resp_pkt->header.msg_type = UWB_MSG_TYPE_RANGE_RESP;
+    uwb_fill_header(&resp_pkt->header, pkt->header.src_id, UWB_MSG_TYPE_RANGE_RESP);
 
     dwt_writetxdata(sizeof(uwb_pkt_range_resp_t), (uint8_t *)resp_pkt, 0);
     dwt_writetxfctrl(sizeof(uwb_pkt_range_resp_t), 0, 1);
@@ -539,11 +1161,15 @@ void uwb_handle_range_poll(uwb_pkt_range_poll_t *pkt){
     // dwt_rxreset();
     dwt_setdelayedtrxtime(resp_tx_time);
     dwt_setrxaftertxdelay(0);
-    dwt_setrxtimeout(RANGE_FINAL_RX_TIMEOUT_UUS);
-    int succ = dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    // listen to everyone after the resp, polls of other initiators can interleave
+    dwt_setrxtimeout(0);
+    uwb_profile_reply_starttx(UWB_PROFILE_REPLY_RESP, poll_rx_ts_64);
+    int succ = uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    uwb_profile_reply_result(UWB_PROFILE_REPLY_RESP, succ == DWT_SUCCESS);
     if (succ != DWT_SUCCESS) {
-        safe_printf("[uwb_handle_range_poll] Failed to start TX for RANGE RESP\n");
+        UWB_LOG0(UWB_LOG_RESP_TX_FAIL);
         
+        uwb_session_close(session);
         uwb_state = UWB_STATE_IDLE;
         dwt_forcetrxoff();
         dwt_rxreset();
@@ -551,28 +1177,30 @@ void uwb_handle_range_poll(uwb_pkt_range_poll_t *pkt){
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
         return;
     }
-    uwb_state = UWB_STATE_WAIT_RANGE_FINAL;
+    uwb_state = UWB_STATE_IDLE;
 }
 
 void uwb_handle_range_resp(uwb_pkt_range_resp_t *pkt){
-    
+    if (uwb_state == UWB_STATE_WAIT_RANGE_RESP_BCAST) {
+        // one of the staggered replies of a broadcast poll
+        uwb_range_bcast_on_resp(pkt);
+        return;
+    }
+    uwb_profile_mark(UWB_PROFILE_STAGE_HANDLER);
+
     // send RANGE FINAL to responder node
     uint64_t poll_tx_ts = get_tx_timestamp();
     uint64_t resp_rx_ts = get_rx_timestamp();
 
     // high 32bit of timestamp, this if for dwt_setdelayedtrxtime()
-    uint32_t final_tx_time = (resp_rx_ts + RANGE_FINAL_TX_DELAY_UUS*UUS_TO_DWT_TIME)>>8;
+    uint32_t final_tx_time = (resp_rx_ts + (uint64_t)uwb_final_tx_delay_uus*UUS_TO_DWT_TIME)>>8;
     
     // 真實從天線發射的時間 = 設定的時間 + TX_ANT_DLY
     // only keep lower 32bit for calculation
     uint32_t final_tx_ts = (((uint64_t)(final_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
     
     uwb_pkt_range_final_t *final_pkt = (uwb_pkt_range_final_t *)tx_buffer;
-    final_pkt->header.group_id = uwb_group_id;
-    final_pkt->header.src_id = uwb_node_id;
-    final_pkt->header.dest_id = pkt->header.src_id;
-    final_pkt->header.seq_num = seq_num++;
-    final_pkt->header.msg_type = UWB_MSG_TYPE_RANGE_FINAL;
+    uwb_fill_header(&final_pkt->header, pkt->header.src_id, UWB_MSG_TYPE_RANGE_FINAL);
     final_pkt->poll_tx_ts = (uint32_t)(poll_tx_ts);
     final_pkt->resp_rx_ts = (uint32_t)(resp_rx_ts);
     final_pkt->final_tx_ts = (uint32_t)(final_tx_ts);
@@ -580,157 +1208,333 @@ void uwb_handle_range_resp(uwb_pkt_range_resp_t *pkt){
     dwt_writetxdata(sizeof(uwb_pkt_range_final_t), (uint8_t *)final_pkt, 0);
     dwt_writetxfctrl(sizeof(uwb_pkt_range_final_t), 0, 1);
 
+    // in trigger multi session, wait the report of this responder before ranging with the next one
+    bool wait_report = (range_multi_count > 0);
+
     dwt_setdelayedtrxtime(final_tx_time); // 40bit time, but function takes upper 32bit
     dwt_setrxaftertxdelay(0);
-    dwt_setrxtimeout(0);
-    int succ = dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    dwt_setrxtimeout(wait_report ? uwb_phy_timing.report_rx_timeout_uus : 0);
+    uwb_profile_reply_starttx(UWB_PROFILE_REPLY_FINAL, resp_rx_ts);
+    int succ = uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    uwb_profile_reply_result(UWB_PROFILE_REPLY_FINAL, succ == DWT_SUCCESS);
     if (succ != DWT_SUCCESS) {
-        safe_printf("[uwb_handle_range_resp] Failed to start TX for RANGE FINAL\n");
+        UWB_LOG0(UWB_LOG_FINAL_TX_FAIL);
         
         uwb_state = UWB_STATE_IDLE;
         dwt_forcetrxoff();
         dwt_rxreset();
         dwt_setrxtimeout(0);
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        uwb_range_multi_next();
         return;
     }
 
-    uwb_state = UWB_STATE_IDLE;
+    uwb_state = wait_report ? UWB_STATE_WAIT_RANGE_REPORT : UWB_STATE_IDLE;
 }
 
-void uwb_handle_range_final(uwb_pkt_range_final_t *pkt){
-
-    // from the initiator node timestamps
-    uint32_t poll_tx_ts = pkt->poll_tx_ts;
-    uint32_t resp_rx_ts = pkt->resp_rx_ts;
-    uint32_t final_tx_ts = pkt->final_tx_ts;
-
-    // from the responder node timestamp
-    uint32_t poll_rx_ts = poll_rx_ts_presave;
-    uint32_t resp_tx_ts = get_tx_timestamp();
-    uint32_t final_rx_ts = get_rx_timestamp();
-
-    // user manual p229, 12.3.2 using thre messages
-    float round1 = (float)( resp_rx_ts  - poll_tx_ts);
-    float round2 = (float)( final_rx_ts - resp_tx_ts);
-    float reply1 = (float)( resp_tx_ts  - poll_rx_ts);
-    float reply2 = (float)( final_tx_ts - resp_rx_ts);
-
-    float tof_dtu = (round1 * round2 - reply1 * reply2) / (round1 + round2 + reply1 + reply2); // todo: round
-    float tof_s = tof_dtu * DWT_TIME_UNITS;
-    float distance_m = tof_s * SPEED_OF_LIGHT;
-
+// save the range final result and broadcast the range report
+// delayed_report sends the report at report_tx_time (high 32 bit of system time) instead of immediately
+static void uwb_range_finish(uint16_t node_a_id, uint16_t node_b_id, int32_t distance_mm, bool delayed_report, uint32_t report_tx_time){
     dwt_rxdiag_t rx_diag;
     dwt_readdiagnostics(&rx_diag);
     float rssi = calc_rssi(&rx_diag);
     
     range_final_received = true;
     range_final_ts = millis();
-    range_final_node_a_id = pkt->header.src_id;
-    range_final_node_b_id = pkt->header.dest_id;
-    range_final_distance_m = (distance_m>0) ? distance_m : 0.0;
+    range_final_node_a_id = node_a_id;
+    range_final_node_b_id = node_b_id;
+    if (distance_mm < 0) {
+        distance_mm = 0;
+    }
+    range_final_distance_m = distance_mm / 1000.0f;
     range_final_rssi_dbm = rssi;
 
-    // send the range report to address 0xFFFF (broadcast)
+    uwb_result_t result;
+    result.type = UWB_RESULT_RANGE_FINAL;
+    result.ts = range_final_ts;
+    result.range.node_a_id = range_final_node_a_id;
+    result.range.node_b_id = range_final_node_b_id;
+    result.range.distance_mm = distance_mm;
+    result.range.rssi_dbm = range_final_rssi_dbm;
+    uwb_result_push(&result);
+
+    // send the range report to all nodes
     uwb_pkt_range_report_t *report_pkt = (uwb_pkt_range_report_t *)tx_buffer;
-    report_pkt->header.group_id = uwb_group_id;
-    report_pkt->header.src_id = uwb_node_id;
-    report_pkt->header.dest_id = 0xFFFF; // broadcast
-    report_pkt->header.seq_num = seq_num++;
-    report_pkt->header.msg_type = UWB_MSG_TYPE_RANGE_REPORT;
-    report_pkt->node_a_id = pkt->header.src_id;
-    report_pkt->node_b_id = pkt->header.dest_id;
-    report_pkt->distance_cm = (distance_m>0)  ? (uint16_t)(distance_m * 100.0f) : 0;
+    uwb_fill_header(&report_pkt->header, UWB_BROADCAST_ID, UWB_MSG_TYPE_RANGE_REPORT);
+    report_pkt->node_a_id = node_a_id;
+    report_pkt->node_b_id = node_b_id;
+    report_pkt->distance_mm = distance_mm;
     report_pkt->rssi_centi_dbm = (int16_t)(rssi * 100.0f);
 
     dwt_writetxdata(sizeof(uwb_pkt_range_report_t), (uint8_t *)report_pkt, 0);
     dwt_writetxfctrl(sizeof(uwb_pkt_range_report_t), 0, 1);
 
     uwb_state = UWB_STATE_IDLE;
+    if (!delayed_report) {
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        uwb_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+        return;
+    }
+
+    // staggered report of a broadcast poll
     dwt_forcetrxoff();
-    dwt_rxreset();
+    dwt_setdelayedtrxtime(report_tx_time);
+    dwt_setrxaftertxdelay(0);
     dwt_setrxtimeout(0);
-    dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+    if (uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_REPORT_TX_FAIL);
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    }
+}
+
+void uwb_handle_range_final(uwb_pkt_range_final_t *pkt){
+    uwb_session_t *session = uwb_session_find(pkt->header.src_id, pkt->header.seq_num);
+    if (session == NULL) {
+        // no poll of this exchange, or it expired
+        UWB_LOG1(UWB_LOG_SESSION_MISS, pkt->header.src_id);
+        uwb_session_expire();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
+
+    // from the initiator node timestamps
+    uint32_t poll_tx_ts = pkt->poll_tx_ts;
+    uint32_t resp_rx_ts = pkt->resp_rx_ts;
+    uint32_t final_tx_ts = pkt->final_tx_ts;
+
+    // from the responder node timestamp, TX timestamp register may belong to a later resp
+    uint32_t poll_rx_ts = session->poll_rx_ts;
+    uint32_t resp_tx_ts = session->resp_tx_ts;
+    uint32_t final_rx_ts = get_rx_timestamp();
+    uwb_session_close(session);
+
+    // kernel selected by UWB_TWR_USE_FLOAT in uwb_twr.h
+    int32_t distance_mm = uwb_twr_ds_distance_mm(poll_tx_ts, resp_rx_ts, final_tx_ts, poll_rx_ts, resp_tx_ts, final_rx_ts);
+    uwb_range_finish(pkt->header.src_id, pkt->header.dest_id, distance_mm, false, 0);
     
-    // safe_printf("[uwb_handle_range_final] distance A(0x%04X) ~ B(0x%04X): %.3f m, rssi: %.2f dBm\n",pkt->header.src_id,pkt->header.dest_id,distance_m,rssi);
+    // safe_printf("[uwb_handle_range_final] distance A(0x%04X) ~ B(0x%04X): %d mm\n",pkt->header.src_id,pkt->header.dest_id,(int)distance_mm);
 }
 
-void uwb_handle_range_final__(uwb_pkt_range_final_t *pkt){
-    // safe_printf("Handling RANGE FINAL\n");
+void uwb_handle_range_poll_ss(uwb_pkt_range_poll_t *pkt){
+    uwb_profile_mark(UWB_PROFILE_STAGE_HANDLER);
 
-    // // from the initiator node timestamps
-    // uint32_t poll_tx_ts = pkt->poll_tx_ts;
-    // uint32_t resp_rx_ts = pkt->resp_rx_ts;
-    // uint32_t final_tx_ts = pkt->final_tx_ts;
+    uint64_t poll_rx_ts_64 = get_rx_timestamp();
+    uint32_t resp_tx_time = (poll_rx_ts_64 + (uint64_t)uwb_resp_tx_delay_uus*UUS_TO_DWT_TIME)>>8;
 
-    // // from the responder node timestamp
-    // uint32_t poll_rx_ts = poll_rx_ts_presave;
-    // uint32_t resp_tx_ts = get_tx_timestamp();
-    // uint32_t final_rx_ts = get_rx_timestamp();
+    // send RANGE RESP SS with both responder timestamps, no final follows so nothing is kept
+    uwb_pkt_range_resp_ss_t *resp_pkt = (uwb_pkt_range_resp_ss_t *)tx_buffer;
+    uwb_fill_header(&resp_pkt->header, pkt->header.src_id, UWB_MSG_TYPE_RANGE_RESP_SS);
+    resp_pkt->poll_rx_ts = (uint32_t)poll_rx_ts_64;
+    // 真實從天線發射的時間 = 設定的時間 + TX_ANT_DLY
+    resp_pkt->resp_tx_ts = (uint32_t)((((uint64_t)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY);
 
+    dwt_writetxdata(sizeof(uwb_pkt_range_resp_ss_t), (uint8_t *)resp_pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_resp_ss_t), 0, 1);
+    dwt_setdelayedtrxtime(resp_tx_time);
+    dwt_setrxaftertxdelay(0);
+    dwt_setrxtimeout(0);
+    uwb_profile_reply_starttx(UWB_PROFILE_REPLY_RESP, poll_rx_ts_64);
+    int succ = uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    uwb_profile_reply_result(UWB_PROFILE_REPLY_RESP, succ == DWT_SUCCESS);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_RESP_TX_FAIL);
 
-    uint32_t poll_tx_ts, resp_rx_ts, final_tx_ts;
-    uint32_t poll_rx_ts_32, resp_tx_ts_32, final_rx_ts_32;
-    double Ra, Rb, Da, Db;
-    int64_t tof_dtu;
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    }
+    uwb_state = UWB_STATE_IDLE;
+}
 
-    uint64_t resp_tx_ts = get_tx_timestamp();
-    uint64_t final_rx_ts = get_rx_timestamp();
+void uwb_handle_range_resp_ss(uwb_pkt_range_resp_ss_t *pkt){
+    uwb_profile_mark(UWB_PROFILE_STAGE_HANDLER);
 
-    poll_tx_ts = pkt->poll_tx_ts;
-    resp_rx_ts = pkt->resp_rx_ts;
-    final_tx_ts = pkt->final_tx_ts;
+    uint32_t poll_tx_ts = (uint32_t)get_tx_timestamp();
+    uint32_t resp_rx_ts = (uint32_t)get_rx_timestamp();
 
+    // carrier integrator of the resp just received gives the responder clock offset
+    const dwt_config_t *config = &uwb_phy_current()->config;
+    int32_t clock_offset_ppb = uwb_twr_clock_offset_ppb(dwt_readcarrierintegrator(), config->chan, config->dataRate);
 
-    poll_rx_ts_32 = (uint32)poll_rx_ts_presave;
-    resp_tx_ts_32 = (uint32)resp_tx_ts;
-    final_rx_ts_32 = (uint32)final_rx_ts;
-    Ra = (double)(resp_rx_ts - poll_tx_ts);
-    Rb = (double)(final_rx_ts_32 - resp_tx_ts_32);
-    Da = (double)(final_tx_ts - resp_rx_ts);
-    Db = (double)(resp_tx_ts_32 - poll_rx_ts_32);
-    tof_dtu = (int64_t)((Ra * Rb - Da * Db) / (Ra + Rb + Da + Db));
+    int32_t distance_mm = uwb_twr_ss_distance_mm(poll_tx_ts, resp_rx_ts, pkt->poll_rx_ts, pkt->resp_tx_ts, clock_offset_ppb);
 
-    double tof = tof_dtu * DWT_TIME_UNITS;
-    double distance = tof * SPEED_OF_LIGHT;
-    
-    dwt_rxdiag_t rx_diag;
-    dwt_readdiagnostics(&rx_diag);
-    // float rssi = calc_rssi(&rx_diag);
-    safe_printf("DIST: %3.2f m\n", distance);
-                        
+    // the initiator has the result, it sends the report itself
+    uwb_range_finish(uwb_node_id, pkt->header.src_id, distance_mm, false, 0);
+}
 
+// index of this node in a packed anchor id list of a broadcast poll, -1 if not listed
+static int uwb_range_bcast_slot(const uint8_t *packed_ids, uint8_t num_anchors){
+    if (num_anchors > UWB_RANGE_MULTI_MAX_TARGETS) {
+        num_anchors = UWB_RANGE_MULTI_MAX_TARGETS;
+    }
+    for (int i = 0; i < num_anchors; i++) {
+        uint16_t id;
+        memcpy(&id, packed_ids + i * sizeof(uint16_t), sizeof(uint16_t)); // not 16 bit aligned
+        if (id == uwb_node_id) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    // print all number for debug
-    // safe_printf("poll_tx_ts: %u, resp_rx_ts: %u, final_tx_ts: %u\n",poll_tx_ts,resp_rx_ts,final_tx_ts);
-    // safe_printf("poll_rx_ts: %u, resp_tx_ts: %u, final_rx_ts: %u\n",poll_rx_ts,resp_tx_ts,final_rx_ts);
-    // safe_printf("round1: %u, round2: %u, reply1: %u, reply2: %u\n",round1,round2,reply1,reply2);
-    // safe_printf("tof_dtu: %.3f, tof_s: %.9f\n",tof_dtu,tof_s);
-   
-    // safe_printf("calculated distance node A (0x%04X) to node B (0x%04X): %.3f m\n",pkt->header.src_id,pkt->header.dest_id,distance_m);
+void uwb_handle_range_poll_bcast(uwb_pkt_range_poll_bcast_t *pkt){
+    int slot = uwb_range_bcast_slot((uint8_t *)pkt + offsetof(uwb_pkt_range_poll_bcast_t, anchor_ids), pkt->num_anchors);
+    if (slot < 0) {
+        // not for this anchor, keep listening
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
 
-    uwb_state = UWB_STATE_IDLE;
-    // dwt_forcetrxoff();
-    // dwt_rxreset();
+    uint64_t poll_rx_ts_64 = get_rx_timestamp();
+    // anchor i replies i slots after the reply delay of the PHY profile, shared by all anchors and
+    // the initiator window, the delay of prof tune is per node and would shift the slots
+    uint32_t slot_uus = uwb_phy_frame_uus(sizeof(uwb_pkt_range_resp_t)) + UWB_PHY_REPLY_PROCESS_UUS;
+    uint64_t resp_delay_uus = uwb_phy_timing.resp_tx_delay_uus + (uint64_t)slot * slot_uus;
+    uint32_t resp_tx_time = (poll_rx_ts_64 + resp_delay_uus*UUS_TO_DWT_TIME)>>8;
+
+    // the final comes after the remaining reply slots
+    uint8_t num_anchors = (pkt->num_anchors > UWB_RANGE_MULTI_MAX_TARGETS) ? UWB_RANGE_MULTI_MAX_TARGETS : pkt->num_anchors;
+    uint32_t final_wait_uus = resp_delay_uus + (num_anchors - slot) * slot_uus + uwb_phy_timing.final_tx_delay_uus
+                            + uwb_phy_frame_uus(sizeof(uwb_pkt_range_final_bcast_t)) + UWB_PHY_RX_TIMEOUT_MARGIN_UUS;
+
+    uwb_session_t *session = uwb_session_open(pkt->header.src_id, pkt->header.seq_num, millis() + final_wait_uus / 1000 + 1);
+    if (session == NULL) {
+        UWB_LOG1(UWB_LOG_SESSION_FULL, pkt->header.src_id);
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
+    session->slot = slot;
+    session->poll_rx_ts = (uint32_t)poll_rx_ts_64;
+    session->resp_tx_ts = (uint32_t)((((uint64_t)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY);
+
+    uwb_pkt_range_resp_t *resp_pkt = (uwb_pkt_range_resp_t *)tx_buffer;
+    uwb_fill_header(&resp_pkt->header, pkt->header.src_id, UWB_MSG_TYPE_RANGE_RESP);
+
+    dwt_writetxdata(sizeof(uwb_pkt_range_resp_t), (uint8_t *)resp_pkt, 0);
+    dwt_writetxfctrl(sizeof(uwb_pkt_range_resp_t), 0, 1);
+    dwt_setdelayedtrxtime(resp_tx_time);
+    dwt_setrxaftertxdelay(0);
     dwt_setrxtimeout(0);
-    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    int succ = uwb_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED);
+    if (succ != DWT_SUCCESS) {
+        UWB_LOG0(UWB_LOG_RESP_TX_FAIL);
+        
+        uwb_session_close(session);
+        uwb_state = UWB_STATE_IDLE;
+        dwt_forcetrxoff();
+        dwt_rxreset();
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
+    uwb_state = UWB_STATE_IDLE;
+}
+
+void uwb_handle_range_final_bcast(uwb_pkt_range_final_bcast_t *pkt){
+    uwb_session_t *session = uwb_session_find(pkt->header.src_id, pkt->header.seq_num);
+    int slot = uwb_range_bcast_slot((uint8_t *)pkt + offsetof(uwb_pkt_range_final_bcast_t, anchor_ids), pkt->num_anchors);
+    uint32_t resp_rx_ts = 0;
+    if (session != NULL && slot >= 0) {
+        memcpy(&resp_rx_ts, (uint8_t *)pkt + offsetof(uwb_pkt_range_final_bcast_t, resp_rx_ts) + slot * sizeof(uint32_t), sizeof(uint32_t));
+    }
+    if (resp_rx_ts == 0) {
+        // not polled, expired, or the tag missed the resp of this anchor
+        uwb_session_close(session);
+        uwb_session_expire();
+        uwb_state = UWB_STATE_IDLE;
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        return;
+    }
 
+    uint64_t final_rx_ts_64 = get_rx_timestamp();
+    int32_t distance_mm = uwb_twr_ds_distance_mm(pkt->poll_tx_ts, resp_rx_ts, pkt->final_tx_ts,
+                                                 session->poll_rx_ts, session->resp_tx_ts, (uint32_t)final_rx_ts_64);
+    uwb_session_close(session);
+
+    // reports are staggered like the resp, anchor i in report slot i
+    uint32_t slot_uus = uwb_phy_frame_uus(sizeof(uwb_pkt_range_report_t)) + UWB_PHY_REPLY_PROCESS_UUS;
+    uint64_t report_delay_uus = uwb_phy_timing.resp_tx_delay_uus + (uint64_t)slot * slot_uus;
+    uint32_t report_tx_time = (final_rx_ts_64 + report_delay_uus*UUS_TO_DWT_TIME)>>8;
+    uwb_range_finish(pkt->header.src_id, uwb_node_id, distance_mm, true, report_tx_time);
 }
 
 void uwb_handle_range_report(uwb_pkt_range_report_t *pkt){
-    
+    bool was_waiting = (uwb_state == UWB_STATE_WAIT_RANGE_REPORT);
+
     range_report_node_a_id = pkt->node_a_id;
     range_report_node_b_id = pkt->node_b_id;
-    range_report_distance_m = pkt->distance_cm / 100.0f;
+    range_report_distance_m = pkt->distance_mm / 1000.0f;
     range_report_rssi_dbm = pkt->rssi_centi_dbm / 100.0f;
     range_report_ts = millis();
     range_report_received = true;
+
+    uwb_result_t result;
+    result.type = UWB_RESULT_RANGE_REPORT;
+    result.ts = range_report_ts;
+    result.range.node_a_id = range_report_node_a_id;
+    result.range.node_b_id = range_report_node_b_id;
+    result.range.distance_mm = pkt->distance_mm;
+    result.range.rssi_dbm = range_report_rssi_dbm;
+    uwb_result_push(&result);
     
     uwb_state = UWB_STATE_IDLE;
-    dwt_setrxtimeout(0);
-    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    uwb_rx_listen();
+
+    // trigger multi session, go on with the next responder
+    if (was_waiting) {
+        uwb_range_multi_next();
+    }
+
+    // safe_printf("[uwb_handle_range_report] A(0x%04X) ~ B(0x%04X): %d mm, rssi: %.2f dBm\n", pkt->node_a_id, pkt->node_b_id, (int)pkt->distance_mm, range_report_rssi_dbm);
+}
+
+void uwb_handle_tdma_beacon(uwb_pkt_tdma_beacon_t *pkt){
+    // keep listening, tags arm their slot timer
+    uwb_state = UWB_STATE_IDLE;
+    uwb_rx_listen();
+
+    // packed ids are not 16 bit aligned
+    uint16_t tag_ids[UWB_TDMA_MAX_TAGS];
+    uint16_t anchor_ids[UWB_TDMA_MAX_ANCHORS];
+    memcpy(tag_ids, (uint8_t *)pkt + offsetof(uwb_pkt_tdma_beacon_t, tag_ids), sizeof(tag_ids));
+    memcpy(anchor_ids, (uint8_t *)pkt + offsetof(uwb_pkt_tdma_beacon_t, anchor_ids), sizeof(anchor_ids));
+    uwb_tdma_on_beacon(pkt->slot_ms, tag_ids, pkt->num_tags, anchor_ids, pkt->num_anchors);
+}
 
-    // safe_printf("[uwb_handle_range_report] A(0x%04X) ~ B(0x%04X): %.3f m, rssi: %.2f dBm\n", pkt->node_a_id, pkt->node_b_id, range_report_distance_m, range_report_rssi_dbm);
+void uwb_handle_tdoa_blink(uwb_pkt_tdoa_blink_t *pkt){
+    uint64_t rx_ts = get_rx_timestamp();
+    uwb_rx_listen();
+    uwb_tdoa_on_blink(pkt->header.src_id, pkt->blink_seq, rx_ts);
+}
+
+void uwb_handle_tdoa_sync(uwb_pkt_tdoa_sync_t *pkt){
+    uint64_t rx_ts = get_rx_timestamp();
+    uint64_t ref_tx_ts = ((uint64_t)pkt->tx_ts_hi << 32) | pkt->tx_ts_lo;
+    // keep listening, anchors with pending blinks replace it with their delayed report
+    uwb_rx_listen();
+    // packed layout, copy before use
+    uwb_tdoa_layout_t layout;
+    memcpy(&layout, &pkt->layout, sizeof(layout));
+    uwb_tdoa_on_sync(pkt->header.src_id, ref_tx_ts, rx_ts, &layout);
+}
+
+void uwb_handle_tdoa_report(uwb_pkt_tdoa_report_t *pkt){
+    uwb_rx_listen();
+
+    // packed entries, copy before use
+    uwb_tdoa_entry_t entries[UWB_TDOA_REPORT_MAX_ENTRIES];
+    memcpy(entries, (uint8_t *)pkt + offsetof(uwb_pkt_tdoa_report_t, entries), pkt->num_entries * sizeof(uwb_tdoa_entry_t));
+    uwb_tdoa_on_report(pkt->header.src_id, entries, pkt->num_entries);
 }
 
 
@@ -741,6 +1545,8 @@ void uwb_task_init(){
     }
 
     uwb_isr_sem = xSemaphoreCreateBinary();
+    uwb_ready_sem = xSemaphoreCreateBinary();
+    uwb_cmd_init();
     
     xTaskCreatePinnedToCore(
         uwb_task, // Function that implements the task.
@@ -752,19 +1558,46 @@ void uwb_task_init(){
         1  // run on core 1
     );
 
-    uwb_init();
-
+    // the radio is set up by uwb_task itself, the only task that calls the decadriver
+    xSemaphoreTake(uwb_ready_sem, portMAX_DELAY);
 }
 
 void uwb_task(void *pvParameters){
+    dw1000_port_set_owner(xTaskGetCurrentTaskHandle());
+    uwb_init();
+    xSemaphoreGive(uwb_ready_sem);
+
     while(1) {
-        if (xSemaphoreTake(uwb_isr_sem, portMAX_DELAY) == pdTRUE) {
-            dwt_isr();
+        // wake up periodically while a command is active to catch its timeout
+        TickType_t wait = uwb_cmd_active() ? pdMS_TO_TICKS(UWB_CMD_POLL_MS) : portMAX_DELAY;
+        if (xSemaphoreTake(uwb_isr_sem, wait) == pdTRUE) {
+            // TDMA timers and commands share the semaphore, dwt_isr does nothing if no DW1000 event
+            uwb_tdma_process();
+            uwb_tdoa_process();
+            uwb_profile_mark(UWB_PROFILE_STAGE_ISR);
+            // an interrupt while nothing is sent is most likely a received frame, read it in one batch
+            bool irq = uwb_irq_pending;
+            uwb_irq_pending = false;
+            if (irq && uwb_rx_fast_isr && !uwb_tx_pending) {
+                dwt_isr_fast(&rx_event);
+            } else {
+                dwt_isr();
+            }
         }
+        // queued commands run when the radio is idle
+        uwb_cmd_process();
+    }
+}
+
+void uwb_task_wake() {
+    if (uwb_isr_sem != NULL) {
+        xSemaphoreGive(uwb_isr_sem);
     }
 }
 
 void IRAM_ATTR uwb_irq_handler() {
+    uwb_profile_mark(UWB_PROFILE_STAGE_IRQ);
+    uwb_irq_pending = true;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     xSemaphoreGiveFromISR(uwb_isr_sem, &xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken) {
@@ -799,11 +1632,22 @@ void uwb_process(){
                 case UWB_MSG_TYPE_PING_RESP: uwb_handle_ping_resp((uwb_pkt_ping_resp_t *)hdr); break;
 
                 case UWB_MSG_TYPE_RANGE_TRIGGER: uwb_handle_range_trigger((uwb_pkt_range_trigger_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_TRIGGER_MULTI: uwb_handle_range_trigger_multi((uwb_pkt_range_trigger_multi_t *)hdr); break;
                 
                 case UWB_MSG_TYPE_RANGE_POLL: uwb_handle_range_poll((uwb_pkt_range_poll_t *)hdr); break;
                 case UWB_MSG_TYPE_RANGE_RESP: uwb_handle_range_resp((uwb_pkt_range_resp_t *)hdr); break;
                 case UWB_MSG_TYPE_RANGE_FINAL: uwb_handle_range_final((uwb_pkt_range_final_t *)hdr); break;
                 case UWB_MSG_TYPE_RANGE_REPORT: uwb_handle_range_report((uwb_pkt_range_report_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_TRIGGER_BCAST: uwb_handle_range_trigger_bcast((uwb_pkt_range_trigger_multi_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_POLL_BCAST: uwb_handle_range_poll_bcast((uwb_pkt_range_poll_bcast_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_FINAL_BCAST: uwb_handle_range_final_bcast((uwb_pkt_range_final_bcast_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_TRIGGER_SS: uwb_handle_range_trigger_ss((uwb_pkt_range_trigger_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_POLL_SS: uwb_handle_range_poll_ss((uwb_pkt_range_poll_t *)hdr); break;
+                case UWB_MSG_TYPE_RANGE_RESP_SS: uwb_handle_range_resp_ss((uwb_pkt_range_resp_ss_t *)hdr); break;
+                case UWB_MSG_TYPE_TDMA_BEACON: uwb_handle_tdma_beacon((uwb_pkt_tdma_beacon_t *)hdr); break;
+                case UWB_MSG_TYPE_TDOA_BLINK: uwb_handle_tdoa_blink((uwb_pkt_tdoa_blink_t *)hdr); break;
+                case UWB_MSG_TYPE_TDOA_SYNC: uwb_handle_tdoa_sync((uwb_pkt_tdoa_sync_t *)hdr); break;
+                case UWB_MSG_TYPE_TDOA_REPORT: uwb_handle_tdoa_report((uwb_pkt_tdoa_report_t *)hdr); break;
                 default:
                     safe_printf("[uwb_process] rx frame valid but not found handler for msg_type=0x%02X\n", hdr->msg_type);
                 
@@ -822,7 +1666,7 @@ void uwb_process(){
             dwt_rxenable(DWT_START_RX_IMMEDIATE);
         }
     }
-    else if (status_reg & (SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)) {
+    else if (status_reg & (SYS_STATUS_ALL_RX_TO | (SYS_STATUS_ALL_RX_ERR & ~SYS_STATUS_AFFREJ))) {
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
 
         if(uwb_state == UWB_STATE_IDLE) {
@@ -839,7 +1683,9 @@ void uwb_process(){
                 uint8_t event;
                 switch (uwb_state) {
                     case UWB_STATE_WAIT_PING_RESP: event = UWB_EVENT_PING_RESP_TIMEOUT; break;
-                    case UWB_STATE_WAIT_RANGE_RESP: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
+                    case UWB_STATE_WAIT_RANGE_RESP:
+                    case UWB_STATE_WAIT_RANGE_RESP_SS:
+                    case UWB_STATE_WAIT_RANGE_RESP_BCAST: event = UWB_EVENT_RANGE_RESP_TIMEOUT; break;
                     case UWB_STATE_WAIT_RANGE_FINAL: event = UWB_EVENT_RANGE_FINAL_TIMEOUT; break;
                     case UWB_STATE_WAIT_RANGE_REPORT: event = UWB_EVENT_RANGE_REPORT_TIMEOUT; break;
                     default: event = UWB_EVENT_UNKNOWN_FRAME_TIMEOUT; break;
@@ -15,16 +15,52 @@ extern "C" {
 
 #include "power.h"
 #include "safe_print.h"
+#include "uwb_log.h"
+#include "uwb_profile.h"
+#include "uwb_phy.h"
+#include "uwb_tdma.h"
+#include "uwb_cmd.h"
+#include "uwb_session.h"
+#include "uwb_twr.h"
+#include "uwb_tdoa.h"
 
 #include "system_config.h"
+#include "uwb_result.h"
 
 
+// radio counts as busy at most this long after dwt_starttx if the TX done event is lost
+#define UWB_TX_PENDING_TIMEOUT_MS 100
 
+// double buffered RX, 1: the receiver goes on into the other buffer while a listen-only frame
+// (range report, TDMA beacon, TDoA) is handled, a frame arriving meanwhile is not lost
+// build_flags = -D UWB_RX_DOUBLE_BUFFER=0 for the old single buffer mode
+#ifndef UWB_RX_DOUBLE_BUFFER
+#define UWB_RX_DOUBLE_BUFFER 1
+#endif
+
+// fused RX interrupt, 1: a DW1000 interrupt while no TX is pending goes to dwt_isr_fast, status, frame
+// info, the first DWT_RX_EVENT_DATA_LEN bytes and the RX timestamp come in one SPI batch
+// build_flags = -D UWB_RX_FAST_ISR=0 for the separate reads of dwt_isr, uwb_rx_fast_isr switches at run time
+#ifndef UWB_RX_FAST_ISR
+#define UWB_RX_FAST_ISR 1
+#endif
+
+// max responders in one RANGE TRIGGER MULTI packet
+#define UWB_RANGE_MULTI_MAX_TARGETS 8
+
+// IEEE 802.15.4 data frame, PAN ID compression, short dest and src address
+// frame type 1 | PAN ID compress (bit 6) | dest addr mode 2 (bits 10-11) | src addr mode 2 (bits 14-15)
+#define UWB_FRAME_CTRL 0x8841
+#define UWB_BROADCAST_ID 0xFFFF
+
+// MAC header + msg_type, the DW1000 frame filter drops frames of other groups (PAN ID)
+// and other nodes (short address) before they raise an interrupt
 typedef struct __attribute__((packed)) {
-    uint16_t group_id;
-    uint16_t src_id;
-    uint16_t dest_id;
+    uint16_t frame_ctrl;   // UWB_FRAME_CTRL
     uint8_t seq_num;
+    uint16_t group_id;     // dest PAN ID
+    uint16_t dest_id;      // dest short address, UWB_BROADCAST_ID for all
+    uint16_t src_id;       // src short address
     uint8_t msg_type;
 } uwb_common_header_t;
 
@@ -50,6 +86,27 @@ typedef struct __attribute__((packed)) {
     uint16_t crc;
 } uwb_pkt_range_trigger_t;
 
+// the packet that send by master anchor to trigger one node to range with several nodes back-to-back
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint8_t num_targets;
+    uint16_t target_node_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+    uint16_t crc;
+} uwb_pkt_range_trigger_multi_t;
+
+// the packet that send by master anchor at the start of every TDMA superframe
+// tag_ids[i] owns slot i + 1, it ranges with all anchor_ids in its slot
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint16_t superframe_seq;
+    uint16_t slot_ms;
+    uint8_t num_tags;
+    uint16_t tag_ids[UWB_TDMA_MAX_TAGS];
+    uint8_t num_anchors;
+    uint16_t anchor_ids[UWB_TDMA_MAX_ANCHORS];
+    uint16_t crc;
+} uwb_pkt_tdma_beacon_t;
+
 typedef struct __attribute__((packed)) {
     uwb_common_header_t header;
     // no payload
@@ -62,6 +119,15 @@ typedef struct __attribute__((packed)) {
     uint16_t crc;
 } uwb_pkt_range_resp_t;
 
+// single-sided TWR, the responder sends its own timestamps in the reply
+// the initiator corrects the responder clock offset with the carrier integrator
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint32_t poll_rx_ts;
+    uint32_t resp_tx_ts;
+    uint16_t crc;
+} uwb_pkt_range_resp_ss_t;
+
 typedef struct __attribute__((packed)) {
     uwb_common_header_t header;
     uint32_t poll_tx_ts;
@@ -70,11 +136,58 @@ typedef struct __attribute__((packed)) {
     uint16_t crc;
 } uwb_pkt_range_final_t;
 
+// one-to-many ranging, the tag polls all anchors at once
+// anchor_ids[i] sends its RANGE RESP in reply slot i after the poll
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint8_t num_anchors;
+    uint16_t anchor_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+    uint16_t crc;
+} uwb_pkt_range_poll_bcast_t;
+
+// single final of the broadcast poll, each anchor picks its resp_rx_ts by its slot
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint8_t num_anchors;
+    uint16_t anchor_ids[UWB_RANGE_MULTI_MAX_TARGETS];
+    uint32_t poll_tx_ts;
+    uint32_t final_tx_ts;
+    uint32_t resp_rx_ts[UWB_RANGE_MULTI_MAX_TARGETS]; // 0 if the resp of the anchor was not received
+    uint16_t crc;
+} uwb_pkt_range_final_bcast_t;
+
+// TDoA blink of a tag, header.seq_num is not used, blink_seq counts the blinks of the tag
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint8_t blink_seq;
+    uint16_t crc;
+} uwb_pkt_tdoa_blink_t;
+
+// TDoA sync of the reference anchor, tx_ts is its 40 bit TX timestamp of this frame
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint32_t tx_ts_lo;
+    uint8_t tx_ts_hi;
+    uwb_tdoa_layout_t layout; // report and blink slots of the period after this sync
+    uint16_t crc;
+} uwb_pkt_tdoa_sync_t;
+
+// blink timestamps of one anchor, sent to the reference anchor after a sync
+// sent with num_entries entries only, UWB_TDOA_REPORT_LEN bytes
+typedef struct __attribute__((packed)) {
+    uwb_common_header_t header;
+    uint8_t num_entries;
+    uwb_tdoa_entry_t entries[UWB_TDOA_REPORT_MAX_ENTRIES];
+    uint16_t crc;
+} uwb_pkt_tdoa_report_t;
+
+#define UWB_TDOA_REPORT_LEN(n) (offsetof(uwb_pkt_tdoa_report_t, entries) + (n) * sizeof(uwb_tdoa_entry_t) + sizeof(uint16_t))
+
 typedef struct __attribute__((packed)) {
     uwb_common_header_t header;
     uint16_t node_a_id;
     uint16_t node_b_id;
-    uint16_t distance_cm;
+    int32_t distance_mm;
     int16_t rssi_centi_dbm;
     uint16_t crc;
 } uwb_pkt_range_report_t;
@@ -87,7 +200,18 @@ typedef enum {
     UWB_MSG_TYPE_RANGE_POLL = 0x12, //
     UWB_MSG_TYPE_RANGE_RESP = 0x13,
     UWB_MSG_TYPE_RANGE_FINAL = 0x14,
-    UWB_MSG_TYPE_RANGE_REPORT = 0x15
+    UWB_MSG_TYPE_RANGE_REPORT = 0x15,
+    UWB_MSG_TYPE_RANGE_TRIGGER_MULTI = 0x16, //
+    UWB_MSG_TYPE_RANGE_TRIGGER_BCAST = 0x17, // same layout as RANGE TRIGGER MULTI
+    UWB_MSG_TYPE_RANGE_POLL_BCAST = 0x18, //
+    UWB_MSG_TYPE_RANGE_FINAL_BCAST = 0x19,
+    UWB_MSG_TYPE_RANGE_TRIGGER_SS = 0x1A, // same layout as RANGE TRIGGER
+    UWB_MSG_TYPE_RANGE_POLL_SS = 0x1B, // same layout as RANGE POLL
+    UWB_MSG_TYPE_RANGE_RESP_SS = 0x1C,
+    UWB_MSG_TYPE_TDMA_BEACON = 0x21, //
+    UWB_MSG_TYPE_TDOA_BLINK = 0x31,
+    UWB_MSG_TYPE_TDOA_SYNC = 0x32,
+    UWB_MSG_TYPE_TDOA_REPORT = 0x33
 } uwb_msg_type_t;
 
 // UWB states
@@ -95,8 +219,10 @@ typedef enum {
     UWB_STATE_IDLE = 0,
     UWB_STATE_WAIT_PING_RESP = 1,
     UWB_STATE_WAIT_RANGE_RESP = 2,
-    UWB_STATE_WAIT_RANGE_FINAL = 3,
+    UWB_STATE_WAIT_RANGE_FINAL = 3, // not used, responders keep their exchanges in uwb_session.h
     UWB_STATE_WAIT_RANGE_REPORT = 4,
+    UWB_STATE_WAIT_RANGE_RESP_BCAST = 5,
+    UWB_STATE_WAIT_RANGE_RESP_SS = 6,
 } uwb_state_t;
 
 // UWB event types
@@ -123,6 +249,9 @@ extern int uwb_node_id_int;
 
 extern uint8_t uwb_state;
 
+// dwt_isr_fast for DW1000 interrupts, default UWB_RX_FAST_ISR
+extern bool uwb_rx_fast_isr;
+
 // ping resp results
 extern bool ping_resp_received;
 extern unsigned long ping_resp_ts;
@@ -158,6 +287,20 @@ void set_uwb_group_id(uint16_t group_id);
 uint16_t get_uwb_node_id();
 void set_uwb_node_id(uint16_t node_id);
 void sync_uwb_node_id_ui_to_uint16();
+// write uwb_group_id / uwb_node_id to the DW1000 frame filter, uwb_task only (UWB_CMD_SET_ADDRESS)
+// the setters above change the ids in RAM and queue the command
+void uwb_apply_address();
+
+// uwb_state not IDLE, or a frame is still waiting to be sent
+bool uwb_radio_busy();
+
+// good frames received, frames found in the other buffer after a handler (double buffer), RX overruns
+uint32_t uwb_rx_frame_count();
+uint32_t uwb_rx_recovered_count();
+uint32_t uwb_rx_overrun_count();
+
+// fill the MAC header of a frame in tx_buffer, takes the next seq_num
+void uwb_fill_header(uwb_common_header_t *hdr, uint16_t dest_id, uint8_t msg_type);
 
 void uwb_register_event_callback(void (*cb)(uwb_event_t event, void *data));
 
@@ -169,22 +312,50 @@ void print_rx_err_flags(uint32_t status_reg);
 
 
 // SEND FUNCTIONS
+// only call from uwb_task, other tasks submit through uwb_cmd.h
 uint8_t uwb_send_ping_req(uint16_t dest_id);
 uint8_t uwb_send_range_trigger(uint16_t initiator_id, uint16_t responder_id);
+// single-sided TWR, poll + resp only, the initiator computes the distance and sends the report
+uint8_t uwb_send_range_trigger_ss(uint16_t initiator_id, uint16_t responder_id);
+uint8_t uwb_send_range_trigger_multi(uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders);
+uint8_t uwb_send_range_trigger_bcast(uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders);
+// TDoA, sync is sent UWB_TDOA_SYNC_TX_DELAY_UUS after the call, blink and report at tx_time (high 32 bit of system time)
+uint8_t uwb_send_tdoa_sync(const uwb_tdoa_layout_t *layout);
+uint8_t uwb_send_tdoa_blink(uint8_t blink_seq, uint32_t tx_time);
+uint8_t uwb_send_tdoa_report(uint16_t dest_id, const uwb_tdoa_entry_t *entries, uint8_t num_entries, uint32_t tx_time);
+uint8_t uwb_send_tdma_beacon(uint16_t superframe_seq, uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors);
+
+// range with each responder back-to-back, same as receiving a RANGE TRIGGER MULTI
+uint8_t uwb_range_multi_start(const uint16_t *responder_ids, uint8_t num_responders);
+// one broadcast poll, staggered responses and a single final for all responders
+uint8_t uwb_range_bcast_start(const uint16_t *responder_ids, uint8_t num_responders);
 
 
 // HANDLE FUNCTIONS 
 void uwb_handle_ping_req(uwb_pkt_ping_req_t *pkt);
 void uwb_handle_ping_resp(uwb_pkt_ping_resp_t *pkt);
 void uwb_handle_range_trigger(uwb_pkt_range_trigger_t *pkt);
+void uwb_handle_range_trigger_ss(uwb_pkt_range_trigger_t *pkt);
+void uwb_handle_range_trigger_multi(uwb_pkt_range_trigger_multi_t *pkt);
+void uwb_handle_range_trigger_bcast(uwb_pkt_range_trigger_multi_t *pkt);
+void uwb_handle_range_poll_bcast(uwb_pkt_range_poll_bcast_t *pkt);
+void uwb_handle_range_final_bcast(uwb_pkt_range_final_bcast_t *pkt);
 void uwb_handle_range_poll(uwb_pkt_range_poll_t *pkt);
 void uwb_handle_range_resp(uwb_pkt_range_resp_t *pkt);
+void uwb_handle_range_poll_ss(uwb_pkt_range_poll_t *pkt);
+void uwb_handle_range_resp_ss(uwb_pkt_range_resp_ss_t *pkt);
 void uwb_handle_range_final(uwb_pkt_range_final_t *pkt);
 void uwb_handle_range_report(uwb_pkt_range_report_t *pkt);
+void uwb_handle_tdma_beacon(uwb_pkt_tdma_beacon_t *pkt);
+void uwb_handle_tdoa_blink(uwb_pkt_tdoa_blink_t *pkt);
+void uwb_handle_tdoa_sync(uwb_pkt_tdoa_sync_t *pkt);
+void uwb_handle_tdoa_report(uwb_pkt_tdoa_report_t *pkt);
 void uwb_process();
 
 void uwb_task_init();
 void uwb_task(void *pvParameters);
+// wake uwb_task from a task or timer callback, not from ISR
+void uwb_task_wake();
 void IRAM_ATTR uwb_irq_handler();
 
 
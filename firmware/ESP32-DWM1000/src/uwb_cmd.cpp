@@ -0,0 +1,182 @@
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "uwb_cmd.h"
+#include "uwb.h"
+#include "uwb_phy.h"
+
+
+static QueueHandle_t cmd_queue[UWB_CMD_PRIO_COUNT];
+
+// only used by uwb_task
+static uwb_cmd_t active_cmd;
+static bool active = false;
+static bool active_tx_done = false;
+static unsigned long active_start_ms = 0;
+
+static uint32_t cmd_submitted = 0;
+static uint32_t cmd_rejected = 0;
+static uint32_t cmd_timeout = 0;
+
+
+void uwb_cmd_init() {
+    if (cmd_queue[0] != NULL) {
+        return;
+    }
+    for (int i = 0; i < UWB_CMD_PRIO_COUNT; i++) {
+        cmd_queue[i] = xQueueCreate(UWB_CMD_QUEUE_LEN, sizeof(uwb_cmd_t));
+    }
+}
+
+bool uwb_cmd_submit(const uwb_cmd_t *cmd, uint8_t prio) {
+    if (prio >= UWB_CMD_PRIO_COUNT || cmd_queue[prio] == NULL) {
+        return false;
+    }
+    if (xQueueSend(cmd_queue[prio], cmd, 0) != pdTRUE) {
+        __atomic_fetch_add(&cmd_rejected, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_fetch_add(&cmd_submitted, 1, __ATOMIC_RELAXED);
+    uwb_task_wake();
+    return true;
+}
+
+bool uwb_cmd_ping(uint16_t dest_id, uint8_t prio) {
+    uwb_cmd_t cmd = {};
+    cmd.type = UWB_CMD_PING;
+    cmd.dest_id = dest_id;
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+bool uwb_cmd_range_trigger(uint16_t initiator_id, uint16_t responder_id, uint8_t prio) {
+    uwb_cmd_t cmd = {};
+    cmd.type = UWB_CMD_RANGE_TRIGGER;
+    cmd.dest_id = initiator_id;
+    cmd.num_ids = 1;
+    cmd.ids[0] = responder_id;
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+bool uwb_cmd_range_trigger_ss(uint16_t initiator_id, uint16_t responder_id, uint8_t prio) {
+    uwb_cmd_t cmd = {};
+    cmd.type = UWB_CMD_RANGE_TRIGGER_SS;
+    cmd.dest_id = initiator_id;
+    cmd.num_ids = 1;
+    cmd.ids[0] = responder_id;
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+bool uwb_cmd_range_trigger_list(uint8_t type, uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders, uint8_t prio) {
+    if (num_responders == 0 || num_responders > UWB_CMD_MAX_IDS) {
+        return false;
+    }
+    uwb_cmd_t cmd = {};
+    cmd.type = type;
+    cmd.dest_id = initiator_id;
+    cmd.num_ids = num_responders;
+    memcpy(cmd.ids, responder_ids, num_responders * sizeof(uint16_t));
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+bool uwb_cmd_set_phy(uint8_t profile_index, uint8_t prio) {
+    uwb_cmd_t cmd = {};
+    cmd.type = UWB_CMD_SET_PHY;
+    cmd.num_ids = 1;
+    cmd.ids[0] = profile_index;
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+bool uwb_cmd_set_address(uint8_t prio) {
+    uwb_cmd_t cmd = {};
+    cmd.type = UWB_CMD_SET_ADDRESS;
+    return uwb_cmd_submit(&cmd, prio);
+}
+
+static uint8_t uwb_cmd_execute(const uwb_cmd_t *cmd) {
+    switch (cmd->type) {
+        case UWB_CMD_PING:                return uwb_send_ping_req(cmd->dest_id);
+        case UWB_CMD_RANGE_TRIGGER:       return uwb_send_range_trigger(cmd->dest_id, cmd->ids[0]);
+        case UWB_CMD_RANGE_TRIGGER_MULTI: return uwb_send_range_trigger_multi(cmd->dest_id, cmd->ids, cmd->num_ids);
+        case UWB_CMD_RANGE_TRIGGER_BCAST: return uwb_send_range_trigger_bcast(cmd->dest_id, cmd->ids, cmd->num_ids);
+        case UWB_CMD_RANGE_TRIGGER_SS:    return uwb_send_range_trigger_ss(cmd->dest_id, cmd->ids[0]);
+        case UWB_CMD_SET_PHY:
+            // nothing goes on air, the command is done when the radio listens again
+            uwb_phy_switch(cmd->ids[0]);
+            active_tx_done = true;
+            return true;
+        case UWB_CMD_SET_ADDRESS:
+            uwb_apply_address();
+            active_tx_done = true;
+            return true;
+        default:                          return false;
+    }
+}
+
+static void uwb_cmd_finish(uint8_t status) {
+    active = false;
+    if (active_cmd.done) {
+        active_cmd.done(&active_cmd, status);
+    }
+}
+
+void uwb_cmd_on_tx_done() {
+    active_tx_done = true;
+}
+
+bool uwb_cmd_active() {
+    return active;
+}
+
+void uwb_cmd_process() {
+    if (active) {
+        // done when the frame is out and the exchange it started is over
+        if (active_tx_done && !uwb_radio_busy()) {
+            uwb_cmd_finish(UWB_CMD_STATUS_DONE);
+        }
+        else if (millis() - active_start_ms > UWB_CMD_ACTIVE_TIMEOUT_MS) {
+            cmd_timeout++;
+            uwb_cmd_finish(UWB_CMD_STATUS_TIMEOUT);
+        }
+        else {
+            return;
+        }
+    }
+
+    // protocol exchanges of other nodes or TDMA keep the radio
+    while (!uwb_radio_busy()) {
+        int prio = 0;
+        while (prio < UWB_CMD_PRIO_COUNT && xQueueReceive(cmd_queue[prio], &active_cmd, 0) != pdTRUE) {
+            prio++;
+        }
+        if (prio == UWB_CMD_PRIO_COUNT) {
+            return;
+        }
+
+        active = true;
+        active_tx_done = false;
+        active_start_ms = millis();
+        if (!uwb_cmd_execute(&active_cmd)) {
+            uwb_cmd_finish(UWB_CMD_STATUS_TX_FAIL);
+        }
+        else if (active_tx_done && !uwb_radio_busy()) {
+            // radio setting commands finish at once, go on with the next one
+            uwb_cmd_finish(UWB_CMD_STATUS_DONE);
+        }
+        else {
+            return;
+        }
+    }
+}
+
+uint32_t uwb_cmd_submitted_count() {
+    return cmd_submitted;
+}
+
+uint32_t uwb_cmd_rejected_count() {
+    return cmd_rejected;
+}
+
+uint32_t uwb_cmd_timeout_count() {
+    return cmd_timeout;
+}
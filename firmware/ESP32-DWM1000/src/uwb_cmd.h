@@ -0,0 +1,87 @@
+#ifndef __UWB_CMD_H__
+#define __UWB_CMD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// radio commands from other tasks (loop, ui), only uwb_task touches the radio
+#define UWB_CMD_QUEUE_LEN 8
+#define UWB_CMD_MAX_IDS 8
+// give up on a command that did not finish, e.g. lost irq
+#define UWB_CMD_ACTIVE_TIMEOUT_MS 500
+// uwb_task wake up period while a command is active
+#define UWB_CMD_POLL_MS 50
+
+typedef enum {
+    UWB_CMD_PING = 0,              // dest_id
+    UWB_CMD_RANGE_TRIGGER,         // dest_id = initiator, ids[0] = responder
+    UWB_CMD_RANGE_TRIGGER_MULTI,   // dest_id = initiator, ids = responders
+    UWB_CMD_RANGE_TRIGGER_BCAST,   // dest_id = initiator, ids = responders
+    UWB_CMD_RANGE_TRIGGER_SS,      // dest_id = initiator, ids[0] = responder, single-sided TWR
+    UWB_CMD_SET_PHY,               // ids[0] = uwb_phy profile index, reconfigure the radio and its timings, no TX
+    UWB_CMD_SET_ADDRESS,           // frame filter PAN ID / short address from uwb_group_id / uwb_node_id, no TX
+} uwb_cmd_type_t;
+
+typedef enum {
+    UWB_CMD_PRIO_HIGH = 0,
+    UWB_CMD_PRIO_NORMAL,
+    UWB_CMD_PRIO_LOW,
+    UWB_CMD_PRIO_COUNT
+} uwb_cmd_prio_t;
+
+typedef enum {
+    UWB_CMD_STATUS_DONE = 0,       // sent and radio back to idle
+    UWB_CMD_STATUS_TX_FAIL,        // dwt_starttx failed
+    UWB_CMD_STATUS_TIMEOUT,        // not finished in UWB_CMD_ACTIVE_TIMEOUT_MS
+} uwb_cmd_status_t;
+
+typedef struct uwb_cmd_s uwb_cmd_t;
+
+// completion callback, runs on uwb_task, keep it short
+typedef void (*uwb_cmd_done_cb_t)(const uwb_cmd_t *cmd, uint8_t status);
+
+struct uwb_cmd_s {
+    uint8_t type;                   // uwb_cmd_type_t
+    uint16_t dest_id;
+    uint8_t num_ids;
+    uint16_t ids[UWB_CMD_MAX_IDS];
+    uwb_cmd_done_cb_t done;         // may be NULL
+    void *arg;
+};
+
+
+void uwb_cmd_init();
+
+// queue a command, return false if the queue of the priority is full
+bool uwb_cmd_submit(const uwb_cmd_t *cmd, uint8_t prio);
+
+// shortcuts without completion callback
+bool uwb_cmd_ping(uint16_t dest_id, uint8_t prio);
+bool uwb_cmd_range_trigger(uint16_t initiator_id, uint16_t responder_id, uint8_t prio);
+bool uwb_cmd_range_trigger_ss(uint16_t initiator_id, uint16_t responder_id, uint8_t prio);
+bool uwb_cmd_range_trigger_list(uint8_t type, uint16_t initiator_id, const uint16_t *responder_ids, uint8_t num_responders, uint8_t prio);
+bool uwb_cmd_set_phy(uint8_t profile_index, uint8_t prio);
+bool uwb_cmd_set_address(uint8_t prio);
+
+// called by uwb_task, finish the active command and start the next one when the radio is idle
+void uwb_cmd_process();
+bool uwb_cmd_active();
+// called from the TX done callback
+void uwb_cmd_on_tx_done();
+
+uint32_t uwb_cmd_submitted_count();
+uint32_t uwb_cmd_rejected_count();
+uint32_t uwb_cmd_timeout_count();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_CMD_H__
@@ -0,0 +1,136 @@
+#include <Arduino.h>
+
+#include "uwb_log.h"
+#include "safe_print.h"
+#include "serial_report.h"
+#include "deca_regs.h"
+
+
+static const char *const uwb_log_fmt[UWB_LOG_ID_COUNT] = {
+#define UWB_LOG_DEF(id, fmt) fmt,
+#include "uwb_log_ids.h"
+#undef UWB_LOG_DEF
+};
+
+// SYS_STATUS rx error bits named in the text of UWB_LOG_RX_ERR_FLAGS, same list as host_app/UWBLogDecoder.py
+static const struct {
+    uint32_t bit;
+    const char *name;
+} uwb_log_rx_err_flags[] = {
+    {SYS_STATUS_RXRFTO, "RXRFTO"},
+    {SYS_STATUS_RXPTO, "RXPTO"},
+    {SYS_STATUS_RXPHE, "RXPHE"},
+    {SYS_STATUS_RXFCE, "RXFCE"},
+    {SYS_STATUS_RXRFSL, "RXRFSL"},
+    {SYS_STATUS_RXSFDTO, "RXSFDTO"},
+    {SYS_STATUS_LDEERR, "LDEERR"},
+    {SYS_STATUS_AFFREJ, "AFFREJ"},
+};
+
+static uwb_log_record_t uwb_log_ring[UWB_LOG_RING_SIZE];
+
+// free running indexes, head moved by producers under the lock, tail only moved by uwb_log_task
+static volatile uint32_t uwb_log_head = 0;
+static volatile uint32_t uwb_log_tail = 0;
+static uint32_t uwb_log_dropped = 0;
+
+static portMUX_TYPE uwb_log_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t uwb_log_task_handle = NULL;
+
+
+void uwb_log_write(uint16_t id, uint8_t num_args, uint32_t a0, uint32_t a1, uint32_t a2) {
+    uint32_t ts_us = micros();
+
+    portENTER_CRITICAL_SAFE(&uwb_log_mux);
+    uint32_t head = uwb_log_head;
+    if (head - __atomic_load_n(&uwb_log_tail, __ATOMIC_ACQUIRE) >= UWB_LOG_RING_SIZE) {
+        uwb_log_dropped++;
+    } else {
+        uwb_log_record_t *rec = &uwb_log_ring[head & (UWB_LOG_RING_SIZE - 1)];
+        rec->ts_us = ts_us;
+        rec->id = id;
+        rec->num_args = num_args;
+        rec->reserved = 0;
+        rec->args[0] = a0;
+        rec->args[1] = a1;
+        rec->args[2] = a2;
+        __atomic_store_n(&uwb_log_head, head + 1, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL_SAFE(&uwb_log_mux);
+}
+
+void uwb_log_init() {
+    if (uwb_log_task_handle != NULL) {
+        return;
+    }
+
+    xTaskCreatePinnedToCore(
+        uwb_log_task,          // Task function
+        "uwb_log_task",        // Name of the task
+        4096,                  // Stack size in words
+        NULL,                  // Task input parameter
+        1,                     // Priority of the task
+        &uwb_log_task_handle,  // Task handle
+        0                      // format on core 0, away from uwb_task
+    );
+}
+
+static void uwb_log_output(const uwb_log_record_t *rec) {
+    // binary mode: send raw record, host_app/UWBLogDecoder.py does the format
+    if (serial_report_get_mode() == SERIAL_REPORT_MODE_BINARY) {
+        serial_report_frame(SERIAL_FRAME_TYPE_LOG, rec, sizeof(uwb_log_record_t));
+        return;
+    }
+
+    if (rec->id >= UWB_LOG_ID_COUNT) {
+        safe_printf("[uwb_log] unknown log id %u\n", rec->id);
+        return;
+    }
+
+    char line[SAFE_PRINT_BUFFER_SIZE];
+    int n = snprintf(line, sizeof(line), "[%u] ", (unsigned)rec->ts_us);
+    snprintf(line + n, sizeof(line) - n, uwb_log_fmt[rec->id], rec->args[0], rec->args[1], rec->args[2]);
+
+    // the hot path only logs the raw status word, name the flags here
+    if (rec->id == UWB_LOG_RX_ERR_FLAGS) {
+        n = strlen(line);
+        if (n > 0 && line[n - 1] == '\n') {
+            n--;
+        }
+        for (uint32_t i = 0; i < sizeof(uwb_log_rx_err_flags) / sizeof(uwb_log_rx_err_flags[0]); i++) {
+            if ((rec->args[0] & uwb_log_rx_err_flags[i].bit) && n < (int)sizeof(line)) {
+                n += snprintf(line + n, sizeof(line) - n, " %s", uwb_log_rx_err_flags[i].name);
+            }
+        }
+        if (n < (int)sizeof(line)) {
+            snprintf(line + n, sizeof(line) - n, "\n");
+        }
+    }
+    safe_printf("%s", line);
+}
+
+void uwb_log_task(void *pvParameters) {
+    uint32_t last_dropped = 0;
+    while (1) {
+        // polling, producers do not pay for a notify
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+        uint32_t tail = uwb_log_tail;
+        uint32_t head = __atomic_load_n(&uwb_log_head, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            uwb_log_record_t rec = uwb_log_ring[tail & (UWB_LOG_RING_SIZE - 1)];
+            tail++;
+            __atomic_store_n(&uwb_log_tail, tail, __ATOMIC_RELEASE);
+            uwb_log_output(&rec);
+        }
+
+        if (uwb_log_dropped != last_dropped) {
+            safe_printf("[uwb_log] %u records dropped\n", (unsigned)(uwb_log_dropped - last_dropped));
+            last_dropped = uwb_log_dropped;
+        }
+    }
+}
+
+uint32_t uwb_log_drop_count() {
+    return uwb_log_dropped;
+}
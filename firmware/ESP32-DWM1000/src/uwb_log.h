@@ -0,0 +1,51 @@
+#ifndef __UWB_LOG_H__
+#define __UWB_LOG_H__
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// record ring, must be power of 2
+#define UWB_LOG_RING_SIZE 256
+#define UWB_LOG_MAX_ARGS 3
+
+typedef enum {
+#define UWB_LOG_DEF(id, fmt) id,
+#include "uwb_log_ids.h"
+#undef UWB_LOG_DEF
+    UWB_LOG_ID_COUNT
+} uwb_log_id_t;
+
+// raw record, also the payload of the binary log frame
+typedef struct __attribute__((packed)) {
+    uint32_t ts_us;
+    uint16_t id;
+    uint8_t num_args;
+    uint8_t reserved;
+    uint32_t args[UWB_LOG_MAX_ARGS];
+} uwb_log_record_t;
+
+
+// only copy id, timestamp and args, the format is done later by uwb_log_task
+void uwb_log_write(uint16_t id, uint8_t num_args, uint32_t a0, uint32_t a1, uint32_t a2);
+
+#define UWB_LOG0(id)             uwb_log_write((id), 0, 0, 0, 0)
+#define UWB_LOG1(id, a0)         uwb_log_write((id), 1, (uint32_t)(a0), 0, 0)
+#define UWB_LOG2(id, a0, a1)     uwb_log_write((id), 2, (uint32_t)(a0), (uint32_t)(a1), 0)
+#define UWB_LOG3(id, a0, a1, a2) uwb_log_write((id), 3, (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2))
+
+void uwb_log_init();
+void uwb_log_task(void *pvParameters);
+
+uint32_t uwb_log_drop_count();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_LOG_H__
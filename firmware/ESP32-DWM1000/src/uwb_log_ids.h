@@ -0,0 +1,24 @@
+// deferred log messages of the UWB hot path, UWB_LOG_DEF(id, fmt)
+// fmt only uses 32 bit integer conversions (%d %u %X ...), max UWB_LOG_MAX_ARGS args
+// host_app/UWBLogDecoder.py parses this file, keep one entry per line and only append new ids
+UWB_LOG_DEF(UWB_LOG_RX_NO_HANDLER,          "[rx_ok_cb] rx frame valid but not found handler for msg_type=0x%02X\n")
+UWB_LOG_DEF(UWB_LOG_RX_TIMEOUT,             "[rx_to_cb] Timeout, uwb_state: %d\n")
+UWB_LOG_DEF(UWB_LOG_RX_ERROR,               "[rx_err_cb] RX error occurred in state %d, %08X\n")
+UWB_LOG_DEF(UWB_LOG_FRAME_UNEXPECTED,       "[uwb_check_frame_valid] Frame not expected in current UWB state, state=%d, msg_type=0x%02X\n")
+UWB_LOG_DEF(UWB_LOG_RX_ERR_FLAGS,           "[print_rx_err_flags] RX error flags: 0x%08X\n")
+UWB_LOG_DEF(UWB_LOG_POLL_TX_FAIL,           "[uwb_start_range_poll] Failed to start TX for RANGE POLL\n")
+UWB_LOG_DEF(UWB_LOG_RESP_TX_FAIL,           "[uwb_handle_range_poll] Failed to start TX for RANGE RESP\n")
+UWB_LOG_DEF(UWB_LOG_FINAL_TX_FAIL,          "[uwb_handle_range_resp] Failed to start TX for RANGE FINAL\n")
+UWB_LOG_DEF(UWB_LOG_BEACON_TX_FAIL,         "[uwb_send_tdma_beacon] Failed to start TX for TDMA BEACON\n")
+UWB_LOG_DEF(UWB_LOG_REPORT_TX_FAIL,         "[uwb_range_finish] Failed to start TX for RANGE REPORT\n")
+UWB_LOG_DEF(UWB_LOG_SESSION_FULL,           "[uwb_session_open] Session table full, poll from 0x%04X dropped\n")
+UWB_LOG_DEF(UWB_LOG_SESSION_MISS,           "[uwb_session_find] No session for final from 0x%04X\n")
+UWB_LOG_DEF(UWB_LOG_TDOA_SYNC_TX_FAIL,      "[uwb_send_tdoa_sync] Failed to start TX for TDOA SYNC\n")
+UWB_LOG_DEF(UWB_LOG_TDOA_REPORT_TX_FAIL,    "[uwb_send_tdoa_report] Failed to start TX for TDOA REPORT\n")
+UWB_LOG_DEF(UWB_LOG_PING_NOT_IDLE,          "[uwb_send_ping_req] Cannot send PING REQ, UWB not in IDLE state, state: %d\n")
+UWB_LOG_DEF(UWB_LOG_PING_TX_FAIL,           "[uwb_send_ping_req] Failed to start TX for PING REQ\n")
+UWB_LOG_DEF(UWB_LOG_TRIGGER_NOT_IDLE,       "[uwb_send_range_trigger_pkt] Cannot send RANGE TRIGGER 0x%02X, UWB not in IDLE state, state: %d\n")
+UWB_LOG_DEF(UWB_LOG_TRIGGER_TX_FAIL,        "[uwb_send_range_trigger_pkt] Failed to start TX for RANGE TRIGGER 0x%02X\n")
+UWB_LOG_DEF(UWB_LOG_TRIGGER_LIST_NOT_IDLE,  "[uwb_send_range_trigger_list] Cannot send RANGE TRIGGER 0x%02X, UWB not in IDLE state, state: %d\n")
+UWB_LOG_DEF(UWB_LOG_TRIGGER_LIST_INVALID,   "[uwb_send_range_trigger_list] Invalid number of responders: %d\n")
+UWB_LOG_DEF(UWB_LOG_TRIGGER_LIST_TX_FAIL,   "[uwb_send_range_trigger_list] Failed to start TX for RANGE TRIGGER 0x%02X\n")
@@ -0,0 +1,188 @@
+#include <Arduino.h>
+
+#include "uwb_phy.h"
+#include "uwb.h"
+#include "uwb_cmd.h"
+
+
+// index 0 is the default, same as the old single config
+const uwb_phy_profile_t uwb_phy_profiles[] = {
+    {
+        "110k_1024",
+        {
+            2,               /* Channel number. */
+            DWT_PRF_64M,     /* Pulse repetition frequency. */
+            DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
+            DWT_PAC64,       /* Preamble acquisition chunk size. Used in RX only. */
+            9,               /* TX preamble code. Used in TX only. */
+            9,               /* RX preamble code. Used in RX only. */
+            1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+            DWT_BR_110K,     /* Data rate. */
+            DWT_PHRMODE_STD, /* PHY header mode. */
+            0                /* SFD timeout, derived. */
+        },
+        1024, 64
+    },
+    {
+        "850k_256",
+        {
+            2,               /* Channel number. */
+            DWT_PRF_64M,     /* Pulse repetition frequency. */
+            DWT_PLEN_256,    /* Preamble length. Used in TX only. */
+            DWT_PAC16,       /* Preamble acquisition chunk size. Used in RX only. */
+            9,               /* TX preamble code. Used in TX only. */
+            9,               /* RX preamble code. Used in RX only. */
+            1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+            DWT_BR_850K,     /* Data rate. */
+            DWT_PHRMODE_STD, /* PHY header mode. */
+            0                /* SFD timeout, derived. */
+        },
+        256, 16
+    },
+    {
+        "6m8_128",
+        {
+            2,               /* Channel number. */
+            DWT_PRF_64M,     /* Pulse repetition frequency. */
+            DWT_PLEN_128,    /* Preamble length. Used in TX only. */
+            DWT_PAC8,        /* Preamble acquisition chunk size. Used in RX only. */
+            9,               /* TX preamble code. Used in TX only. */
+            9,               /* RX preamble code. Used in RX only. */
+            0,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+            DWT_BR_6M8,      /* Data rate. */
+            DWT_PHRMODE_STD, /* PHY header mode. */
+            0                /* SFD timeout, derived. */
+        },
+        128, 8
+    },
+};
+const uint8_t uwb_phy_profile_count = sizeof(uwb_phy_profiles) / sizeof(uwb_phy_profiles[0]);
+
+uwb_phy_timing_t uwb_phy_timing;
+
+// profile the radio and uwb_phy_timing use, only changed by uwb_task once the radio runs
+static uint8_t uwb_phy_profile_index = 0;
+// profile selected by the user and saved to NVS, applied by the queued UWB_CMD_SET_PHY
+static uint8_t uwb_phy_profile_selected = 0;
+static bool uwb_phy_radio_ready = false;
+
+
+// user manual table 55, symbol / bit durations in ns
+static uint32_t symbol_ns(const uwb_phy_profile_t *p) {
+    return (p->config.prf == DWT_PRF_16M) ? 994 : 1018;
+}
+
+static uint32_t data_bit_ns(const uwb_phy_profile_t *p) {
+    switch (p->config.dataRate) {
+        case DWT_BR_110K: return 8205;
+        case DWT_BR_850K: return 1026;
+        default:          return 128;
+    }
+}
+
+static uint32_t phr_bit_ns(const uwb_phy_profile_t *p) {
+    // PHR is sent at 850k for both 850k and 6.8M
+    return (p->config.dataRate == DWT_BR_110K) ? 8205 : 1026;
+}
+
+uint32_t uwb_phy_frame_tail_ns(const uwb_phy_profile_t *profile, uint16_t len) {
+    // 21 bits PHR, data with 48 Reed Solomon parity bits per 330 bits block
+    uint32_t data_bits = len * 8;
+    data_bits += ((data_bits + 329) / 330) * 48;
+    return 21 * phr_bit_ns(profile) + data_bits * data_bit_ns(profile);
+}
+
+uint32_t uwb_phy_frame_duration_ns(const uwb_phy_profile_t *profile, uint16_t len) {
+    uint32_t shr_ns = (profile->preamble_symbols + profile->sfd_symbols) * symbol_ns(profile);
+    return shr_ns + uwb_phy_frame_tail_ns(profile, len);
+}
+
+uint32_t uwb_phy_frame_uus(uint16_t len) {
+    return uwb_phy_frame_duration_ns(uwb_phy_current(), len) / 1026 + 1;
+}
+
+static uint16_t clamp_timeout(uint32_t uus) {
+    return (uus > 0xFFFF) ? 0xFFFF : (uint16_t)uus;
+}
+
+static void uwb_phy_update_timing() {
+    const uwb_phy_profile_t *p = uwb_phy_current();
+
+    // 1 uus = 512 / 499.2 us
+    uint32_t tail_uus = uwb_phy_frame_tail_ns(p, UWB_PHY_MAX_FRAME_LEN) / 1026 + 1;
+    uint32_t frame_uus = uwb_phy_frame_duration_ns(p, UWB_PHY_MAX_FRAME_LEN) / 1026 + 1;
+    uint32_t shr_uus = frame_uus - tail_uus;
+
+    // delayed reply: rx frame end after RMARKER, processing, and the preamble of the reply before its RMARKER
+    uint32_t reply_uus = tail_uus + UWB_PHY_REPLY_PROCESS_UUS + shr_uus;
+    uwb_phy_timing.resp_tx_delay_uus = reply_uus;
+    uwb_phy_timing.final_tx_delay_uus = reply_uus;
+
+    // rx timeouts start after own TX, wait reply delay (or processing for immediate replies) plus one frame
+    uwb_phy_timing.resp_rx_timeout_uus = clamp_timeout(reply_uus + frame_uus + UWB_PHY_RX_TIMEOUT_MARGIN_UUS);
+    uwb_phy_timing.final_rx_timeout_uus = clamp_timeout(reply_uus + frame_uus + UWB_PHY_RX_TIMEOUT_MARGIN_UUS);
+    uwb_phy_timing.ping_rx_timeout_uus = clamp_timeout(UWB_PHY_REPLY_PROCESS_UUS + frame_uus + UWB_PHY_RX_TIMEOUT_MARGIN_UUS);
+    uwb_phy_timing.report_rx_timeout_uus = clamp_timeout(UWB_PHY_REPLY_PROCESS_UUS + frame_uus + UWB_PHY_RX_TIMEOUT_MARGIN_UUS);
+
+    // profiler starts from the derived delays
+    uwb_resp_tx_delay_uus = uwb_phy_timing.resp_tx_delay_uus;
+    uwb_final_tx_delay_uus = uwb_phy_timing.final_tx_delay_uus;
+}
+
+const uwb_phy_profile_t *uwb_phy_current() {
+    return &uwb_phy_profiles[uwb_phy_profile_index];
+}
+
+uint8_t get_uwb_phy_profile() {
+    return uwb_phy_profile_selected;
+}
+
+bool set_uwb_phy_profile(uint8_t index) {
+    if (index >= uwb_phy_profile_count) {
+        return false;
+    }
+    // the radio and the timings it uses are only changed by uwb_task, once the current exchange is over
+    if (uwb_phy_radio_ready) {
+        if (!uwb_cmd_set_phy(index, UWB_CMD_PRIO_HIGH)) {
+            return false;
+        }
+    } else {
+        // before uwb_init, it applies the profile
+        uwb_phy_profile_index = index;
+    }
+    uwb_phy_profile_selected = index;
+    save_uwb_phy_profile();
+    return true;
+}
+
+void uwb_phy_switch(uint8_t index) {
+    // stop the irq while the radio is reconfigured
+    decaIrqStatus_t stat = decamutexon();
+    dwt_forcetrxoff();
+    uwb_phy_profile_index = index;
+    uwb_phy_apply();
+    uwb_state = UWB_STATE_IDLE;
+    dwt_rxreset();
+    dwt_setrxtimeout(0);
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    decamutexoff(stat);
+}
+
+void uwb_phy_apply() {
+    const uwb_phy_profile_t *p = uwb_phy_current();
+
+    // SFD timeout = preamble length + 1 + SFD length - PAC size
+    dwt_config_t cfg = p->config;
+    uint16_t pac_symbols = 8 << cfg.rxPAC;
+    cfg.sfdTO = p->preamble_symbols + 1 + p->sfd_symbols - pac_symbols;
+
+    dwt_configure(&cfg);
+    dwt_setsmarttxpower(0);
+    dwt_configuretxrf(&txconfig);
+
+    dwt_setrxantennadelay(RX_ANT_DLY);
+    dwt_settxantennadelay(TX_ANT_DLY);
+
+    uwb_phy_update_timing();
+    uwb_phy_radio_ready = true;
+}
@@ -0,0 +1,67 @@
+#ifndef __UWB_PHY_H__
+#define __UWB_PHY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "deca_device_api.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// longest frame used by the protocol, for the reply delay
+#define UWB_PHY_MAX_FRAME_LEN 32
+// cpu + spi budget from rx frame end to dwt_starttx of the reply
+#define UWB_PHY_REPLY_PROCESS_UUS 1200
+// extra wait on top of the expected frame arrival
+#define UWB_PHY_RX_TIMEOUT_MARGIN_UUS 2000
+
+typedef struct {
+    const char *name;
+    dwt_config_t config;       // sfdTO is derived, value in the table is ignored
+    uint16_t preamble_symbols; // same as config.txPreambLength
+    uint8_t sfd_symbols;       // SFD length for the data rate and config.nsSFD
+} uwb_phy_profile_t;
+
+// timings derived from the selected profile
+typedef struct {
+    uint32_t resp_tx_delay_uus;    // poll rx -> resp tx
+    uint32_t final_tx_delay_uus;   // resp rx -> final tx
+    uint16_t ping_rx_timeout_uus;
+    uint16_t resp_rx_timeout_uus;
+    uint16_t final_rx_timeout_uus;
+    uint16_t report_rx_timeout_uus;
+} uwb_phy_timing_t;
+
+extern const uwb_phy_profile_t uwb_phy_profiles[];
+extern const uint8_t uwb_phy_profile_count;
+extern uwb_phy_timing_t uwb_phy_timing;
+
+// selected profile, the one saved to NVS, may not be applied yet
+uint8_t get_uwb_phy_profile();
+// select profile, save to NVS and queue the radio reconfiguration (UWB_CMD_SET_PHY) if it is running
+// false for an unknown index or a full command queue, nothing is changed then
+bool set_uwb_phy_profile(uint8_t index);
+// profile the radio runs with, uwb_phy_timing belongs to it
+const uwb_phy_profile_t *uwb_phy_current();
+
+// configure DW1000 with the selected profile, called by uwb_init
+void uwb_phy_apply();
+// radio off, select index, uwb_phy_apply and back to listening, uwb_task only (UWB_CMD_SET_PHY)
+void uwb_phy_switch(uint8_t index);
+
+// air time of a frame with len bytes (crc included), full frame and after RMARKER only
+uint32_t uwb_phy_frame_duration_ns(const uwb_phy_profile_t *profile, uint16_t len);
+uint32_t uwb_phy_frame_tail_ns(const uwb_phy_profile_t *profile, uint16_t len);
+// full air time of a frame with the selected profile, in uus
+uint32_t uwb_phy_frame_uus(uint16_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_PHY_H__
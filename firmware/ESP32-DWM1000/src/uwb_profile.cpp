@@ -0,0 +1,174 @@
+#include "uwb_profile.h"
+
+#include "deca_device_api.h"
+#include "dw1000_config.h"
+#include "uwb_phy.h"
+
+
+// set from the PHY profile timing by uwb_phy_apply
+uint32_t uwb_resp_tx_delay_uus = 5000;
+uint32_t uwb_final_tx_delay_uus = 5000;
+
+static bool profile_enabled = false;
+static bool profile_autotune = false;
+
+// cycle count of each stage for the frame in process
+static volatile uint32_t stage_ccount[UWB_PROFILE_STAGE_COUNT];
+
+// stage to stage delta stats, in cycles
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} uwb_profile_stat_t;
+
+static uwb_profile_stat_t stage_stat[UWB_PROFILE_STAGE_COUNT - 1];
+
+// rx timestamp to dwt_starttx, measured on the DW1000 clock
+typedef struct {
+    uint32_t count;
+    uint32_t max_uus;
+    uint32_t late;     // delayed TX failed, reply delay too short
+    uint32_t hist[UWB_PROFILE_HIST_BUCKETS];
+} uwb_profile_reply_stat_t;
+
+static uwb_profile_reply_stat_t reply_stat[UWB_PROFILE_REPLY_COUNT];
+
+static const char *const stage_names[UWB_PROFILE_STAGE_COUNT - 1] = {
+    "irq_to_isr", "isr_to_rx_cb", "rx_cb_to_handler", "handler_to_starttx"
+};
+static const char *const reply_names[UWB_PROFILE_REPLY_COUNT] = {
+    "resp", "final"
+};
+
+
+static uint32_t *reply_delay(uwb_profile_reply_t reply) {
+    return (reply == UWB_PROFILE_REPLY_RESP) ? &uwb_resp_tx_delay_uus : &uwb_final_tx_delay_uus;
+}
+
+static uint32_t reply_default(uwb_profile_reply_t reply) {
+    return (reply == UWB_PROFILE_REPLY_RESP) ? uwb_phy_timing.resp_tx_delay_uus : uwb_phy_timing.final_tx_delay_uus;
+}
+
+void uwb_profile_enable(bool enable) {
+    if (enable && !profile_enabled) {
+        uwb_profile_reset();
+    }
+    profile_enabled = enable;
+    if (!enable) {
+        profile_autotune = false;
+    }
+}
+
+void uwb_profile_autotune(bool enable) {
+    profile_autotune = enable;
+    if (enable) {
+        profile_enabled = true;
+        uwb_profile_reset();
+    } else {
+        // back to the safe delays of the PHY profile
+        uwb_resp_tx_delay_uus = uwb_phy_timing.resp_tx_delay_uus;
+        uwb_final_tx_delay_uus = uwb_phy_timing.final_tx_delay_uus;
+    }
+}
+
+void uwb_profile_reset() {
+    memset(stage_stat, 0, sizeof(stage_stat));
+    memset(reply_stat, 0, sizeof(reply_stat));
+    for (int i = 0; i < UWB_PROFILE_STAGE_COUNT - 1; i++) {
+        stage_stat[i].min = UINT32_MAX;
+    }
+}
+
+bool uwb_profile_is_enabled() {
+    return profile_enabled;
+}
+
+void IRAM_ATTR uwb_profile_mark(uwb_profile_stage_t stage) {
+    if (profile_enabled) {
+        stage_ccount[stage] = ESP.getCycleCount();
+    }
+}
+
+void uwb_profile_reply_starttx(uwb_profile_reply_t reply, uint64_t rx_ts) {
+    if (!profile_enabled) {
+        return;
+    }
+
+    // DW1000 side: system time now minus rx timestamp, both in 256 dtu units
+    uint32_t sys_hi = dwt_readsystimestamphi32();
+    uint32_t elapsed_uus = (sys_hi - (uint32_t)(rx_ts >> 8)) / (UUS_TO_DWT_TIME >> 8);
+
+    uwb_profile_mark(UWB_PROFILE_STAGE_STARTTX);
+
+    // cpu side: stage deltas of this frame
+    for (int i = 0; i < UWB_PROFILE_STAGE_COUNT - 1; i++) {
+        uint32_t delta = stage_ccount[i + 1] - stage_ccount[i];
+        uwb_profile_stat_t *st = &stage_stat[i];
+        st->count++;
+        st->sum += delta;
+        if (delta < st->min) st->min = delta;
+        if (delta > st->max) st->max = delta;
+    }
+
+    uwb_profile_reply_stat_t *rs = &reply_stat[reply];
+    uint32_t bucket = elapsed_uus / UWB_PROFILE_HIST_BUCKET_UUS;
+    if (bucket >= UWB_PROFILE_HIST_BUCKETS) {
+        bucket = UWB_PROFILE_HIST_BUCKETS - 1;
+    }
+    rs->hist[bucket]++;
+    rs->count++;
+    if (elapsed_uus > rs->max_uus) {
+        rs->max_uus = elapsed_uus;
+    }
+
+    // autotune: worst turnaround seen plus margin, never above the compile time default
+    if (profile_autotune && rs->count >= UWB_PROFILE_TUNE_SAMPLES) {
+        uint32_t tuned = rs->max_uus + UWB_PROFILE_TUNE_MARGIN_UUS;
+        if (tuned < UWB_PROFILE_TUNE_MIN_UUS) tuned = UWB_PROFILE_TUNE_MIN_UUS;
+        if (tuned > reply_default(reply)) tuned = reply_default(reply);
+        *reply_delay(reply) = tuned;
+    }
+}
+
+void uwb_profile_reply_result(uwb_profile_reply_t reply, bool success) {
+    if (!profile_enabled || success) {
+        return;
+    }
+
+    reply_stat[reply].late++;
+    if (profile_autotune) {
+        // too late for the deadline, back off by one margin
+        uint32_t *delay = reply_delay(reply);
+        *delay += UWB_PROFILE_TUNE_MARGIN_UUS;
+        if (*delay > reply_default(reply)) {
+            *delay = reply_default(reply);
+        }
+    }
+}
+
+void uwb_profile_report() {
+    uint32_t mhz = getCpuFrequencyMhz();
+
+    Serial.printf("{\"event\":\"prof\",\"enabled\":%d,\"autotune\":%d,\"resp_delay_uus\":%u,\"final_delay_uus\":%u,\"stages_us\":{",
+        profile_enabled, profile_autotune, (unsigned)uwb_resp_tx_delay_uus, (unsigned)uwb_final_tx_delay_uus);
+    for (int i = 0; i < UWB_PROFILE_STAGE_COUNT - 1; i++) {
+        uwb_profile_stat_t *st = &stage_stat[i];
+        uint32_t avg = st->count ? (uint32_t)(st->sum / st->count) : 0;
+        Serial.printf("%s\"%s\":{\"count\":%u,\"min\":%u,\"avg\":%u,\"max\":%u}",
+            i ? "," : "", stage_names[i], (unsigned)st->count,
+            (unsigned)(st->count ? st->min / mhz : 0), (unsigned)(avg / mhz), (unsigned)(st->max / mhz));
+    }
+    Serial.printf("},\"turnaround_uus\":{");
+    for (int r = 0; r < UWB_PROFILE_REPLY_COUNT; r++) {
+        uwb_profile_reply_stat_t *rs = &reply_stat[r];
+        Serial.printf("%s\"%s\":{\"count\":%u,\"max\":%u,\"late\":%u,\"bucket_uus\":%d,\"hist\":[",
+            r ? "," : "", reply_names[r], (unsigned)rs->count, (unsigned)rs->max_uus, (unsigned)rs->late, UWB_PROFILE_HIST_BUCKET_UUS);
+        for (int b = 0; b < UWB_PROFILE_HIST_BUCKETS; b++) {
+            Serial.printf("%s%u", b ? "," : "", (unsigned)rs->hist[b]);
+        }
+        Serial.printf("]}");
+    }
+    Serial.printf("}}\n");
+}
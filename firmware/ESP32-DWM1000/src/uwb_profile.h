@@ -0,0 +1,63 @@
+#ifndef __UWB_PROFILE_H__
+#define __UWB_PROFILE_H__
+
+#include <Arduino.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// turnaround histogram, bucket width in uus
+#define UWB_PROFILE_HIST_BUCKETS 64
+#define UWB_PROFILE_HIST_BUCKET_UUS 100
+
+// autotune: samples needed before tuning, margin added to the worst turnaround seen
+#define UWB_PROFILE_TUNE_SAMPLES 32
+#define UWB_PROFILE_TUNE_MARGIN_UUS 300
+#define UWB_PROFILE_TUNE_MIN_UUS 500
+
+// cpu side stages from frame IRQ to dwt_starttx
+typedef enum {
+    UWB_PROFILE_STAGE_IRQ = 0,     // uwb_irq_handler
+    UWB_PROFILE_STAGE_ISR,         // uwb_task calls dwt_isr
+    UWB_PROFILE_STAGE_RX_CB,       // rx_ok_cb
+    UWB_PROFILE_STAGE_HANDLER,     // uwb_handle_range_poll / uwb_handle_range_resp
+    UWB_PROFILE_STAGE_STARTTX,     // right before dwt_starttx
+    UWB_PROFILE_STAGE_COUNT
+} uwb_profile_stage_t;
+
+// delayed replies that are profiled and tuned
+typedef enum {
+    UWB_PROFILE_REPLY_RESP = 0,    // poll rx -> resp tx
+    UWB_PROFILE_REPLY_FINAL,       // resp rx -> final tx
+    UWB_PROFILE_REPLY_COUNT
+} uwb_profile_reply_t;
+
+
+// reply delays used by uwb.cpp, start from the PHY profile timing (uwb_phy.h)
+extern uint32_t uwb_resp_tx_delay_uus;
+extern uint32_t uwb_final_tx_delay_uus;
+
+void uwb_profile_enable(bool enable);
+void uwb_profile_autotune(bool enable);
+void uwb_profile_reset();
+bool uwb_profile_is_enabled();
+
+void IRAM_ATTR uwb_profile_mark(uwb_profile_stage_t stage);
+
+// call right before dwt_starttx of a delayed reply, rx_ts is the 40 bit rx timestamp of the frame replied to
+void uwb_profile_reply_starttx(uwb_profile_reply_t reply, uint64_t rx_ts);
+// call with the dwt_starttx result, a late TX makes autotune back off
+void uwb_profile_reply_result(uwb_profile_reply_t reply, bool success);
+
+// print profile as one JSON line
+void uwb_profile_report();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_PROFILE_H__
@@ -0,0 +1,64 @@
+#include "uwb_result.h"
+
+
+static uwb_result_t result_ring[UWB_RESULT_RING_SIZE];
+
+// free running indexes, head only written by producer, tail only written by consumer
+static uint32_t result_head = 0;
+static uint32_t result_tail = 0;
+
+// counters, only written by producer
+static uint32_t result_pushed = 0;
+static uint32_t result_overflow = 0;
+static uint32_t result_max_level = 0;
+
+
+bool uwb_result_push(const uwb_result_t *result) {
+    uint32_t head = result_head;
+    uint32_t tail = __atomic_load_n(&result_tail, __ATOMIC_ACQUIRE);
+    uint32_t level = head - tail;
+
+    if (level >= UWB_RESULT_RING_SIZE) {
+        // full, drop the new one and count it
+        result_overflow++;
+        return false;
+    }
+
+    result_ring[head & (UWB_RESULT_RING_SIZE - 1)] = *result;
+    // publish the record before moving head
+    __atomic_store_n(&result_head, head + 1, __ATOMIC_RELEASE);
+
+    result_pushed++;
+    if (level + 1 > result_max_level) {
+        result_max_level = level + 1;
+    }
+    return true;
+}
+
+uint32_t uwb_result_pop_batch(uwb_result_t *out, uint32_t max_count) {
+    uint32_t tail = result_tail;
+    uint32_t head = __atomic_load_n(&result_head, __ATOMIC_ACQUIRE);
+    uint32_t count = head - tail;
+
+    if (count > max_count) {
+        count = max_count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = result_ring[(tail + i) & (UWB_RESULT_RING_SIZE - 1)];
+    }
+    // release the slots after copy out
+    __atomic_store_n(&result_tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+uint32_t uwb_result_pushed_count() {
+    return result_pushed;
+}
+
+uint32_t uwb_result_overflow_count() {
+    return result_overflow;
+}
+
+uint32_t uwb_result_max_level() {
+    return result_max_level;
+}
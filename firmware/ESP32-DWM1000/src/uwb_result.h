@@ -0,0 +1,61 @@
+#ifndef __UWB_RESULT_H__
+#define __UWB_RESULT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// must be power of 2
+#define UWB_RESULT_RING_SIZE 64
+
+typedef enum {
+    UWB_RESULT_PING_RESP = 0,
+    UWB_RESULT_RANGE_FINAL = 1,
+    UWB_RESULT_RANGE_REPORT = 2,
+    UWB_RESULT_TDOA = 3,
+} uwb_result_type_t;
+
+typedef struct {
+    uint8_t type; // uwb_result_type_t
+    unsigned long ts;
+    union {
+        struct {
+            uint16_t node_id;
+            uint8_t system_state;
+            uint16_t voltage_mv;
+        } ping;
+        struct {
+            uint16_t node_a_id;
+            uint16_t node_b_id;
+            int32_t distance_mm; // as computed by uwb_twr, 0 if negative
+            float rssi_dbm;
+        } range;
+        struct {
+            uint16_t anchor_id;
+            uint16_t tag_id;
+            uint8_t blink_seq;
+            uint64_t ts; // 40 bit, reference anchor clock
+        } tdoa;
+    };
+} uwb_result_t;
+
+
+// single producer (uwb_task) / single consumer (reporting task), lock free
+bool uwb_result_push(const uwb_result_t *result);
+uint32_t uwb_result_pop_batch(uwb_result_t *out, uint32_t max_count);
+
+uint32_t uwb_result_pushed_count();
+uint32_t uwb_result_overflow_count();
+uint32_t uwb_result_max_level();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_RESULT_H__
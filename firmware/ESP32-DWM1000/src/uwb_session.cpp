@@ -0,0 +1,101 @@
+#include <Arduino.h>
+
+#include "uwb_session.h"
+
+
+// only used by uwb_task
+static uwb_session_t sessions[UWB_SESSION_MAX];
+
+static uint32_t session_expired = 0;
+static uint32_t session_overflow = 0;
+
+
+static bool session_expired_at(const uwb_session_t *s, unsigned long now_ms) {
+    return (long)(now_ms - s->deadline_ms) > 0;
+}
+
+uwb_session_t *uwb_session_open(uint16_t peer_id, uint8_t poll_seq, unsigned long deadline_ms) {
+    uwb_session_t *free_slot = NULL;
+
+    for (int i = 0; i < UWB_SESSION_MAX; i++) {
+        uwb_session_t *s = &sessions[i];
+        if (s->used && s->peer_id == peer_id) {
+            // the initiator gave up the old exchange
+            free_slot = s;
+            break;
+        }
+        if (!s->used && free_slot == NULL) {
+            free_slot = s;
+        }
+    }
+
+    if (free_slot == NULL) {
+        uwb_session_reap(millis());
+        for (int i = 0; i < UWB_SESSION_MAX && free_slot == NULL; i++) {
+            if (!sessions[i].used) {
+                free_slot = &sessions[i];
+            }
+        }
+    }
+    if (free_slot == NULL) {
+        session_overflow++;
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(uwb_session_t));
+    free_slot->used = true;
+    free_slot->peer_id = peer_id;
+    free_slot->poll_seq = poll_seq;
+    free_slot->deadline_ms = deadline_ms;
+    return free_slot;
+}
+
+uwb_session_t *uwb_session_find(uint16_t peer_id, uint8_t final_seq) {
+    for (int i = 0; i < UWB_SESSION_MAX; i++) {
+        uwb_session_t *s = &sessions[i];
+        if (!s->used || s->peer_id != peer_id) {
+            continue;
+        }
+        if ((uint8_t)(s->poll_seq + 1) != final_seq || session_expired_at(s, millis())) {
+            return NULL;
+        }
+        return s;
+    }
+    return NULL;
+}
+
+void uwb_session_close(uwb_session_t *session) {
+    if (session) {
+        session->used = false;
+    }
+}
+
+uint8_t uwb_session_reap(unsigned long now_ms) {
+    uint8_t count = 0;
+    for (int i = 0; i < UWB_SESSION_MAX; i++) {
+        if (sessions[i].used && session_expired_at(&sessions[i], now_ms)) {
+            sessions[i].used = false;
+            count++;
+        }
+    }
+    session_expired += count;
+    return count;
+}
+
+uint8_t uwb_session_active_count() {
+    uint8_t count = 0;
+    for (int i = 0; i < UWB_SESSION_MAX; i++) {
+        if (sessions[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t uwb_session_expired_count() {
+    return session_expired;
+}
+
+uint32_t uwb_session_overflow_count() {
+    return session_overflow;
+}
@@ -0,0 +1,45 @@
+#ifndef __UWB_SESSION_H__
+#define __UWB_SESSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// responder side ranging exchanges in flight, one per initiator
+#define UWB_SESSION_MAX 8
+
+typedef struct {
+    bool used;
+    uint16_t peer_id;        // initiator node id
+    uint8_t poll_seq;        // seq_num of the poll, the final of the same exchange has poll_seq + 1
+    uint8_t slot;            // reply slot of a broadcast poll, 0 for unicast
+    uint32_t poll_rx_ts;     // low 32 bit
+    uint32_t resp_tx_ts;     // low 32 bit, antenna delay included
+    unsigned long deadline_ms;
+} uwb_session_t;
+
+
+// new session for a poll, replaces an older session of the same peer
+// return NULL if the table is full
+uwb_session_t *uwb_session_open(uint16_t peer_id, uint8_t poll_seq, unsigned long deadline_ms);
+// session of the final frame, NULL if not found or expired
+uwb_session_t *uwb_session_find(uint16_t peer_id, uint8_t final_seq);
+void uwb_session_close(uwb_session_t *session);
+// drop expired sessions, return how many
+uint8_t uwb_session_reap(unsigned long now_ms);
+
+uint8_t uwb_session_active_count();
+uint32_t uwb_session_expired_count();
+uint32_t uwb_session_overflow_count();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_SESSION_H__
@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include "esp_timer.h"
+
+#include "uwb_tdma.h"
+#include "uwb.h"
+
+
+#define TDMA_PENDING_BEACON 0x01
+#define TDMA_PENDING_SLOT   0x02
+
+// set by the esp_timer task, cleared by uwb_task
+static volatile uint8_t tdma_pending = 0;
+
+static esp_timer_handle_t beacon_timer = NULL;
+static esp_timer_handle_t slot_timer = NULL;
+
+// master side
+static bool tdma_running = false;
+static uint16_t tdma_slot_ms = UWB_TDMA_DEFAULT_SLOT_MS;
+static uint16_t tdma_tag_ids[UWB_TDMA_MAX_TAGS];
+static uint8_t tdma_num_tags = 0;
+static uint16_t tdma_anchor_ids[UWB_TDMA_MAX_ANCHORS];
+static uint8_t tdma_num_anchors = 0;
+static uint16_t tdma_superframe_seq = 0;
+
+// tag side, anchors of the coming slot
+static uint16_t slot_anchor_ids[UWB_TDMA_MAX_ANCHORS];
+static uint8_t slot_num_anchors = 0;
+
+// counters
+static uint32_t beacon_tx_count = 0;
+static uint32_t beacon_skip_count = 0;
+static uint32_t beacon_rx_count = 0;
+static uint32_t slot_run_count = 0;
+static uint32_t slot_skip_count = 0;
+
+
+static void tdma_timer_cb(void *arg) {
+    __atomic_fetch_or(&tdma_pending, (uint8_t)(uintptr_t)arg, __ATOMIC_RELEASE);
+    uwb_task_wake();
+}
+
+static void tdma_timer_init() {
+    if (beacon_timer != NULL) {
+        return;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = tdma_timer_cb;
+    args.dispatch_method = ESP_TIMER_TASK;
+
+    args.arg = (void *)(uintptr_t)TDMA_PENDING_BEACON;
+    args.name = "tdma_beacon";
+    esp_timer_create(&args, &beacon_timer);
+
+    args.arg = (void *)(uintptr_t)TDMA_PENDING_SLOT;
+    args.name = "tdma_slot";
+    esp_timer_create(&args, &slot_timer);
+}
+
+uint32_t uwb_tdma_min_slot_us(uint8_t num_anchors) {
+    // one exchange: poll, resp after the reply delay, final after the reply delay, report
+    uint32_t frame_us = uwb_phy_frame_duration_ns(uwb_phy_current(), UWB_PHY_MAX_FRAME_LEN) / 1000 + 1;
+    uint32_t exchange_us = uwb_phy_timing.resp_tx_delay_uus + uwb_phy_timing.final_tx_delay_uus
+                         + 2 * frame_us + UWB_PHY_REPLY_PROCESS_UUS;
+    return num_anchors * exchange_us + UWB_TDMA_SLOT_GUARD_US;
+}
+
+bool uwb_tdma_start(uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors) {
+    if (num_tags == 0 || num_tags > UWB_TDMA_MAX_TAGS || num_anchors == 0 || num_anchors > UWB_TDMA_MAX_ANCHORS) {
+        return false;
+    }
+    if ((uint32_t)slot_ms * 1000 < uwb_tdma_min_slot_us(num_anchors)) {
+        return false;
+    }
+
+    tdma_timer_init();
+    uwb_tdma_stop();
+
+    tdma_slot_ms = slot_ms;
+    memcpy(tdma_tag_ids, tag_ids, num_tags * sizeof(uint16_t));
+    tdma_num_tags = num_tags;
+    memcpy(tdma_anchor_ids, anchor_ids, num_anchors * sizeof(uint16_t));
+    tdma_num_anchors = num_anchors;
+
+    beacon_tx_count = 0;
+    beacon_skip_count = 0;
+
+    uint64_t superframe_us = (uint64_t)slot_ms * 1000 * (num_tags + 1);
+    tdma_running = true;
+    esp_timer_start_periodic(beacon_timer, superframe_us);
+    return true;
+}
+
+void uwb_tdma_stop() {
+    if (beacon_timer == NULL) {
+        return;
+    }
+    tdma_running = false;
+    esp_timer_stop(beacon_timer);
+    __atomic_and_fetch(&tdma_pending, (uint8_t)~TDMA_PENDING_BEACON, __ATOMIC_RELAXED);
+}
+
+bool uwb_tdma_running() {
+    return tdma_running;
+}
+
+void uwb_tdma_on_beacon(uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors) {
+    beacon_rx_count++;
+
+    int slot_index = -1;
+    for (int i = 0; i < num_tags && i < UWB_TDMA_MAX_TAGS; i++) {
+        if (tag_ids[i] == uwb_node_id) {
+            slot_index = i;
+            break;
+        }
+    }
+    if (slot_index < 0 || num_anchors == 0) {
+        return;
+    }
+
+    if (num_anchors > UWB_TDMA_MAX_ANCHORS) {
+        num_anchors = UWB_TDMA_MAX_ANCHORS;
+    }
+    memcpy(slot_anchor_ids, anchor_ids, num_anchors * sizeof(uint16_t));
+    slot_num_anchors = num_anchors;
+
+    // slot 0 is the beacon, tag i owns slot i + 1
+    tdma_timer_init();
+    esp_timer_stop(slot_timer);
+    esp_timer_start_once(slot_timer, (uint64_t)slot_ms * 1000 * (slot_index + 1) + UWB_TDMA_SLOT_GUARD_US);
+}
+
+void uwb_tdma_process() {
+    uint8_t pending = __atomic_exchange_n(&tdma_pending, 0, __ATOMIC_ACQUIRE);
+    if (pending == 0) {
+        return;
+    }
+
+    if ((pending & TDMA_PENDING_BEACON) && tdma_running) {
+        // a late exchange still holds the radio, skip this superframe instead of breaking it
+        if (!uwb_radio_busy() && uwb_send_tdma_beacon(tdma_superframe_seq++, tdma_slot_ms, tdma_tag_ids, tdma_num_tags, tdma_anchor_ids, tdma_num_anchors)) {
+            beacon_tx_count++;
+        } else {
+            beacon_skip_count++;
+        }
+    }
+
+    if (pending & TDMA_PENDING_SLOT) {
+        if (!uwb_radio_busy() && uwb_range_multi_start(slot_anchor_ids, slot_num_anchors)) {
+            slot_run_count++;
+        } else {
+            slot_skip_count++;
+        }
+    }
+}
+
+void uwb_tdma_report() {
+    Serial.printf("{\"event\":\"tdma\",\"running\":%s,\"slot_ms\":%u,\"num_tags\":%u,\"num_anchors\":%u,\"superframe_ms\":%u,\"min_slot_us\":%u,\"beacon_tx\":%u,\"beacon_skip\":%u,\"beacon_rx\":%u,\"slot_run\":%u,\"slot_skip\":%u}\n",
+        tdma_running ? "true" : "false",
+        (unsigned)tdma_slot_ms,
+        (unsigned)tdma_num_tags,
+        (unsigned)tdma_num_anchors,
+        (unsigned)(tdma_slot_ms * (tdma_num_tags + 1)),
+        (unsigned)uwb_tdma_min_slot_us(tdma_num_anchors ? tdma_num_anchors : 1),
+        (unsigned)beacon_tx_count,
+        (unsigned)beacon_skip_count,
+        (unsigned)beacon_rx_count,
+        (unsigned)slot_run_count,
+        (unsigned)slot_skip_count
+    );
+}
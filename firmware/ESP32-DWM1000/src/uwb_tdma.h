@@ -0,0 +1,45 @@
+#ifndef __UWB_TDMA_H__
+#define __UWB_TDMA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// superframe = beacon slot + one slot per tag
+// | beacon | tag 0 | tag 1 | ... | tag n-1 | beacon | ...
+#define UWB_TDMA_MAX_TAGS 8
+#define UWB_TDMA_MAX_ANCHORS 8
+#define UWB_TDMA_DEFAULT_SLOT_MS 100
+// tag starts its exchanges this late into the slot, covers beacon handling jitter
+#define UWB_TDMA_SLOT_GUARD_US 2000
+
+
+// master anchor: broadcast a beacon every superframe, each tag ranges with all anchors in its slot
+// return false if the slot is too short for the anchors with the current PHY profile
+bool uwb_tdma_start(uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors);
+void uwb_tdma_stop();
+bool uwb_tdma_running();
+
+// shortest slot for num_anchors exchanges with the current PHY profile
+uint32_t uwb_tdma_min_slot_us(uint8_t num_anchors);
+
+// called by uwb_task, runs the beacon tx / tag slot requested by the timers
+void uwb_tdma_process();
+
+// tag side, called from the beacon handler
+void uwb_tdma_on_beacon(uint16_t slot_ms, const uint16_t *tag_ids, uint8_t num_tags, const uint16_t *anchor_ids, uint8_t num_anchors);
+
+// print {"event":"tdma",...}
+void uwb_tdma_report();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_TDMA_H__
@@ -0,0 +1,479 @@
+#include <Arduino.h>
+#include "esp_timer.h"
+
+#include "uwb_tdoa.h"
+#include "uwb.h"
+
+
+#define TDOA_PENDING_SYNC  0x01
+#define TDOA_PENDING_BLINK 0x02
+
+// a clock model older than this can not convert timestamps, 2^38 dtu = 4.3 s
+#define TDOA_MAX_SPAN_DTU (1ULL << 38)
+
+// set by the esp_timer task, cleared by uwb_task
+static volatile uint8_t tdoa_pending = 0;
+
+static esp_timer_handle_t sync_timer = NULL;
+static esp_timer_handle_t blink_timer = NULL;
+
+// reference anchor side
+static bool tdoa_running = false;
+static uint16_t tdoa_sync_ms = UWB_TDOA_DEFAULT_SYNC_MS;
+static uint16_t tdoa_blink_ms = UWB_TDOA_DEFAULT_BLINK_MS;
+static uint8_t tdoa_anchors = UWB_TDOA_DEFAULT_ANCHORS;
+static uint32_t tdoa_sync_seq = 0;
+// reference: sized by uwb_tdoa_start, anchors and tags: from the last sync
+static uwb_tdoa_layout_t tdoa_layout = {UWB_TDOA_MAX_ANCHORS, 1, 0, 1, 0};
+
+// anchor side, reference clock = model_ref_ts + d + d * drift, d = local - model_local_ts
+static uint16_t model_ref_id = 0;
+static uint8_t model_syncs = 0;        // syncs of model_ref_id in a row, valid from 2
+static uint64_t model_ref_ts = 0;
+static uint64_t model_local_ts = 0;
+static int32_t model_drift_ppb = 0;
+
+// anchor side, blinks waiting for the next sync
+#define TDOA_PERIOD_MAX_ENTRIES (UWB_TDOA_REPORT_MAX_ENTRIES * UWB_TDOA_REPORT_FRAMES_MAX)
+static uwb_tdoa_entry_t pending_entries[TDOA_PERIOD_MAX_ENTRIES];
+static uint8_t pending_count = 0;
+
+// anchor side, blinks of the last period on their way out, one report frame after the other in the slot
+static uwb_tdoa_entry_t report_entries[TDOA_PERIOD_MAX_ENTRIES];
+static uint8_t report_count = 0;
+static uint8_t report_next = 0;      // first entry of the next frame
+static uint8_t report_frame = 0;     // next frame in the slot
+static uint16_t report_dest = 0;
+static uint64_t report_slot_ts = 0;  // local DW1000 time of the slot start
+
+// tag side, the blink of this period, a delayed TX from the sync RX
+static bool tag_blink_armed = false;
+static uint64_t tag_blink_tx_ts = 0;
+static uint8_t tag_blink_seq = 0;
+
+// counters
+static uint32_t sync_tx_count = 0;
+static uint32_t sync_skip_count = 0;
+static uint32_t sync_rx_count = 0;
+static uint32_t blink_tx_count = 0;
+static uint32_t blink_skip_count = 0;
+static uint32_t blink_rx_count = 0;
+static uint32_t entry_drop_count = 0;
+static uint32_t report_tx_count = 0;
+static uint32_t report_fail_count = 0;
+static uint32_t report_rx_count = 0;
+
+
+static void tdoa_timer_cb(void *arg) {
+    __atomic_fetch_or(&tdoa_pending, (uint8_t)(uintptr_t)arg, __ATOMIC_RELEASE);
+    uwb_task_wake();
+}
+
+static void tdoa_timer_init() {
+    if (sync_timer != NULL) {
+        return;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = tdoa_timer_cb;
+    args.dispatch_method = ESP_TIMER_TASK;
+
+    args.arg = (void *)(uintptr_t)TDOA_PENDING_SYNC;
+    args.name = "tdoa_sync";
+    esp_timer_create(&args, &sync_timer);
+
+    args.arg = (void *)(uintptr_t)TDOA_PENDING_BLINK;
+    args.name = "tdoa_blink";
+    esp_timer_create(&args, &blink_timer);
+}
+
+// one full report frame and the time to load the next one
+static uint32_t tdoa_report_frame_uus() {
+    return uwb_phy_frame_uus(sizeof(uwb_pkt_tdoa_report_t)) + UWB_TDOA_REPORT_GAP_UUS;
+}
+
+static uint32_t tdoa_blink_slot_uus() {
+    return uwb_phy_frame_uus(sizeof(uwb_pkt_tdoa_blink_t)) + UWB_TDOA_BLINK_GUARD_UUS;
+}
+
+// sync RX to the report slots
+static uint32_t tdoa_report_start_uus() {
+    return uwb_phy_timing.resp_tx_delay_uus;
+}
+
+// sync RX to the end of the report slots, the blink slots start here
+static uint32_t tdoa_report_end_uus(uint8_t anchor_slots, uint8_t report_frames) {
+    return tdoa_report_start_uus() + (uint32_t)anchor_slots * report_frames * tdoa_report_frame_uus();
+}
+
+// sync RX to the start of the next sync frame, the next sync TX is read SYNC_TX_DELAY before it goes out
+static uint32_t tdoa_period_end_uus(uint16_t sync_ms) {
+    uint32_t period_uus = (uint32_t)((uint64_t)sync_ms * 1000 * 1000 / 1026);
+    uint32_t margin_uus = uwb_phy_frame_uus(sizeof(uwb_pkt_tdoa_sync_t)) + UWB_TDOA_SYNC_TX_DELAY_UUS;
+    return (period_uus > margin_uus) ? period_uus - margin_uus : 0;
+}
+
+static uint32_t tdoa_blink_slots_fit(uint16_t sync_ms, uint8_t anchor_slots, uint8_t report_frames) {
+    uint32_t start_uus = tdoa_report_end_uus(anchor_slots, report_frames);
+    uint32_t end_uus = tdoa_period_end_uus(sync_ms);
+    return (end_uus > start_uus) ? (end_uus - start_uus) / tdoa_blink_slot_uus() : 0;
+}
+
+// blink every blink_ms, in whole sync periods
+static uint8_t tdoa_blink_cycle(uint16_t sync_ms, uint16_t blink_ms) {
+    uint32_t cycle = ((uint32_t)blink_ms + sync_ms / 2) / sync_ms;
+    return (cycle < 1) ? 1 : (cycle > 255) ? 255 : (uint8_t)cycle;
+}
+
+// blinks of one period an anchor can take, limited by the blink slots and by its report frames
+static uint32_t tdoa_period_tags(uint16_t sync_ms, uint8_t anchor_slots, uint8_t report_frames) {
+    uint32_t slots = tdoa_blink_slots_fit(sync_ms, anchor_slots, report_frames);
+    uint32_t entries = (uint32_t)report_frames * UWB_TDOA_REPORT_MAX_ENTRIES;
+    uint32_t tags = (slots < entries) ? slots : entries;
+    return (tags > 255) ? 255 : tags;
+}
+
+uint16_t uwb_tdoa_max_tags(uint16_t sync_ms, uint16_t blink_ms, uint8_t anchors) {
+    if (sync_ms == 0 || anchors == 0 || anchors > UWB_TDOA_MAX_ANCHORS) {
+        return 0;
+    }
+    uint32_t best = 0;
+    for (uint8_t frames = 1; frames <= UWB_TDOA_REPORT_FRAMES_MAX; frames++) {
+        uint32_t tags = tdoa_period_tags(sync_ms, anchors, frames);
+        if (tags > best) {
+            best = tags;
+        }
+    }
+    best *= tdoa_blink_cycle(sync_ms, blink_ms);
+    return (best > 0xFFFF) ? 0xFFFF : (uint16_t)best;
+}
+
+const uwb_tdoa_layout_t *uwb_tdoa_layout() {
+    return &tdoa_layout;
+}
+
+bool uwb_tdoa_start(uint16_t sync_ms, uint16_t blink_ms, uint8_t anchors, uint16_t tags) {
+    if (sync_ms == 0 || anchors == 0 || anchors > UWB_TDOA_MAX_ANCHORS) {
+        return false;
+    }
+    if (tags == 0) {
+        tags = uwb_tdoa_max_tags(sync_ms, blink_ms, anchors);
+    }
+
+    // blink_ms 0 keeps the tags quiet, the syncs still run
+    uwb_tdoa_layout_t layout = {anchors, 1, 0, 1, 0};
+    if (blink_ms > 0 && tags > 0) {
+        layout.blink_cycle = tdoa_blink_cycle(sync_ms, blink_ms);
+        uint32_t per_period = ((uint32_t)tags + layout.blink_cycle - 1) / layout.blink_cycle;
+
+        // fewest report frames that carry the blinks of one period and still leave room for their slots
+        uint8_t frames = 0;
+        for (uint8_t f = 1; f <= UWB_TDOA_REPORT_FRAMES_MAX; f++) {
+            if (tdoa_period_tags(sync_ms, anchors, f) >= per_period) {
+                frames = f;
+                break;
+            }
+        }
+        if (frames == 0) {
+            return false;
+        }
+        layout.report_frames = frames;
+        layout.blink_slots = (uint8_t)per_period;
+    } else if (tdoa_report_end_uus(anchors, 1) > tdoa_period_end_uus(sync_ms)) {
+        return false;
+    }
+
+    tdoa_timer_init();
+    uwb_tdoa_stop();
+
+    tdoa_sync_ms = sync_ms;
+    tdoa_blink_ms = blink_ms;
+    tdoa_anchors = anchors;
+    tdoa_layout = layout;
+    tdoa_sync_seq = 0;
+    sync_tx_count = 0;
+    sync_skip_count = 0;
+
+    tdoa_running = true;
+    esp_timer_start_periodic(sync_timer, (uint64_t)sync_ms * 1000);
+    return true;
+}
+
+void uwb_tdoa_stop() {
+    if (sync_timer == NULL) {
+        return;
+    }
+    tdoa_running = false;
+    esp_timer_stop(sync_timer);
+    __atomic_and_fetch(&tdoa_pending, (uint8_t)~TDOA_PENDING_SYNC, __ATOMIC_RELAXED);
+}
+
+bool uwb_tdoa_running() {
+    return tdoa_running;
+}
+
+static void tdoa_model_update(uint16_t ref_id, uint64_t ref_tx_ts, uint64_t local_rx_ts) {
+    if (ref_id != model_ref_id) {
+        model_ref_id = ref_id;
+        model_syncs = 0;
+    }
+
+    if (model_syncs > 0) {
+        uint64_t ref_span = uwb_twr_diff40(ref_tx_ts, model_ref_ts);
+        uint64_t local_span = uwb_twr_diff40(local_rx_ts, model_local_ts);
+        if (local_span > 0 && local_span < TDOA_MAX_SPAN_DTU) {
+            // span difference is at most ~2^26 dtu, times 1e9 still fits
+            int32_t ppb = (int32_t)(((int64_t)ref_span - (int64_t)local_span) * 1000000000LL / (int64_t)local_span);
+            // first estimate as is, then a light low pass against timestamp noise
+            model_drift_ppb = (model_syncs == 1) ? ppb : model_drift_ppb + (ppb - model_drift_ppb) / 4;
+        } else {
+            // lost too many syncs, start over
+            model_syncs = 0;
+        }
+    }
+
+    model_ref_ts = ref_tx_ts;
+    model_local_ts = local_rx_ts;
+    if (model_syncs < 255) {
+        model_syncs++;
+    }
+}
+
+static bool tdoa_model_to_ref(uint64_t local_ts, uint64_t *ref_ts) {
+    if (model_syncs < 2) {
+        return false;
+    }
+    uint64_t d = uwb_twr_diff40(local_ts, model_local_ts);
+    if (d >= TDOA_MAX_SPAN_DTU) {
+        return false;
+    }
+    int64_t correction = (int64_t)d * model_drift_ppb / 1000000000LL;
+    *ref_ts = (model_ref_ts + d + correction) & UWB_TWR_TS_MASK;
+    return true;
+}
+
+static void tdoa_push_result(uint16_t anchor_id, uint16_t tag_id, uint8_t blink_seq, uint64_t ts) {
+    uwb_result_t result;
+    result.type = UWB_RESULT_TDOA;
+    result.ts = millis();
+    result.tdoa.anchor_id = anchor_id;
+    result.tdoa.tag_id = tag_id;
+    result.tdoa.blink_seq = blink_seq;
+    result.tdoa.ts = ts;
+    uwb_result_push(&result);
+}
+
+// blink slot of this tag in the period of this sync, false if it does not blink in this period
+static bool tdoa_tag_slot(const uwb_tdoa_layout_t *layout, uint32_t *slot) {
+    if (layout->blink_slots == 0) {
+        return false;
+    }
+    uint32_t idx = uwb_node_id % ((uint32_t)layout->blink_cycle * layout->blink_slots);
+    if (idx % layout->blink_cycle != layout->blink_phase) {
+        return false;
+    }
+    *slot = idx / layout->blink_cycle;
+    return true;
+}
+
+static void tdoa_tag_arm(uint32_t delay_us) {
+    tdoa_timer_init();
+    esp_timer_stop(blink_timer);
+    esp_timer_start_once(blink_timer, delay_us);
+}
+
+// next report frame at its place in the slot, a late one drops the rest of the period
+static void tdoa_report_next() {
+    uint8_t n = report_count - report_next;
+    if (n > UWB_TDOA_REPORT_MAX_ENTRIES) {
+        n = UWB_TDOA_REPORT_MAX_ENTRIES;
+    }
+    uint64_t tx_ts = report_slot_ts + (uint64_t)report_frame * tdoa_report_frame_uus() * UUS_TO_DWT_TIME;
+    if (uwb_send_tdoa_report(report_dest, &report_entries[report_next], n, (uint32_t)(tx_ts >> 8))) {
+        report_tx_count++;
+        report_next += n;
+        report_frame++;
+    } else {
+        report_fail_count++;
+        entry_drop_count += report_count - report_next;
+        report_next = report_count;
+    }
+}
+
+void uwb_tdoa_on_tx_done() {
+    if (report_frame > 0 && report_next < report_count) {
+        tdoa_report_next();
+    }
+}
+
+void uwb_tdoa_on_sync(uint16_t ref_id, uint64_t ref_tx_ts, uint64_t local_rx_ts, const uwb_tdoa_layout_t *layout) {
+    sync_rx_count++;
+
+    // the reference anchor does not follow another one
+    if (tdoa_running) {
+        return;
+    }
+
+    tdoa_layout = *layout;
+    if (tdoa_layout.anchor_slots == 0 || tdoa_layout.anchor_slots > UWB_TDOA_MAX_ANCHORS) {
+        tdoa_layout.anchor_slots = UWB_TDOA_MAX_ANCHORS;
+    }
+    if (tdoa_layout.report_frames == 0 || tdoa_layout.report_frames > UWB_TDOA_REPORT_FRAMES_MAX) {
+        tdoa_layout.report_frames = (tdoa_layout.report_frames == 0) ? 1 : UWB_TDOA_REPORT_FRAMES_MAX;
+    }
+    if (tdoa_layout.blink_cycle == 0) {
+        tdoa_layout.blink_cycle = 1;
+    }
+
+    if (uwb_node_is_tag) {
+        // the blink slots follow the report slots of all anchors, so blinks never hit a report
+        uint32_t slot;
+        if (!tdoa_tag_slot(&tdoa_layout, &slot)) {
+            return;
+        }
+        uint32_t offset_uus = tdoa_report_end_uus(tdoa_layout.anchor_slots, tdoa_layout.report_frames) + slot * tdoa_blink_slot_uus();
+        tag_blink_tx_ts = (local_rx_ts + (uint64_t)offset_uus * UUS_TO_DWT_TIME) & UWB_TWR_TS_MASK;
+        tag_blink_armed = true;
+        uint32_t arm_uus = (offset_uus > UWB_TDOA_BLINK_ARM_UUS) ? offset_uus - UWB_TDOA_BLINK_ARM_UUS : 0;
+        tdoa_tag_arm((uint32_t)((uint64_t)arm_uus * 1026 / 1000) + 1);
+        return;
+    }
+
+    tdoa_model_update(ref_id, ref_tx_ts, local_rx_ts);
+
+    // frames of the last period that did not go out before this sync
+    if (report_next < report_count) {
+        entry_drop_count += report_count - report_next;
+    }
+    report_count = 0;
+    report_next = 0;
+    report_frame = 0;
+
+    if (pending_count == 0) {
+        return;
+    }
+
+    // the blinks of the last period go in this anchor's slot after the sync, as many as its frames hold
+    uint8_t n = pending_count;
+    if (n > tdoa_layout.report_frames * UWB_TDOA_REPORT_MAX_ENTRIES) {
+        n = tdoa_layout.report_frames * UWB_TDOA_REPORT_MAX_ENTRIES;
+        entry_drop_count += pending_count - n;
+    }
+    memcpy(report_entries, pending_entries, n * sizeof(uwb_tdoa_entry_t));
+    report_count = n;
+    report_dest = ref_id;
+    pending_count = 0;
+
+    uint32_t slot = (uwb_node_id & 0xFF) % tdoa_layout.anchor_slots;
+    uint64_t slot_delay_uus = tdoa_report_start_uus() + (uint64_t)slot * tdoa_layout.report_frames * tdoa_report_frame_uus();
+    report_slot_ts = local_rx_ts + slot_delay_uus * UUS_TO_DWT_TIME;
+    tdoa_report_next();
+}
+
+void uwb_tdoa_on_blink(uint16_t tag_id, uint8_t blink_seq, uint64_t local_rx_ts) {
+    blink_rx_count++;
+
+    // reference clock is the local clock
+    if (tdoa_running) {
+        tdoa_push_result(uwb_node_id, tag_id, blink_seq, local_rx_ts);
+        return;
+    }
+
+    // tags hear the blinks of the other tags
+    if (!uwb_node_is_anchor) {
+        return;
+    }
+    uint64_t ref_ts;
+    if (!tdoa_model_to_ref(local_rx_ts, &ref_ts)) {
+        entry_drop_count++;
+        return;
+    }
+    if (pending_count >= TDOA_PERIOD_MAX_ENTRIES) {
+        entry_drop_count++;
+        return;
+    }
+
+    uwb_tdoa_entry_t *entry = &pending_entries[pending_count++];
+    entry->tag_id = tag_id;
+    entry->blink_seq = blink_seq;
+    entry->ts_lo = (uint32_t)ref_ts;
+    entry->ts_hi = (uint8_t)(ref_ts >> 32);
+}
+
+void uwb_tdoa_on_report(uint16_t anchor_id, const uwb_tdoa_entry_t *entries, uint8_t num_entries) {
+    report_rx_count++;
+    if (num_entries > UWB_TDOA_REPORT_MAX_ENTRIES) {
+        num_entries = UWB_TDOA_REPORT_MAX_ENTRIES;
+    }
+    for (int i = 0; i < num_entries; i++) {
+        uint64_t ts = ((uint64_t)entries[i].ts_hi << 32) | entries[i].ts_lo;
+        tdoa_push_result(anchor_id, entries[i].tag_id, entries[i].blink_seq, ts);
+    }
+}
+
+void uwb_tdoa_process() {
+    uint8_t pending = __atomic_exchange_n(&tdoa_pending, 0, __ATOMIC_ACQUIRE);
+    if (pending == 0) {
+        return;
+    }
+
+    if ((pending & TDOA_PENDING_SYNC) && tdoa_running) {
+        // the phase runs on with skipped syncs, the tags of a skipped period just do not blink
+        tdoa_layout.blink_phase = (uint8_t)(tdoa_sync_seq % tdoa_layout.blink_cycle);
+        // anchors need two syncs for their clock model, the tags start blinking after the second
+        uwb_tdoa_layout_t layout = tdoa_layout;
+        if (tdoa_sync_seq++ == 0) {
+            layout.blink_slots = 0;
+        }
+        // a running exchange holds the radio, skip this sync, anchors keep their model
+        if (!uwb_radio_busy() && uwb_send_tdoa_sync(&layout)) {
+            sync_tx_count++;
+        } else {
+            sync_skip_count++;
+        }
+    }
+
+    if ((pending & TDOA_PENDING_BLINK) && tag_blink_armed) {
+        tag_blink_armed = false;
+        if (!uwb_radio_busy() && uwb_send_tdoa_blink(tag_blink_seq, (uint32_t)(tag_blink_tx_ts >> 8))) {
+            blink_tx_count++;
+        } else {
+            blink_skip_count++;
+        }
+        tag_blink_seq++;
+    }
+}
+
+uint32_t uwb_tdoa_entry_drop_count() {
+    return entry_drop_count;
+}
+
+uint32_t uwb_tdoa_report_fail_count() {
+    return report_fail_count;
+}
+
+void uwb_tdoa_report() {
+    Serial.printf("{\"event\":\"tdoa\",\"running\":%s,\"sync_ms\":%u,\"blink_ms\":%u,\"anchors\":%u,\"max_tags\":%u,\"report_frames\":%u,\"blink_slots\":%u,\"blink_cycle\":%u,\"sync_tx\":%u,\"sync_skip\":%u,\"sync_rx\":%u,\"ref_id\":%u,\"model_valid\":%s,\"drift_ppb\":%d,\"blink_tx\":%u,\"blink_skip\":%u,\"blink_rx\":%u,\"entry_drop\":%u,\"report_tx\":%u,\"report_fail\":%u,\"report_rx\":%u}\n",
+        tdoa_running ? "true" : "false",
+        (unsigned)tdoa_sync_ms,
+        (unsigned)tdoa_blink_ms,
+        (unsigned)tdoa_anchors,
+        (unsigned)uwb_tdoa_max_tags(tdoa_sync_ms, tdoa_blink_ms, tdoa_anchors),
+        (unsigned)tdoa_layout.report_frames,
+        (unsigned)tdoa_layout.blink_slots,
+        (unsigned)tdoa_layout.blink_cycle,
+        (unsigned)sync_tx_count,
+        (unsigned)sync_skip_count,
+        (unsigned)sync_rx_count,
+        (unsigned)model_ref_id,
+        (model_syncs >= 2) ? "true" : "false",
+        (int)model_drift_ppb,
+        (unsigned)blink_tx_count,
+        (unsigned)blink_skip_count,
+        (unsigned)blink_rx_count,
+        (unsigned)entry_drop_count,
+        (unsigned)report_tx_count,
+        (unsigned)report_fail_count,
+        (unsigned)report_rx_count
+    );
+}
@@ -0,0 +1,95 @@
+#ifndef __UWB_TDOA_H__
+#define __UWB_TDOA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// TDoA: tags send a single blink, anchors timestamp it in the clock of the reference anchor
+// the reference anchor broadcasts sync frames with its own TX timestamp, the other anchors
+// model their clock offset and drift from two syncs, and send their blink timestamps back
+// in up to report_frames batched reports per sync period
+//
+// one sync period, the layout is in every sync (uwb_tdoa_layout_t), times from the sync RX:
+// | sync | resp delay | a0 r0 r1 .. | a1 r0 r1 .. | ... | blink slot 0 | 1 | ... | margin | sync
+//                     ^ anchor slot = anchor id low byte % anchor_slots
+// a tag blinks once every blink_cycle periods, in the period with blink_phase == id % blink_cycle,
+// in blink slot (id % (blink_cycle * blink_slots)) / blink_cycle, so tags with consecutive ids never
+// collide, blinks never overlap the reports, and an anchor gets at most blink_slots blinks per period
+// entries of one report, fills a 127 byte frame (standard PHR)
+#define UWB_TDOA_REPORT_MAX_ENTRIES 14
+// report frames of one anchor per sync period
+#define UWB_TDOA_REPORT_FRAMES_MAX 6
+// TX done of a report frame to the next delayed TX, a frame load over SPI and the task latency
+#define UWB_TDOA_REPORT_GAP_UUS 500
+// air between two blink slots, covers the clock drift of the tags over one sync period
+#define UWB_TDOA_BLINK_GUARD_UUS 200
+// the blink timer fires this long before the blink, which is a delayed TX from the sync RX time
+#define UWB_TDOA_BLINK_ARM_UUS 2000
+// report slots after a sync, anchor low byte modulo anchor_slots
+#define UWB_TDOA_MAX_ANCHORS 16
+#define UWB_TDOA_DEFAULT_ANCHORS 8
+#define UWB_TDOA_DEFAULT_SYNC_MS 200
+#define UWB_TDOA_DEFAULT_BLINK_MS 200
+// sync TX is scheduled this long after reading the system time, covers SPI and task latency
+#define UWB_TDOA_SYNC_TX_DELAY_UUS 1000
+
+// layout of the sync period, sent by the reference anchor in every sync
+typedef struct __attribute__((packed)) {
+    uint8_t anchor_slots;
+    uint8_t report_frames;  // report frames per anchor slot
+    uint8_t blink_slots;    // blinks per period, 0 stops the tags
+    uint8_t blink_cycle;    // sync periods per blink of a tag
+    uint8_t blink_phase;    // period of this sync in the blink cycle
+} uwb_tdoa_layout_t;
+
+// one blink timestamp, ts is 40 bit DW1000 time in the reference anchor clock
+// it is late by the sync flight time from the reference anchor, the gateway adds it back
+typedef struct __attribute__((packed)) {
+    uint16_t tag_id;
+    uint8_t blink_seq;
+    uint32_t ts_lo;
+    uint8_t ts_hi;
+} uwb_tdoa_entry_t;
+
+
+// reference anchor: broadcast a sync every sync_ms, tags blink every blink_ms (rounded to sync periods)
+// report frames and blink slots are sized for anchors (1 .. UWB_TDOA_MAX_ANCHORS) and tags, 0 tags = as many as fit
+// return false if they do not fit in sync_ms with the current PHY profile
+bool uwb_tdoa_start(uint16_t sync_ms, uint16_t blink_ms, uint8_t anchors, uint16_t tags);
+void uwb_tdoa_stop();
+bool uwb_tdoa_running();
+
+// most tags uwb_tdoa_start takes with these settings and the current PHY profile, 0 if nothing fits
+uint16_t uwb_tdoa_max_tags(uint16_t sync_ms, uint16_t blink_ms, uint8_t anchors);
+// layout of uwb_tdoa_start or of the last sync
+const uwb_tdoa_layout_t *uwb_tdoa_layout();
+
+// called by uwb_task, runs the sync / blink requested by the timers
+void uwb_tdoa_process();
+
+// called from the frame handlers
+void uwb_tdoa_on_sync(uint16_t ref_id, uint64_t ref_tx_ts, uint64_t local_rx_ts, const uwb_tdoa_layout_t *layout);
+void uwb_tdoa_on_blink(uint16_t tag_id, uint8_t blink_seq, uint64_t local_rx_ts);
+void uwb_tdoa_on_report(uint16_t anchor_id, const uwb_tdoa_entry_t *entries, uint8_t num_entries);
+// called from the TX done callback, sends the next report frame of the slot
+void uwb_tdoa_on_tx_done();
+
+// print {"event":"tdoa",...}
+void uwb_tdoa_report();
+
+// anchor side, blink timestamps that never made it into a sent report, report frames that failed to go out
+uint32_t uwb_tdoa_entry_drop_count();
+uint32_t uwb_tdoa_report_fail_count();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_TDOA_H__
@@ -0,0 +1,164 @@
+#include <Arduino.h>
+
+#include "uwb_twr.h"
+#include "deca_device_api.h"
+#include "dw1000_config.h"
+
+
+int64_t uwb_twr_ds_tof_q16(uint32_t round1, uint32_t reply1, uint32_t round2, uint32_t reply2) {
+    // user manual p229, 12.3.2 using three messages
+    // tof = (round1 * round2 - reply1 * reply2) / (round1 + round2 + reply1 + reply2)
+    uint64_t sum = (uint64_t)round1 + round2 + reply1 + reply2;
+    if (sum == 0) {
+        return 0;
+    }
+
+    // both products fit in 64 bit unsigned, their difference is small so the signed result is exact
+    int64_t num = (int64_t)((uint64_t)round1 * round2 - (uint64_t)reply1 * reply2);
+    bool negative = num < 0;
+    uint64_t n = negative ? (uint64_t)(-num) : (uint64_t)num;
+
+    // integer part and rounded Q16 fraction, r < sum so r << 16 can not overflow
+    uint64_t q = n / sum;
+    uint64_t r = n % sum;
+    int64_t tof_q16 = (int64_t)((q << 16) + (((r << 16) + sum / 2) / sum));
+    return negative ? -tof_q16 : tof_q16;
+}
+
+int32_t uwb_twr_tof_q16_to_mm(int64_t tof_q16) {
+    // clamp to about 300 km, keeps the product in 64 bit
+    const int64_t limit = (int64_t)1 << 42;
+    if (tof_q16 > limit) tof_q16 = limit;
+    if (tof_q16 < -limit) tof_q16 = -limit;
+
+    // Q16 * Q24 = Q40
+    int64_t mm_q40 = tof_q16 * UWB_TWR_MM_PER_DTU_Q24;
+    const int64_t half = (int64_t)1 << 39;
+    return (int32_t)((mm_q40 >= 0) ? ((mm_q40 + half) >> 40) : -((-mm_q40 + half) >> 40));
+}
+
+int32_t uwb_twr_ds_distance_mm_int(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                                   uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts) {
+    // uint32 subtraction handles the wrap of the low 32 bit
+    uint32_t round1 = resp_rx_ts  - poll_tx_ts;
+    uint32_t round2 = final_rx_ts - resp_tx_ts;
+    uint32_t reply1 = resp_tx_ts  - poll_rx_ts;
+    uint32_t reply2 = final_tx_ts - resp_rx_ts;
+    return uwb_twr_tof_q16_to_mm(uwb_twr_ds_tof_q16(round1, reply1, round2, reply2));
+}
+
+int32_t uwb_twr_ds_distance_mm_float(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                                     uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts) {
+    float round1 = (float)( resp_rx_ts  - poll_tx_ts);
+    float round2 = (float)( final_rx_ts - resp_tx_ts);
+    float reply1 = (float)( resp_tx_ts  - poll_rx_ts);
+    float reply2 = (float)( final_tx_ts - resp_rx_ts);
+
+    float tof_dtu = (round1 * round2 - reply1 * reply2) / (round1 + round2 + reply1 + reply2);
+    float tof_s = tof_dtu * DWT_TIME_UNITS;
+    return (int32_t)lroundf(tof_s * SPEED_OF_LIGHT * 1000.0f);
+}
+
+int32_t uwb_twr_ds_distance_mm(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                               uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts) {
+#if UWB_TWR_USE_FLOAT
+    return uwb_twr_ds_distance_mm_float(poll_tx_ts, resp_rx_ts, final_tx_ts, poll_rx_ts, resp_tx_ts, final_rx_ts);
+#else
+    return uwb_twr_ds_distance_mm_int(poll_tx_ts, resp_rx_ts, final_tx_ts, poll_rx_ts, resp_tx_ts, final_rx_ts);
+#endif
+}
+
+int32_t uwb_twr_clock_offset_ppb(int32_t carrier_integrator, uint8_t chan, uint8_t data_rate) {
+    // user manual 7.2.17, carrier integrator to Hz, then Hz to ppm of the carrier frequency
+    double hz_mult = (data_rate == DWT_BR_110K) ? FREQ_OFFSET_MULTIPLIER_110KB : FREQ_OFFSET_MULTIPLIER;
+    double ppm_mult;
+    switch (chan) {
+        case 1:  ppm_mult = HERTZ_TO_PPM_MULTIPLIER_CHAN_1; break;
+        case 3:  ppm_mult = HERTZ_TO_PPM_MULTIPLIER_CHAN_3; break;
+        case 5:
+        case 7:  ppm_mult = HERTZ_TO_PPM_MULTIPLIER_CHAN_5; break;
+        default: ppm_mult = HERTZ_TO_PPM_MULTIPLIER_CHAN_2; break; // 2 and 4 share the centre frequency
+    }
+    float ppb_mult = (float)(hz_mult * ppm_mult * 1.0e3);
+    return (int32_t)lroundf((float)carrier_integrator * ppb_mult);
+}
+
+int32_t uwb_twr_ss_distance_mm(uint32_t poll_tx_ts, uint32_t resp_rx_ts,
+                               uint32_t poll_rx_ts, uint32_t resp_tx_ts, int32_t clock_offset_ppb) {
+    const int32_t limit_ppb = 100000;
+    if (clock_offset_ppb > limit_ppb) clock_offset_ppb = limit_ppb;
+    if (clock_offset_ppb < -limit_ppb) clock_offset_ppb = -limit_ppb;
+
+    uint32_t round1 = resp_rx_ts - poll_tx_ts;
+    uint32_t reply1 = resp_tx_ts - poll_rx_ts;
+
+    // reply * ppb * 2^16 / 1e9 = reply * ppb * 8192 / 125000000, at most 2^32 * 2^17 * 2^13
+    int64_t correction_q16 = (int64_t)reply1 * clock_offset_ppb * 8192 / 125000000;
+    int64_t tof_q16 = ((((int64_t)round1 - (int64_t)reply1) << 16) + correction_q16) / 2;
+    return uwb_twr_tof_q16_to_mm(tof_q16);
+}
+
+// synthetic exchange: distance, reply delays and clock drift of the responder
+static void bench_exchange(uint32_t i, uint32_t ts[6], int32_t *expect_mm) {
+    // 0.5 .. 100 m, reply 1000 .. 6000 uus, drift -20 .. +20 ppm
+    int32_t distance_mm = 500 + (int32_t)((i * 7919u) % 99500u);
+    uint64_t tof = ((uint64_t)distance_mm << 24) / UWB_TWR_MM_PER_DTU_Q24;
+    uint64_t reply_a = (1000 + (i * 104729u) % 5000u) * (uint64_t)UUS_TO_DWT_TIME;
+    uint64_t reply_b = (1000 + (i * 1299709u) % 5000u) * (uint64_t)UUS_TO_DWT_TIME;
+    int32_t drift_ppm = (int32_t)(i % 41) - 20;
+
+    // initiator clock is the reference, responder intervals scaled by its drift
+    uint64_t poll_tx = (uint64_t)i * 0x12345678ULL;                  // wraps the 32 bit timestamps
+    uint64_t poll_rx = poll_tx * 3 + 0xABCDEF;                         // unrelated responder epoch
+    uint64_t resp_tx = poll_rx + reply_b + (int64_t)reply_b * drift_ppm / 1000000;
+    uint64_t resp_rx = poll_tx + tof + reply_b + tof;
+    uint64_t final_tx = resp_rx + reply_a;
+    uint64_t final_rx = resp_tx + (uint64_t)((int64_t)(tof + reply_a + tof) * (1000000 + drift_ppm) / 1000000);
+
+    ts[0] = (uint32_t)poll_tx;  ts[1] = (uint32_t)resp_rx; ts[2] = (uint32_t)final_tx;
+    ts[3] = (uint32_t)poll_rx;  ts[4] = (uint32_t)resp_tx; ts[5] = (uint32_t)final_rx;
+    // exact distance of the quantized tof
+    *expect_mm = (int32_t)((tof * UWB_TWR_MM_PER_DTU_Q24 + (1 << 23)) >> 24);
+}
+
+void uwb_twr_benchmark(uint32_t iterations) {
+    if (iterations == 0) {
+        iterations = 1000;
+    }
+
+    uint32_t cycles_int = 0;
+    uint32_t cycles_float = 0;
+    int32_t max_err_int = 0;
+    int32_t max_err_float = 0;
+    volatile int32_t sink = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t ts[6];
+        int32_t expect_mm;
+        bench_exchange(i, ts, &expect_mm);
+
+        uint32_t t0 = ESP.getCycleCount();
+        int32_t mm_int = uwb_twr_ds_distance_mm_int(ts[0], ts[1], ts[2], ts[3], ts[4], ts[5]);
+        uint32_t t1 = ESP.getCycleCount();
+        int32_t mm_float = uwb_twr_ds_distance_mm_float(ts[0], ts[1], ts[2], ts[3], ts[4], ts[5]);
+        uint32_t t2 = ESP.getCycleCount();
+
+        cycles_int += t1 - t0;
+        cycles_float += t2 - t1;
+        sink += mm_int + mm_float;
+
+        int32_t err_int = abs(mm_int - expect_mm);
+        int32_t err_float = abs(mm_float - expect_mm);
+        if (err_int > max_err_int) max_err_int = err_int;
+        if (err_float > max_err_float) max_err_float = err_float;
+    }
+
+    Serial.printf("{\"event\":\"twr_bench\",\"kernel\":\"%s\",\"iterations\":%u,\"int_cycles\":%u,\"float_cycles\":%u,\"int_max_err_mm\":%d,\"float_max_err_mm\":%d}\n",
+        UWB_TWR_USE_FLOAT ? "float" : "int64",
+        (unsigned)iterations,
+        (unsigned)(cycles_int / iterations),
+        (unsigned)(cycles_float / iterations),
+        (int)max_err_int,
+        (int)max_err_float
+    );
+}
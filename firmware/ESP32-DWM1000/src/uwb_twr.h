@@ -0,0 +1,63 @@
+#ifndef __UWB_TWR_H__
+#define __UWB_TWR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// DS-TWR kernel used by uwb.cpp, 0: exact int64 (default), 1: old float formula
+// build_flags = -D UWB_TWR_USE_FLOAT=1
+#ifndef UWB_TWR_USE_FLOAT
+#define UWB_TWR_USE_FLOAT 0
+#endif
+
+#define UWB_TWR_TS_MASK 0xFFFFFFFFFFULL // 40 bit DW1000 timestamp
+
+// mm per dtu (SPEED_OF_LIGHT * DWT_TIME_UNITS * 1000) in Q24
+#define UWB_TWR_MM_PER_DTU_Q24 78691130LL
+
+
+// interval between two 40 bit timestamps, handles the wrap around
+static inline uint64_t uwb_twr_diff40(uint64_t later, uint64_t earlier) {
+    return (later - earlier) & UWB_TWR_TS_MASK;
+}
+
+// time of flight in dtu Q16 from the four DS-TWR intervals, exact for any 32 bit interval
+int64_t uwb_twr_ds_tof_q16(uint32_t round1, uint32_t reply1, uint32_t round2, uint32_t reply2);
+int32_t uwb_twr_tof_q16_to_mm(int64_t tof_q16);
+
+// the packets carry the low 32 bit of the 40 bit timestamps, the kernels below take the intervals
+// as uint32 differences, so every round and reply interval must be below 2^32 dtu (~67 ms),
+// a longer one wraps and gives a wrong distance without an error
+
+// distance from the low 32 bit of the six timestamps
+int32_t uwb_twr_ds_distance_mm_int(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                                   uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts);
+int32_t uwb_twr_ds_distance_mm_float(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                                     uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts);
+
+// kernel selected by UWB_TWR_USE_FLOAT
+int32_t uwb_twr_ds_distance_mm(uint32_t poll_tx_ts, uint32_t resp_rx_ts, uint32_t final_tx_ts,
+                               uint32_t poll_rx_ts, uint32_t resp_tx_ts, uint32_t final_rx_ts);
+
+// responder clock offset from dwt_readcarrierintegrator() of its reply, ppb (decawave ss_twr sign convention)
+int32_t uwb_twr_clock_offset_ppb(int32_t carrier_integrator, uint8_t chan, uint8_t data_rate);
+
+// SS-TWR, tof = (round - reply * (1 - offset)) / 2, offset limited to +-100 ppm, intervals below 2^32 dtu as above
+int32_t uwb_twr_ss_distance_mm(uint32_t poll_tx_ts, uint32_t resp_rx_ts,
+                               uint32_t poll_rx_ts, uint32_t resp_tx_ts, int32_t clock_offset_ppb);
+
+// run both kernels on synthetic exchanges, print {"event":"twr_bench",...}
+void uwb_twr_benchmark(uint32_t iterations);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UWB_TWR_H__
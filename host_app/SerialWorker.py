@@ -1,13 +1,75 @@
-import serial, threading, queue, json, time
+import serial, threading, queue, json, time, struct, binascii
+
+# binary frame: SYNC | type | len | payload[len] | crc16, same as firmware serial_report.h
+FRAME_SYNC = 0xA5
+FRAME_HEADER_LEN = 3
+FRAME_CRC_LEN = 2
+
+FRAME_TYPE_PING_RESP = 0x02
+FRAME_TYPE_RANGE_FINAL = 0x14
+FRAME_TYPE_RANGE_REPORT = 0x15
+FRAME_TYPE_LOG = 0x30
+FRAME_TYPE_TDOA = 0x33
+
+_PING_RESP = struct.Struct("<HBH")  # node_id, system_state, voltage_mv
+_RANGE = struct.Struct("<HHih")     # node_a_id, node_b_id, distance_mm, rssi_centi_dbm
+_TDOA = struct.Struct("<HHBIB")     # anchor_id, tag_id, blink_seq, ts_lo, ts_hi
+_REQ = struct.Struct("<I")          # 指令帶 request id（#<id>）時附加在 ping_resp / range payload 之後
+
+
+def frame_crc16(data: bytes) -> int:
+    # CRC-16/CCITT-FALSE
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def _split_req(payload: bytes, size: int):
+    """回傳 (payload 本體, request id)，沒有 request id 或長度不符時 req 為 None / 本體為 None"""
+    if len(payload) == size:
+        return payload, None
+    if len(payload) == size + _REQ.size:
+        return payload[:size], _REQ.unpack_from(payload, size)[0]
+    return None, None
+
+
+def decode_frame(frame_type: int, payload: bytes) -> dict | None:
+    """decode a binary frame into the same dict as the JSON event"""
+    event = None
+    req = None
+    if frame_type == FRAME_TYPE_PING_RESP:
+        body, req = _split_req(payload, _PING_RESP.size)
+        if body is not None:
+            node_id, system_state, voltage_mv = _PING_RESP.unpack(body)
+            event = {"event": "ping_resp", "node_id": node_id, "system_state": system_state, "voltage_mv": voltage_mv}
+    elif frame_type in (FRAME_TYPE_RANGE_FINAL, FRAME_TYPE_RANGE_REPORT):
+        body, req = _split_req(payload, _RANGE.size)
+        if body is not None:
+            node_a_id, node_b_id, distance_mm, rssi_centi_dbm = _RANGE.unpack(body)
+            event = {
+                "event": "range_final" if frame_type == FRAME_TYPE_RANGE_FINAL else "range_report",
+                "node_a_id": node_a_id,
+                "node_b_id": node_b_id,
+                "distance_m": distance_mm / 1000.0,
+                "rssi_dbm": rssi_centi_dbm / 100.0,
+            }
+    if event is not None:
+        if req is not None:
+            event["req"] = req
+        return event
+    if frame_type == FRAME_TYPE_TDOA and len(payload) == _TDOA.size:
+        anchor_id, tag_id, blink_seq, ts_lo, ts_hi = _TDOA.unpack(payload)
+        return {"event": "tdoa_ts", "anchor_id": anchor_id, "tag_id": tag_id, "blink_seq": blink_seq, "ts": (ts_hi << 32) | ts_lo}
+    return None
+
 
 class SerialWorker:
-    def __init__(self, port, baudrate=115200, debug_print=True):
+    def __init__(self, port, baudrate=115200, debug_print=True, log_decoder=None):
         self.ser: serial.Serial = None
         
         self.port = port
         self.baudrate = baudrate
         
         self.debug_print = debug_print
+        self.log_decoder = log_decoder  # UWBLogDecoder, for the binary log frames
         
         self.queue = queue.Queue()
         self._run = False
@@ -35,28 +97,82 @@ class SerialWorker:
             if self.debug_print:
                 print(f"[SerialWorker]: Serial port already closed or not initialized")
     
-    def _check_is_json(self, text: str) -> bool:
+    def set_baudrate(self, baudrate: int):
+        self.baudrate = baudrate
+        if self.ser and self.ser.is_open:
+            self.ser.baudrate = baudrate
+            if self.debug_print:
+                print(f"[SerialWorker]: Baudrate changed to {baudrate}")
+
+    def _parse_json(self, text: str) -> dict | None:
         if not text or text[0] not in "{[":
-            return False
+            return None
         try:
-            json.loads(text)
-            return True
+            return json.loads(text)
         except json.JSONDecodeError:
-            return False
+            return None
+
+    def _handle_line(self, raw: bytes):
+        line = raw.decode(errors="ignore").strip()
+        if not line:
+            return
+        data = self._parse_json(line)
+        if data is not None:
+            self.queue.put(data)
+        elif self.debug_print:
+            print(f"[SerialWorker] receive line: <{line}>")
+
+    def _parse_buffer(self, buffer: bytearray):
+        # binary frames and text lines are mixed in the stream, SYNC byte is never in the text
+        while buffer:
+            if buffer[0] == FRAME_SYNC:
+                if len(buffer) < FRAME_HEADER_LEN:
+                    return
+                total = FRAME_HEADER_LEN + buffer[2] + FRAME_CRC_LEN
+                if len(buffer) < total:
+                    return
+                body = bytes(buffer[1:total - FRAME_CRC_LEN])
+                crc = buffer[total - 2] | (buffer[total - 1] << 8)
+                if frame_crc16(body) != crc:
+                    # not a frame or corrupted, resync on next byte
+                    del buffer[:1]
+                    continue
+                if body[0] == FRAME_TYPE_LOG:
+                    # deferred log of the firmware, not a response
+                    if self.debug_print and self.log_decoder:
+                        record = self.log_decoder.decode(body[2:])
+                        if record:
+                            print(f"[SerialWorker] log: {self.log_decoder.format(record)}")
+                    del buffer[:total]
+                    continue
+                event = decode_frame(body[0], body[2:])
+                if event is not None:
+                    self.queue.put(event)
+                elif self.debug_print:
+                    print(f"[SerialWorker] unknown frame type: 0x{body[0]:02X}")
+                del buffer[:total]
+                continue
+
+            idx_sync = buffer.find(FRAME_SYNC)
+            idx_nl = buffer.find(b"\n")
+            if idx_sync != -1 and (idx_nl == -1 or idx_sync < idx_nl):
+                # text before the frame, flush it as a line
+                self._handle_line(bytes(buffer[:idx_sync]))
+                del buffer[:idx_sync]
+                continue
+            if idx_nl == -1:
+                return
+            self._handle_line(bytes(buffer[:idx_nl]))
+            del buffer[:idx_nl + 1]
 
     def _reader(self):
-        buffer = ""
+        buffer = bytearray()
         while self._run:
-            data = self.ser.read(self.ser.in_waiting or 1).decode(errors="ignore")
+            data = self.ser.read(self.ser.in_waiting or 1)
             if not data:
                 continue
             buffer += data
-            while "\n" in buffer:
-                line, buffer = buffer.split("\n", 1)
-                if self._check_is_json(line.strip()):
-                    self.queue.put(json.loads(line.strip()))
-                elif self.debug_print:
-                    print(f"[SerialWorker] receive line: <{line.strip()}>")
+            self._parse_buffer(buffer)
 
     def send_command(self, msg: str):
         if '\n' in msg:
@@ -0,0 +1,214 @@
+import time
+import numpy as np
+
+# 與韌體 dw1000_config.h / deca_device_api.h 相同
+SPEED_OF_LIGHT = 299702547.0
+DWT_TIME_UNITS = 1.0 / 499.2e6 / 128.0
+TS_WRAP = 1 << 40
+
+
+class TDoACollector:
+    """
+    將各 anchor 回報的 blink 時間戳（tdoa_ts 事件）依 (tag_id, blink_seq) 分組。
+
+    non-reference anchor 的時間戳在下一個 sync 之後才批次送達，
+    因此同一個 blink 的時間戳會分散在約一個 sync 週期內到達。
+    """
+
+    def __init__(self, anchor_ids, window_s=0.6, min_anchors=3):
+        self.anchor_ids = set(anchor_ids)
+        self.window_s = window_s
+        self.min_anchors = min_anchors
+        # (tag_id, blink_seq) -> (first_seen, {anchor_id: ts})
+        self._groups: dict[tuple[int, int], tuple[float, dict[int, int]]] = {}
+
+    def add(self, stamp) -> list[tuple[int, int, dict[int, int]]]:
+        """
+        加入一筆 TDoATimestamp，回傳已完成的分組 [(tag_id, blink_seq, {anchor_id: ts}), ...]
+        所有 anchor 都到齊、或超過 window_s 時完成。
+        """
+        now = time.time()
+        done = []
+        if stamp.anchor_id in self.anchor_ids:
+            key = (stamp.tag_id, stamp.blink_seq)
+            first_seen, stamps = self._groups.setdefault(key, (now, {}))
+            stamps[stamp.anchor_id] = stamp.ts
+            if self.anchor_ids.issubset(stamps):
+                del self._groups[key]
+                done.append((key[0], key[1], stamps))
+        done.extend(self._expire(now))
+        return done
+
+    def _expire(self, now):
+        done = []
+        for key, (first_seen, stamps) in list(self._groups.items()):
+            if now - first_seen < self.window_s:
+                continue
+            del self._groups[key]
+            # blink_seq 為 8 bit 會重複，過期的分組一律移除
+            if len(stamps) >= self.min_anchors:
+                done.append((key[0], key[1], stamps))
+        return done
+
+
+class TDoASolver:
+    """
+    TDoA 雙曲線定位求解器（Gauss-Newton）
+
+    時間戳皆為 reference anchor 時鐘的 40 bit DW1000 時間。其他 anchor 以 sync frame
+    對時，時間戳比實際晚了 reference → anchor 的飛行時間，求解前依 anchor 座標補回。
+
+    支援：
+      - 3D（未知 z，需要 ≥4 anchors）
+      - 已知 Z（需要 ≥3 anchors）
+    """
+
+    def __init__(self, anchors: dict, ref_id: int):
+        """
+        anchors: dict[int, tuple(float, float, float)]
+            anchor id -> 座標 (x, y, z)
+        ref_id: int
+            送出 sync 的 reference anchor id
+        """
+        self.anchors = {aid: np.array(pos, dtype=float) for aid, pos in anchors.items()}
+        if ref_id not in self.anchors:
+            raise ValueError("reference anchor 必須在 anchors 之中。")
+        self.ref_id = ref_id
+
+    # ------------------------------------------------------------
+    def range_differences(self, timestamps: dict):
+        """
+        timestamps: dict[int, int]，anchor id -> 40 bit 時間戳
+        回傳 (anchor 座標陣列, 相對第一個 anchor 的距離差 (m))，第一列為基準
+        """
+        ids = [aid for aid in sorted(timestamps) if aid in self.anchors]
+        ref_pos = self.anchors[self.ref_id]
+
+        base_ts = timestamps[ids[0]]
+        pos = []
+        t = []
+        for aid in ids:
+            # 40 bit 回繞，取與基準最近的差值
+            dt = (timestamps[aid] - base_ts + TS_WRAP // 2) % TS_WRAP - TS_WRAP // 2
+            # 補回 sync 從 reference anchor 飛到此 anchor 的時間
+            sync_tof = np.linalg.norm(self.anchors[aid] - ref_pos) / SPEED_OF_LIGHT
+            t.append(dt * DWT_TIME_UNITS + sync_tof)
+            pos.append(self.anchors[aid])
+
+        t = np.array(t)
+        return np.array(pos), (t[1:] - t[0]) * SPEED_OF_LIGHT
+
+    # ------------------------------------------------------------
+    def solve(self, timestamps: dict, known_z=None, initial=None, iterations=20):
+        """
+        計算 Tag 的座標。
+
+        參數:
+            timestamps : dict[int, int]
+                anchor id -> 同一個 blink 的時間戳
+            known_z : float | None
+                若指定已知 z，則只求 x, y
+            initial : array | None
+                初始猜測，預設為 anchors 重心
+
+        回傳:
+            np.array([x, y, z])
+        """
+        anchors, rd = self.range_differences(timestamps)
+        n = len(anchors)
+        if known_z is None and n < 4:
+            raise ValueError("3D TDoA 定位需要至少 4 個 anchors。")
+        if n < 3:
+            raise ValueError("已知 Z 的情況下需要至少 3 個 anchors。")
+
+        p = np.array(initial, dtype=float) if initial is not None else anchors.mean(axis=0)
+        if known_z is not None:
+            p[2] = known_z
+        dims = 2 if known_z is not None else 3
+
+        for _ in range(iterations):
+            diff = p - anchors
+            dist = np.maximum(np.linalg.norm(diff, axis=1), 1e-6)
+            unit = diff / dist[:, None]
+
+            # f_i = |p - a_i| - |p - a_0| - rd_i
+            f = dist[1:] - dist[0] - rd
+            J = (unit[1:] - unit[0])[:, :dims]
+
+            step = np.linalg.lstsq(J, -f, rcond=None)[0]
+            p[:dims] += step
+            if np.linalg.norm(step) < 1e-4:
+                break
+
+        return p
+
+    # ------------------------------------------------------------
+    @staticmethod
+    def test_solver():
+        """
+        測試與驗證公式正確性。
+        """
+        anchors = {
+            0xFF00: (0, 0, 2.0),
+            0xFF01: (8, 0, 2.5),
+            0xFF02: (8, 6, 2.0),
+            0xFF03: (0, 6, 2.5),
+        }
+        true_pos = np.array([3.0, 2.0, 1.2])
+        ref_id = 0xFF00
+        ref_pos = np.array(anchors[ref_id])
+
+        # 模擬：時間戳 = blink 抵達時間 - sync 飛行時間
+        t0 = 123456789
+        timestamps = {}
+        for aid, pos in anchors.items():
+            pos = np.array(pos)
+            tof = np.linalg.norm(true_pos - pos) / SPEED_OF_LIGHT
+            sync_tof = np.linalg.norm(pos - ref_pos) / SPEED_OF_LIGHT
+            timestamps[aid] = int(round(t0 + (tof - sync_tof) / DWT_TIME_UNITS)) % TS_WRAP
+
+        solver = TDoASolver(anchors, ref_id)
+        est = solver.solve(timestamps)
+        print("✅ 測試 (3D)")
+        print("真實位置:", true_pos)
+        print("估計結果:", np.round(est, 3))
+        print("誤差:", np.linalg.norm(est - true_pos))
+
+        est2 = solver.solve(timestamps, known_z=true_pos[2])
+        print("\n✅ 測試 (已知 Z)")
+        print("估計結果:", np.round(est2, 3))
+        print("誤差:", np.linalg.norm(est2 - true_pos))
+
+
+if __name__ == "__main__":
+    from SerialWorker import SerialWorker
+    from UWBController import UWBController
+
+    anchors = {
+        0xFF00: (0, 0, 1.53),
+        0xFF01: (-0.35, 1.12, 2.23),
+        0xFF02: (2.57, 1.61, 2.21),
+        0xFF03: (2.57, -0.51, 2.24),
+    }
+    ref_id = 0xFF00  # 接在序列埠上的 anchor
+
+    COM = "COM18"
+    worker = SerialWorker(port=COM, baudrate=115200, debug_print=False)
+    worker.open()
+    uwb = UWBController(serial_worker=worker, debug_print=True)
+
+    solver = TDoASolver(anchors, ref_id)
+    collector = TDoACollector(anchors.keys())
+    uwb.tdoa_start(sync_ms=200, blink_ms=200)
+
+    try:
+        while True:
+            for stamp in uwb.read_tdoa(timeout=0.05):
+                for tag_id, blink_seq, timestamps in collector.add(stamp):
+                    pos = solver.solve(timestamps, known_z=1.0)
+                    print(f"📍 Tag {tag_id} #{blink_seq}: [{pos[0]:.2f},{pos[1]:.2f},{pos[2]:.2f}] ({len(timestamps)} anchors)")
+    except KeyboardInterrupt:
+        print("Exiting...")
+
+    uwb.tdoa_stop()
+    worker.close()
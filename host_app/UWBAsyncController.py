@@ -0,0 +1,223 @@
+import itertools
+import threading
+import time
+from concurrent.futures import Future
+from dataclasses import dataclass, field
+from typing import Callable, Literal, Optional
+
+from SerialWorker import SerialWorker
+from UWBController import PingResponse, RangeResponse
+
+
+@dataclass
+class _Request:
+    req_id: int
+    cmd: str
+    timeout: float   # radio time of this command alone
+    deadline: float
+    # (event kind, node_a_id, node_b_id) -> future, ping uses ("ping", node_id, 0) like the firmware,
+    # the kind keeps a range result of (node_id, 0) away from a ping of node_id
+    futures: dict[tuple[str, int, int], Future] = field(default_factory=dict)
+    acked: bool = False
+
+
+class UWBAsyncController:
+    """
+    pipelined controller, keeps up to max_in_flight commands on the serial line
+
+    every command is sent as "#<req_id> <cmd>", the firmware echoes the id in the ack and in
+    the result (serial_cmd.h). results without id (old firmware, or the second result of the
+    same pair) are matched by the event kind and (node_a_id, node_b_id), oldest request first.
+    futures resolve to RangeResponse / PingResponse, or None on timeout / rejected command.
+    the firmware runs the commands one after the other, so a timeout counts from the ack and is
+    scaled by the commands still ahead of it in the firmware queue.
+    """
+
+    MAX_MULTI_TARGETS = 8  # same as UWB_RANGE_MULTI_MAX_TARGETS in firmware
+
+    def __init__(self, serial_worker: SerialWorker, max_in_flight=8, debug_print=True,
+                 event_callback: Optional[Callable[[dict], None]] = None):
+        """
+        max_in_flight: commands waiting for their result, keep <= UWB_CMD_QUEUE_LEN (8) of the
+                       firmware or commands get rejected when the radio is slower than the host
+        event_callback: called on the dispatcher thread with events that answer no request
+        """
+        self.serial_worker = serial_worker
+        self.debug_print = debug_print
+        self.event_callback = event_callback
+
+        self._slots = threading.BoundedSemaphore(max_in_flight)
+        self._lock = threading.Lock()
+        self._requests: dict[int, _Request] = {}
+        self._req_ids = itertools.count(1)
+
+        self._run = True
+        self._thread = threading.Thread(target=self._dispatch, daemon=True)
+        self._thread.start()
+
+    def _debug(self, msg: str):
+        if self.debug_print:
+            print(f"[UWBAsyncController] {msg}")
+
+    def close(self):
+        """stop the dispatcher, pending futures resolve to None"""
+        self._run = False
+        self._thread.join(timeout=1.0)
+        with self._lock:
+            requests = list(self._requests.values())
+            self._requests.clear()
+        for req in requests:
+            self._finish(req)
+
+    # ------------------------------------------------------------
+    def _submit(self, cmd: str, keys: list[tuple[str, int, int]], timeout: float, block: bool) -> list[Future]:
+        if not self._slots.acquire(blocking=block):
+            futures = [Future() for _ in keys]
+            for fut in futures:
+                fut.set_result(None)
+            return futures
+
+        req = _Request(req_id=next(self._req_ids), cmd=cmd, timeout=timeout, deadline=0.0)
+        req.futures = {key: Future() for key in keys}
+        with self._lock:
+            # until the ack, the commands already in flight run first
+            req.deadline = time.time() + timeout * (len(self._requests) + 1)
+            self._requests[req.req_id] = req
+        self.serial_worker.send_command(f"#{req.req_id} {cmd}")
+        self._debug(f"Sent command #{req.req_id}: {cmd}")
+        return list(req.futures.values())
+
+    def ping(self, node_id: int, timeout=0.2, block=True) -> Future:
+        return self._submit(f"ping {node_id}", [("ping", node_id, 0)], timeout, block)[0]
+
+    def trigger(self, initiator_id: int, responder_id: int, timeout=0.2,
+                mode: Literal["ds", "ss"] = "ds", block=True) -> Future:
+        command = "trigger_ss" if mode == "ss" else "trigger"
+        return self._submit(f"{command} {initiator_id} {responder_id}", [("range", initiator_id, responder_id)], timeout, block)[0]
+
+    def trigger_multiple(self, initiator_id: int, responder_ids: list[int], timeout=0.1,
+                         command: Literal["trigger_multi", "trigger_bcast"] = "trigger_multi", block=True) -> list[Future]:
+        """one future per responder, timeout is per responder like UWBController.trigger_multiple"""
+        futures = []
+        for i in range(0, len(responder_ids), self.MAX_MULTI_TARGETS):
+            chunk = responder_ids[i:i + self.MAX_MULTI_TARGETS]
+            cmd = f"{command} {initiator_id} " + " ".join(str(rid) for rid in chunk)
+            futures.extend(self._submit(cmd, [("range", initiator_id, rid) for rid in chunk], timeout * len(chunk), block))
+        return futures
+
+    def range_all(self, pairs: list[tuple[int, int]], timeout=0.2,
+                  mode: Literal["ds", "ss"] = "ds") -> list[Optional[RangeResponse]]:
+        """range all (initiator, responder) pairs with up to max_in_flight outstanding, in pair order"""
+        futures = [self.trigger(a, b, timeout=timeout, mode=mode) for a, b in pairs]
+        return [fut.result() for fut in futures]
+
+    # ------------------------------------------------------------
+    def _finish(self, req: _Request):
+        # not holding self._lock, future callbacks may submit again
+        for fut in req.futures.values():
+            if not fut.done():
+                fut.set_result(None)
+        self._slots.release()
+
+    def _take_result(self, data: dict) -> bool:
+        """resolve the future the event answers, False if it answers no request"""
+        event = data.get("event")
+        if event == "ping_resp":
+            key = ("ping", data.get("node_id"), 0)
+            result = PingResponse.from_json(data)
+        elif event in ("range_report", "range_final"):
+            key = ("range", data.get("node_a_id"), data.get("node_b_id"))
+            result = RangeResponse.from_json(data)
+        else:
+            return False
+        if result is None:
+            return False
+
+        done = None
+        with self._lock:
+            req = self._requests.get(data.get("req"))
+            if req is None or key not in req.futures or req.futures[key].done():
+                # no id, match the oldest request still waiting for this kind and pair
+                req = next((r for r in self._requests.values()
+                            if key in r.futures and not r.futures[key].done()), None)
+            if req is None:
+                return False
+            fut = req.futures[key]
+            if all(f.done() for k, f in req.futures.items() if k != key):
+                done = self._requests.pop(req.req_id)
+        fut.set_result(result)
+        if done:
+            self._finish(done)
+        return True
+
+    def _take_ack(self, data: dict) -> bool:
+        with self._lock:
+            req = self._requests.get(data.get("req"))
+            if req is None:
+                return False
+            req.acked = True
+            if data.get("ok"):
+                # queued in the firmware behind the acked commands still waiting for their result
+                ahead = sum(1 for r in self._requests.values() if r.acked and r.req_id < req.req_id)
+                req.deadline = time.time() + req.timeout * (ahead + 1)
+                return True
+            self._requests.pop(req.req_id)
+        # rejected, e.g. radio command queue of the firmware full
+        self._debug(f"⚠️ command #{req.req_id} rejected: {req.cmd}")
+        self._finish(req)
+        return True
+
+    def _expire(self):
+        now = time.time()
+        with self._lock:
+            expired = [r for r in self._requests.values() if now > r.deadline]
+            for req in expired:
+                self._requests.pop(req.req_id)
+        for req in expired:
+            self._debug(f"⚠️ command #{req.req_id} timeout: {req.cmd}")
+            self._finish(req)
+
+    def _dispatch(self):
+        while self._run:
+            data = self.serial_worker.read_response(timeout=0.01)
+            if data:
+                handled = self._take_ack(data) if data.get("event") == "ack" else self._take_result(data)
+                if not handled and self.event_callback:
+                    self.event_callback(data)
+            self._expire()
+
+
+# === Example main ===
+if __name__ == "__main__":
+    COM = "COM18"
+    worker = SerialWorker(port=COM, baudrate=115200, debug_print=False)
+    worker.open()
+
+    controller = UWBAsyncController(serial_worker=worker, max_in_flight=8, debug_print=False)
+
+    anchor_ids = [0xFF00, 0xFF01, 0xFF02]
+    tag_ids = [0x0000]
+    pairs = [(tag_id, anchor_id) for tag_id in tag_ids for anchor_id in anchor_ids]
+
+    last_fps_time = time.time()
+    frame_count = 0
+
+    try:
+        while True:
+            reports = controller.range_all(pairs)
+            for (tag_id, anchor_id), report in zip(pairs, reports):
+                if report is None:
+                    print(f"❌ {tag_id:#06x}↔{anchor_id:#06x} timeout")
+
+            frame_count += 1
+            if time.time() - last_fps_time >= 1.0:
+                fps = frame_count / (time.time() - last_fps_time)
+                print(f"🔄 FPS: {fps:.2f} ({fps * len(pairs):.1f} ranges/s)")
+                frame_count = 0
+                last_fps_time = time.time()
+
+    except KeyboardInterrupt:
+        print("Exiting...")
+
+    controller.close()
+    worker.close()
@@ -49,8 +49,32 @@ class PingResponse:
             return None
 
 
+@dataclass
+class TDoATimestamp:
+    anchor_id: int
+    tag_id: int
+    blink_seq: int
+    ts: int  # 40 bit DW1000 time in the reference anchor clock
+
+    @classmethod
+    def from_json(cls, data: dict) -> Optional["TDoATimestamp"]:
+        if data.get("event") != "tdoa_ts":
+            return None
+        try:
+            return cls(
+                anchor_id=data["anchor_id"],
+                tag_id=data["tag_id"],
+                blink_seq=data["blink_seq"],
+                ts=data["ts"],
+            )
+        except KeyError:
+            return None
+
+
 # === Controller ===
 class UWBController:
+    MAX_MULTI_TARGETS = 8  # same as UWB_RANGE_MULTI_MAX_TARGETS in firmware
+
     def __init__(self, serial_worker: SerialWorker, debug_print=True):
         self.serial_worker = serial_worker
         self.debug_print = debug_print
@@ -59,6 +83,34 @@ class UWBController:
         if self.debug_print:
             print(f"[UWBController] {msg}")
 
+    def _wait_event(self, event: str, timeout: float) -> Optional[dict]:
+        deadline = time.time() + timeout
+        while (remaining := deadline - time.time()) > 0:
+            data = self.serial_worker.read_response(timeout=remaining)
+            if data and data.get("event") == event:
+                return data
+        return None
+
+    def set_binary_mode(self, enable: bool, timeout=0.5) -> bool:
+        """switch the firmware result output between binary frames and JSON lines"""
+        mode = "bin" if enable else "json"
+        self.serial_worker.send_command(f"mode {mode}")
+        ack = self._wait_event("mode", timeout)
+        ok = ack is not None and ack.get("mode") == mode
+        self._debug(f"{'✅' if ok else '⚠️'} mode {mode}")
+        return ok
+
+    def set_baudrate(self, baudrate: int, timeout=0.5) -> bool:
+        """ask firmware to change baudrate (max 2 Mbaud), then follow on the host side"""
+        self.serial_worker.send_command(f"baud {baudrate}")
+        ack = self._wait_event("baud", timeout)
+        if ack is None or ack.get("baud") != baudrate:
+            self._debug(f"⚠️ baudrate {baudrate} rejected")
+            return False
+        self.serial_worker.set_baudrate(baudrate)
+        self._debug(f"✅ baudrate {baudrate}")
+        return True
+
     def calc_node_id(self, role: Literal["anchor", "tag"], node_id: int) -> int:
         base = 0xFF00 if role == "anchor" else 0x0000
         return base + node_id
@@ -85,8 +137,10 @@ class UWBController:
             responses.append(response)
         return responses
 
-    def trigger(self, initiator_id: int, responder_id: int, timeout=0.1) -> Optional[RangeResponse]:
-        cmd = f"trigger {initiator_id} {responder_id}"
+    def trigger(self, initiator_id: int, responder_id: int, timeout=0.1, mode: Literal["ds", "ss"] = "ds") -> Optional[RangeResponse]:
+        # ds: poll/resp/final, ss: poll/resp only with clock offset correction on the initiator
+        command = "trigger_ss" if mode == "ss" else "trigger"
+        cmd = f"{command} {initiator_id} {responder_id}"
         self.serial_worker.send_command(cmd)
         self._debug(f"Sent command: {cmd}")
 
@@ -104,11 +158,76 @@ class UWBController:
         return report
     
     def trigger_multiple(self, initiator_id: int, responder_ids: list[int], timeout=0.1) -> list[Optional[RangeResponse]]:
+        # firmware ranges with all responders back-to-back, max MAX_MULTI_TARGETS per command
         reports = []
-        for responder_id in responder_ids:
-            report = self.trigger(initiator_id, responder_id, timeout=timeout)
-            reports.append(report)
+        for i in range(0, len(responder_ids), self.MAX_MULTI_TARGETS):
+            chunk = responder_ids[i:i + self.MAX_MULTI_TARGETS]
+            reports.extend(self._trigger_multi(initiator_id, chunk, timeout=timeout))
         return reports
+
+    def trigger_broadcast(self, initiator_id: int, responder_ids: list[int], timeout=0.1) -> list[Optional[RangeResponse]]:
+        # one broadcast poll, all responders reply in staggered slots and share one final
+        reports = []
+        for i in range(0, len(responder_ids), self.MAX_MULTI_TARGETS):
+            chunk = responder_ids[i:i + self.MAX_MULTI_TARGETS]
+            reports.extend(self._trigger_multi(initiator_id, chunk, timeout=timeout, command="trigger_bcast"))
+        return reports
+
+    def tdoa_start(self, sync_ms=200, blink_ms=200, timeout=0.5) -> bool:
+        """the anchor on the serial port becomes the TDoA reference, tags hearing its sync start to blink"""
+        self.serial_worker.send_command(f"tdoa {sync_ms} {blink_ms}")
+        ack = self._wait_event("tdoa", timeout)
+        ok = ack is not None and ack.get("running", False)
+        self._debug(f"{'✅' if ok else '⚠️'} tdoa sync={sync_ms}ms blink={blink_ms}ms")
+        return ok
+
+    def tdoa_stop(self, timeout=0.5) -> bool:
+        self.serial_worker.send_command("tdoa off")
+        return self._wait_event("tdoa", timeout) is not None
+
+    def read_tdoa(self, timeout=0.1) -> list[TDoATimestamp]:
+        """all blink timestamps received within timeout, other events are dropped"""
+        stamps = []
+        deadline = time.time() + timeout
+        while (remaining := deadline - time.time()) > 0:
+            data = self.serial_worker.read_response(timeout=remaining)
+            if not data:
+                break
+            stamp = TDoATimestamp.from_json(data)
+            if stamp:
+                stamps.append(stamp)
+        return stamps
+
+    def _trigger_multi(self, initiator_id: int, responder_ids: list[int], timeout=0.1, command="trigger_multi") -> list[Optional[RangeResponse]]:
+        cmd = f"{command} {initiator_id} " + " ".join(str(rid) for rid in responder_ids)
+        self.serial_worker.send_command(cmd)
+        self._debug(f"Sent command: {cmd}")
+
+        # each responder has its own timeout budget, reports stream back one by one
+        results: dict[int, Optional[RangeResponse]] = {rid: None for rid in responder_ids}
+        deadline = time.time() + timeout * len(responder_ids)
+        while any(r is None for r in results.values()):
+            remaining = deadline - time.time()
+            if remaining <= 0:
+                break
+            data = self.serial_worker.read_response(timeout=remaining)
+            if not data:
+                break
+            report = RangeResponse.from_json(data)
+            if not report or report.node_a_id != initiator_id:
+                continue
+            if report.node_b_id not in results or results[report.node_b_id] is not None:
+                continue
+            results[report.node_b_id] = report
+            self._debug(
+                f"📡 range: {report.node_a_id}↔{report.node_b_id} "
+                f"{report.distance_m:.2f}m RSSI={report.rssi_dbm:.1f}dBm"
+            )
+
+        missing = [rid for rid, r in results.items() if r is None]
+        if missing:
+            self._debug(f"⚠️ range timeout: {missing}")
+        return [results[rid] for rid in responder_ids]
         
     
     
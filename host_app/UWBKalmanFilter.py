@@ -15,8 +15,7 @@ class UWBKalmanFilter:
 
         # 狀態轉移矩陣 F
         self.F = np.eye(6)
-        for i in range(3):
-            self.F[i, i + 3] = dt
+        self.set_dt(dt)
 
         # 觀測矩陣 H
         self.H = np.zeros((3, 6))
@@ -32,8 +31,17 @@ class UWBKalmanFilter:
         self.R = np.eye(3) * measurement_var
 
     # ------------------------------------------------------------
-    def predict(self):
-        """預測下一時刻狀態"""
+    def set_dt(self, dt):
+        """更新兩次觀測之間的時間間隔（秒）"""
+        self.dt = dt
+        for i in range(3):
+            self.F[i, i + 3] = dt
+
+    # ------------------------------------------------------------
+    def predict(self, dt=None):
+        """預測下一時刻狀態，dt 為 None 時沿用上次的間隔"""
+        if dt is not None:
+            self.set_dt(dt)
         self.x = self.F @ self.x
         self.P = self.F @ self.P @ self.F.T + self.Q
         return self.x[:3].flatten()
@@ -51,7 +59,7 @@ class UWBKalmanFilter:
         return self.x[:3].flatten()
 
     # ------------------------------------------------------------
-    def filter(self, z_measured):
+    def filter(self, z_measured, dt=None):
         """預測 + 更新"""
-        self.predict()
+        self.predict(dt)
         return self.update(z_measured)
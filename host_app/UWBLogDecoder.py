@@ -0,0 +1,65 @@
+import os, re, struct
+
+# same layout as uwb_log_record_t in firmware src/uwb_log.h
+_RECORD = struct.Struct("<IHBB3I")  # ts_us, id, num_args, reserved, args[3]
+
+_DEFAULT_IDS_FILE = os.path.join(os.path.dirname(__file__), "..", "firmware", "ESP32-DWM1000", "src", "uwb_log_ids.h")
+_DEF_PATTERN = re.compile(r'^\s*UWB_LOG_DEF\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+_CONV_PATTERN = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[diuxXoc]")
+
+# SYS_STATUS rx error bits, print_rx_err_flags only logs the raw register
+_RX_ERR_FLAGS = [
+    (0x00020000, "RXRFTO"),
+    (0x00200000, "RXPTO"),
+    (0x00001000, "RXPHE"),
+    (0x00008000, "RXFCE"),
+    (0x00010000, "RXRFSL"),
+    (0x04000000, "RXSFDTO"),
+    (0x00040000, "LDEERR"),
+    (0x20000000, "AFFREJ"),
+]
+
+
+class UWBLogDecoder:
+    """format the binary log records of the firmware with the table in uwb_log_ids.h"""
+
+    def __init__(self, ids_file: str = _DEFAULT_IDS_FILE):
+        self.names: list[str] = []
+        self.formats: list[str] = []
+        with open(ids_file, encoding="utf-8") as f:
+            for line in f:
+                m = _DEF_PATTERN.match(line)
+                if m:
+                    self.names.append(m.group(1))
+                    self.formats.append(m.group(2).encode().decode("unicode_escape"))
+
+    def decode(self, payload: bytes) -> dict | None:
+        if len(payload) != _RECORD.size:
+            return None
+        ts_us, log_id, num_args, _, a0, a1, a2 = _RECORD.unpack(payload)
+        return {"event": "log", "ts_us": ts_us, "id": log_id, "args": [a0, a1, a2][:num_args]}
+
+    def format(self, record: dict) -> str:
+        log_id = record["id"]
+        if log_id >= len(self.formats):
+            return f"[{record['ts_us']}] unknown log id {log_id} args={record['args']}"
+
+        fmt = self.formats[log_id]
+        convs = _CONV_PATTERN.findall(fmt)
+        args = []
+        for conv, value in zip(convs, record["args"]):
+            # args are raw uint32, %d / %i are signed in C
+            if conv[-1] in "di" and value & 0x80000000:
+                value -= 1 << 32
+            args.append(value)
+        text = fmt % tuple(args) if len(args) == len(convs) else fmt
+        if self.names[log_id] == "UWB_LOG_RX_ERR_FLAGS" and record["args"]:
+            flags = [name for bit, name in _RX_ERR_FLAGS if record["args"][0] & bit]
+            text = text.rstrip("\n") + " " + " ".join(flags) + "\n"
+        return f"[{record['ts_us']}] {text}".rstrip("\n")
+
+
+if __name__ == "__main__":
+    decoder = UWBLogDecoder()
+    for i, (name, fmt) in enumerate(zip(decoder.names, decoder.formats)):
+        print(f"{i:3d} {name:28s} {fmt!r}")
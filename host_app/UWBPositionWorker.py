@@ -0,0 +1,168 @@
+import queue
+import threading
+import time
+from dataclasses import dataclass, field
+from typing import Optional
+
+from UWBController import RangeResponse, UWBController
+from TrilaterationSolver3D import TrilaterationSolver3D
+from UWBKalmanFilter import UWBKalmanFilter
+
+
+@dataclass
+class TagFix:
+    tag_id: int
+    # (anchor_id, report or None on timeout), in anchor order
+    reports: list[tuple[int, Optional[RangeResponse]]] = field(default_factory=list)
+    # filtered [x, y, z], None if less than 3 anchors answered
+    pos: Optional[tuple[float, float, float]] = None
+
+
+@dataclass
+class PositionFrame:
+    seq: int
+    timestamp: float
+    fixes: list[TagFix] = field(default_factory=list)
+    error: Optional[str] = None
+
+
+class UWBPositionWorker:
+    """
+    ranging + solving thread, the GUI only picks up finished frames
+
+    every cycle ranges all enabled tags against all enabled anchors, solves and filters the
+    positions and puts one PositionFrame into a bounded queue. when the GUI falls behind the
+    oldest frame is dropped, latest() returns only the newest frame so stale positions are
+    never drawn. the controller is shared with the GUI (ping / calibration), both sides hold
+    controller_lock around a command.
+    """
+
+    def __init__(self, controller: UWBController, controller_lock: threading.Lock,
+                 queue_size=4, min_period=0.0, debug_print=False):
+        """
+        queue_size: frames kept for the GUI, older ones are dropped
+        min_period: minimum seconds between cycles, 0 = range as fast as the radio allows
+        """
+        self.controller = controller
+        self.controller_lock = controller_lock
+        self.min_period = min_period
+        self.debug_print = debug_print
+
+        self._frames: queue.Queue[PositionFrame] = queue.Queue(maxsize=queue_size)
+        self._layout_lock = threading.Lock()
+        self._anchors: list[tuple[int, list[float]]] = []
+        self._tags: list[tuple[int, float]] = []
+        self._filters: dict[int, UWBKalmanFilter] = {}
+        # time of the last filtered fix per tag, the filter steps by the measured interval
+        self._fix_time: dict[int, float] = {}
+
+        self.frame_count = 0
+        self.dropped_count = 0
+
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+    def _debug(self, msg: str):
+        if self.debug_print:
+            print(f"[UWBPositionWorker] {msg}")
+
+    def set_layout(self, anchors: list[tuple[int, list[float]]], tags: list[tuple[int, float]]):
+        """enabled anchors as (id, [x, y, z]) and tags as (id, z), used from the next cycle on"""
+        with self._layout_lock:
+            self._anchors = [(aid, list(pos)) for aid, pos in anchors]
+            self._tags = list(tags)
+
+    def start(self):
+        if self._thread and self._thread.is_alive():
+            return
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self, timeout=2.0):
+        """wait for the running cycle to finish, queued frames are discarded"""
+        self._stop.set()
+        if self._thread:
+            self._thread.join(timeout=timeout)
+            self._thread = None
+        self.latest()
+
+    def latest(self) -> Optional[PositionFrame]:
+        """newest frame since the last call, None if there is none, older frames are skipped"""
+        frame = None
+        while True:
+            try:
+                newer = self._frames.get_nowait()
+            except queue.Empty:
+                return frame
+            if frame is not None:
+                self.dropped_count += 1
+            frame = newer
+
+    # ------------------------------------------------------------
+    def _publish(self, frame: PositionFrame):
+        while True:
+            try:
+                self._frames.put_nowait(frame)
+                return
+            except queue.Full:
+                pass
+            try:
+                self._frames.get_nowait()
+                self.dropped_count += 1
+            except queue.Empty:
+                pass
+
+    def _solve_tag(self, tag_id: int, tag_z: float, anchors: list[tuple[int, list[float]]]) -> TagFix:
+        with self.controller_lock:
+            reports = self.controller.trigger_multiple(tag_id, [aid for aid, _ in anchors])
+        fix = TagFix(tag_id=tag_id, reports=[(aid, r) for (aid, _), r in zip(anchors, reports)])
+
+        # [([x, y, z], distance), ...]
+        valid_pairs = [(pos, r.distance_m) for (_, pos), r in zip(anchors, reports) if r and r.distance_m > 0]
+        if len(valid_pairs) < 3:
+            return fix
+
+        anchor_pos, dist = zip(*valid_pairs)
+        tag_pos = TrilaterationSolver3D(list(anchor_pos)).solve(list(dist), known_z=tag_z)
+        now = time.time()
+        last = self._fix_time.get(tag_id)
+        self._fix_time[tag_id] = now
+        kf = self._filters.get(tag_id)
+        if kf is None:
+            kf = self._filters[tag_id] = UWBKalmanFilter(dt=0.2, process_var=1e-3, measurement_var=1e-1)
+        x, y, z = kf.filter(tag_pos, dt=(now - last) if last is not None else None)
+        fix.pos = (float(x), float(y), float(z))
+        return fix
+
+    def _run(self):
+        seq = 0
+        while not self._stop.is_set():
+            start = time.time()
+            with self._layout_lock:
+                anchors, tags = list(self._anchors), list(self._tags)
+
+            frame = PositionFrame(seq=seq, timestamp=start)
+            if len(anchors) < 3:
+                frame.error = "⚠️ 啟用中的 Anchor 少於 3 個，無法定位 Tag。"
+            else:
+                try:
+                    for tag_id, tag_z in tags:
+                        if self._stop.is_set():
+                            break
+                        frame.fixes.append(self._solve_tag(tag_id, tag_z, anchors))
+                except Exception as e:
+                    # serial closed or solver failure, keep the fixes of this cycle
+                    frame.error = f"⚠️ {e}"
+                    self._debug(frame.error)
+
+            frame.timestamp = time.time()
+            self._publish(frame)
+            self.frame_count += 1
+            seq += 1
+
+            # nothing to range, do not spin on the lock
+            idle = frame.error is not None or not tags
+            wait = max(self.min_period - (time.time() - start), 0.2 if idle else 0.0)
+            if wait > 0:
+                self._stop.wait(wait)
@@ -1,7 +1,9 @@
 import sys
 import json
 import time
+import threading
 import numpy as np
+from concurrent.futures import Future, ThreadPoolExecutor
 from dataclasses import dataclass, field
 from PyQt6 import QtWidgets, QtCore, QtGui
 import pyqtgraph as pg
@@ -9,11 +11,11 @@ from pyqtgraph.GraphicsScene.mouseEvents import MouseDragEvent
 
 from SerialWorker import SerialWorker
 from UWBController import UWBController
-from TrilaterationSolver3D import TrilaterationSolver3D
-from UWBKalmanFilter import UWBKalmanFilter
+from UWBPositionWorker import PositionFrame, UWBPositionWorker
 
 CONFIG_FILE = "config.json"
 PATH_HISTORY_LIMIT = 100
+RENDER_INTERVAL_MS = 33  # plot refresh rate, independent of the ranging rate
 
 
 class DraggableScatterPlotItem(pg.ScatterPlotItem):
@@ -141,7 +143,6 @@ class Tag:
     id: int
     z: float = 1.0
     enable: bool = True
-    filter: UWBKalmanFilter = field(default_factory=lambda: UWBKalmanFilter(dt=0.2, process_var=1e-3, measurement_var=1e-1))
     last_seen: float = 0.0
     plot_item: pg.ScatterPlotItem | None = None
     path: list[tuple[float, float]] = field(default_factory=list)
@@ -205,6 +206,10 @@ class TagManager:
 
 
 class UWBMainWindow(QtWidgets.QMainWindow):
+    # emitted from the command thread, delivered on the GUI thread
+    commandFinished = QtCore.pyqtSignal(object, object)  # callback, Future
+    commandProgress = QtCore.pyqtSignal(str)
+
     def __init__(self):
         super().__init__()
         self.setWindowTitle("UWB 定位系統 (PyQt6)")
@@ -221,10 +226,17 @@ class UWBMainWindow(QtWidgets.QMainWindow):
         # 模組
         self.worker = None
         self.controller = None
-
-        # 更新計時器
+        # 量測在背景執行緒，ping / 校正與它共用 controller
+        self.controller_lock = threading.Lock()
+        self.position_worker = None
+        # ping / 校正在這個執行緒等 controller_lock 與回覆，不卡住 GUI
+        self.command_executor = ThreadPoolExecutor(max_workers=1, thread_name_prefix="uwb_cmd")
+        self.commandFinished.connect(lambda callback, future: callback(future))
+        self.commandProgress.connect(self.statusBar().showMessage)
+
+        # 畫面更新計時器，固定頻率取最新一筆定位結果
         self.timer = QtCore.QTimer()
-        self.timer.timeout.connect(self.update_position)
+        self.timer.timeout.connect(self.render_positions)
 
         # UI 初始化
         self._init_ui()
@@ -384,6 +396,11 @@ class UWBMainWindow(QtWidgets.QMainWindow):
         if hasattr(self, "btn_calibrate"):
             self.btn_calibrate.setEnabled(connected and not self._calibrating)
 
+    def _run_command(self, fn, callback):
+        """run fn on the command thread, callback(future) is called on the GUI thread"""
+        future = self.command_executor.submit(fn)
+        future.add_done_callback(lambda f: self.commandFinished.emit(callback, f))
+
     def _color_for_tag(self, tag_id):
         tag_ids = [tag.id for tag in self.tag_manager]
         idx = tag_ids.index(tag_id) if tag_id in tag_ids else len(tag_ids)
@@ -439,19 +456,24 @@ class UWBMainWindow(QtWidgets.QMainWindow):
             self.worker = SerialWorker(port=port, baudrate=baud, debug_print=False)
             self.worker.open()
             self.controller = UWBController(serial_worker=self.worker, debug_print=False)
+            self.position_worker = UWBPositionWorker(self.controller, self.controller_lock)
             self.statusBar().showMessage(f"✅ Connected to {port} @ {baud}")
             self._update_connection_buttons()
         except Exception as e:
             self.worker = None
             self.controller = None
+            self.position_worker = None
             self._update_connection_buttons()
             QtWidgets.QMessageBox.critical(self, "Error", f"Failed to open port: {e}")
 
     def disconnect_serial(self):
         if self.worker:
+            if self.is_running:
+                self.toggle_start()
             self.worker.close()
             self.worker = None
             self.controller = None
+            self.position_worker = None
             self.statusBar().showMessage("❌ Disconnected")
         else:
             self.statusBar().showMessage("⚠️ 尚未連線")
@@ -480,8 +502,20 @@ class UWBMainWindow(QtWidgets.QMainWindow):
             QtWidgets.QMessageBox.warning(self, "格式錯誤", "Node ID 請輸入 16 進位 (0xFFFF) 或 10 進位數字。")
             return
 
+        controller = self.controller
+
+        def ping():
+            with self.controller_lock:
+                return controller.ping(node_id, timeout=0.2)
+
+        self.btn_ping.setEnabled(False)
+        self.ping_result_label.setText("⏳ 等待回應…")
+        self._run_command(ping, self._on_ping_done)
+
+    def _on_ping_done(self, future: Future):
+        self.btn_ping.setEnabled(True)
         try:
-            resp = self.controller.ping(node_id, timeout=0.2)
+            resp = future.result()
         except Exception as exc:
             self.ping_result_label.setText("⚠️ 讀取失敗")
             self.statusBar().showMessage(f"⚠️ ping 失敗: {exc}")
@@ -504,9 +538,12 @@ class UWBMainWindow(QtWidgets.QMainWindow):
         self.btn_start.setText("⏸️ Stop" if self.is_running else "▶️ Start")
         if self.is_running:
             # self._reset_tag_markers()
-            self.timer.start(200)
+            self._push_layout()
+            self.position_worker.start()
+            self.timer.start(RENDER_INTERVAL_MS)
         else:
             self.timer.stop()
+            self.position_worker.stop()
 
     # ----------------------------------------------------------------------
     def add_anchor(self):
@@ -708,13 +745,21 @@ class UWBMainWindow(QtWidgets.QMainWindow):
 
         self._calibrating = True
         self._update_connection_buttons()
-        QtWidgets.QApplication.setOverrideCursor(QtCore.Qt.CursorShape.WaitCursor)
-        try:
-            dist_matrix = self._measure_anchor_distances(active_indices)
+        controller = self.controller
+        anchor_ids = self.anchor_manager.ids_for_indices(active_indices)
+
+        def calibrate():
+            dist_matrix = self._measure_anchor_distances(controller, anchor_ids)
             coords = self._compute_anchor_layout(dist_matrix)
             if not coords or len(coords) != len(active_indices):
                 raise RuntimeError("無法推算座標，請確認量測結果。")
+            return coords
+
+        self._run_command(calibrate, lambda future: self._on_calibration_done(future, active_indices))
 
+    def _on_calibration_done(self, future: Future, active_indices):
+        try:
+            coords = future.result()
             for idx, (x, y) in zip(active_indices, coords):
                 anchor = self.anchor_manager[idx]
                 anchor.pos[0] = float(x)
@@ -727,34 +772,30 @@ class UWBMainWindow(QtWidgets.QMainWindow):
         finally:
             self._calibrating = False
             self._update_connection_buttons()
-            QtWidgets.QApplication.restoreOverrideCursor()
 
-    def _measure_anchor_distances(self, anchor_indices):
-        anchor_ids = self.anchor_manager.ids_for_indices(anchor_indices)
+    # runs on the command thread, progress goes to the status bar through commandProgress
+    def _measure_anchor_distances(self, controller: UWBController, anchor_ids):
         n = len(anchor_ids)
         matrix = np.zeros((n, n), dtype=float)
         for i in range(n):
             matrix[i, i] = 0.0
             for j in range(i + 1, n):
-                QtWidgets.QApplication.processEvents()
-                self.statusBar().showMessage(f"🔧 測距 Anchor {anchor_ids[i]:04X} ↔ {anchor_ids[j]:04X}")
-                dist = self._range_between(anchor_ids[i], anchor_ids[j])
+                self.commandProgress.emit(f"🔧 測距 Anchor {anchor_ids[i]:04X} ↔ {anchor_ids[j]:04X}")
+                dist = self._range_between(controller, anchor_ids[i], anchor_ids[j])
                 if dist is None:
                     raise RuntimeError(f"Anchor {anchor_ids[i]:04X} ↔ {anchor_ids[j]:04X} 測距失敗")
                 matrix[i, j] = matrix[j, i] = dist
         return matrix
 
-    def _range_between(self, aid_a, aid_b, attempts=10):
-        if not self.controller:
-            return None
+    def _range_between(self, controller: UWBController, aid_a, aid_b, attempts=10):
         samples = []
         for _ in range(attempts):
             for initiator, responder in ((aid_a, aid_b), (aid_b, aid_a)):
-                report = self.controller.trigger(initiator, responder)
+                with self.controller_lock:
+                    report = controller.trigger(initiator, responder)
                 if report and report.distance_m > 0:
                     samples.append(report.distance_m)
                     break
-            QtWidgets.QApplication.processEvents()
         if samples:
             return float(np.mean(samples))
         return None
@@ -851,58 +892,64 @@ class UWBMainWindow(QtWidgets.QMainWindow):
         self.update_tables()
 
     # --------------------- 定期更新 Tag 位置 --------------
-    def update_position(self):
-        """定期更新 Tag 位置"""
-        
-        try:
-            act_anchors: list[Anchor] = [anchor for anchor in self.anchor_manager if anchor.enable]
-            act_tags: list[Tag] = [tag for tag in self.tag_manager if tag.enable]
-
-            if len(act_anchors) < 3:
-                self.statusBar().showMessage("⚠️ 啟用中的 Anchor 少於 3 個，無法定位 Tag。")
-                return
+    def _push_layout(self):
+        """把目前啟用的 Anchor/Tag 交給量測執行緒，下一輪開始生效"""
+        self.position_worker.set_layout(
+            [(anchor.id, anchor.pos) for anchor in self.anchor_manager if anchor.enable],
+            [(tag.id, tag.z) for tag in self.tag_manager if tag.enable],
+        )
+
+    def render_positions(self):
+        """固定頻率重繪，只畫最新一筆結果，過時的 frame 直接丟棄"""
+        if not self.position_worker:
+            return
+        # 表格/拖曳修改隨時生效
+        self._push_layout()
 
+        frame: PositionFrame | None = self.position_worker.latest()
+        if frame is None:
+            self._hide_lost_tags()
+            return
 
+        try:
+            tags = {tag.id: tag for tag in self.tag_manager if tag.enable}
             rssi_rows = []
-            for tag in act_tags:
-                reports = self.controller.trigger_multiple(tag.id, [anchor.id for anchor in act_anchors])
-                dist = [r.distance_m if r else -1 for r in reports]
-                for anchor, report in zip(act_anchors, reports):
-                    distance = report.distance_m if report else None
-                    rssi_value = report.rssi_dbm if report else None
+            for fix in frame.fixes:
+                for anchor_id, report in fix.reports:
                     rssi_rows.append((
-                        f"0x{tag.id:04X}",
-                        f"0x{anchor.id:04X}",
-                        f"{distance:.2f}" if distance is not None else "--",
-                        f"{rssi_value:.1f}" if rssi_value is not None else "--",
+                        f"0x{fix.tag_id:04X}",
+                        f"0x{anchor_id:04X}",
+                        f"{report.distance_m:.2f}" if report else "--",
+                        f"{report.rssi_dbm:.1f}" if report else "--",
                     ))
-                # [([x, y, z], distance), ...]
-                valid_pairs = [(act_anchors[i].pos, dist[i]) for i in range(len(dist)) if dist[i] > 0]
-
-                if len(valid_pairs) >= 3:
-                    anchor_pos, dist = zip(*valid_pairs)
-                    tag_pos = TrilaterationSolver3D(list(anchor_pos)).solve(list(dist), known_z=tag.z)
-                    tag_pos_f = tag.filter.filter(tag_pos)
-                    x, y, z = tag_pos_f
-                    tag.last_seen = time.time()
-                    # tag.plot_item
-                    if tag.plot_item is None:
-                        tag.plot_item = self.plot_widget.plot([], [], pen=None, symbol="o", symbolSize=12)
-                        color = self._color_for_tag(tag.id)
-                        tag.plot_item.setSymbolBrush(color)
-                    tag.plot_item.setData([x], [y])
-                    self._append_tag_path_point(tag, x, y)
-                    self.statusBar().showMessage(f"Tag 0x{tag.id:04X}: x={x:.2f}, y={y:.2f}, z={z:.2f}")
-                else:
-                    # 超過 2 秒沒看到就隱藏
-                    if tag.last_seen and time.time() - tag.last_seen > 2.0:
-                        if tag.plot_item:
-                            tag.plot_item.setData([], [])
-                        tag.last_seen = 0.0
+
+                tag = tags.get(fix.tag_id)
+                if tag is None or fix.pos is None:
+                    continue
+                x, y, z = fix.pos
+                tag.last_seen = frame.timestamp
+                # tag.plot_item
+                if tag.plot_item is None:
+                    tag.plot_item = self.plot_widget.plot([], [], pen=None, symbol="o", symbolSize=12)
+                    color = self._color_for_tag(tag.id)
+                    tag.plot_item.setSymbolBrush(color)
+                tag.plot_item.setData([x], [y])
+                self._append_tag_path_point(tag, x, y)
+                self.statusBar().showMessage(f"Tag 0x{tag.id:04X}: x={x:.2f}, y={y:.2f}, z={z:.2f}")
             self._update_rssi_table(rssi_rows)
+            if frame.error:
+                self.statusBar().showMessage(frame.error)
         except Exception as e:
             self.statusBar().showMessage(f"⚠️ {e}")
-                        
+        self._hide_lost_tags()
+
+    def _hide_lost_tags(self):
+        # 超過 2 秒沒看到就隱藏
+        for tag in self.tag_manager:
+            if tag.last_seen and time.time() - tag.last_seen > 2.0:
+                if tag.plot_item:
+                    tag.plot_item.setData([], [])
+                tag.last_seen = 0.0
 
 
 if __name__ == "__main__":